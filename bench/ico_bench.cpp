@@ -0,0 +1,116 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Icon extraction benchmark, native parser vs. the old icoextract/icotool route.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroico.h"
+
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Point NERO_BENCH_EXE_DIR at a directory of .exe/.dll files (e.g. a prefix's drive_c) to run this;
+// the process-based side also needs icoextract & icotool on the PATH.
+class IcoBench : public QObject
+{
+    Q_OBJECT
+
+private:
+    QStringList corpus;
+    QTemporaryDir scratch;
+
+    // What GetIcon used to do per file: extract the .ico, list its frames, then convert the best one.
+    bool ViaProcesses(const QString &icoextract, const QString &icotool, const QString &sourceFile)
+    {
+        const QString ico = scratch.filePath("icon.ico");
+        const QString png = scratch.filePath("icon.png");
+        QProcess proc;
+        proc.start(icoextract, { sourceFile, ico });
+        if(!proc.waitForFinished() || proc.exitCode() != 0)
+            return false;
+
+        proc.start(icotool, { "-l", "--icon", ico });
+        if(!proc.waitForFinished())
+            return false;
+        // "--icon --index=N --width=W --height=H --bit-depth=D --palette-size=P"
+        int bestIndex = -1, bestScore = -1;
+        while(proc.canReadLine()) {
+            const QStringList fields = QString(proc.readLine()).simplified().split(' ');
+            if(fields.count() < 5 || fields.at(0) != "--icon")
+                continue;
+            const int score = fields.at(2).section('=', 1).toInt() * fields.at(4).section('=', 1).toInt();
+            if(score > bestScore) {
+                bestScore = score;
+                bestIndex = fields.at(1).section('=', 1).toInt();
+            }
+        }
+        if(bestIndex < 0)
+            return false;
+
+        proc.start(icotool, { "-x", ico, "--icon", "-i", QString::number(bestIndex), "-o", png });
+        return proc.waitForFinished() && QFileInfo::exists(png);
+    }
+
+private slots:
+    void initTestCase()
+    {
+        const QString corpusDir = qEnvironmentVariable("NERO_BENCH_EXE_DIR");
+        if(corpusDir.isEmpty())
+            QSKIP("set NERO_BENCH_EXE_DIR to a directory of .exe/.dll files");
+        QDirIterator it(corpusDir, { "*.exe", "*.dll", "*.EXE", "*.DLL" }, QDir::Files, QDirIterator::Subdirectories);
+        while(it.hasNext())
+            corpus << it.next();
+        if(corpus.isEmpty())
+            QSKIP("no .exe/.dll files in NERO_BENCH_EXE_DIR");
+        qInfo("%lld files in the corpus", (long long)corpus.count());
+    }
+
+    void native()
+    {
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for(const QString &file : std::as_const(corpus))
+                if(!NeroIcoExtractor::GetIcon(file).isEmpty())
+                    found++;
+        }
+        qInfo("%d icons found", found);
+    }
+
+    void processes()
+    {
+        const QString icoextract = QStandardPaths::findExecutable("icoextract");
+        const QString icotool = QStandardPaths::findExecutable("icotool");
+        if(icoextract.isEmpty() || icotool.isEmpty())
+            QSKIP("icoextract and icotool are needed for the comparison");
+
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for(const QString &file : std::as_const(corpus))
+                if(ViaProcesses(icoextract, icotool, file))
+                    found++;
+        }
+        qInfo("%d icons found", found);
+    }
+};
+
+QTEST_GUILESS_MAIN(IcoBench)
+#include "ico_bench.moc"
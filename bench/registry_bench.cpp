@@ -0,0 +1,122 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Registry benchmark: indexing, committing, compacting & cached views of a big .reg file.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroregistry.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Generates a user.reg of NERO_BENCH_REG_MB (50 by default) MB, about what a prefix with a few years of
+// game installs & MRU clutter ends up with, then times each of the registry's hot paths over it.
+class RegistryBench : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir dir;
+    QString regPath;
+    int keyCount = 0;
+
+    QString KeyName(const int i) const { return QString("Software\\Bench\\Vendor%1\\Product%2").arg(i % 97).arg(i); }
+
+private slots:
+    void initTestCase()
+    {
+        const int megabytes = qEnvironmentVariableIntValue("NERO_BENCH_REG_MB");
+        const qint64 targetSize = (megabytes > 0 ? megabytes : 50) * 1024LL * 1024;
+        regPath = dir.filePath("user.reg");
+        QFile reg(regPath);
+        QVERIFY(reg.open(QIODevice::WriteOnly));
+        reg.write("WINE REGISTRY Version 2\n;; All keys relative to \\\\User\\\\S-1-5-21-0-0-0-1000\n\n#arch=win64\n");
+        while(reg.pos() < targetSize) {
+            const QByteArray key = NeroRegistry::EscapeKey(KeyName(keyCount));
+            QByteArray section = "\n[" + key + "] 1700000000\n#time=1da1b2c3d4e5f60\n";
+            section += "\"InstallPath\"=\"C:\\\\Games\\\\Product" + QByteArray::number(keyCount) + "\"\n";
+            section += "\"Version\"=dword:" + QByteArray::number(keyCount, 16).rightJustified(8, '0') + "\n";
+            section += "\"Blob\"=hex:" + QByteArray(48, 'a').replace("aaa", "00,") + "\\\n  01,02,03\n";
+            // older edits that wrote the same key out again, which Compact folds back in
+            if(keyCount % 50 == 0)
+                section += "\n[" + key + "] 1700000001\n\"Version\"=dword:00000001\n";
+            reg.write(section);
+            keyCount++;
+        }
+        reg.close();
+        qInfo("%s: %lld MB, %d keys", qPrintable(regPath), (long long)(QFileInfo(regPath).size() / (1024*1024)), keyCount);
+    }
+
+    void openAndIndex()
+    {
+        QBENCHMARK {
+            NeroRegistry reg;
+            QVERIFY(reg.Open(regPath));
+            QVERIFY(reg.HasKey(KeyName(keyCount / 2)));
+        }
+    }
+
+    void commitFewEdits()
+    {
+        NeroRegistry reg;
+        QVERIFY(reg.Open(regPath));
+        int round = 0;
+        QBENCHMARK {
+            // Commit empties the queue, so the edits are set up again each time; a handful spread through the file
+            for(int i = 0; i < 5; ++i)
+                reg.SetDword(KeyName(keyCount * i / 5), "Version", round);
+            reg.SetString("Software\\Wine\\Direct3D", "renderer", "vulkan");
+            reg.DeleteValue(KeyName(keyCount - 1), "Blob");
+            QVERIFY(reg.Commit());
+            round++;
+        }
+    }
+
+    // the first lookup through a view indexes the file, later views of the unchanged file share that index
+    void viewCold()
+    {
+        QBENCHMARK_ONCE {
+            NeroRegistryView view(regPath);
+            QVERIFY(view.HasKey(KeyName(1)));
+        }
+    }
+
+    void viewCachedReopen()
+    {
+        { NeroRegistryView warm(regPath); warm.HasKey(KeyName(0)); }
+        QBENCHMARK {
+            NeroRegistryView view(regPath);
+            QVERIFY(view.HasKey(KeyName(keyCount / 3)));
+            QVERIFY(view.GetDword(KeyName(keyCount / 3), "Version") >= 0);
+        }
+    }
+
+    // last, since it rewrites the file; once, since after the first pass there's nothing left to merge
+    void compact()
+    {
+        NeroRegistry::CompactStats stats;
+        QBENCHMARK_ONCE {
+            QVERIFY(NeroRegistry::Compact(regPath, QStringList{ "Software\\Bench\\Vendor13" }, stats));
+        }
+        qInfo("%lld -> %lld bytes, %d -> %d keys, %d duplicates merged, %d pruned", stats.sizeBefore, stats.sizeAfter,
+              stats.keysBefore, stats.keysAfter, stats.duplicatesMerged, stats.keysPruned);
+    }
+};
+
+QTEST_GUILESS_MAIN(RegistryBench)
+#include "registry_bench.moc"
@@ -0,0 +1,128 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Verb filter benchmark: typing a search into the winetricks verb list, a character at a time.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerotricks.h"
+
+#include <QProcess>
+#include <QSortFilterProxyModel>
+#include <QtTest>
+
+// Lists the verbs of the winetricks at NERO_BENCH_WINETRICKS (same as the tricks window does), or makes up
+// about as many as a current winetricks has when that's not set, then times every keystroke of a few searches
+// through NeroVerbFilter, with a plain fixed-string proxy over the same model as the baseline.
+class VerbFilterBench : public QObject
+{
+    Q_OBJECT
+
+private:
+    NeroVerbCatalog::Catalog catalog;
+    NeroVerbModel *model = nullptr;
+
+    // every prefix of each query, as the search box sends them while typing
+    static QStringList Keystrokes(const QString &query)
+    {
+        QStringList keystrokes;
+        for(int i = 1; i <= query.length(); ++i)
+            keystrokes << query.left(i);
+        return keystrokes;
+    }
+
+    // (no dxvk, vkd3d or faudio, since Parse drops those like it does the real ones)
+    static QByteArray MakeListing()
+    {
+        static const char *stems[] = { "vcrun", "d3dx", "dotnet", "xact", "directx", "msxml", "mfc", "physx",
+                                       "quartz", "d3dcompiler_", "xinput", "gdiplus", "riched", "wmp", "xna", "vb" };
+        QByteArray listing;
+        for(int i = 0; i < 1000; ++i) {
+            const QByteArray stem = stems[i % (sizeof(stems) / sizeof(stems[0]))];
+            listing += stem + QByteArray::number(2000 + i) + "           " + (stem == "vcrun" ? "Visual C++ " : "Microsoft ") + stem + " runtime build "
+                       + QByteArray::number(i) + " (Microsoft, " + QByteArray::number(2000 + i % 25) + ") [downloadable]\n";
+        }
+        return listing;
+    }
+
+    void TypeQueries_data()
+    {
+        QTest::addColumn<QString>("query");
+        QTest::newRow("exact name") << "vcrun2019";
+        QTest::newRow("fuzzy name") << "vcr19";
+        QTest::newRow("description") << "visual c++";
+        QTest::newRow("two words") << "directx runtime";
+        QTest::newRow("no match") << "zzzzzz";
+    }
+
+private slots:
+    void initTestCase()
+    {
+        const QString winetricks = qEnvironmentVariable("NERO_BENCH_WINETRICKS");
+        if(!winetricks.isEmpty()) {
+            QProcess list;
+            list.start(winetricks, {"dlls", "list"});
+            QVERIFY(list.waitForFinished(120000));
+            QCOMPARE(list.exitCode(), 0);
+            catalog = NeroVerbCatalog::Parse(winetricks, list.readAllStandardOutput());
+        } else
+            catalog = NeroVerbCatalog::Parse("winetricks", MakeListing());
+        QVERIFY(!catalog.verbs.isEmpty());
+        model = new NeroVerbModel(catalog.verbs, catalog.descriptions, this);
+        qInfo("%s: %lld verbs", qPrintable(winetricks.isEmpty() ? QString("generated") : winetricks),
+              (long long)catalog.verbs.count());
+    }
+
+    void setSearch_data() { TypeQueries_data(); }
+    void setSearch()
+    {
+        QFETCH(QString, query);
+        const QStringList keystrokes = Keystrokes(query);
+        NeroVerbFilter filter(model);
+        int shown = 0;
+        QBENCHMARK {
+            for(const QString &keystroke : keystrokes) {
+                filter.SetSearch(keystroke);
+                shown = filter.rowCount();
+            }
+            // the box gets cleared again before the next round
+            filter.SetSearch(QString());
+        }
+        Q_UNUSED(shown)
+    }
+
+    void setFilterFixedString_data() { TypeQueries_data(); }
+    void setFilterFixedString()
+    {
+        QFETCH(QString, query);
+        const QStringList keystrokes = Keystrokes(query);
+        QSortFilterProxyModel filter;
+        filter.setSourceModel(model);
+        filter.setFilterCaseSensitivity(Qt::CaseInsensitive);
+        filter.setFilterKeyColumn(-1);
+        int shown = 0;
+        QBENCHMARK {
+            for(const QString &keystroke : keystrokes) {
+                filter.setFilterFixedString(keystroke);
+                shown = filter.rowCount();
+            }
+            filter.setFilterFixedString(QString());
+        }
+        Q_UNUSED(shown)
+    }
+};
+
+QTEST_GUILESS_MAIN(VerbFilterBench)
+#include "verbfilter_bench.moc"
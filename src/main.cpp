@@ -18,26 +18,109 @@
 #include "neromanager.h"
 #include "nerofs.h"
 #include "neroonetimedialog.h"
+#include "nerodedup.h"
+#include "nerodiskusage.h"
+#include "nerojobs.h"
+#include "neromanifest.h"
+#include "neroregistry.h"
 #include "nerorunner.h"
+#include "nerosysinfo.h"
+#include "nerotuning.h"
 
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QLocale>
 #include <QTranslator>
 
+#include <mutex>
+
 void PrintHelp()
 {
     printf(
-        "usage: nero-umu [--prefix \"Prefix Name\" [--list] [--shortcut \"Shortcut Name\"]] executable [arg1] [arg2] [...]\n\n"
+        "usage: nero-umu [--prefix \"Prefix Name\" [--list] [--shortcut \"Shortcut Name\"]] [tuning options] executable [arg1] [arg2] [...]\n"
+        "       nero-umu --prefix \"Prefix Name\" --clone \"New Prefix Name\" [--skip-caches]\n"
+        "       nero-umu --prefix \"Prefix Name\" --snapshot [\"Description\"] | --snapshots | --restore ID | --prune [N]\n"
+        "       nero-umu --prefix \"Prefix Name\" --export file.zip|- [--shortcut \"Shortcut Name\"] [--level N]\n"
+        "       nero-umu --import file.zip [\"New Prefix Name\"]\n"
+        "       nero-umu --prefix \"Prefix Name\" --hibernate | --wake\n"
+        "       nero-umu --prefix \"Prefix Name\" --reg-compact [--prune-key KEY]... [--no-bench]\n"
+        "       nero-umu --prefix \"Prefix Name\" --reg-snapshot [\"Description\"] | --reg-diff [ID [ID2]]\n"
+        "       nero-umu --hibernate-idle [DAYS]\n"
+        "       nero-umu --upgrade-prefixes [--all] [--jobs N] [\"Prefix Name\" ...]\n"
+        "       nero-umu --create-prefix \"Prefix Name\" [--runner RUNNER] [--verbs verb1,verb2] [--user-links] [--no-template]\n"
+        "       nero-umu --create-prefixes specfile [--jobs N] [--no-template]\n"
+        "       nero-umu --apply manifest.json [--jobs N] [--dry-run] [--no-template]\n"
+        "       nero-umu du [--full] [--shared] [\"Prefix Name\"]\n\n"
         "Nero-umu CLI: Launch Windows executables within a Nero-managed Prefix\n\n"
         "options:\n"
         "  --prefix \"Prefix Name\"        Run executable within \"Prefix Name\"\n"
         "  --list                        List contents of prefix specified with --prefix\n"
         "  --shortcut \"Shortcut Name\"    Launch a specific shortcut from specified --prefix, according to the prefix's current settings.\n"
+        "  --clone \"New Prefix Name\"     Make a copy of --prefix (including its shortcuts) named \"New Prefix Name\".\n"
+        "  --skip-caches                 With --clone, leave out the prefix's logs and shader cache.\n"
+        "  --snapshot [\"Description\"]    Take a snapshot of --prefix that it can be rolled back to later.\n"
+        "  --snapshots                   List the snapshots of --prefix, newest first.\n"
+        "  --restore ID                  Roll --prefix back to snapshot ID (as shown by --snapshots).\n"
+        "  --prune [N]                   Delete all but the newest N (default 5) snapshots of --prefix.\n"
+        "  --export file.zip|-           Pack --prefix (or just --shortcut of it) into a portable bundle, or write it to stdout.\n"
+        "  --level N                     With --export, the compression level (0-9, default 1).\n"
+        "  --import file.zip             Unpack a bundle made with --export as a new prefix, optionally under a new name.\n"
+        "  --hibernate                   Pack --prefix away into a compressed image, leaving only its settings & icons.\n"
+        "                                It's restored automatically the next time it's used.\n"
+        "  --wake                        Restore a hibernated --prefix right away.\n"
+        "  --reg-compact                 Rewrite --prefix's registry files without duplicate keys, MRU lists & other cruft\n"
+        "                                (plus any --prune-key HKCU subtrees), timing wineboot before & after unless --no-bench.\n"
+        "  --reg-snapshot [\"Description\"] Record a fingerprint of every key in --prefix's registry (taken automatically\n"
+        "                                around winetricks runs too).\n"
+        "  --reg-diff [ID [ID2]]         List --prefix's registry snapshots, or show which keys were added (+), removed (-)\n"
+        "                                or changed (~) between snapshot ID and ID2 (default: the registry as it is now).\n"
+        "  --hibernate-idle [DAYS]       Hibernate every prefix not launched in DAYS days (default from Nero's preferences).\n"
+        "  --upgrade-prefixes            Run Proton's prefix upgrade now for every prefix whose runner changed or was updated\n"
+        "                                (or the given prefixes, or --all of them), N (default 2) at a time.\n"
+        "  --create-prefix \"Prefix Name\" Make a new prefix with RUNNER (default: the first installed one), installing any\n"
+        "                                winetricks verbs and linking the user's home folders into it with --user-links.\n"
+        "  --create-prefixes specfile    Make every prefix listed in specfile, N (default 2) at a time. One per line, as\n"
+        "                                Name|Runner|verb verb|links (all but Name optional; # starts a comment).\n"
+        "  --no-template                 With --create-prefix(es) or --apply, boot new prefixes from scratch instead of using templates.\n"
+        "  --apply manifest.json         Make the prefixes in manifest.json (runner, verbs, settings, drives & shortcuts) match it,\n"
+        "                                only doing whatever's missing, N (default 2) prefixes at a time. --dry-run just shows what'd change.\n"
+        "\n"
+        "tuning options (override the prefix/shortcut's Process Tuning settings):\n"
+        "  --nice N                      Run with CPU nice level N (-20 to 19; negative values need privileges).\n"
+        "  --sched normal|batch|idle     Run under the SCHED_OTHER, SCHED_BATCH or SCHED_IDLE CPU scheduling policy.\n"
+        "  --ioprio idle|be:N|rt:N       Set the I/O priority class and level (0-7) for the app.\n"
+        "  --oom-adj N                   Set the OOM killer score adjustment (-1000 to 1000).\n"
+        "\n"
+        "  du                            Show how much disk space each prefix (or just \"Prefix Name\") uses, and on what.\n"
+        "                                --full ignores cached results, --shared also counts space shared via reflinks.\n"
+        "  --dedup                       Share identical Wine system files between all prefixes (needs btrfs, xfs or similar).\n"
+        "                                Can be interrupted, and picks up where it left off next time.\n"
+        "  --doctor                      Check this system for common performance problems, and how to fix them.\n"
         "  -v, --version                 Show version information.\n"
         "  -h, --help                    Show this help. Helpful, huh? c:\n"
         );
 }
 
+// Hibernated prefixes get restored on their first launch.
+bool WakeIfHibernated(const QString &prefix)
+{
+    if(!NeroFS::IsPrefixHibernated(prefix))
+        return true;
+
+    printf("Prefix %s is hibernated, restoring it first...\n", prefix.toLocal8Bit().constData());
+    NeroBundle::Stats stats;
+    const bool woken = NeroFS::WakePrefix(prefix, stats, [](const NeroBundle::Stats &current) {
+        printf("\rRestoring... %lld/%lld files", current.files, current.totalFiles);
+        fflush(stdout);
+        return true;
+    });
+    printf("\n");
+    if(!woken)
+        printf("Couldn't restore %s! (%lld files failed to extract)\n", prefix.toLocal8Bit().constData(), stats.errors);
+    return woken;
+}
+
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
@@ -60,6 +143,16 @@ int main(int argc, char *argv[])
         for(int i = 1; i < argc; ++i)
             arguments.append(argv[i]);
 
+        NeroTuning::Params tuning;
+        if(!NeroTuning::TakeCliArgs(arguments, tuning))
+            return 1;
+        // everything below checks argument counts against argc, so keep it in sync.
+        argc = arguments.count()+1;
+        if(argc < 2) {
+            PrintHelp();
+            return 1;
+        }
+
         // One-time runner (executable only) - prompt user for prefix
         if(argc < 3 && (arguments.last().toLower().endsWith(".exe") ||
                         arguments.last().toLower().endsWith(".msi") ||
@@ -72,8 +165,11 @@ int main(int argc, char *argv[])
                 oneTimeDiag.exec();
 
                 if(!oneTimeDiag.selected.isEmpty()) {
+                    if(!WakeIfHibernated(oneTimeDiag.selected))
+                        return 1;
                     NeroFS::SetCurrentPrefix(oneTimeDiag.selected);
                     NeroRunner runner;
+                    runner.tuningOverride = tuning;
                     return runner.StartOnetime(arguments.last(), {});
                 } else {
                     printf("No prefix selected! Aborting...\n");
@@ -90,19 +186,74 @@ int main(int argc, char *argv[])
                    arguments.at(arguments.indexOf("--prefix")+2).toLower().endsWith(".bat") ||
                    arguments.at(arguments.indexOf("--prefix")+2).toLower().endsWith(".cmd"))) {
             if(NeroFS::InitPaths()) {
+                if(!WakeIfHibernated(arguments.at(arguments.indexOf("--prefix")+1)))
+                    return 1;
                 NeroFS::SetCurrentPrefix(arguments.takeAt(arguments.indexOf("--prefix")+1));
                 arguments.removeAt(arguments.indexOf("--prefix"));
 
                 NeroRunner runner;
+                runner.tuningOverride = tuning;
                 QString executable = arguments.takeFirst();
                 return runner.StartOnetime(executable, false, arguments);
             } else {
                 printf("Nero cannot run without a home directory set! Aborting...\n");
                 return 1;
             }
+        // Export prefix bundle (checked before shortcuts, since it can take one too)
+        } else if(argc > 4 && arguments.contains("--prefix") && arguments.contains("--export")) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.at(arguments.indexOf("--prefix")+1);
+                const QString outPath = arguments.value(arguments.indexOf("--export")+1);
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                if(outPath.isEmpty() || (outPath.startsWith("--") && outPath != "-")) {
+                    printf("No file to export to given!\n");
+                    return 1;
+                }
+
+                QString shortcutHash;
+                if(arguments.contains("--shortcut")) {
+                    NeroFS::SetCurrentPrefix(prefix);
+                    shortcutHash = NeroFS::GetCurrentShortcutsMap().value(arguments.value(arguments.indexOf("--shortcut")+1));
+                    if(shortcutHash.isEmpty()) {
+                        printf("Shortcut not found in prefix! Check that the spelling is correct.\n");
+                        return 1;
+                    }
+                }
+                bool isNumber = false;
+                const int level = arguments.value(arguments.indexOf("--level")+1).toInt(&isNumber);
+
+                // the archive itself might be going to stdout
+                FILE *status = outPath == "-" ? stderr : stdout;
+                NeroBundle::Stats stats;
+                const bool exported = NeroFS::ExportPrefix(prefix, outPath, shortcutHash,
+                                                           arguments.contains("--level") && isNumber ? qBound(0, level, 9) : 1, stats,
+                                                           [status](const NeroBundle::Stats &current) {
+                    fprintf(status, "\rExporting... %.1f/%.1f MiB", current.bytes / (1024.0*1024), current.totalBytes / (1024.0*1024));
+                    fflush(status);
+                    return true;
+                });
+                fprintf(status, "\n");
+                if(exported) {
+                    fprintf(status, "Exported %s (%lld files, %.1f MiB compressed to %.1f MiB).\n", prefix.toLocal8Bit().constData(),
+                            stats.files, stats.bytes / (1024.0*1024), stats.archiveBytes / (1024.0*1024));
+                    return 0;
+                } else {
+                    fprintf(status, "Couldn't export %s! (can't write to %s, or %lld files failed to read)\n",
+                            prefix.toLocal8Bit().constData(), outPath.toLocal8Bit().constData(), stats.errors);
+                    return 1;
+                }
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
         // One-time runner using prefix with provided preset shortcut
         } else if(argc > 4 && arguments.contains("--prefix") && arguments.contains("--shortcut")) {
             if(NeroFS::InitPaths()) {
+                if(!WakeIfHibernated(arguments.at(arguments.indexOf("--prefix")+1)))
+                    return 1;
                 NeroFS::SetCurrentPrefix(arguments.takeAt(arguments.indexOf("--prefix")+1));
                 arguments.removeAt(arguments.indexOf("--prefix"));
 
@@ -112,6 +263,7 @@ int main(int argc, char *argv[])
                     return 1;
                 } else {
                     NeroRunner runner;
+                    runner.tuningOverride = tuning;
                     return runner.StartShortcut(shortcutHash);
                 }
             } else {
@@ -140,6 +292,702 @@ int main(int argc, char *argv[])
                 printf("Nero cannot run without a home directory set! Aborting...\n");
                 return 1;
             }
+        // System readiness checks
+        } else if(argc < 3 && arguments.last() == "--doctor") {
+            // don't prompt for a home dir here, the free space check just gets skipped without one.
+            const QString home = NeroFS::GetManagerCfg()->value("NeroSettings/Home").toString();
+            const QList<NeroSysInfo::Check> checks = NeroSysInfo::RunChecks(home);
+            int warnings = 0;
+            for(const NeroSysInfo::Check &check : checks) {
+                printf("[%s] %s: %s\n", check.ok ? " OK " : "WARN", check.name.toLocal8Bit().constData(), check.value.toLocal8Bit().constData());
+                if(!check.ok) {
+                    printf("       -> %s\n", check.hint.toLocal8Bit().constData());
+                    warnings++;
+                }
+            }
+            if(warnings) printf("\n%d check(s) need attention.\n", warnings);
+            else printf("\nEverything looks good!\n");
+            return warnings ? 1 : 0;
+        // Clone prefix
+        } else if(argc > 4 && arguments.contains("--prefix") && arguments.contains("--clone")) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.at(arguments.indexOf("--prefix")+1);
+                const QString newPrefix = arguments.value(arguments.indexOf("--clone")+1);
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                if(NeroTuning::FindWineserver(NeroFS::GetPrefixesPath()->path() + '/' + prefix)) {
+                    printf("Prefix %s is currently running! Close any apps running in it before cloning.\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+
+                NeroCopy::Stats stats;
+                const bool cloned = NeroFS::ClonePrefix(prefix, newPrefix, arguments.contains("--skip-caches"), stats,
+                                                        [](const NeroCopy::Stats &current) {
+                    printf("\rCloning files... %lld/%lld", current.files, current.totalFiles);
+                    fflush(stdout);
+                    return true;
+                });
+                printf("\n");
+                if(cloned) {
+                    printf("Cloned %s to %s: %.1f MiB reflinked, %.1f MiB physically copied.\n",
+                           prefix.toLocal8Bit().constData(), newPrefix.toLocal8Bit().constData(),
+                           stats.bytesReflinked / (1024.0*1024), stats.bytesCopied / (1024.0*1024));
+                    return 0;
+                } else {
+                    printf("Couldn't clone %s to %s! (name already taken, or %lld files failed to copy)\n",
+                           prefix.toLocal8Bit().constData(), newPrefix.toLocal8Bit().constData(), stats.errors);
+                    return 1;
+                }
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Prefix snapshots
+        } else if(argc > 3 && arguments.contains("--prefix") &&
+                  (arguments.contains("--snapshot") || arguments.contains("--snapshots") ||
+                   arguments.contains("--restore") || arguments.contains("--prune"))) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.at(arguments.indexOf("--prefix")+1);
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                auto printProgress = [](const NeroSnapshot::Stats &current) {
+                    printf("\r%lld/%lld files (%lld changed)", current.files, current.totalFiles, current.filesChanged);
+                    fflush(stdout);
+                    return true;
+                };
+
+                if(arguments.contains("--snapshots")) {
+                    const QList<NeroSnapshot::Info> snapshots = NeroSnapshot::List(NeroFS::GetSnapshotsPath(prefix));
+                    if(snapshots.isEmpty())
+                        printf("Prefix %s doesn't have any snapshots.\n", prefix.toLocal8Bit().constData());
+                    for(const NeroSnapshot::Info &info : snapshots)
+                        printf("%-20s %s  %-8s %8lld files, %8.1f MiB stored  %s\n",
+                               info.id.toLocal8Bit().constData(),
+                               info.created.toString("yyyy-MM-dd HH:mm:ss").toLocal8Bit().constData(),
+                               info.mode == NeroSnapshot::ModeReflink ? "reflink" : "chunked",
+                               info.files, info.storedBytes / (1024.0*1024),
+                               info.reason.toLocal8Bit().constData());
+                    return 0;
+                } else if(arguments.contains("--prune")) {
+                    bool isNumber = false;
+                    const int keep = arguments.value(arguments.indexOf("--prune")+1).toInt(&isNumber);
+                    const int removed = NeroSnapshot::Prune(NeroFS::GetSnapshotsPath(prefix),
+                                                            isNumber ? keep : NeroFS::GetManagerCfg()->value("SnapshotsToKeep", 5).toInt());
+                    printf("Removed %d snapshot(s) of %s.\n", removed, prefix.toLocal8Bit().constData());
+                    return 0;
+                } else if(arguments.contains("--restore")) {
+                    const QString id = arguments.value(arguments.indexOf("--restore")+1);
+                    NeroSnapshot::Stats stats;
+                    printf("Restoring %s to snapshot %s...\n", prefix.toLocal8Bit().constData(), id.toLocal8Bit().constData());
+                    const bool restored = NeroFS::RestorePrefixSnapshot(prefix, id, stats, printProgress);
+                    printf("\n");
+                    if(restored) {
+                        printf("Restored %s (%lld files written back).\n", prefix.toLocal8Bit().constData(), stats.filesChanged);
+                        return 0;
+                    } else {
+                        printf("Couldn't restore %s! (snapshot not found, prefix still running, or %lld files failed)\n",
+                               prefix.toLocal8Bit().constData(), stats.errors);
+                        return 1;
+                    }
+                } else {
+                    const QString reason = arguments.value(arguments.indexOf("--snapshot")+1, "Manual snapshot");
+                    NeroSnapshot::Stats stats;
+                    const bool created = NeroFS::SnapshotPrefix(prefix, reason.startsWith("--") ? "Manual snapshot" : reason, stats, printProgress);
+                    printf("\n");
+                    if(created) {
+                        printf("Snapshot of %s taken (%.1f MiB of new data stored).\n", prefix.toLocal8Bit().constData(),
+                               stats.bytesStored / (1024.0*1024));
+                        return 0;
+                    } else {
+                        printf("Couldn't snapshot %s! (%lld files failed)\n", prefix.toLocal8Bit().constData(), stats.errors);
+                        return 1;
+                    }
+                }
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Hibernate/wake prefix
+        } else if(argc > 3 && arguments.contains("--prefix") && (arguments.last() == "--hibernate" || arguments.last() == "--wake")) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.at(arguments.indexOf("--prefix")+1);
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                if(arguments.last() == "--wake")
+                    return WakeIfHibernated(prefix) ? 0 : 1;
+
+                NeroBundle::Stats stats;
+                const bool hibernated = NeroFS::HibernatePrefix(prefix, stats, [](const NeroBundle::Stats &current) {
+                    printf("\rPacking... %.1f/%.1f MiB", current.bytes / (1024.0*1024), current.totalBytes / (1024.0*1024));
+                    fflush(stdout);
+                    return true;
+                });
+                printf("\n");
+                if(hibernated) {
+                    printf("Hibernated %s (%.1f MiB packed into %.1f MiB).\n", prefix.toLocal8Bit().constData(),
+                           stats.bytes / (1024.0*1024), stats.archiveBytes / (1024.0*1024));
+                    return 0;
+                } else {
+                    printf("Couldn't hibernate %s! (already hibernated, still running, or %lld files failed)\n",
+                           prefix.toLocal8Bit().constData(), stats.errors);
+                    return 1;
+                }
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Disk usage
+        } else if(arguments.first() == "du" || arguments.first() == "--du") {
+            bool fullRescan = false, checkShared = false;
+            QString onlyPrefix;
+            for(int i = 1; i < arguments.count(); ++i) {
+                if(arguments.at(i) == "--full") fullRescan = true;
+                else if(arguments.at(i) == "--shared") checkShared = true;
+                else onlyPrefix = arguments.at(i);
+            }
+            if(NeroFS::InitPaths()) {
+                const QString home = NeroFS::GetPrefixesPath()->path();
+                if(!onlyPrefix.isEmpty() && !NeroFS::GetPrefixes().contains(onlyPrefix)) {
+                    printf("Prefix %s doesn't exist!\n", onlyPrefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                QStringList prefixPaths;
+                for(const QString &prefix : onlyPrefix.isEmpty() ? NeroFS::GetPrefixes() : QStringList(onlyPrefix))
+                    prefixPaths << home + '/' + prefix;
+
+                int measured = 0;
+                const QMap<QString, NeroDiskUsage::Usage> usages = NeroDiskUsage::Measure(prefixPaths, home + "/.nero-du-cache", checkShared, fullRescan,
+                                                                                          [&measured, &prefixPaths](const QString &, const NeroDiskUsage::Usage &) {
+                    printf("\rMeasuring prefixes... %d/%lld", ++measured, (long long)prefixPaths.count());
+                    fflush(stdout);
+                    return true;
+                });
+
+                printf("\r%-32s %10s %10s %10s %10s %10s %10s%s\n", "Prefix", "Total", "drive_c", "Shaders", "Logs", "Icons", "Other",
+                       checkShared ? "     Shared" : "");
+                NeroDiskUsage::Usage sum;
+                for(auto usage = usages.constBegin(); usage != usages.constEnd(); ++usage) {
+                    printf("%-32s %10s %10s %10s %10s %10s %10s",
+                           QFileInfo(usage.key()).fileName().toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->Total()).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->driveC).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->shaderCache).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->logs).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->icoCache).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(usage->other).toLocal8Bit().constData());
+                    if(checkShared) printf(" %10s", NeroDiskUsage::FormatSize(usage->shared).toLocal8Bit().constData());
+                    printf("\n");
+                    sum.driveC += usage->driveC, sum.shaderCache += usage->shaderCache, sum.logs += usage->logs;
+                    sum.icoCache += usage->icoCache, sum.other += usage->other, sum.shared += usage->shared;
+                }
+                if(usages.count() > 1) {
+                    printf("%-32s %10s", "(all prefixes)", NeroDiskUsage::FormatSize(sum.Total()).toLocal8Bit().constData());
+                    if(checkShared) printf(", of which %s is shared", NeroDiskUsage::FormatSize(sum.shared).toLocal8Bit().constData());
+                    printf("\n");
+                }
+                return 0;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Upgrade prefixes for their (new) runners ahead of time
+        } else if(arguments.first() == "--upgrade-prefixes") {
+            if(NeroFS::InitPaths()) {
+                QStringList args = arguments.mid(1);
+                bool isNumber = false;
+                int jobs = NeroFS::GetManagerCfg()->value("ConcurrentUpgrades", 2).toInt();
+                if(args.contains("--jobs")) {
+                    const int value = args.value(args.indexOf("--jobs")+1).toInt(&isNumber);
+                    if(isNumber) jobs = qBound(1, value, 16);
+                    args.removeAt(args.indexOf("--jobs")+1);
+                    args.removeAll("--jobs");
+                }
+                const bool all = args.removeAll("--all");
+
+                QStringList prefixes;
+                if(!args.isEmpty()) {
+                    for(const QString &prefix : std::as_const(args)) {
+                        if(!NeroFS::GetPrefixes().contains(prefix)) {
+                            printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                            return 1;
+                        }
+                    }
+                    prefixes = args;
+                } else if(all) {
+                    for(const QString &prefix : NeroFS::GetPrefixes())
+                        if(!NeroFS::IsPrefixHibernated(prefix))
+                            prefixes.append(prefix);
+                } else prefixes = NeroFS::GetPrefixesNeedingUpgrade();
+                if(prefixes.isEmpty()) {
+                    printf("All prefixes are up to date with their runners.\n");
+                    return 0;
+                }
+                const QString umuPath = NeroFS::GetUmU();
+                if(umuPath.isEmpty())
+                    return 1;
+
+                NeroJobQueue queue(jobs);
+                for(const QString &prefix : std::as_const(prefixes)) {
+                    queue.Add(prefix, [umuPath, prefix]() {
+                        const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix;
+                        if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty())
+                            return -2;
+                        const QString runner = QSettings(prefixPath + "/nero-settings.ini", QSettings::IniFormat)
+                                                   .value("PrefixSettings/CurrentRunner").toString();
+                        const int result = NeroRunner::UpgradePrefix(umuPath, prefixPath, NeroFS::GetProtonsPath()->path() + '/' + runner);
+                        if(result == 0)
+                            NeroFS::SetPrefixUpgraded(prefix, runner);
+                        return result;
+                    });
+                }
+                printf("Upgrading %lld prefix(es), %d at a time...\n", (long long)prefixes.count(), jobs);
+                const bool upgraded = queue.Run([](const NeroJobQueue::Stats &current) {
+                    printf("\r%d/%d done, %d failed%s%s\033[K", current.finished, current.total, current.failed,
+                           current.current.isEmpty() ? "" : " - running: ", current.current.join(", ").toLocal8Bit().constData());
+                    fflush(stdout);
+                    return true;
+                });
+                printf("\n\n");
+                for(const NeroJobQueue::Job &job : queue.Jobs()) {
+                    QString status;
+                    if(job.result == 0) status = "upgraded";
+                    else if(job.result == -2) status = "skipped (still running)";
+                    else status = QString("failed (code %1, see .logs/%2)").arg(job.result).arg(Logs::upgradeLogName);
+                    printf("%-32s %7.1fs  %s\n", job.name.toLocal8Bit().constData(), job.msecs / 1000.0, status.toLocal8Bit().constData());
+                }
+                return upgraded ? 0 : 1;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Make new prefixes, optionally a whole batch of them at once
+        } else if(argc > 2 && (arguments.first() == "--create-prefix" || arguments.first() == "--create-prefixes")) {
+            if(NeroFS::InitPaths()) {
+                QStringList args = arguments.mid(1);
+                bool isNumber = false;
+                int jobs = 2;
+                if(args.contains("--jobs")) {
+                    const int value = args.value(args.indexOf("--jobs")+1).toInt(&isNumber);
+                    if(isNumber) jobs = qBound(1, value, 16);
+                    args.removeAt(args.indexOf("--jobs")+1);
+                    args.removeAll("--jobs");
+                }
+                const int templateMode = args.removeAll("--no-template") ? NeroFS::TemplatesOff : NeroFS::GetPrefixTemplateMode();
+
+                struct PrefixSpec {
+                    QString name;
+                    QString runner;
+                    QStringList verbs;
+                    bool userLinks = false;
+                };
+                QList<PrefixSpec> specs;
+
+                if(arguments.first() == "--create-prefix") {
+                    PrefixSpec spec;
+                    if(args.contains("--runner")) {
+                        spec.runner = args.value(args.indexOf("--runner")+1);
+                        args.removeAt(args.indexOf("--runner")+1);
+                        args.removeAll("--runner");
+                    }
+                    if(args.contains("--verbs")) {
+                        spec.verbs = args.value(args.indexOf("--verbs")+1).split(',', Qt::SkipEmptyParts);
+                        args.removeAt(args.indexOf("--verbs")+1);
+                        args.removeAll("--verbs");
+                    }
+                    spec.userLinks = args.removeAll("--user-links");
+                    spec.name = args.value(0);
+                    specs.append(spec);
+                } else {
+                    // one prefix per line, as Name|Runner|verb verb ...|links
+                    // (everything past the name is optional; lines starting with # are ignored)
+                    QFile specFile(args.value(0));
+                    if(!specFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                        printf("Couldn't open %s!\n", args.value(0).toLocal8Bit().constData());
+                        return 1;
+                    }
+                    while(!specFile.atEnd()) {
+                        const QString line = QString::fromUtf8(specFile.readLine()).trimmed();
+                        if(line.isEmpty() || line.startsWith('#'))
+                            continue;
+                        const QStringList fields = line.split('|');
+                        PrefixSpec spec;
+                        spec.name = fields.value(0).trimmed();
+                        spec.runner = fields.value(1).trimmed();
+                        spec.verbs = fields.value(2).split(' ', Qt::SkipEmptyParts);
+                        spec.userLinks = fields.value(3).trimmed() == "links";
+                        specs.append(spec);
+                    }
+                }
+
+                // check everything up front, so a typo doesn't leave a batch half-made
+                if(NeroFS::GetAvailableProtons()->isEmpty()) {
+                    printf("No Proton runners are installed!\n");
+                    return 1;
+                }
+                QStringList names;
+                for(PrefixSpec &spec : specs) {
+                    if(spec.runner.isEmpty())
+                        spec.runner = NeroFS::GetAvailableProtons()->first();
+                    if(spec.name.isEmpty() || spec.name.contains('/') || spec.name.startsWith('.')) {
+                        printf("\"%s\" isn't a valid prefix name!\n", spec.name.toLocal8Bit().constData());
+                        return 1;
+                    } else if(names.contains(spec.name) || NeroFS::GetPrefixes().contains(spec.name) ||
+                              QFileInfo::exists(NeroFS::GetPrefixesPath()->path() + '/' + spec.name)) {
+                        printf("Prefix %s already exists!\n", spec.name.toLocal8Bit().constData());
+                        return 1;
+                    } else if(!NeroFS::GetAvailableProtons()->contains(spec.runner)) {
+                        printf("Runner %s isn't installed!\n", spec.runner.toLocal8Bit().constData());
+                        return 1;
+                    }
+                    names.append(spec.name);
+                }
+                if(specs.isEmpty()) {
+                    printf("Nothing to create.\n");
+                    return 0;
+                }
+                const QString umuPath = NeroFS::GetUmU();
+                if(umuPath.isEmpty())
+                    return 1;
+
+                // status lines come in from every job's thread at once
+                std::mutex printMutex;
+                NeroJobQueue queue(jobs);
+                for(const PrefixSpec &spec : std::as_const(specs)) {
+                    queue.Add(spec.name, [&printMutex, umuPath, spec, templateMode]() {
+                        QString lastStatus;
+                        return NeroRunner::CreatePrefix(umuPath, spec.name, spec.runner, spec.verbs, templateMode, spec.userLinks,
+                                                        [&](const QString &status) {
+                            if(status != lastStatus) {
+                                lastStatus = status;
+                                std::lock_guard<std::mutex> lock(printMutex);
+                                printf("[%s] %s\n", spec.name.toLocal8Bit().constData(), QString(status).replace('\n', ' ').simplified().toLocal8Bit().constData());
+                                fflush(stdout);
+                            }
+                            return true;
+                        });
+                    });
+                }
+                printf("Creating %lld prefix(es), %d at a time...\n", (long long)specs.count(), jobs);
+                const bool created = queue.Run();
+                printf("\n");
+                for(const NeroJobQueue::Job &job : queue.Jobs()) {
+                    QString status;
+                    if(job.result == 0) status = "created";
+                    else if(QFileInfo::exists(NeroFS::GetPrefixesPath()->path() + '/' + job.name + "/nero-settings.ini"))
+                        status = QString("created, but umu exited with code %1 (see .logs/%2)").arg(job.result).arg(Logs::createLogName);
+                    else status = QString("failed (code %1)").arg(job.result);
+                    printf("%-32s %7.1fs  %s\n", job.name.toLocal8Bit().constData(), job.msecs / 1000.0, status.toLocal8Bit().constData());
+                }
+                return created ? 0 : 1;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Bring the home in line with a manifest, doing only what's missing
+        } else if(argc > 2 && arguments.first() == "--apply") {
+            if(NeroFS::InitPaths()) {
+                QStringList args = arguments.mid(1);
+                bool isNumber = false;
+                int jobs = 2;
+                if(args.contains("--jobs")) {
+                    const int value = args.value(args.indexOf("--jobs")+1).toInt(&isNumber);
+                    if(isNumber) jobs = qBound(1, value, 16);
+                    args.removeAt(args.indexOf("--jobs")+1);
+                    args.removeAll("--jobs");
+                }
+                const bool dryRun = args.removeAll("--dry-run");
+                const int templateMode = args.removeAll("--no-template") ? NeroFS::TemplatesOff : NeroFS::GetPrefixTemplateMode();
+                const int snapshotsToKeep = NeroFS::GetManagerCfg()->value("AutoSnapshots", true).toBool() ?
+                                            NeroFS::GetManagerCfg()->value("SnapshotsToKeep", 5).toInt() : 0;
+
+                QElapsedTimer timer;
+                timer.start();
+                QList<NeroManifest::Prefix> prefixes;
+                if(!NeroManifest::Load(args.value(0), prefixes))
+                    return 1;
+
+                bool needsUmu = false;
+                QList<NeroManifest::Plan> plans;
+                for(NeroManifest::Prefix &prefix : prefixes) {
+                    if(!prefix.runner.isEmpty() && !NeroFS::GetAvailableProtons()->contains(prefix.runner)) {
+                        printf("%s: runner %s isn't installed!\n", prefix.name.toLocal8Bit().constData(), prefix.runner.toLocal8Bit().constData());
+                        return 1;
+                    }
+                    plans << NeroManifest::Diff(prefix);
+                    if(plans.last().create && prefix.runner.isEmpty()) {
+                        if(NeroFS::GetAvailableProtons()->isEmpty()) {
+                            printf("No Proton runners are installed!\n");
+                            return 1;
+                        }
+                        prefix.runner = NeroFS::GetAvailableProtons()->first();
+                    }
+                    if(plans.last().create || !plans.last().verbs.isEmpty())
+                        needsUmu = true;
+                    for(const QString &line : plans.last().Describe())
+                        printf("[%s] %s\n", prefix.name.toLocal8Bit().constData(), line.toLocal8Bit().constData());
+                }
+
+                int pending = 0;
+                for(const NeroManifest::Plan &plan : std::as_const(plans))
+                    if(!plan.IsEmpty()) pending++;
+                if(!pending) {
+                    printf("All %lld prefix(es) are up to date (checked in %lld ms).\n", (long long)prefixes.count(), timer.elapsed());
+                    return 0;
+                } else if(dryRun) {
+                    printf("%d of %lld prefix(es) would be changed.\n", pending, (long long)prefixes.count());
+                    return 0;
+                }
+                const QString umuPath = needsUmu ? NeroFS::GetUmU() : QString();
+                if(needsUmu && umuPath.isEmpty())
+                    return 1;
+
+                std::mutex printMutex;
+                NeroJobQueue queue(jobs);
+                for(int i = 0; i < prefixes.count(); ++i) {
+                    if(plans.at(i).IsEmpty())
+                        continue;
+                    queue.Add(prefixes.at(i).name, [&printMutex, umuPath, prefix = prefixes.at(i), plan = plans.at(i), templateMode, snapshotsToKeep]() {
+                        QString lastStatus;
+                        return NeroManifest::Apply(umuPath, prefix, plan, templateMode, snapshotsToKeep, [&](const QString &status) {
+                            if(!status.isEmpty() && status != lastStatus) {
+                                lastStatus = status;
+                                std::lock_guard<std::mutex> lock(printMutex);
+                                printf("[%s] %s\n", prefix.name.toLocal8Bit().constData(), QString(status).replace('\n', ' ').simplified().toLocal8Bit().constData());
+                                fflush(stdout);
+                            }
+                            return true;
+                        });
+                    });
+                }
+                printf("Applying changes to %d prefix(es), %d at a time...\n", pending, jobs);
+                const bool applied = queue.Run();
+                printf("\n");
+                for(const NeroJobQueue::Job &job : queue.Jobs())
+                    printf("%-32s %7.1fs  %s\n", job.name.toLocal8Bit().constData(), job.msecs / 1000.0,
+                           job.result == 0 ? "done" : QString("failed (code %1)").arg(job.result).toLocal8Bit().constData());
+                return applied ? 0 : 1;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Slim down a prefix's registry files
+        } else if(argc > 3 && arguments.contains("--prefix") && arguments.contains("--reg-compact")) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.value(arguments.indexOf("--prefix")+1);
+                const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix;
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                } else if(NeroFS::IsPrefixHibernated(prefix)) {
+                    printf("Prefix %s is hibernated; wake it up first.\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                } else if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty()) {
+                    printf("Prefix %s still has running processes, not touching its registry!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+
+                QStringList pruneKeys = NeroFS::GetManagerCfg()->value("RegistryPruneKeys", NeroRegistry::DefaultPruneKeys()).toStringList();
+                for(int i = 0; i < arguments.count() - 1; ++i)
+                    if(arguments.at(i) == "--prune-key")
+                        pruneKeys << arguments.at(i+1);
+
+                QString umuPath, runnerPath;
+                qint64 bootBefore = -1;
+                if(!arguments.contains("--no-bench")) {
+                    umuPath = NeroFS::GetUmU();
+                    runnerPath = NeroFS::GetProtonsPath()->path() + '/' +
+                                 QSettings(prefixPath + "/nero-settings.ini", QSettings::IniFormat).value("PrefixSettings/CurrentRunner").toString();
+                    printf("Timing wineboot before compacting...\n");
+                    bootBefore = NeroRunner::TimeWineboot(umuPath, prefixPath, runnerPath);
+                }
+
+                if(NeroFS::GetManagerCfg()->value("AutoSnapshots", true).toBool()) {
+                    NeroSnapshot::Stats stats;
+                    if(!NeroFS::SnapshotPrefix(prefix, "Before compacting the registry", stats))
+                        printf("Couldn't snapshot %s first, compacting anyway...\n", prefix.toLocal8Bit().constData());
+                }
+
+                QList<QPair<QString, NeroRegistry::CompactStats>> compactStats;
+                const bool compacted = NeroRegistry::CompactPrefix(prefixPath, pruneKeys, compactStats);
+                for(const QPair<QString, NeroRegistry::CompactStats> &file : std::as_const(compactStats))
+                    printf("%-12s %10s -> %-10s %d -> %d keys (%d duplicate sections merged, %d pruned)\n", file.first.toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(file.second.sizeBefore).toLocal8Bit().constData(),
+                           NeroDiskUsage::FormatSize(file.second.sizeAfter).toLocal8Bit().constData(),
+                           file.second.keysBefore, file.second.keysAfter, file.second.duplicatesMerged, file.second.keysPruned);
+
+                if(bootBefore >= 0) {
+                    printf("Timing wineboot after compacting...\n");
+                    const qint64 bootAfter = NeroRunner::TimeWineboot(umuPath, prefixPath, runnerPath);
+                    if(bootAfter >= 0)
+                        printf("wineboot: %.2fs before, %.2fs after (%+.2fs)\n", bootBefore / 1000.0, bootAfter / 1000.0, (bootAfter - bootBefore) / 1000.0);
+                    else printf("wineboot failed after compacting! Roll back with --restore if the prefix misbehaves.\n");
+                } else if(!arguments.contains("--no-bench"))
+                    printf("Couldn't time wineboot for this prefix.\n");
+                return compacted ? 0 : 1;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Registry fingerprints, and what changed between them
+        } else if(argc > 3 && arguments.contains("--prefix") && (arguments.contains("--reg-snapshot") || arguments.contains("--reg-diff"))) {
+            if(NeroFS::InitPaths()) {
+                const QString prefix = arguments.value(arguments.indexOf("--prefix")+1);
+                if(!NeroFS::GetPrefixes().contains(prefix)) {
+                    printf("Prefix %s doesn't exist!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                } else if(NeroFS::IsPrefixHibernated(prefix)) {
+                    printf("Prefix %s is hibernated; wake it up first.\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+
+                if(arguments.contains("--reg-snapshot")) {
+                    const QString label = arguments.value(arguments.indexOf("--reg-snapshot")+1, "Manual snapshot");
+                    QString id;
+                    if(!NeroFS::SnapshotPrefixRegistry(prefix, label.startsWith("--") ? "Manual snapshot" : label, &id)) {
+                        printf("Couldn't snapshot the registry of %s!\n", prefix.toLocal8Bit().constData());
+                        return 1;
+                    }
+                    printf("Registry snapshot %s taken.\n", id.toLocal8Bit().constData());
+                    return 0;
+                }
+
+                const QString snapshotsPath = NeroFS::GetRegistrySnapshotsPath(prefix);
+                QStringList ids;
+                for(int i = arguments.indexOf("--reg-diff")+1; i < arguments.count() && !arguments.at(i).startsWith("--"); ++i)
+                    ids << arguments.at(i);
+
+                if(ids.isEmpty()) {
+                    const QList<NeroRegistry::Snapshot> snapshots = NeroRegistry::ListSnapshots(snapshotsPath);
+                    if(snapshots.isEmpty())
+                        printf("No registry snapshots of %s yet.\n", prefix.toLocal8Bit().constData());
+                    for(const NeroRegistry::Snapshot &snapshot : snapshots)
+                        printf("%s  %s  %7d keys  %s\n", snapshot.id.toLocal8Bit().constData(),
+                               snapshot.created.toString("yyyy-MM-dd hh:mm:ss").toLocal8Bit().constData(),
+                               snapshot.keyCount, snapshot.label.toLocal8Bit().constData());
+                    return 0;
+                }
+
+                QElapsedTimer timer;
+                timer.start();
+                NeroRegistry::Snapshot from, to;
+                if(!NeroRegistry::LoadSnapshot(snapshotsPath + '/' + ids.at(0) + ".regsnap", from)) {
+                    printf("No registry snapshot %s for %s!\n", ids.at(0).toLocal8Bit().constData(), prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+                // against what's there now, if there's no second one
+                if(ids.count() > 1) {
+                    if(!NeroRegistry::LoadSnapshot(snapshotsPath + '/' + ids.at(1) + ".regsnap", to)) {
+                        printf("No registry snapshot %s for %s!\n", ids.at(1).toLocal8Bit().constData(), prefix.toLocal8Bit().constData());
+                        return 1;
+                    }
+                } else if(!NeroRegistry::TakeSnapshot(NeroFS::GetPrefixesPath()->path() + '/' + prefix, "Current registry", to)) {
+                    printf("Couldn't read the registry of %s!\n", prefix.toLocal8Bit().constData());
+                    return 1;
+                }
+
+                const NeroRegistry::SnapshotDiff diff = NeroRegistry::DiffSnapshots(from, to);
+                printf("%s (%s) -> %s\n", from.id.toLocal8Bit().constData(), from.label.toLocal8Bit().constData(),
+                       ids.count() > 1 ? QString("%1 (%2)").arg(to.id, to.label).toLocal8Bit().constData() : "current registry");
+                for(const QString &key : diff.added)
+                    printf("+ %s\n", key.toLocal8Bit().constData());
+                for(const QString &key : diff.removed)
+                    printf("- %s\n", key.toLocal8Bit().constData());
+                for(const QString &key : diff.changed)
+                    printf("~ %s\n", key.toLocal8Bit().constData());
+                printf("%d added, %d removed, %d changed (of %d keys) in %.2fs\n", (int)diff.added.count(), (int)diff.removed.count(),
+                       (int)diff.changed.count(), to.keyCount, timer.elapsed() / 1000.0);
+                return 0;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Hibernate everything that's been sitting idle
+        } else if(arguments.first() == "--hibernate-idle") {
+            if(NeroFS::InitPaths()) {
+                bool isNumber = false;
+                const int days = arguments.value(1).toInt(&isNumber);
+                const int idleDays = isNumber ? days : NeroFS::GetManagerCfg()->value("HibernateAfterDays", 0).toInt();
+                if(idleDays <= 0) {
+                    printf("Auto-hibernation is off; pass a number of days, or set one in Nero's preferences.\n");
+                    return 1;
+                }
+                const QStringList idle = NeroFS::GetIdlePrefixes(idleDays);
+                int failed = 0;
+                for(const QString &prefix : idle) {
+                    NeroBundle::Stats stats;
+                    printf("Hibernating %s...\n", prefix.toLocal8Bit().constData());
+                    if(!NeroFS::HibernatePrefix(prefix, stats)) {
+                        printf("Couldn't hibernate %s! (%lld files failed)\n", prefix.toLocal8Bit().constData(), stats.errors);
+                        failed++;
+                    }
+                }
+                printf("Hibernated %lld prefix(es).\n", (long long)(idle.count() - failed));
+                return failed ? 1 : 0;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Import prefix bundle
+        } else if(argc > 2 && arguments.first() == "--import") {
+            if(NeroFS::InitPaths()) {
+                const QString archivePath = arguments.at(1);
+                const QString newName = arguments.value(2);
+                QString importedName;
+                NeroBundle::Stats stats;
+                const bool imported = NeroFS::ImportPrefix(archivePath, newName, importedName, stats,
+                                                           [](const NeroBundle::Stats &current) {
+                    printf("\rImporting... %lld/%lld files, %.1f/%.1f MiB", current.files, current.totalFiles,
+                           current.bytes / (1024.0*1024), current.totalBytes / (1024.0*1024));
+                    fflush(stdout);
+                    return true;
+                });
+                printf("\n");
+                if(imported) {
+                    printf("Imported %s (%lld files).\n", importedName.toLocal8Bit().constData(), stats.files);
+                    return 0;
+                } else {
+                    printf("Couldn't import %s! (not a Nero bundle, prefix name already taken, or %lld files failed to extract)\n",
+                           archivePath.toLocal8Bit().constData(), stats.errors);
+                    return 1;
+                }
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
+        // Cross-prefix deduplication
+        } else if(argc < 3 && arguments.last() == "--dedup") {
+            if(NeroFS::InitPaths()) {
+                const QString home = NeroFS::GetPrefixesPath()->path();
+                NeroDedup::Stats stats;
+                const bool finished = NeroDedup::Run(NeroDedup::GetDedupRoots(home), home + "/.nero-dedup-state", stats,
+                                                     [](const NeroDedup::Stats &current) {
+                    switch(current.phase) {
+                    case NeroDedup::PhaseScanning:
+                        printf("\rScanning prefixes... %lld files", current.filesScanned); break;
+                    case NeroDedup::PhaseHashing:
+                        printf("\rHashing candidates... %lld/%lld", current.hashed, current.toHash); break;
+                    case NeroDedup::PhaseDeduplicating:
+                        printf("\rDeduplicating... %lld/%lld groups, %.1f MiB shared", current.groupsDone, current.groups,
+                               current.bytesDeduped / (1024.0*1024)); break;
+                    default: break;
+                    }
+                    fflush(stdout);
+                    return true;
+                });
+                printf("\n%s: %lld files deduplicated, %.1f MiB reclaimed%s\n", finished ? "Done" : "Stopped",
+                       stats.filesDeduped, stats.bytesDeduped / (1024.0*1024),
+                       stats.errors ? QString(" (%1 errors)").arg(stats.errors).toLocal8Bit().constData() : "");
+                return finished ? 0 : 1;
+            } else {
+                printf("Nero cannot run without a home directory set! Aborting...\n");
+                return 1;
+            }
         // Version printout
         } else if(argc < 3 && (arguments.last() == "-v" || arguments.last() == "--version")) {
             printf("nero-umu %s \"%s\"\n", NERO_VERSION, NERO_CODENAME);
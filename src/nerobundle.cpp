@@ -0,0 +1,748 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Portable prefix bundles (zip archives) for moving prefixes between machines.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerobundle.h"
+#include "nerocopy.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "../lib/quazip/quazip/quazip.h"
+#include "../lib/quazip/quazip/quazipfile.h"
+
+namespace {
+    // regenerated on demand and often huge, so no point in carrying them to another machine
+    const QStringList excludedDirs = { ".logs", ".shaderCache" };
+
+    // files are compressed in blocks of this size in parallel (like pigz), then stitched back together in order
+    const size_t blockSize = 1024*1024;
+
+    enum { ItemDir = 0, ItemFile, ItemLink, ItemInline };
+
+    struct Item {
+        // name inside the archive
+        QByteArray name;
+        // where it's read from (ItemFile only)
+        QByteArray path;
+        int type = ItemFile;
+        quint32 mode = 0;
+        qint64 mtime = 0;
+        qint64 size = 0;
+        // link target, or the contents of generated files (e.g. a filtered nero-settings.ini)
+        QByteArray data;
+        size_t firstBlock = 0;
+        size_t blocks = 0;
+    };
+
+    struct Block {
+        size_t item = 0;
+        qint64 offset = 0;
+        size_t length = 0;
+        bool last = false;
+        QByteArray out;
+        quint32 crc = 0;
+        bool ready = false;
+        bool failed = false;
+    };
+
+    // what's needed for the central directory once an entry's been written
+    struct CentralEntry {
+        QByteArray name;
+        quint16 method = 0;
+        quint16 dosTime = 0, dosDate = 0;
+        quint32 crc = 0;
+        quint64 compressed = 0, uncompressed = 0, offset = 0;
+        quint32 externalAttr = 0;
+        qint64 mtime = 0;
+    };
+
+    void Put16(QByteArray &buf, const quint16 value) { buf.append((char)(value & 0xff)).append((char)(value >> 8)); }
+    void Put32(QByteArray &buf, const quint32 value) { Put16(buf, value & 0xffff); Put16(buf, value >> 16); }
+    void Put64(QByteArray &buf, const quint64 value) { Put32(buf, value & 0xffffffff); Put32(buf, value >> 32); }
+
+    void DosDateTime(const qint64 mtime, quint16 &dosTime, quint16 &dosDate)
+    {
+        const time_t seconds = mtime;
+        struct tm local;
+        localtime_r(&seconds, &local);
+        if(local.tm_year < 80) {
+            dosTime = 0, dosDate = (1 << 5) | 1;
+            return;
+        }
+        dosTime = (local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2);
+        dosDate = ((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday;
+    }
+
+    bool WriteAll(const int fd, const char *data, size_t length)
+    {
+        while(length) {
+            const ssize_t put = write(fd, data, length);
+            if(put < 0) {
+                if(errno == EINTR) continue;
+                return false;
+            }
+            data += put;
+            length -= put;
+        }
+        return true;
+    }
+
+    // Same as ini text, minus every shortcut other than keepHash (QSettings can't write to memory, so it's done by hand).
+    QByteArray FilterSettings(const QByteArray &ini, const QString &keepHash)
+    {
+        QByteArray filtered;
+        QByteArray group;
+        for(const QByteArray &line : ini.split('\n')) {
+            const QByteArray trimmed = line.trimmed();
+            if(trimmed.startsWith('[') && trimmed.endsWith(']'))
+                group = trimmed.mid(1, trimmed.size()-2);
+            if(group.startsWith("Shortcuts--") && group != "Shortcuts--" + keepHash.toUtf8())
+                continue;
+            // shortcut hashes are the keys here, and their names the values
+            if(group == "Shortcuts" && trimmed.contains('=') && trimmed.left(trimmed.indexOf('=')).trimmed() != keepHash.toUtf8())
+                continue;
+            filtered.append(line).append('\n');
+        }
+        return filtered;
+    }
+
+    void CollectItems(const QByteArray &root, const QByteArray &relative, const QByteArray &top, const dev_t dev,
+                      const QString &shortcutHash, std::vector<Item> &items, NeroBundle::Stats &stats)
+    {
+        const QByteArray dirPath = relative.isEmpty() ? root : root + '/' + relative;
+        DIR *dir = opendir(dirPath.constData());
+        if(!dir) {
+            stats.errors++;
+            return;
+        }
+
+        while(struct dirent *dirEntry = readdir(dir)) {
+            const QByteArray name(dirEntry->d_name);
+            if(name == "." || name == "..")
+                continue;
+            if(relative.isEmpty() && excludedDirs.contains(QString::fromLocal8Bit(name)))
+                continue;
+            // only the chosen shortcut's icon comes along
+            if(!shortcutHash.isEmpty() && relative == ".icoCache" && !name.endsWith('-' + shortcutHash.toUtf8() + ".png"))
+                continue;
+
+            struct stat st;
+            if(fstatat(dirfd(dir), name.constData(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                stats.errors++;
+                continue;
+            }
+
+            Item item;
+            const QByteArray itemRelative = relative.isEmpty() ? name : relative + '/' + name;
+            item.name = top + '/' + itemRelative;
+            item.path = root + '/' + itemRelative;
+            item.mode = st.st_mode & 07777;
+            item.mtime = st.st_mtim.tv_sec;
+            if(S_ISDIR(st.st_mode)) {
+                if(st.st_dev != dev)
+                    continue;
+                item.type = ItemDir;
+                item.name.append('/');
+                items.push_back(item);
+                CollectItems(root, itemRelative, top, dev, shortcutHash, items, stats);
+            } else if(S_ISLNK(st.st_mode)) {
+                char target[PATH_MAX];
+                const ssize_t len = readlinkat(dirfd(dir), name.constData(), target, sizeof(target)-1);
+                if(len < 0) {
+                    stats.errors++;
+                    continue;
+                }
+                item.type = ItemLink;
+                item.data = QByteArray(target, len);
+                item.size = len;
+                items.push_back(item);
+            } else if(S_ISREG(st.st_mode)) {
+                if(relative.isEmpty() && name == "nero-settings.ini" && !shortcutHash.isEmpty()) {
+                    QFile ini(QString::fromLocal8Bit(item.path));
+                    if(!ini.open(QIODevice::ReadOnly)) {
+                        stats.errors++;
+                        continue;
+                    }
+                    item.type = ItemInline;
+                    item.data = FilterSettings(ini.readAll(), shortcutHash);
+                    item.size = item.data.size();
+                } else {
+                    item.type = ItemFile;
+                    item.size = st.st_size;
+                }
+                stats.totalFiles++;
+                stats.totalBytes += item.size;
+                items.push_back(item);
+            }
+        }
+        closedir(dir);
+    }
+
+    bool CompressBlock(const Item &item, Block &block, const int level)
+    {
+        QByteArray in;
+        if(item.type == ItemFile) {
+            in.resize(block.length);
+            const int fd = open(item.path.constData(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+            if(fd < 0)
+                return false;
+            size_t got = 0;
+            while(got < block.length) {
+                const ssize_t read = pread(fd, in.data() + got, block.length - got, block.offset + got);
+                if(read < 0 && errno == EINTR)
+                    continue;
+                if(read <= 0)
+                    break;
+                got += read;
+            }
+            close(fd);
+            // the file shrank out from under us
+            if(got != block.length)
+                return false;
+        } else in = item.data;
+
+        block.crc = crc32(0L, (const Bytef*)in.constData(), in.size());
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        block.out.resize(deflateBound(&stream, in.size()) + 16);
+        stream.next_in = (Bytef*)in.constData();
+        stream.avail_in = in.size();
+        stream.next_out = (Bytef*)block.out.data();
+        stream.avail_out = block.out.size();
+        // every block but the last is sync flushed (byte aligned, no final bit), so they can simply be concatenated
+        const int result = deflate(&stream, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+        const bool ok = block.last ? result == Z_STREAM_END : (result == Z_OK && stream.avail_in == 0);
+        block.out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return ok;
+    }
+
+    QByteArray LocalHeader(const CentralEntry &entry)
+    {
+        QByteArray header;
+        Put32(header, 0x04034b50);
+        Put16(header, 45);                  // version needed: zip64
+        Put16(header, 0x0808);              // sizes & crc follow the data, utf-8 names
+        Put16(header, entry.method);
+        Put16(header, entry.dosTime);
+        Put16(header, entry.dosDate);
+        Put32(header, 0);
+        Put32(header, 0xffffffff);
+        Put32(header, 0xffffffff);
+        Put16(header, entry.name.size());
+        Put16(header, 20);
+        header.append(entry.name);
+        Put16(header, 0x0001);              // zip64 extra; real sizes are in the data descriptor
+        Put16(header, 16);
+        Put64(header, 0);
+        Put64(header, 0);
+        return header;
+    }
+
+    QByteArray DataDescriptor(const CentralEntry &entry)
+    {
+        QByteArray descriptor;
+        Put32(descriptor, 0x08074b50);
+        Put32(descriptor, entry.crc);
+        Put64(descriptor, entry.compressed);
+        Put64(descriptor, entry.uncompressed);
+        return descriptor;
+    }
+
+    QByteArray CentralHeader(const CentralEntry &entry)
+    {
+        QByteArray header;
+        Put32(header, 0x02014b50);
+        Put16(header, (3 << 8) | 45);       // made by unix, so the mode bits (and symlinks) mean something
+        Put16(header, 45);
+        Put16(header, 0x0808);
+        Put16(header, entry.method);
+        Put16(header, entry.dosTime);
+        Put16(header, entry.dosDate);
+        Put32(header, entry.crc);
+        Put32(header, 0xffffffff);
+        Put32(header, 0xffffffff);
+        Put16(header, entry.name.size());
+        Put16(header, 28 + 9);
+        Put16(header, 0);
+        Put16(header, 0);
+        Put16(header, 0);
+        Put32(header, entry.externalAttr);
+        Put32(header, 0xffffffff);
+        header.append(entry.name);
+        Put16(header, 0x0001);
+        Put16(header, 24);
+        Put64(header, entry.uncompressed);
+        Put64(header, entry.compressed);
+        Put64(header, entry.offset);
+        Put16(header, 0x5455);              // extended timestamp, for mtimes better than DOS's 2 seconds
+        Put16(header, 5);
+        header.append((char)1);
+        Put32(header, (quint32)entry.mtime);
+        return header;
+    }
+
+    QByteArray EndOfCentralDirectory(const quint64 entries, const quint64 size, const quint64 offset)
+    {
+        QByteArray end;
+        Put32(end, 0x06064b50);             // zip64 end of central directory
+        Put64(end, 44);
+        Put16(end, (3 << 8) | 45);
+        Put16(end, 45);
+        Put32(end, 0);
+        Put32(end, 0);
+        Put64(end, entries);
+        Put64(end, entries);
+        Put64(end, size);
+        Put64(end, offset);
+        Put32(end, 0x07064b50);             // ...and where to find it
+        Put32(end, 0);
+        Put64(end, offset + size);
+        Put32(end, 1);
+        Put32(end, 0x06054b50);
+        Put16(end, 0);
+        Put16(end, 0);
+        Put16(end, 0xffff);
+        Put16(end, 0xffff);
+        Put32(end, 0xffffffff);
+        Put32(end, 0xffffffff);
+        Put16(end, 0);
+        return end;
+    }
+
+    qint64 ExtendedMtime(const QByteArray &extra)
+    {
+        for(int i = 0; i + 4 <= extra.size();) {
+            const quint16 id = (uchar)extra[i] | ((uchar)extra[i+1] << 8);
+            const quint16 size = (uchar)extra[i+2] | ((uchar)extra[i+3] << 8);
+            if(id == 0x5455 && size >= 5 && i + 4 + size <= extra.size() && (extra[i+4] & 1))
+                return (quint32)((uchar)extra[i+5] | ((uchar)extra[i+6] << 8) | ((uchar)extra[i+7] << 16) | ((quint32)(uchar)extra[i+8] << 24));
+            i += 4 + size;
+        }
+        return -1;
+    }
+}
+
+bool NeroBundle::Export(const QString &prefixPath, const QString &outPath, const QString &shortcutHash,
+                        const int level, Stats &stats, const ProgressFunc &progress)
+{
+    stats = Stats();
+
+    const QByteArray root = prefixPath.toLocal8Bit();
+    struct stat rootStat;
+    if(stat(root.constData(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode) ||
+       !QFileInfo::exists(prefixPath + "/nero-settings.ini"))
+        return false;
+
+    std::vector<Item> items;
+    Item topItem;
+    topItem.name = QFileInfo(prefixPath).fileName().toUtf8() + '/';
+    topItem.type = ItemDir;
+    topItem.mode = rootStat.st_mode & 07777;
+    topItem.mtime = rootStat.st_mtim.tv_sec;
+    items.push_back(topItem);
+    CollectItems(root, QByteArray(), QFileInfo(prefixPath).fileName().toUtf8(), rootStat.st_dev, shortcutHash, items, stats);
+    if(stats.errors)
+        return false;
+
+    std::vector<Block> blocks;
+    for(size_t i = 0; i < items.size(); ++i) {
+        Item &item = items[i];
+        item.firstBlock = blocks.size();
+        if(item.type == ItemDir)
+            continue;
+        // links & generated files are tiny, so they're a single block
+        const qint64 length = item.type == ItemFile ? item.size : item.data.size();
+        qint64 offset = 0;
+        do {
+            Block block;
+            block.item = i;
+            block.offset = offset;
+            block.length = qMin<qint64>(blockSize, length - offset);
+            offset += block.length;
+            block.last = offset >= length;
+            blocks.push_back(block);
+        } while(offset < length);
+        item.blocks = blocks.size() - item.firstBlock;
+    }
+
+    const bool toStdout = outPath == "-";
+    const int out = toStdout ? STDOUT_FILENO : open(outPath.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(out < 0)
+        return false;
+
+    // Workers compress blocks ahead of the writer, but only so far ahead: memory use stays at a few MiB
+    // per thread no matter how big the prefix is.
+    const int threadCount = qBound(2, QThread::idealThreadCount(), 32);
+    const size_t window = threadCount * 4;
+    std::mutex mutex;
+    std::condition_variable blockDone, blockWritten;
+    std::atomic<size_t> next(0);
+    std::atomic<qint64> bytesRead(0);
+    size_t written = 0;
+    bool cancel = false;
+
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threadCount && (size_t)t < blocks.size(); ++t)
+        workers.emplace_back([&]() {
+            for(size_t i = next++; i < blocks.size(); i = next++) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    blockWritten.wait(lock, [&]() { return cancel || i < written + window; });
+                    if(cancel) return;
+                }
+                Block &block = blocks[i];
+                const bool ok = CompressBlock(items.at(block.item), block, level);
+                bytesRead += block.length;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    block.failed = !ok;
+                    block.ready = true;
+                }
+                blockDone.notify_all();
+            }
+        });
+
+    // the calling thread does the writing, in archive order
+    QByteArray buffer;
+    quint64 offset = 0;
+    std::vector<CentralEntry> central;
+    central.reserve(items.size());
+    bool ok = true;
+    auto lastProgress = std::chrono::steady_clock::now();
+    auto flush = [&](const bool force) {
+        if(ok && (force || buffer.size() >= 4*1024*1024)) {
+            ok = WriteAll(out, buffer.constData(), buffer.size());
+            buffer.clear();
+        }
+    };
+    auto report = [&]() {
+        stats.bytes = bytesRead;
+        stats.archiveBytes = offset;
+        if(progress && !progress(stats))
+            ok = false;
+        lastProgress = std::chrono::steady_clock::now();
+    };
+
+    for(size_t i = 0; i < items.size() && ok; ++i) {
+        const Item &item = items.at(i);
+        CentralEntry entry;
+        entry.name = item.name;
+        entry.method = item.type == ItemDir ? 0 : Z_DEFLATED;
+        entry.mtime = item.mtime;
+        entry.offset = offset;
+        DosDateTime(item.mtime, entry.dosTime, entry.dosDate);
+        const quint32 fileType = item.type == ItemDir ? S_IFDIR : (item.type == ItemLink ? S_IFLNK : S_IFREG);
+        entry.externalAttr = ((fileType | item.mode) << 16) | (item.type == ItemDir ? 0x10 : 0);
+
+        const QByteArray header = LocalHeader(entry);
+        buffer.append(header);
+        offset += header.size();
+
+        quint32 crc = crc32(0L, Z_NULL, 0);
+        for(size_t b = item.firstBlock; b < item.firstBlock + item.blocks && ok; ++b) {
+            Block &block = blocks[b];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!block.ready) {
+                    blockDone.wait_for(lock, std::chrono::milliseconds(50));
+                    if(std::chrono::steady_clock::now() - lastProgress > std::chrono::milliseconds(50)) {
+                        lock.unlock();
+                        report();
+                        lock.lock();
+                        if(!ok) break;
+                    }
+                }
+            }
+            if(!ok) break;
+            if(block.failed) {
+                stats.errors++;
+                ok = false;
+                break;
+            }
+            crc = crc32_combine(crc, block.crc, block.length);
+            entry.compressed += block.out.size();
+            entry.uncompressed += block.length;
+            offset += block.out.size();
+            buffer.append(block.out);
+            block.out = QByteArray();
+            flush(false);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                written = b + 1;
+            }
+            blockWritten.notify_all();
+        }
+        if(!ok) break;
+        entry.crc = crc;
+
+        const QByteArray descriptor = DataDescriptor(entry);
+        buffer.append(descriptor);
+        offset += descriptor.size();
+        central.push_back(entry);
+        if(item.type != ItemDir) stats.files++;
+        flush(false);
+    }
+
+    if(ok) {
+        const quint64 centralOffset = offset;
+        for(const CentralEntry &entry : central) {
+            const QByteArray header = CentralHeader(entry);
+            buffer.append(header);
+            offset += header.size();
+            flush(false);
+        }
+        const QByteArray end = EndOfCentralDirectory(central.size(), offset - centralOffset, centralOffset);
+        buffer.append(end);
+        offset += end.size();
+        flush(true);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancel = true;
+    }
+    blockWritten.notify_all();
+    for(auto &worker : workers)
+        worker.join();
+
+    stats.bytes = bytesRead;
+    stats.archiveBytes = offset;
+    if(!toStdout) {
+        if(close(out) != 0)
+            ok = false;
+        // don't leave half an archive lying around
+        if(!ok)
+            unlink(outPath.toLocal8Bit().constData());
+    }
+    return ok && !stats.errors;
+}
+
+bool NeroBundle::Extract(const QString &archivePath, const QString &destPath, QString *topName,
+                         Stats &stats, const ProgressFunc &progress)
+{
+    stats = Stats();
+
+    QuaZip zip(archivePath);
+    if(!zip.open(QuaZip::mdUnzip))
+        return false;
+    const QList<QuaZipFileInfo64> infos = zip.getFileInfoList64();
+    zip.close();
+    if(infos.isEmpty())
+        return false;
+
+    // Everything has to live under one top-level dir, with nothing escaping it.
+    const QString top = infos.first().name.section('/', 0, 0);
+    if(top.isEmpty() || top.startsWith('.'))
+        return false;
+    bool hasSettings = false;
+    QStringList links;
+    for(const QuaZipFileInfo64 &info : infos) {
+        if(info.name.startsWith('/') || info.name.section('/', 0, 0) != top ||
+           info.name.split('/').contains("..") || info.name.contains('\\'))
+            return false;
+        if(info.name == top + "/nero-settings.ini")
+            hasSettings = true;
+        const quint32 mode = (info.versionCreated >> 8) == 3 ? info.externalAttr >> 16 : 0;
+        if(S_ISLNK(mode))
+            links.append(info.name);
+        else if(!info.name.endsWith('/')) {
+            stats.totalFiles++;
+            stats.totalBytes += info.uncompressedSize;
+        }
+    }
+    if(!hasSettings)
+        return false;
+    // nothing gets to be written through a link from the same archive
+    for(const QuaZipFileInfo64 &info : infos)
+        for(const QString &link : links)
+            if(info.name.startsWith(link + '/'))
+                return false;
+
+    if(topName)
+        *topName = top;
+    if(QFileInfo::exists(destPath))
+        return false;
+
+    auto failed = [&]() {
+        NeroCopy::Stats removeStats;
+        NeroCopy::RemoveTree(destPath, removeStats);
+        return false;
+    };
+    auto localPath = [&](const QString &name) {
+        return destPath + '/' + name.mid(top.size() + 1);
+    };
+
+    for(const QuaZipFileInfo64 &info : infos) {
+        const QString path = localPath(info.name);
+        if(!QDir().mkpath(info.name.endsWith('/') ? path : QFileInfo(path).path()))
+            return failed();
+    }
+
+    // Each worker has its own handle on the archive (QuaZip isn't thread-safe) and extracts every Nth file.
+    const int threadCount = qBound(2, QThread::idealThreadCount(), 16);
+    std::atomic<qint64> filesDone(0), bytesDone(0), errors(0);
+    std::atomic<int> workersDone(0);
+    std::atomic<bool> cancel(false);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threadCount; ++t)
+        workers.emplace_back([&, t]() {
+            QuaZip workerZip(archivePath);
+            if(!workerZip.open(QuaZip::mdUnzip)) {
+                errors++;
+                workersDone++;
+                return;
+            }
+            QByteArray buffer(1024*1024, Qt::Uninitialized);
+            int index = 0;
+            for(bool more = workerZip.goToFirstFile(); more && !cancel; more = workerZip.goToNextFile(), ++index) {
+                if(index % threadCount != t || index >= infos.size())
+                    continue;
+                const QuaZipFileInfo64 &info = infos.at(index);
+                const quint32 mode = (info.versionCreated >> 8) == 3 ? info.externalAttr >> 16 : 0;
+                if(info.name.endsWith('/') || S_ISLNK(mode))
+                    continue;
+
+                QuaZipFile file(&workerZip);
+                const int fd = open(localPath(info.name).toLocal8Bit().constData(),
+                                    O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+                if(fd < 0 || !file.open(QIODevice::ReadOnly)) {
+                    if(fd >= 0) close(fd);
+                    errors++;
+                    continue;
+                }
+                bool ok = true;
+                while(ok && !cancel) {
+                    const qint64 got = file.read(buffer.data(), buffer.size());
+                    if(got < 0) ok = false;
+                    if(got <= 0) break;
+                    ok = WriteAll(fd, buffer.constData(), got);
+                    bytesDone += got;
+                }
+                file.close();
+                // closing is where minizip checks the crc
+                if(file.getZipError() != UNZ_OK)
+                    ok = false;
+
+                fchmod(fd, (mode & 07777) ? (mode & 07777) : 0644);
+                qint64 mtime = ExtendedMtime(info.extra);
+                if(mtime < 0)
+                    mtime = info.dateTime.toSecsSinceEpoch();
+                const struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+                futimens(fd, times);
+                if(close(fd) != 0)
+                    ok = false;
+                if(ok) filesDone++;
+                else errors++;
+            }
+            workerZip.close();
+            workersDone++;
+        });
+
+    while(workersDone < threadCount && !cancel) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        stats.files = filesDone;
+        stats.bytes = bytesDone;
+        stats.errors = errors;
+        if(progress && !progress(stats))
+            cancel = true;
+    }
+    for(auto &worker : workers)
+        worker.join();
+    stats.files = filesDone;
+    stats.bytes = bytesDone;
+    stats.errors = errors;
+    if(cancel || stats.errors || stats.files != stats.totalFiles)
+        return failed();
+
+    // links go in last, once nothing else is being written into the tree
+    if(!links.isEmpty()) {
+        if(!zip.open(QuaZip::mdUnzip))
+            return failed();
+        for(const QString &link : links) {
+            zip.setCurrentFile(link);
+            QuaZipFile file(&zip);
+            if(!file.open(QIODevice::ReadOnly))
+                return failed();
+            const QByteArray target = file.readAll();
+            file.close();
+            QString path = localPath(link);
+            if(path.endsWith('/')) path.chop(1);
+            if(target.isEmpty() || symlink(target.constData(), path.toLocal8Bit().constData()) != 0)
+                return failed();
+        }
+        zip.close();
+    }
+
+    // dir permissions go on after everything's in them, so a read-only dir doesn't get in the way
+    for(const QuaZipFileInfo64 &info : infos) {
+        const quint32 mode = (info.versionCreated >> 8) == 3 ? info.externalAttr >> 16 : 0;
+        if(info.name.endsWith('/') && S_ISDIR(mode))
+            chmod(localPath(info.name).toLocal8Bit().constData(), (mode & 07777) | S_IRWXU);
+    }
+    return true;
+}
+
+bool NeroBundle::Import(const QString &archivePath, const QString &home, const QString &newName,
+                        QString &importedName, Stats &stats, const ProgressFunc &progress)
+{
+    if(!newName.isEmpty() && (newName.contains('/') || newName.startsWith('.') || QFileInfo::exists(home + '/' + newName)))
+        return false;
+
+    // extracted next to its final spot, so the prefix only shows up once it's complete
+    const QString tmpPath = QString("%1/.import-%2.tmp").arg(home).arg(QDateTime::currentMSecsSinceEpoch());
+    QString top;
+    if(!Extract(archivePath, tmpPath, &top, stats, progress))
+        return false;
+
+    importedName = newName.isEmpty() ? top : newName;
+    const QString prefixPath = home + '/' + importedName;
+    if(QFileInfo::exists(prefixPath) || rename(tmpPath.toLocal8Bit().constData(), prefixPath.toLocal8Bit().constData()) != 0) {
+        NeroCopy::Stats removeStats;
+        NeroCopy::RemoveTree(tmpPath, removeStats);
+        return false;
+    }
+
+    QSettings settings(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+    settings.setValue("PrefixSettings/Name", importedName);
+    return true;
+}
@@ -0,0 +1,57 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Portable prefix bundles (zip archives) for moving prefixes between machines.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROBUNDLE_H
+#define NEROBUNDLE_H
+
+#include <QString>
+
+#include <functional>
+
+class NeroBundle
+{
+public:
+    struct Stats {
+        qint64 files = 0;
+        qint64 totalFiles = 0;
+        // uncompressed bytes read (export) or written out (import)
+        qint64 bytes = 0;
+        qint64 totalBytes = 0;
+        // size of the archive written so far (export only)
+        qint64 archiveBytes = 0;
+        qint64 errors = 0;
+    };
+
+    // Called from the calling thread every so often; return false to cancel.
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+
+    // Writes prefixPath (minus logs & shader caches) as a zip64 archive, with everything under a top-level dir
+    // named after the prefix. If shortcutHash is set, only that shortcut's settings & icon are included.
+    // outPath can be "-" for stdout, since the archive is written strictly front to back.
+    static bool Export(const QString &prefixPath, const QString &outPath, const QString &shortcutHash,
+                       const int level, Stats &stats, const ProgressFunc &progress = nullptr);
+    // Extracts the contents of a bundle's top-level dir into destPath (which mustn't exist yet), and cleans up on failure.
+    static bool Extract(const QString &archivePath, const QString &destPath, QString *topName,
+                        Stats &stats, const ProgressFunc &progress = nullptr);
+    // Extracts a bundle into home/<newName> (or the bundle's own name if empty); never overwrites an existing prefix.
+    static bool Import(const QString &archivePath, const QString &home, const QString &newName,
+                       QString &importedName, Stats &stats, const ProgressFunc &progress = nullptr);
+};
+
+#endif // NEROBUNDLE_H
@@ -102,6 +102,47 @@ public:
         DLLNativeOnly,
         DLLDisabled
     } DLLoverrideTypes_e;
+
+    static enum {
+        NiceDefault = 0,
+        NiceHigher,
+        NiceHighest,
+        NiceLower,
+        NiceLowerMore,
+        NiceLowest
+    } ProcessNiceLevels_e;
+
+    static enum {
+        SchedDefault = 0,
+        SchedBatch,
+        SchedIdle
+    } SchedPolicies_e;
+
+    static enum {
+        IoPrioDefault = 0,
+        IoPrioHigh,
+        IoPrioLow,
+        IoPrioIdle
+    } IoPriorities_e;
+
+    static enum {
+        OomDefault = 0,
+        OomProtect,
+        OomPreferKill,
+        OomKillFirst
+    } OomPolicies_e;
+
+    static enum {
+        WineserverPrioDefault = 0,
+        WineserverPrioRaised,
+        WineserverPrioHigh,
+        WineserverPrioRealtime
+    } WineserverPriorities_e;
+
+    static enum {
+        WineserverAffinityDefault = 0,
+        WineserverAffinityDedicated
+    } WineserverAffinities_e;
 };
 
 #endif // NEROCONSTANTS_H
@@ -0,0 +1,367 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Fast (copy-on-write where possible) file & directory tree copying, and parallel removal.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerocopy.h"
+
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+
+namespace {
+    struct FileJob {
+        QByteArray src;
+        QByteArray dst;
+        struct stat st;
+    };
+
+    bool PlainCopy(const int in, const int out)
+    {
+        static const size_t bufSize = 1024*1024;
+        std::vector<char> buf(bufSize);
+        for(;;) {
+            const ssize_t got = read(in, buf.data(), bufSize);
+            if(got < 0) {
+                if(errno == EINTR) continue;
+                return false;
+            }
+            if(got == 0)
+                return true;
+            ssize_t written = 0;
+            while(written < got) {
+                const ssize_t put = write(out, buf.data() + written, got - written);
+                if(put < 0) {
+                    if(errno == EINTR) continue;
+                    return false;
+                }
+                written += put;
+            }
+        }
+    }
+
+    // Walks the source tree, making directories & symlinks as it goes and queueing up regular files.
+    // Directories are made up-front so the workers never have to care about parents existing.
+    void WalkTree(const QByteArray &src, const QByteArray &dst, std::vector<FileJob> &jobs,
+                  NeroCopy::Stats &stats, const QStringList &skip)
+    {
+        DIR *dir = opendir(src.constData());
+        if(!dir) {
+            stats.errors++;
+            return;
+        }
+
+        while(struct dirent *entry = readdir(dir)) {
+            const QByteArray name(entry->d_name);
+            if(name == "." || name == "..")
+                continue;
+            if(!skip.isEmpty() && skip.contains(QString::fromLocal8Bit(name)))
+                continue;
+
+            FileJob job;
+            job.src = src + '/' + name;
+            job.dst = dst + '/' + name;
+            if(lstat(job.src.constData(), &job.st) != 0) {
+                stats.errors++;
+                continue;
+            }
+
+            if(S_ISDIR(job.st.st_mode)) {
+                if(mkdir(job.dst.constData(), job.st.st_mode & 07777) != 0 && errno != EEXIST) {
+                    stats.errors++;
+                    continue;
+                }
+                stats.dirs++;
+                // skip list only applies to the top level
+                WalkTree(job.src, job.dst, jobs, stats, {});
+            } else if(S_ISLNK(job.st.st_mode)) {
+                // prefixes rely on these (dosdevices), so keep them as links rather than following them
+                char target[PATH_MAX];
+                const ssize_t len = readlink(job.src.constData(), target, sizeof(target)-1);
+                if(len < 0 || symlink(QByteArray(target, len).constData(), job.dst.constData()) != 0)
+                    stats.errors++;
+                else stats.links++;
+            } else if(S_ISREG(job.st.st_mode)) {
+                stats.totalFiles++;
+                stats.totalBytes += job.st.st_size;
+                jobs.push_back(job);
+            }
+            // sockets, fifos & device nodes don't belong in a prefix, so they're just left out.
+        }
+        closedir(dir);
+    }
+
+    // Same idea as WalkTree, but for removal: everything that isn't a directory gets queued to be unlinked,
+    // and directories are listed parents-first so they can be removed in reverse once they're empty.
+    // A big prefix can take a while just to list, so progress gets a look in every so often here too.
+    void WalkRemoval(const QByteArray &path, const dev_t rootDev, std::vector<QByteArray> &files,
+                     std::vector<QByteArray> &dirs, NeroCopy::Stats &stats,
+                     const NeroCopy::ProgressFunc &progress, bool &cancel)
+    {
+        if(cancel)
+            return;
+        DIR *dir = opendir(path.constData());
+        if(!dir) {
+            stats.errors++;
+            return;
+        }
+        dirs.push_back(path);
+
+        while(struct dirent *entry = readdir(dir)) {
+            const QByteArray name(entry->d_name);
+            if(name == "." || name == "..")
+                continue;
+            if(cancel)
+                break;
+
+            const QByteArray child = path + '/' + name;
+            struct stat st;
+            if(lstat(child.constData(), &st) != 0) {
+                stats.errors++;
+                continue;
+            }
+
+            if(S_ISDIR(st.st_mode)) {
+                // something mounted inside the prefix isn't ours to delete
+                if(st.st_dev != rootDev) {
+                    stats.errors++;
+                    continue;
+                }
+                stats.dirs++;
+                if(progress && stats.dirs % 256 == 0 && !progress(stats))
+                    cancel = true;
+                WalkRemoval(child, rootDev, files, dirs, stats, progress, cancel);
+            } else {
+                if(S_ISLNK(st.st_mode)) stats.links++;
+                else stats.totalBytes += st.st_size;
+                stats.totalFiles++;
+                files.push_back(child);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+bool NeroCopy::SupportsReflink(const QByteArray &srcFile, const QByteArray &dstDir)
+{
+    const int in = open(srcFile.constData(), O_RDONLY | O_CLOEXEC);
+    if(in < 0)
+        return false;
+    const QByteArray probePath = dstDir + "/.reflink-probe";
+    const int out = open(probePath.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool supported = false;
+    if(out >= 0) {
+        supported = ioctl(out, FICLONE, in) == 0;
+        close(out);
+        unlink(probePath.constData());
+    }
+    close(in);
+    return supported;
+}
+
+int NeroCopy::CloneFile(const QByteArray &src, const QByteArray &dst, const struct stat &srcStat)
+{
+    const int in = open(src.constData(), O_RDONLY | O_CLOEXEC);
+    if(in < 0)
+        return CloneFailed;
+    const int out = open(dst.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, srcStat.st_mode & 07777);
+    if(out < 0) {
+        close(in);
+        return CloneFailed;
+    }
+
+    int result = CloneFailed;
+    // btrfs/xfs/bcachefs: share the extents outright, which is effectively free.
+    if(ioctl(out, FICLONE, in) == 0)
+        result = CloneReflinked;
+    else {
+        // in-kernel copy (no round trip through userspace), which can still be offloaded by e.g. NFS
+        bool ok = true;
+        off_t left = srcStat.st_size;
+        while(left > 0) {
+            const ssize_t copied = copy_file_range(in, nullptr, out, nullptr, left, 0);
+            if(copied < 0) {
+                if(errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            if(copied == 0)
+                break;
+            left -= copied;
+        }
+        // EXDEV/ENOSYS/EOPNOTSUPP and friends: start over the old fashioned way.
+        if(!ok) {
+            ok = lseek(in, 0, SEEK_SET) == 0 &&
+                 lseek(out, 0, SEEK_SET) == 0 &&
+                 ftruncate(out, 0) == 0 &&
+                 PlainCopy(in, out);
+        }
+        if(ok) result = CloneCopied;
+    }
+
+    if(result != CloneFailed) {
+        // keep timestamps, since wine & proton compare them to decide when to update things
+        const struct timespec times[2] = { srcStat.st_atim, srcStat.st_mtim };
+        futimens(out, times);
+    }
+
+    close(in);
+    if(close(out) != 0)
+        result = CloneFailed;
+    if(result == CloneFailed)
+        unlink(dst.constData());
+    return result;
+}
+
+bool NeroCopy::CloneTree(const QString &src, const QString &dst, Stats &stats,
+                         const QStringList &skipTopLevel, const ProgressFunc &progress)
+{
+    stats = Stats();
+
+    const QByteArray srcPath = src.toLocal8Bit();
+    const QByteArray dstPath = dst.toLocal8Bit();
+    struct stat rootStat;
+    if(stat(srcPath.constData(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode))
+        return false;
+    if(mkdir(dstPath.constData(), rootStat.st_mode & 07777) != 0 && errno != EEXIST)
+        return false;
+
+    std::vector<FileJob> jobs;
+    WalkTree(srcPath, dstPath, jobs, stats, skipTopLevel);
+
+    // Most of a prefix is small files, so the per-file syscall overhead dominates over raw throughput
+    // and several workers go a long way - even on a single spinning disk, the kernel can merge requests.
+    std::atomic<size_t> next(0);
+    std::atomic<qint64> files(0), reflinked(0), copied(0), errors(0);
+    std::atomic<bool> cancel(false);
+    auto worker = [&]() {
+        for(size_t i = next++; i < jobs.size() && !cancel; i = next++) {
+            const FileJob &job = jobs.at(i);
+            switch(CloneFile(job.src, job.dst, job.st)) {
+            case CloneReflinked: reflinked += job.st.st_size; break;
+            case CloneCopied:    copied += job.st.st_size;    break;
+            default:             errors++;                    break;
+            }
+            files++;
+        }
+    };
+
+    const int threadCount = qBound(2, QThread::idealThreadCount(), 16);
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threadCount && (size_t)i < jobs.size(); ++i)
+        workers.emplace_back(worker);
+
+    auto update = [&]() {
+        stats.files = files;
+        stats.bytesReflinked = reflinked;
+        stats.bytesCopied = copied;
+        stats.errors += errors.exchange(0);
+    };
+    while(files < (qint64)jobs.size() && !cancel) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        update();
+        if(progress && !progress(stats))
+            cancel = true;
+    }
+    for(auto &thread : workers)
+        thread.join();
+    update();
+    if(progress) progress(stats);
+
+    return !cancel && stats.errors == 0;
+}
+
+bool NeroCopy::RemoveTree(const QString &path, Stats &stats, const ProgressFunc &progress)
+{
+    stats = Stats();
+
+    const QByteArray rootPath = path.toLocal8Bit();
+    struct stat rootStat;
+    if(lstat(rootPath.constData(), &rootStat) != 0)
+        return errno == ENOENT;
+    if(!S_ISDIR(rootStat.st_mode))
+        return unlink(rootPath.constData()) == 0;
+
+    std::vector<QByteArray> files, dirs;
+    bool walkCanceled = false;
+    WalkRemoval(rootPath, rootStat.st_dev, files, dirs, stats, progress, walkCanceled);
+
+    // unlinks are mostly metadata updates to different directories, which the filesystem can do in parallel
+    std::atomic<size_t> next(0);
+    std::atomic<qint64> removed(0), errors(0);
+    std::atomic<bool> cancel(walkCanceled);
+    auto worker = [&]() {
+        for(size_t i = next++; i < files.size() && !cancel; i = next++) {
+            if(unlinkat(AT_FDCWD, files.at(i).constData(), 0) != 0 && errno != ENOENT)
+                errors++;
+            removed++;
+        }
+    };
+
+    const int threadCount = qBound(2, QThread::idealThreadCount(), 16);
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threadCount && (size_t)i < files.size(); ++i)
+        workers.emplace_back(worker);
+
+    auto update = [&]() {
+        stats.files = removed;
+        stats.errors += errors.exchange(0);
+    };
+    while(removed < (qint64)files.size() && !cancel) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        update();
+        if(progress && !progress(stats))
+            cancel = true;
+    }
+    for(auto &thread : workers)
+        thread.join();
+    update();
+
+    if(!cancel) {
+        // deepest first, so each one is empty by the time it's reached
+        size_t count = 0;
+        for(auto dir = dirs.rbegin(); dir != dirs.rend() && !cancel; ++dir) {
+            if(unlinkat(AT_FDCWD, dir->constData(), AT_REMOVEDIR) != 0 && errno != ENOENT)
+                stats.errors++;
+            if(progress && ++count % 256 == 0 && !progress(stats))
+                cancel = true;
+        }
+    }
+    if(progress) progress(stats);
+
+    return !cancel && stats.errors == 0;
+}
+
+QString NeroCopy::FormatStats(const Stats &stats)
+{
+    auto mib = [](const qint64 bytes) { return QString::number(bytes / (1024.0*1024), 'f', 1); };
+    return QString("%1 files, %2 dirs, %3 links; %4 MiB reflinked, %5 MiB copied%6")
+            .arg(stats.files).arg(stats.dirs).arg(stats.links)
+            .arg(mib(stats.bytesReflinked), mib(stats.bytesCopied),
+                 stats.errors ? QString(", %1 errors").arg(stats.errors) : QString());
+}
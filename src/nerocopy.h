@@ -0,0 +1,68 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Fast (copy-on-write where possible) file & directory tree copying, and parallel removal.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROCOPY_H
+#define NEROCOPY_H
+
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+#include <sys/stat.h>
+
+class NeroCopy
+{
+public:
+    struct Stats {
+        qint64 files = 0;
+        qint64 totalFiles = 0;
+        qint64 dirs = 0;
+        qint64 links = 0;
+        qint64 totalBytes = 0;
+        // bytes that share extents with the source (FICLONE), vs. ones physically written out
+        qint64 bytesReflinked = 0;
+        qint64 bytesCopied = 0;
+        qint64 errors = 0;
+    };
+
+    enum {
+        CloneFailed = 0,
+        CloneReflinked,
+        CloneCopied
+    } CloneResults_e;
+
+    // Called from the calling thread every so often while the copy runs (so GUI callers can pump events);
+    // return false to cancel.
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+
+    static int CloneFile(const QByteArray &src, const QByteArray &dst, const struct stat &srcStat);
+    // Tries cloning srcFile into dstDir, which is the only reliable way to tell if CloneTree between the two
+    // would share extents rather than copy everything.
+    static bool SupportsReflink(const QByteArray &srcFile, const QByteArray &dstDir);
+    // skipTopLevel: names directly under src to leave out (e.g. ".logs")
+    static bool CloneTree(const QString &src, const QString &dst, Stats &stats,
+                          const QStringList &skipTopLevel = {}, const ProgressFunc &progress = nullptr);
+    // Only files, links & dirs are counted here (totalFiles being everything non-dir to unlink); never follows
+    // symlinks or crosses into other mounts, so e.g. dosdevices/z: is just removed as a link. progress also gets
+    // called while the tree's being listed (with files still at 0), so long walks can be canceled too.
+    static bool RemoveTree(const QString &path, Stats &stats, const ProgressFunc &progress = nullptr);
+    static QString FormatStats(const Stats &stats);
+};
+
+#endif // NEROCOPY_H
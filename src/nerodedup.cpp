@@ -0,0 +1,537 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Cross-prefix file deduplication (via reflinks).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerodedup.h"
+#include "nerotuning.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+namespace {
+    // small files aren't worth the syscalls, and share at most a block or two anyways
+    const off_t minFileSize = 16*1024;
+    // how much of the start & end of each file goes into the hash; the full compare happens later
+    const size_t sampleSize = 64*1024;
+    // btrfs caps each dedupe request at 16MiB
+    const off_t dedupeChunk = 16*1024*1024;
+
+    // The parts of a prefix that are (nearly) the same everywhere: Wine's own DLLs & fonts,
+    // plus the shared redistributable dirs winetricks installs into.
+    const QStringList dedupDirs = {
+        "drive_c/windows",
+        "drive_c/Program Files/Common Files",
+        "drive_c/Program Files (x86)/Common Files",
+    };
+
+    struct FileEntry {
+        QByteArray path;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        off_t size = 0;
+        qint64 mtime = 0;
+        quint64 hash = 0;
+        bool hashed = false;
+        bool done = false;
+        bool busy = false;
+    };
+
+    enum { DedupeOk, DedupeDiffers, DedupeUnsupported, DedupeFailed };
+
+    struct Shared {
+        std::atomic<int> phase { NeroDedup::PhaseScanning };
+        std::atomic<qint64> filesScanned { 0 }, candidates { 0 }, hashed { 0 }, toHash { 0 };
+        std::atomic<qint64> groupsDone { 0 }, groups { 0 }, filesDeduped { 0 }, bytesDeduped { 0 }, errors { 0 };
+        std::atomic<bool> cancel { false };
+        std::atomic<bool> finished { false };
+    };
+
+    inline quint64 Mix(quint64 h, const quint64 v)
+    {
+        h ^= v * 0x9E3779B97F4A7C15ull;
+        h = (h << 31) | (h >> 33);
+        return h * 0xC2B2AE3D27D4EB4Full;
+    }
+
+    quint64 HashBuffer(quint64 h, const char *data, const size_t len)
+    {
+        size_t i = 0;
+        for(; i + 8 <= len; i += 8) {
+            quint64 v;
+            memcpy(&v, data + i, 8);
+            h = Mix(h, v);
+        }
+        quint64 tail = 0;
+        memcpy(&tail, data + i, len - i);
+        return Mix(h, tail ^ len);
+    }
+
+    // Sampled (head + tail + size) hash - only used to find likely matches, which then get compared in full.
+    bool SampleHash(FileEntry &file)
+    {
+        // O_NOATIME is only allowed on files we own
+        int fd = open(file.path.constData(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+        if(fd < 0) fd = open(file.path.constData(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return false;
+
+        std::vector<char> buf(sampleSize);
+        quint64 h = Mix(0, file.size);
+        ssize_t got = pread(fd, buf.data(), sampleSize, 0);
+        if(got > 0) h = HashBuffer(h, buf.data(), got);
+        if(file.size > (off_t)sampleSize) {
+            got = pread(fd, buf.data(), sampleSize, file.size - sampleSize);
+            if(got > 0) h = HashBuffer(h, buf.data(), got);
+        }
+        close(fd);
+
+        file.hash = h;
+        file.hashed = got >= 0;
+        return file.hashed;
+    }
+
+    bool SameContents(const int a, const int b, const off_t size)
+    {
+        static const size_t bufSize = 1024*1024;
+        std::vector<char> bufA(bufSize), bufB(bufSize);
+        for(off_t off = 0; off < size;) {
+            const size_t want = std::min<off_t>(bufSize, size - off);
+            if(pread(a, bufA.data(), want, off) != (ssize_t)want ||
+               pread(b, bufB.data(), want, off) != (ssize_t)want ||
+               memcmp(bufA.data(), bufB.data(), want) != 0)
+                return false;
+            off += want;
+        }
+        return true;
+    }
+
+    // Last resort for filesystems without FIDEDUPERANGE: compare ourselves, then swap in a reflinked copy.
+    // Never a hardlink - prefixes must stay independent, so a write in one can't show up in another.
+    int CloneReplace(const FileEntry &target, const int srcFd, const int dstFd)
+    {
+        if(!SameContents(srcFd, dstFd, target.size))
+            return DedupeDiffers;
+
+        struct stat targetStat, st;
+        if(fstat(dstFd, &targetStat) != 0)
+            return DedupeFailed;
+
+        const QByteArray tempPath = target.path + ".nero-dedup";
+        const int tempFd = open(tempPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, targetStat.st_mode & 07777);
+        if(tempFd < 0)
+            return DedupeFailed;
+        if(ioctl(tempFd, FICLONE, srcFd) != 0) {
+            const int err = errno;
+            close(tempFd);
+            unlink(tempPath.constData());
+            return (err == EOPNOTSUPP || err == EINVAL || err == ENOTTY || err == EXDEV) ? DedupeUnsupported : DedupeFailed;
+        }
+        // the swapped-in file has to look exactly like the old one: umask may have eaten mode bits on create,
+        // and a file that'd change hands (e.g. root-owned prefix files) isn't worth the space saved
+        const bool sameOwner = fstat(tempFd, &st) == 0 && st.st_uid == targetStat.st_uid && st.st_gid == targetStat.st_gid;
+        const struct timespec times[2] = { targetStat.st_atim, targetStat.st_mtim };
+        // (chown first, since it drops setuid/setgid bits)
+        if((!sameOwner && fchown(tempFd, targetStat.st_uid, targetStat.st_gid) != 0) ||
+           fchmod(tempFd, targetStat.st_mode & 07777) != 0 ||
+           futimens(tempFd, times) != 0) {
+            close(tempFd);
+            unlink(tempPath.constData());
+            return DedupeFailed;
+        }
+        close(tempFd);
+
+        if(rename(tempPath.constData(), target.path.constData()) != 0) {
+            unlink(tempPath.constData());
+            return DedupeFailed;
+        }
+        return DedupeOk;
+    }
+
+    int Dedupe(const FileEntry &source, const FileEntry &target, qint64 &bytes)
+    {
+        const int srcFd = open(source.path.constData(), O_RDONLY | O_CLOEXEC);
+        if(srcFd < 0)
+            return DedupeFailed;
+        const int dstFd = open(target.path.constData(), O_RDWR | O_CLOEXEC);
+        if(dstFd < 0) {
+            close(srcFd);
+            return DedupeFailed;
+        }
+
+        // Ideally the kernel does the compare & share in one go, which is also safe against either file
+        // being written to mid-way, and leaves the target's inode (and metadata) untouched.
+        int result = DedupeOk;
+        bytes = 0;
+        file_dedupe_range *range = (file_dedupe_range*)calloc(1, sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info));
+        for(off_t off = 0; off < source.size && result == DedupeOk;) {
+            range->src_offset = off;
+            range->src_length = std::min(dedupeChunk, source.size - off);
+            range->dest_count = 1;
+            range->info[0].dest_fd = dstFd;
+            range->info[0].dest_offset = off;
+            range->info[0].bytes_deduped = 0;
+            range->info[0].status = 0;
+
+            if(ioctl(srcFd, FIDEDUPERANGE, range) != 0) {
+                result = (errno == EOPNOTSUPP || errno == EINVAL || errno == ENOTTY || errno == EXDEV) ? DedupeUnsupported : DedupeFailed;
+            } else if(range->info[0].status == FILE_DEDUPE_RANGE_DIFFERS) {
+                result = DedupeDiffers;
+            } else if(range->info[0].status < 0) {
+                result = range->info[0].status == -EOPNOTSUPP || range->info[0].status == -EINVAL ? DedupeUnsupported : DedupeFailed;
+            } else if(range->info[0].bytes_deduped == 0) {
+                result = DedupeFailed;
+            } else {
+                off += range->info[0].bytes_deduped;
+                bytes += range->info[0].bytes_deduped;
+            }
+        }
+        free(range);
+
+        // only fall back when nothing's been shared yet, else the file's already half-done & identical so far
+        if(result == DedupeUnsupported && bytes == 0) {
+            result = CloneReplace(target, srcFd, dstFd);
+            if(result == DedupeOk) bytes = source.size;
+        }
+
+        close(srcFd);
+        close(dstFd);
+        return result;
+    }
+
+    void ScanDir(const QByteArray &path, std::vector<FileEntry> &files, Shared &shared)
+    {
+        DIR *dir = opendir(path.constData());
+        if(!dir)
+            return;
+        while(struct dirent *entry = readdir(dir)) {
+            if(shared.cancel)
+                break;
+            const QByteArray name(entry->d_name);
+            if(name == "." || name == "..")
+                continue;
+
+            FileEntry file;
+            file.path = path + '/' + name;
+            struct stat st;
+            // lstat, since Proton's builtin DLLs are often symlinks into the runner (which are left alone)
+            if(lstat(file.path.constData(), &st) != 0)
+                continue;
+            if(S_ISDIR(st.st_mode))
+                ScanDir(file.path, files, shared);
+            else if(S_ISREG(st.st_mode) && st.st_size >= minFileSize) {
+                file.dev = st.st_dev;
+                file.ino = st.st_ino;
+                file.size = st.st_size;
+                file.mtime = (qint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+                files.push_back(file);
+                shared.filesScanned++;
+            }
+        }
+        closedir(dir);
+    }
+
+    // state file lines: "<H|D>\t<ino>\t<size>\t<mtime>\t<hash>\t<path>"
+    // H = hash is known, D = file has also been deduplicated already.
+    QHash<QByteArray, FileEntry> LoadState(const QString &statePath)
+    {
+        QHash<QByteArray, FileEntry> state;
+        QFile file(statePath);
+        if(!file.open(QIODevice::ReadOnly))
+            return state;
+        while(!file.atEnd()) {
+            const QByteArray line = file.readLine();
+            const QList<QByteArray> fields = line.left(line.size() - (line.endsWith('\n') ? 1 : 0)).split('\t');
+            if(fields.count() < 6)
+                continue;
+            FileEntry entry;
+            entry.done = fields.at(0) == "D";
+            entry.ino = fields.at(1).toULongLong();
+            entry.size = fields.at(2).toLongLong();
+            entry.mtime = fields.at(3).toLongLong();
+            entry.hash = fields.at(4).toULongLong(nullptr, 16);
+            entry.hashed = true;
+            // paths could have tabs in them in theory, so take everything from here on
+            entry.path = fields.mid(5).join('\t');
+            // a later D line for the same path supersedes an earlier H line
+            state.insert(entry.path, entry);
+        }
+        return state;
+    }
+
+    QByteArray StateLine(const FileEntry &entry)
+    {
+        return (entry.done ? "D\t" : "H\t") + QByteArray::number((qulonglong)entry.ino) + '\t' +
+               QByteArray::number((qlonglong)entry.size) + '\t' + QByteArray::number(entry.mtime) + '\t' +
+               QByteArray::number(entry.hash, 16) + '\t' + entry.path + '\n';
+    }
+
+    template<typename Func>
+    void RunPool(const size_t count, Shared &shared, Func func)
+    {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        const int threadCount = qBound(2, QThread::idealThreadCount(), 8);
+        for(int t = 0; t < threadCount && (size_t)t < count; ++t)
+            workers.emplace_back([&]() {
+                // keep out of the way of whatever's actually being played
+                NeroTuning::SetIoPriority(0, NeroTuning::IoClassIdle, 0);
+                for(size_t i = next++; i < count && !shared.cancel; i = next++)
+                    func(i);
+            });
+        for(auto &worker : workers)
+            worker.join();
+    }
+
+    void DedupJob(const QStringList &roots, const QString &statePath, Shared &shared)
+    {
+        NeroTuning::SetIoPriority(0, NeroTuning::IoClassIdle, 0);
+
+        // 1. find everything worth looking at
+        std::vector<FileEntry> files;
+        for(const QString &root : roots)
+            for(const QString &dir : dedupDirs)
+                ScanDir(QString(root + '/' + dir).toLocal8Bit(), files, shared);
+        if(shared.cancel)
+            return;
+
+        // only files sharing a size (on the same filesystem, since reflinks can't cross them) can be duplicates
+        std::sort(files.begin(), files.end(), [](const FileEntry &a, const FileEntry &b) {
+            if(a.dev != b.dev) return a.dev < b.dev;
+            if(a.size != b.size) return a.size < b.size;
+            return a.ino < b.ino;
+        });
+        std::vector<FileEntry> candidates;
+        for(size_t i = 0; i < files.size();) {
+            size_t end = i + 1;
+            while(end < files.size() && files[end].dev == files[i].dev && files[end].size == files[i].size)
+                ++end;
+            // hardlinks already share everything, so only one path per inode
+            std::vector<FileEntry> unique;
+            for(size_t j = i; j < end; ++j)
+                if(unique.empty() || unique.back().ino != files[j].ino)
+                    unique.push_back(files[j]);
+            if(unique.size() > 1)
+                candidates.insert(candidates.end(), unique.begin(), unique.end());
+            i = end;
+        }
+        files.clear();
+        shared.candidates = candidates.size();
+
+        // 2. hash what isn't already known from a previous run
+        shared.phase = NeroDedup::PhaseHashing;
+        const QHash<QByteArray, FileEntry> state = LoadState(statePath);
+        std::vector<size_t> toHash;
+        for(size_t i = 0; i < candidates.size(); ++i) {
+            FileEntry &file = candidates[i];
+            const auto known = state.constFind(file.path);
+            if(known != state.constEnd() && known->ino == file.ino && known->size == file.size && known->mtime == file.mtime) {
+                file.hash = known->hash;
+                file.hashed = true;
+                file.done = known->done;
+            } else toHash.push_back(i);
+        }
+        shared.toHash = toHash.size();
+        RunPool(toHash.size(), shared, [&](const size_t i) {
+            if(!SampleHash(candidates[toHash[i]]))
+                shared.errors++;
+            shared.hashed++;
+        });
+        if(shared.cancel)
+            return;
+
+        // 3. dedupe each group of likely-identical files against one of them
+        shared.phase = NeroDedup::PhaseDeduplicating;
+        // hashing can take a while, so leave out anything under a prefix that's been started up since;
+        // swapping files out from under a running Wine is asking for trouble
+        // (their files can still be the source, that only ever gets read)
+        QList<QByteArray> busyRoots;
+        for(const QString &root : roots)
+            if(!NeroTuning::FindPrefixProcesses(root).isEmpty())
+                busyRoots << QString(root + '/').toLocal8Bit();
+        if(!busyRoots.isEmpty()) {
+            printf("Deduplication skipping %d prefix(es) that are running.\n", (int)busyRoots.count());
+            for(FileEntry &file : candidates)
+                for(const QByteArray &root : busyRoots)
+                    if(file.path.startsWith(root))
+                        file.busy = true;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const FileEntry &a, const FileEntry &b) {
+            if(a.dev != b.dev) return a.dev < b.dev;
+            if(a.size != b.size) return a.size < b.size;
+            if(a.hash != b.hash) return a.hash < b.hash;
+            // files finished in an earlier run go first, so they're used as the source
+            return a.done > b.done;
+        });
+        std::vector<std::pair<size_t, size_t>> groups;
+        for(size_t i = 0; i < candidates.size();) {
+            size_t end = i + 1;
+            while(end < candidates.size() && candidates[end].dev == candidates[i].dev &&
+                  candidates[end].size == candidates[i].size && candidates[end].hash == candidates[i].hash)
+                ++end;
+            if(candidates[i].hashed && end - i > 1)
+                groups.push_back({ i, end });
+            i = end;
+        }
+        shared.groups = groups.size();
+
+        // finished files are appended as they go, so an interrupted run picks up where it left off
+        FILE *stateFile = fopen(QFile::encodeName(statePath).constData(), "a");
+        std::mutex stateLock;
+        QSet<dev_t> unsupported;
+        RunPool(groups.size(), shared, [&](const size_t g) {
+            FileEntry &source = candidates[groups[g].first];
+            for(size_t i = groups[g].first + 1; i < groups[g].second && !shared.cancel; ++i) {
+                FileEntry &target = candidates[i];
+                if(target.done || target.busy)
+                    continue;
+                {
+                    std::lock_guard<std::mutex> lock(stateLock);
+                    if(unsupported.contains(target.dev))
+                        break;
+                }
+
+                qint64 bytes = 0;
+                switch(Dedupe(source, target, bytes)) {
+                case DedupeOk: {
+                    shared.filesDeduped++;
+                    shared.bytesDeduped += bytes;
+                    struct stat st;
+                    // the fallback path swaps the file out, so refresh what's remembered about it
+                    if(stat(target.path.constData(), &st) == 0)
+                        target.ino = st.st_ino;
+                    source.done = target.done = true;
+                    std::lock_guard<std::mutex> lock(stateLock);
+                    if(stateFile) {
+                        const QByteArray lines = StateLine(source) + StateLine(target);
+                        fwrite(lines.constData(), 1, lines.size(), stateFile);
+                        fflush(stateFile);
+                    }
+                    break;
+                }
+                case DedupeUnsupported: {
+                    std::lock_guard<std::mutex> lock(stateLock);
+                    unsupported.insert(target.dev);
+                    break;
+                }
+                case DedupeDiffers:
+                    // same sampled hash but different contents, nothing to do
+                    break;
+                default:
+                    shared.errors++;
+                    break;
+                }
+            }
+            shared.groupsDone++;
+        });
+        if(stateFile)
+            fclose(stateFile);
+
+        if(!unsupported.isEmpty())
+            printf("Deduplication skipped %d filesystem(s) that don't support reflinks.\n", (int)unsupported.count());
+
+        // 4. compact the state down to what exists now (drops superseded lines & deleted prefixes)
+        QFile compacted(statePath + ".new");
+        if(compacted.open(QIODevice::WriteOnly)) {
+            for(const FileEntry &file : candidates)
+                if(file.hashed)
+                    compacted.write(StateLine(file));
+            compacted.close();
+            if(!shared.cancel) {
+                QFile::remove(statePath);
+                compacted.rename(statePath);
+            } else compacted.remove();
+        }
+    }
+}
+
+QStringList NeroDedup::GetDedupRoots(const QString &home)
+{
+    QStringList roots;
+    const QDir homeDir(home);
+    for(const QString &prefix : homeDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QString prefixPath = homeDir.path() + '/' + prefix;
+        if(!homeDir.exists(prefix + "/nero-settings.ini"))
+            continue;
+        // a hibernated prefix is just a stub waiting on its archive, and a running one is off limits
+        if(QSettings(prefixPath + "/nero-settings.ini", QSettings::IniFormat).value("PrefixSettings/Hibernated", false).toBool() ||
+           !NeroTuning::FindPrefixProcesses(prefixPath).isEmpty())
+            continue;
+        roots << prefixPath;
+    }
+    // templates are prefixes too, and are what new prefixes are cloned from
+    const QDir templates(home + "/.templates");
+    for(const QString &templateDir : templates.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        if(!templateDir.endsWith(".tmp"))
+            roots << templates.path() + '/' + templateDir;
+    return roots;
+}
+
+bool NeroDedup::Run(const QStringList &prefixRoots, const QString &statePath, Stats &stats, const ProgressFunc &progress)
+{
+    Shared shared;
+    std::thread job([&]() {
+        DedupJob(prefixRoots, statePath, shared);
+        shared.finished = true;
+    });
+
+    auto update = [&]() {
+        stats.phase = shared.finished ? (int)PhaseDone : shared.phase.load();
+        stats.filesScanned = shared.filesScanned;
+        stats.candidates = shared.candidates;
+        stats.hashed = shared.hashed;
+        stats.toHash = shared.toHash;
+        stats.groupsDone = shared.groupsDone;
+        stats.groups = shared.groups;
+        stats.filesDeduped = shared.filesDeduped;
+        stats.bytesDeduped = shared.bytesDeduped;
+        stats.errors = shared.errors;
+    };
+    while(!shared.finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        update();
+        if(progress && !shared.cancel && !progress(stats))
+            shared.cancel = true;
+    }
+    job.join();
+    update();
+    if(progress) progress(stats);
+
+    return !shared.cancel;
+}
@@ -0,0 +1,61 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Cross-prefix file deduplication (via reflinks).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NERODEDUP_H
+#define NERODEDUP_H
+
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+class NeroDedup
+{
+public:
+    enum {
+        PhaseScanning = 0,
+        PhaseHashing,
+        PhaseDeduplicating,
+        PhaseDone
+    } Phases_e;
+
+    struct Stats {
+        int phase = PhaseScanning;
+        qint64 filesScanned = 0;
+        qint64 candidates = 0;
+        qint64 hashed = 0;
+        qint64 toHash = 0;
+        qint64 groupsDone = 0;
+        qint64 groups = 0;
+        qint64 filesDeduped = 0;
+        qint64 bytesDeduped = 0;
+        qint64 errors = 0;
+    };
+
+    // Called from the calling thread every so often; return false to stop (progress is kept for next time).
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+
+    // Every prefix & template under the Nero home, which is what --dedup and the preferences button go over.
+    static QStringList GetDedupRoots(const QString &home);
+    // statePath is where hashes & finished files are remembered between (possibly interrupted) runs.
+    static bool Run(const QStringList &prefixRoots, const QString &statePath, Stats &stats,
+                    const ProgressFunc &progress = nullptr);
+};
+
+#endif // NERODEDUP_H
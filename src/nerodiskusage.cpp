@@ -0,0 +1,394 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Prefix disk usage accounting, cached between runs.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerodiskusage.h"
+#include "nerotuning.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <QSaveFile>
+#include <QSet>
+#include <QThread>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+namespace {
+    // bump whenever DirCache changes shape, so old caches just get ignored
+    const quint32 cacheMagic = 0x4e524455; // "NRDU"
+    const quint32 cacheVersion = 1;
+
+    // checking extents on every tiny file isn't worth it; they're at most a block or two either way
+    const off_t minSharedCheckSize = 64*1024;
+
+    struct DirCache {
+        qint64 mtime = 0;
+        // the dir itself, plus every non-dir child that isn't hardlinked elsewhere
+        qint64 bytes = 0;
+        qint64 shared = 0;
+        qint64 files = 0;
+        bool sharedChecked = false;
+        QList<QByteArray> subdirs;
+        // hardlinked children as (dev, ino, bytes, shared), so they're only counted once per prefix
+        QList<qint64> links;
+    };
+
+    QDataStream &operator<<(QDataStream &out, const DirCache &entry)
+    {
+        return out << entry.mtime << entry.bytes << entry.shared << entry.files << entry.sharedChecked
+                   << entry.subdirs << entry.links;
+    }
+
+    QDataStream &operator>>(QDataStream &in, DirCache &entry)
+    {
+        return in >> entry.mtime >> entry.bytes >> entry.shared >> entry.files >> entry.sharedChecked
+                  >> entry.subdirs >> entry.links;
+    }
+
+    typedef QHash<QByteArray, DirCache> CacheMap;
+
+    void LoadCache(const QString &cachePath, CacheMap &cache)
+    {
+        QFile file(cachePath);
+        if(!file.open(QIODevice::ReadOnly))
+            return;
+        QDataStream in(&file);
+        quint32 magic = 0, version = 0;
+        in >> magic >> version;
+        if(magic != cacheMagic || version != cacheVersion)
+            return;
+        in >> cache;
+        if(in.status() != QDataStream::Ok)
+            cache.clear();
+    }
+
+    void SaveCache(const QString &cachePath, const CacheMap &cache)
+    {
+        QSaveFile file(cachePath);
+        if(!file.open(QIODevice::WriteOnly))
+            return;
+        QDataStream out(&file);
+        out << cacheMagic << cacheVersion << cache;
+        file.commit();
+    }
+
+    qint64 SharedBytes(const int dirFd, const char *name, const qint64 allocated)
+    {
+        const int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+        if(fd < 0)
+            return 0;
+
+        struct {
+            struct fiemap map;
+            struct fiemap_extent extents[32];
+        } buf;
+        qint64 shared = 0;
+        __u64 start = 0;
+        bool last = false;
+        while(!last) {
+            memset(&buf, 0, sizeof(buf));
+            buf.map.fm_start = start;
+            buf.map.fm_length = FIEMAP_MAX_OFFSET - start;
+            buf.map.fm_extent_count = 32;
+            if(ioctl(fd, FS_IOC_FIEMAP, &buf.map) != 0 || buf.map.fm_mapped_extents == 0)
+                break;
+            const __u64 previousStart = start;
+            for(__u32 i = 0; i < buf.map.fm_mapped_extents; ++i) {
+                const struct fiemap_extent &extent = buf.extents[i];
+                if(extent.fe_flags & FIEMAP_EXTENT_SHARED)
+                    shared += extent.fe_length;
+                if(extent.fe_flags & FIEMAP_EXTENT_LAST)
+                    last = true;
+                start = extent.fe_logical + extent.fe_length;
+            }
+            if(start <= previousStart)
+                break;
+        }
+        close(fd);
+        // extents can run past EOF/allocated blocks a little, so don't claim more than the file actually has
+        return qMin(shared, allocated);
+    }
+
+    class Walker
+    {
+    public:
+        Walker(const CacheMap &old, const bool shared, const std::atomic<bool> &stop)
+            : oldCache(old), checkShared(shared), cancel(stop) {}
+
+        CacheMap newCache;
+        qint64 shared = 0;
+        qint64 files = 0;
+
+        // returns the allocated bytes under path (path being a directory that was just lstat'd into st)
+        qint64 Walk(const QByteArray &path, const struct stat &st, const bool useCache)
+        {
+            if(cancel)
+                return 0;
+
+            const qint64 mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            DirCache entry;
+            const auto cached = oldCache.constFind(path);
+            if(useCache && cached != oldCache.constEnd() && cached->mtime == mtime &&
+               (cached->sharedChecked || !checkShared))
+                entry = *cached;
+            else if(!ReadDir(path, st, mtime, entry))
+                return st.st_blocks * 512;
+
+            qint64 total = entry.bytes;
+            shared += entry.shared;
+            files += entry.files;
+            for(int i = 0; i+3 < entry.links.count(); i += 4) {
+                const QPair<qint64, qint64> inode(entry.links.at(i), entry.links.at(i+1));
+                if(!seenInodes.contains(inode)) {
+                    seenInodes.insert(inode);
+                    total += entry.links.at(i+2);
+                    shared += entry.links.at(i+3);
+                    files++;
+                }
+            }
+
+            for(const QByteArray &subdir : std::as_const(entry.subdirs)) {
+                const QByteArray child = path + '/' + subdir;
+                struct stat childStat;
+                // stale cache entries would've changed the parent's mtime, but be careful anyways
+                if(lstat(child.constData(), &childStat) == 0 && S_ISDIR(childStat.st_mode) && childStat.st_dev == st.st_dev)
+                    total += Walk(child, childStat, useCache);
+            }
+
+            newCache.insert(path, entry);
+            return total;
+        }
+
+    private:
+        const CacheMap &oldCache;
+        const bool checkShared;
+        const std::atomic<bool> &cancel;
+        QSet<QPair<qint64, qint64>> seenInodes;
+
+        bool ReadDir(const QByteArray &path, const struct stat &st, const qint64 mtime, DirCache &entry)
+        {
+            DIR *dir = opendir(path.constData());
+            if(!dir)
+                return false;
+
+            entry.mtime = mtime;
+            entry.bytes = st.st_blocks * 512;
+            entry.sharedChecked = checkShared;
+            while(struct dirent *dirEntry = readdir(dir)) {
+                const char *name = dirEntry->d_name;
+                if(!strcmp(name, ".") || !strcmp(name, ".."))
+                    continue;
+
+                struct stat childStat;
+                if(fstatat(dirfd(dir), name, &childStat, AT_SYMLINK_NOFOLLOW) != 0)
+                    continue;
+
+                if(S_ISDIR(childStat.st_mode)) {
+                    // don't wander into other mounts
+                    if(childStat.st_dev == st.st_dev)
+                        entry.subdirs << QByteArray(name);
+                    continue;
+                }
+
+                const qint64 bytes = childStat.st_blocks * 512;
+                const qint64 sharedBytes = (checkShared && S_ISREG(childStat.st_mode) && childStat.st_size >= minSharedCheckSize)
+                        ? SharedBytes(dirfd(dir), name, bytes) : 0;
+                if(childStat.st_nlink > 1) {
+                    entry.links << (qint64)childStat.st_dev << (qint64)childStat.st_ino << bytes << sharedBytes;
+                } else {
+                    entry.bytes += bytes;
+                    entry.shared += sharedBytes;
+                    entry.files++;
+                }
+            }
+            closedir(dir);
+            return true;
+        }
+    };
+
+    NeroDiskUsage::Usage MeasurePrefix(const QString &prefixPath, Walker &walker, const bool useCache)
+    {
+        NeroDiskUsage::Usage usage;
+        const QByteArray rootPath = prefixPath.toLocal8Bit();
+        struct stat rootStat;
+        if(lstat(rootPath.constData(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode))
+            return usage;
+        DIR *dir = opendir(rootPath.constData());
+        if(!dir)
+            return usage;
+
+        usage.other += rootStat.st_blocks * 512;
+        while(struct dirent *dirEntry = readdir(dir)) {
+            const QByteArray name(dirEntry->d_name);
+            if(name == "." || name == "..")
+                continue;
+
+            struct stat childStat;
+            if(fstatat(dirfd(dir), name.constData(), &childStat, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+
+            qint64 *category = &usage.other;
+            if(name == "drive_c")           category = &usage.driveC;
+            else if(name == ".shaderCache") category = &usage.shaderCache;
+            else if(name == ".logs")        category = &usage.logs;
+            else if(name == ".icoCache")    category = &usage.icoCache;
+
+            if(S_ISDIR(childStat.st_mode)) {
+                if(childStat.st_dev != rootStat.st_dev)
+                    continue;
+                // logs & shader caches are appended to in place, which doesn't touch any directory mtimes
+                const bool growsInPlace = (name == ".logs" || name == ".shaderCache");
+                *category += walker.Walk(rootPath + '/' + name, childStat, useCache && !growsInPlace);
+            } else {
+                *category += childStat.st_blocks * 512;
+                walker.files++;
+            }
+        }
+        closedir(dir);
+
+        usage.shared = walker.shared;
+        usage.files = walker.files;
+        return usage;
+    }
+}
+
+QMap<QString, NeroDiskUsage::Usage> NeroDiskUsage::Measure(const QStringList &prefixPaths, const QString &cachePath,
+                                                           const bool checkShared, const bool fullRescan,
+                                                           const ResultFunc &onResult)
+{
+    CacheMap oldCache;
+    if(!cachePath.isEmpty())
+        LoadCache(cachePath, oldCache);
+
+    std::vector<Usage> results(prefixPaths.count());
+    std::vector<CacheMap> newCaches(prefixPaths.count());
+    std::vector<char> finished(prefixPaths.count(), 0);
+
+    std::atomic<int> next(0);
+    std::atomic<bool> cancel(false);
+    std::mutex resultMutex;
+    // one prefix per worker; most of the time here is spent waiting on metadata reads anyways
+    auto worker = [&]() {
+        NeroTuning::SetIoPriority(0, NeroTuning::IoClassIdle, 0);
+        for(int i = next++; i < prefixPaths.count() && !cancel; i = next++) {
+            Walker walker(oldCache, checkShared, cancel);
+            const Usage usage = MeasurePrefix(prefixPaths.at(i), walker, !fullRescan);
+            if(cancel)
+                break;
+            results[i] = usage;
+            newCaches[i] = std::move(walker.newCache);
+            finished[i] = 1;
+            if(onResult) {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if(!onResult(prefixPaths.at(i), usage))
+                    cancel = true;
+            }
+        }
+    };
+
+    const int threadCount = qBound(2, QThread::idealThreadCount(), 8);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threadCount && t < prefixPaths.count(); ++t)
+        workers.emplace_back(worker);
+    for(auto &thread : workers)
+        thread.join();
+
+    QMap<QString, Usage> usages;
+    CacheMap mergedCache;
+    for(int i = 0; i < prefixPaths.count(); ++i) {
+        if(!finished[i])
+            continue;
+        usages.insert(prefixPaths.at(i), results[i]);
+        for(auto entry = newCaches[i].constBegin(); entry != newCaches[i].constEnd(); ++entry)
+            mergedCache.insert(entry.key(), entry.value());
+    }
+
+    if(!cachePath.isEmpty()) {
+        // Keep whatever was cached for prefixes that weren't part of this run, as long as they're still around;
+        // deleted & renamed ones would otherwise be carried along forever. Entries are keyed by full path, so the
+        // prefix each one belongs to is the first component under the prefixes dir (which is where the cache lives).
+        QSet<QByteArray> bases { QFileInfo(cachePath).path().toLocal8Bit() };
+        QSet<QByteArray> measured;
+        for(const QString &prefixPath : prefixPaths) {
+            bases.insert(QFileInfo(prefixPath).path().toLocal8Bit());
+            measured.insert(prefixPath.toLocal8Bit());
+        }
+        QHash<QByteArray, bool> rootExists;
+        for(auto entry = oldCache.constBegin(); entry != oldCache.constEnd(); ++entry) {
+            QByteArray root;
+            for(const QByteArray &base : bases)
+                if(entry.key().startsWith(base + '/')) {
+                    const int end = entry.key().indexOf('/', base.size() + 1);
+                    root = end < 0 ? entry.key() : entry.key().left(end);
+                    break;
+                }
+            if(root.isEmpty() || measured.contains(root))
+                continue;
+            auto exists = rootExists.find(root);
+            if(exists == rootExists.end())
+                exists = rootExists.insert(root, QFileInfo::exists(QString::fromLocal8Bit(root)));
+            if(*exists)
+                mergedCache.insert(entry.key(), entry.value());
+        }
+        SaveCache(cachePath, mergedCache);
+    }
+
+    return usages;
+}
+
+QString NeroDiskUsage::Describe(const Usage &usage)
+{
+    QString description = QString("Apps & Windows (drive_c): %1\n"
+                                  "Shader Cache: %2\n"
+                                  "Logs: %3\n"
+                                  "Icons: %4\n"
+                                  "Other (registry, etc.): %5")
+                                  .arg(FormatSize(usage.driveC), FormatSize(usage.shaderCache), FormatSize(usage.logs),
+                                       FormatSize(usage.icoCache), FormatSize(usage.other));
+    if(usage.shared)
+        description.append(QString("\n\n%1 of this is shared with other prefixes/files (reflinked)").arg(FormatSize(usage.shared)));
+    return description;
+}
+
+QString NeroDiskUsage::FormatSize(const qint64 bytes)
+{
+    const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double size = bytes;
+    int unit = 0;
+    while(size >= 1024 && unit < 4) {
+        size /= 1024;
+        unit++;
+    }
+    return QString("%1 %2").arg(QString::number(size, 'f', unit ? 1 : 0), units[unit]);
+}
@@ -0,0 +1,60 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Prefix disk usage accounting, cached between runs.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NERODISKUSAGE_H
+#define NERODISKUSAGE_H
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+class NeroDiskUsage
+{
+public:
+    // All in bytes actually allocated on disk (st_blocks), so sparse files count for what they really use.
+    struct Usage {
+        qint64 driveC = 0;
+        qint64 shaderCache = 0;
+        qint64 logs = 0;
+        qint64 icoCache = 0;
+        // registry files, dosdevices, etc.
+        qint64 other = 0;
+        // portion of the above whose extents are shared with other files (reflinks/dedup); only filled in with checkShared
+        qint64 shared = 0;
+        qint64 files = 0;
+
+        qint64 Total() const { return driveC + shaderCache + logs + icoCache + other; }
+    };
+
+    // Called from the worker threads as each prefix finishes; return false to stop early.
+    typedef std::function<bool(const QString &prefixPath, const Usage &)> ResultFunc;
+
+    // Directories whose mtime hasn't changed since the last run (as recorded in cachePath) aren't re-read,
+    // except for .logs & .shaderCache, whose files grow in place. fullRescan ignores the cache entirely.
+    static QMap<QString, Usage> Measure(const QStringList &prefixPaths, const QString &cachePath,
+                                        const bool checkShared = false, const bool fullRescan = false,
+                                        const ResultFunc &onResult = nullptr);
+
+    static QString Describe(const Usage &usage);
+    static QString FormatSize(const qint64 bytes);
+};
+
+#endif // NERODISKUSAGE_H
@@ -19,7 +19,11 @@
 
 #include "nerofs.h"
 #include "neroconstants.h"
+#include "neroregistry.h"
+#include "nerotuning.h"
 
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QStandardPaths>
@@ -170,18 +174,6 @@ QStringList* NeroFS::GetAvailableProtons()
     return &availableProtons;
 }
 
-QString NeroFS::GetIcoextract()
-{
-    return QStandardPaths::findExecutable("icoextract");
-}
-
-
-QString NeroFS::GetIcoutils()
-{
-    return QStandardPaths::findExecutable("icotool");
-}
-
-
 QString NeroFS::GetUmU()
 {
     // if empty, assume first time checking so that UMU is tested
@@ -322,46 +314,58 @@ QMap<QString, QVariant> NeroFS::GetCurrentPrefixSettings()
     return settingsMap;
 }
 
-void NeroFS::AddNewPrefix(const QString &newPrefix, const QString &runner)
+void NeroFS::AddNewPrefix(const QString &newPrefix)
 {
-    prefixes.append(newPrefix);
-    SetCurrentPrefix(newPrefix);
-    GetCurrentPrefixCfg();
-    prefixCfg->beginGroup("PrefixSettings");
-    prefixCfg->setValue("Name", newPrefix);
-    prefixCfg->setValue("CurrentRunner", runner);
-    prefixCfg->setValue("WindowsVersion", NeroConstant::WinVer10);
-    prefixCfg->setValue("Gamemode", false);
-    prefixCfg->setValue("VKcapture", false);
-    prefixCfg->setValue("Mangohud", false);
-    prefixCfg->setValue("EnableNVAPI", false);
-    prefixCfg->setValue("ScalingMode", NeroConstant::ScalingNormal);
-    prefixCfg->setValue("FSRcustomResW", "");
-    prefixCfg->setValue("FSRcustomResH", "");
-    prefixCfg->setValue("GamescopeOutResW", "");
-    prefixCfg->setValue("GamescopeOutResH", "");
-    prefixCfg->setValue("GamescopeWinResW", "");
-    prefixCfg->setValue("GamescopeWinResH", "");
-    prefixCfg->setValue("GamescopeScaler", NeroConstant::GSscalerAuto);
-    prefixCfg->setValue("GamescopeFilter", NeroConstant::GSfilterLinear);
-    //prefixCfg->setValue("GamescopeFilterStrength", 0);
-    prefixCfg->setValue("DLLoverrides", {""});
-    prefixCfg->setValue("ForceiGPU", false);
-    prefixCfg->setValue("LimitGLextensions", false);
-    prefixCfg->setValue("DebugOutput", NeroConstant::DebugDisabled);
-    prefixCfg->setValue("FileSyncMode", NeroConstant::NTsync);
-    prefixCfg->setValue("NoD8VK", false);
-    prefixCfg->setValue("ForceWineD3D", false);
-    prefixCfg->setValue("UseWayland", false);
-    prefixCfg->setValue("UseHDR", false);
-    prefixCfg->setValue("AllowHidraw", false);
-    prefixCfg->setValue("UseXalia", false);
-    prefixCfg->setValue("CustomEnvVars", {""});
-    prefixCfg->setValue("RuntimeUpdateOnLaunch", true);
-    prefixCfg->setValue("DiscordRPCinstalled", false);
-    prefixCfg->endGroup();
-    // since we aren't actually selecting this prefix, just clear the value.
-    currentPrefix.clear();
+    if(!prefixes.contains(newPrefix))
+        prefixes.append(newPrefix);
+}
+
+// Writes out default settings for a freshly made prefix. Uses its own QSettings rather than prefixCfg,
+// so that this is safe to call from prefix creation jobs running off the main thread.
+void NeroFS::InitPrefixSettings(const QString &prefix, const QString &runner)
+{
+    QSettings cfg(prefixesPath.path() + '/' + prefix + "/nero-settings.ini", QSettings::IniFormat);
+    cfg.beginGroup("PrefixSettings");
+    cfg.setValue("Name", prefix);
+    cfg.setValue("CurrentRunner", runner);
+    cfg.setValue("WindowsVersion", NeroConstant::WinVer10);
+    cfg.setValue("Gamemode", false);
+    cfg.setValue("VKcapture", false);
+    cfg.setValue("Mangohud", false);
+    cfg.setValue("EnableNVAPI", false);
+    cfg.setValue("ScalingMode", NeroConstant::ScalingNormal);
+    cfg.setValue("FSRcustomResW", "");
+    cfg.setValue("FSRcustomResH", "");
+    cfg.setValue("GamescopeOutResW", "");
+    cfg.setValue("GamescopeOutResH", "");
+    cfg.setValue("GamescopeWinResW", "");
+    cfg.setValue("GamescopeWinResH", "");
+    cfg.setValue("GamescopeScaler", NeroConstant::GSscalerAuto);
+    cfg.setValue("GamescopeFilter", NeroConstant::GSfilterLinear);
+    //cfg.setValue("GamescopeFilterStrength", 0);
+    cfg.setValue("DLLoverrides", {""});
+    cfg.setValue("ForceiGPU", false);
+    cfg.setValue("GpuDevice", "auto");
+    cfg.setValue("LimitGLextensions", false);
+    cfg.setValue("DebugOutput", NeroConstant::DebugDisabled);
+    cfg.setValue("FileSyncMode", NeroConstant::NTsync);
+    cfg.setValue("NiceLevel", NeroConstant::NiceDefault);
+    cfg.setValue("CpuSchedPolicy", NeroConstant::SchedDefault);
+    cfg.setValue("IoPriority", NeroConstant::IoPrioDefault);
+    cfg.setValue("OomScoreAdj", NeroConstant::OomDefault);
+    cfg.setValue("WineserverPriority", NeroConstant::WineserverPrioDefault);
+    cfg.setValue("WineserverAffinity", NeroConstant::WineserverAffinityDefault);
+    cfg.setValue("NoD8VK", false);
+    cfg.setValue("ForceWineD3D", false);
+    cfg.setValue("UseWayland", false);
+    cfg.setValue("UseHDR", false);
+    cfg.setValue("AllowHidraw", false);
+    cfg.setValue("UseXalia", false);
+    cfg.setValue("CustomEnvVars", {""});
+    cfg.setValue("RuntimeUpdateOnLaunch", true);
+    cfg.setValue("DiscordRPCinstalled", false);
+    cfg.endGroup();
+    cfg.sync();
 }
 
 void NeroFS::AddNewShortcut(const QString &newShortcutHash, const QString &newShortcutName, const QString &newAppPath) {
@@ -438,10 +442,382 @@ QMap<QString, QString> NeroFS::GetCurrentShortcutsMap()
 
 bool NeroFS::DeletePrefix(const QString &prefix)
 {
+    const QString prefixPath = prefixesPath.path() + '/' + prefix;
+    if(prefix.isEmpty() || prefix.contains('/') || prefix.startsWith('.') || !QFileInfo::exists(prefixPath))
+        return false;
+
+    // pulling a prefix out from under a running app goes nowhere good
+    if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty()) {
+        printf("Prefix %s still has running processes, not deleting!\n", prefix.toLocal8Bit().constData());
+        return false;
+    }
+
+    // a rename is instant (and atomic) no matter how big the prefix is, so it's gone from the list right away;
+    // the actual removal happens afterwards in EmptyTrash.
+    QDir().mkpath(prefixesPath.path() + "/.trash");
+    const QString trashPath = QString("%1/.trash/%2.%3").arg(prefixesPath.path(), prefix).arg(QDateTime::currentMSecsSinceEpoch());
+    if(rename(prefixPath.toLocal8Bit().constData(), trashPath.toLocal8Bit().constData()) != 0)
+        return false;
+
+    // its snapshots go along with it
+    if(QFileInfo::exists(GetSnapshotsPath(prefix)))
+        rename(GetSnapshotsPath(prefix).toLocal8Bit().constData(), QString(trashPath + ".snapshots").toLocal8Bit().constData());
+    // ...as does its hibernated image, if any
+    if(QFileInfo::exists(GetHibernatedPath(prefix)))
+        rename(GetHibernatedPath(prefix).toLocal8Bit().constData(), QString(trashPath + ".nero.zip").toLocal8Bit().constData());
+
     prefixes.removeOne(prefix);
-    if(QDir(prefixesPath.path() + '/' + prefix).removeRecursively())
+    return true;
+}
+
+bool NeroFS::IsPrefixHibernated(const QString &prefix)
+{
+    QSettings cfg(prefixesPath.path() + '/' + prefix + "/nero-settings.ini", QSettings::IniFormat);
+    return cfg.value("PrefixSettings/Hibernated", false).toBool() && QFileInfo::exists(GetHibernatedPath(prefix));
+}
+
+bool NeroFS::HibernatePrefix(const QString &prefix, NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress)
+{
+    const QString prefixPath = prefixesPath.path() + '/' + prefix;
+    if(prefix.isEmpty() || prefix.contains('/') || prefix.startsWith('.') ||
+       !QFileInfo::exists(prefixPath + "/nero-settings.ini") || IsPrefixHibernated(prefix))
+        return false;
+    if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty()) {
+        printf("Prefix %s still has running processes, not hibernating!\n", prefix.toLocal8Bit().constData());
+        return false;
+    }
+
+    // cold storage, so spend a bit more time on compression than a regular export would
+    QDir().mkpath(prefixesPath.path() + "/.hibernated");
+    const QString archivePath = GetHibernatedPath(prefix);
+    if(!NeroBundle::Export(prefixPath, archivePath + ".tmp", "", 6, stats, progress) ||
+       rename(QString(archivePath + ".tmp").toLocal8Bit().constData(), archivePath.toLocal8Bit().constData()) != 0)
+        return false;
+
+    // flagged before anything's moved out, so a crash partway through still leaves a stub that can be woken up
+    QSettings cfg(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+    cfg.setValue("PrefixSettings/Hibernated", true);
+    cfg.sync();
+    if(cfg.status() != QSettings::NoError) {
+        QFile::remove(archivePath);
+        return false;
+    }
+
+    // everything but the settings & icons goes, so it still shows up (with its shortcuts) in the list
+    QDir().mkpath(prefixesPath.path() + "/.trash");
+    const QString trashPath = QString("%1/.trash/%2.%3").arg(prefixesPath.path(), prefix).arg(QDateTime::currentMSecsSinceEpoch());
+    QDir().mkpath(trashPath);
+    QStringList moved;
+    for(const QString &entry : QDir(prefixPath).entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot)) {
+        if(entry == "nero-settings.ini" || entry == ".icoCache")
+            continue;
+        if(rename(QString(prefixPath + '/' + entry).toLocal8Bit().constData(), QString(trashPath + '/' + entry).toLocal8Bit().constData()) != 0) {
+            printf("Couldn't move %s out of %s, putting the prefix back...\n", entry.toLocal8Bit().constData(), prefix.toLocal8Bit().constData());
+            for(const QString &back : moved)
+                rename(QString(trashPath + '/' + back).toLocal8Bit().constData(), QString(prefixPath + '/' + back).toLocal8Bit().constData());
+            QDir().rmdir(trashPath);
+            cfg.remove("PrefixSettings/Hibernated");
+            cfg.sync();
+            QFile::remove(archivePath);
+            return false;
+        }
+        moved << entry;
+    }
+
+    if(prefix == currentPrefix)
+        SetCurrentPrefix(prefix);
+
+    NeroCopy::Stats removeStats;
+    NeroCopy::RemoveTree(trashPath, removeStats);
+    return true;
+}
+
+bool NeroFS::WakePrefix(const QString &prefix, NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress)
+{
+    if(!IsPrefixHibernated(prefix))
         return true;
-    else return false;
+
+    const QString prefixPath = prefixesPath.path() + '/' + prefix;
+    const QString wakePath = prefixesPath.path() + "/.wake-" + prefix + ".tmp";
+    // left over from an interrupted wake-up
+    NeroCopy::Stats removeStats;
+    NeroCopy::RemoveTree(wakePath, removeStats);
+    if(!NeroBundle::Extract(GetHibernatedPath(prefix), wakePath, nullptr, stats, progress))
+        return false;
+
+    // The stub's settings & icons win, since shortcuts can still be edited (or added by --apply) while hibernated.
+    // They're copied rather than moved, so the stub stays whole until the very last rename if anything goes wrong.
+    QFile::remove(wakePath + "/nero-settings.ini");
+    bool carried = QFile::copy(prefixPath + "/nero-settings.ini", wakePath + "/nero-settings.ini");
+    const QDir stubIcons(prefixPath + "/.icoCache");
+    if(carried && stubIcons.exists()) {
+        QDir().mkpath(wakePath + "/.icoCache");
+        for(const QString &icon : stubIcons.entryList(QDir::Files | QDir::Hidden)) {
+            QFile::remove(wakePath + "/.icoCache/" + icon);
+            carried = carried && QFile::copy(stubIcons.filePath(icon), wakePath + "/.icoCache/" + icon);
+        }
+    }
+    if(carried) {
+        QSettings cfg(wakePath + "/nero-settings.ini", QSettings::IniFormat);
+        cfg.remove("PrefixSettings/Hibernated");
+        cfg.sync();
+        carried = cfg.status() == QSettings::NoError;
+    }
+    if(!carried) {
+        NeroCopy::RemoveTree(wakePath, removeStats);
+        return false;
+    }
+
+    QDir().mkpath(prefixesPath.path() + "/.trash");
+    const QString trashPath = QString("%1/.trash/%2.%3").arg(prefixesPath.path(), prefix).arg(QDateTime::currentMSecsSinceEpoch());
+    if(rename(prefixPath.toLocal8Bit().constData(), trashPath.toLocal8Bit().constData()) != 0) {
+        NeroCopy::RemoveTree(wakePath, removeStats);
+        return false;
+    }
+    if(rename(wakePath.toLocal8Bit().constData(), prefixPath.toLocal8Bit().constData()) != 0) {
+        // put the stub back where it was, still flagged
+        rename(trashPath.toLocal8Bit().constData(), prefixPath.toLocal8Bit().constData());
+        NeroCopy::RemoveTree(wakePath, removeStats);
+        return false;
+    }
+
+    QFile::remove(GetHibernatedPath(prefix));
+    NeroCopy::RemoveTree(trashPath, removeStats);
+    if(prefix == currentPrefix)
+        SetCurrentPrefix(prefix);
+    return true;
+}
+
+QStringList NeroFS::GetIdlePrefixes(const int days)
+{
+    QStringList idle;
+    if(days <= 0)
+        return idle;
+
+    const QDateTime cutoff = QDateTime::currentDateTime().addDays(-days);
+    for(const QString &prefix : GetPrefixes()) {
+        const QString prefixPath = prefixesPath.path() + '/' + prefix;
+        if(IsPrefixHibernated(prefix) || !NeroTuning::FindPrefixProcesses(prefixPath).isEmpty())
+            continue;
+
+        QSettings cfg(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+        QDateTime lastLaunched = cfg.value("PrefixSettings/LastLaunched").toDateTime();
+        // prefixes from before launches were tracked: wine rewrites system.reg whenever it shuts down, so go by that
+        if(!lastLaunched.isValid())
+            lastLaunched = QFileInfo(prefixPath + "/system.reg").lastModified();
+        if(lastLaunched.isValid() && lastLaunched < cutoff)
+            idle.append(prefix);
+    }
+    return idle;
+}
+
+bool NeroFS::SnapshotPrefix(const QString &prefix, const QString &reason,
+                            NeroSnapshot::Stats &stats, const NeroSnapshot::ProgressFunc &progress)
+{
+    // there's nothing but a stub to snapshot
+    if(IsPrefixHibernated(prefix))
+        return false;
+    if(!NeroSnapshot::Create(prefixesPath.path() + '/' + prefix, GetSnapshotsPath(prefix), reason, stats, progress))
+        return false;
+    NeroSnapshot::Prune(GetSnapshotsPath(prefix), managerCfg.value("SnapshotsToKeep", 5).toInt());
+    return true;
+}
+
+bool NeroFS::SnapshotPrefixRegistry(const QString &prefix, const QString &label, QString *id)
+{
+    if(IsPrefixHibernated(prefix))
+        return false;
+
+    NeroRegistry::Snapshot snapshot;
+    if(!NeroRegistry::TakeSnapshot(prefixesPath.path() + '/' + prefix, label, snapshot)
+        || !NeroRegistry::SaveSnapshot(GetRegistrySnapshotsPath(prefix), snapshot))
+        return false;
+    // they're only a few MB at most, but there's no point keeping every last one
+    NeroRegistry::PruneSnapshots(GetRegistrySnapshotsPath(prefix), 20);
+    if(id) *id = snapshot.id;
+    return true;
+}
+
+bool NeroFS::RestorePrefixSnapshot(const QString &prefix, const QString &id,
+                                   NeroSnapshot::Stats &stats, const NeroSnapshot::ProgressFunc &progress)
+{
+    const QString prefixPath = prefixesPath.path() + '/' + prefix;
+    if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty()) {
+        printf("Prefix %s still has running processes, not restoring!\n", prefix.toLocal8Bit().constData());
+        return false;
+    }
+
+    const bool restored = NeroSnapshot::Restore(prefixPath, GetSnapshotsPath(prefix), id, stats, progress);
+    // nero-settings.ini comes back too, so the runner may well be different now
+    if(prefix == currentPrefix)
+        SetCurrentPrefix(prefix);
+    return restored;
+}
+
+bool NeroFS::EmptyTrash(NeroCopy::Stats &stats, const NeroCopy::ProgressFunc &progress)
+{
+    // also picks up whatever was left over from an earlier, canceled deletion
+    return NeroCopy::RemoveTree(prefixesPath.path() + "/.trash", stats, progress);
+}
+
+bool NeroFS::ClonePrefix(const QString &prefix, const QString &newPrefix, const bool skipCaches,
+                         NeroCopy::Stats &stats, const NeroCopy::ProgressFunc &progress)
+{
+    const QString srcPath = prefixesPath.path() + '/' + prefix;
+    const QString dstPath = prefixesPath.path() + '/' + newPrefix;
+    if(newPrefix.isEmpty() || newPrefix.contains('/') || newPrefix.startsWith('.') ||
+       !QFileInfo::exists(srcPath + "/nero-settings.ini") || QFileInfo::exists(dstPath))
+        return false;
+
+    // logs & caches get remade on the next launch, so there's not much point in keeping them around twice
+    QStringList skip;
+    if(skipCaches) skip << ".logs" << ".shaderCache";
+
+    if(!NeroCopy::CloneTree(srcPath, dstPath, stats, skip, progress)) {
+        QDir(dstPath).removeRecursively();
+        return false;
+    }
+
+    // shortcuts & icons come along as-is, only the name needs changing.
+    QSettings newCfg(dstPath + "/nero-settings.ini", QSettings::IniFormat);
+    newCfg.setValue("PrefixSettings/Name", newPrefix);
+    newCfg.sync();
+
+    // let GetPrefixes() pick it up (in sorted order) next time around
+    prefixes.clear();
+    return newCfg.status() == QSettings::NoError;
+}
+
+bool NeroFS::ExportPrefix(const QString &prefix, const QString &outPath, const QString &shortcutHash, const int level,
+                          NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress)
+{
+    if(prefix.isEmpty() || prefix.contains('/') || prefix.startsWith('.'))
+        return false;
+    return NeroBundle::Export(prefixesPath.path() + '/' + prefix, outPath, shortcutHash, level, stats, progress);
+}
+
+bool NeroFS::ImportPrefix(const QString &archivePath, const QString &newName, QString &importedName,
+                          NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress)
+{
+    if(!NeroBundle::Import(archivePath, prefixesPath.path(), newName, importedName, stats, progress))
+        return false;
+
+    prefixes.clear();
+    return true;
+}
+
+// version file changes whenever the runner's been updated, which makes any template made with it stale.
+static QByteArray GetRunnerStamp(const QString &runner)
+{
+    QFile versionFile(NeroFS::GetProtonsPath()->path() + '/' + runner + "/version");
+    if(versionFile.open(QIODevice::ReadOnly))
+        return versionFile.readAll().trimmed();
+    return QByteArray();
+}
+
+bool NeroFS::PrefixNeedsUpgrade(const QString &prefix)
+{
+    const QString prefixPath = prefixesPath.path() + '/' + prefix;
+    QSettings cfg(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+    const QString runner = cfg.value("PrefixSettings/CurrentRunner").toString();
+    if(runner.isEmpty() || !QFileInfo::exists(protonsPath.path() + '/' + runner) || cfg.value("PrefixSettings/Hibernated", false).toBool())
+        return false;
+
+    const QString upgraded = cfg.value("PrefixSettings/UpgradedRunner").toString();
+    if(upgraded.isEmpty()) {
+        // not tracked yet: Proton leaves a version file in the prefix whenever it upgrades it,
+        // so it's due if that's older than the runner's own
+        const QFileInfo prefixVersion(prefixPath + "/version");
+        const QFileInfo runnerVersion(protonsPath.path() + '/' + runner + "/version");
+        return runnerVersion.exists() && (!prefixVersion.exists() || prefixVersion.lastModified() < runnerVersion.lastModified());
+    }
+    return upgraded != runner + '|' + QString::fromUtf8(GetRunnerStamp(runner));
+}
+
+void NeroFS::SetPrefixUpgraded(const QString &prefix, const QString &runner)
+{
+    QSettings cfg(prefixesPath.path() + '/' + prefix + "/nero-settings.ini", QSettings::IniFormat);
+    cfg.setValue("PrefixSettings/UpgradedRunner", runner + '|' + QString::fromUtf8(GetRunnerStamp(runner)));
+}
+
+QStringList NeroFS::GetPrefixesNeedingUpgrade()
+{
+    QStringList due;
+    for(const QString &prefix : GetPrefixes())
+        if(PrefixNeedsUpgrade(prefix))
+            due.append(prefix);
+    return due;
+}
+
+int NeroFS::GetPrefixTemplateMode()
+{
+    if(!managerCfg.value("UsePrefixTemplates", true).toBool())
+        return TemplatesOff;
+    return managerCfg.value("PrefixTemplatesPerVerbSet", false).toBool() ? TemplatesPerVerbSet : TemplatesPerRunner;
+}
+
+QString NeroFS::GetPrefixTemplatePath(const QString &runner, QStringList verbs)
+{
+    QString path = prefixesPath.path() + "/.templates/" + runner;
+    if(!verbs.isEmpty()) {
+        // order verbs were picked in shouldn't matter
+        verbs.sort();
+        path += "--" + QCryptographicHash::hash(verbs.join(',').toUtf8(), QCryptographicHash::Md5).toHex().left(8);
+    }
+    return path;
+}
+
+bool NeroFS::IsPrefixTemplateCurrent(const QString &templatePath, const QString &runner)
+{
+    QFile stamp(templatePath + "/.nero-template");
+    if(!stamp.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray stampedVersion = stamp.readLine().trimmed();
+    return !stampedVersion.isEmpty() && stampedVersion == GetRunnerStamp(runner);
+}
+
+bool NeroFS::SavePrefixTemplate(const QString &prefixPath, const QString &runner, const QStringList &verbs)
+{
+    const QString templatePath = GetPrefixTemplatePath(runner, verbs);
+    // build next to the real one and swap it in, so a half-made template is never used
+    const QString tempPath = templatePath + ".tmp";
+    QDir(tempPath).removeRecursively();
+    QDir().mkpath(prefixesPath.path() + "/.templates");
+
+    // without reflinks, a template would be a full second copy of the prefix kept around for good
+    if(!NeroCopy::SupportsReflink((prefixPath + "/system.reg").toLocal8Bit(), (prefixesPath.path() + "/.templates").toLocal8Bit())) {
+        printf("Filesystem doesn't support reflinks, not saving a prefix template for %s\n", runner.toLocal8Bit().constData());
+        return false;
+    }
+
+    NeroCopy::Stats stats;
+    if(!NeroCopy::CloneTree(prefixPath, tempPath, stats, { "nero-settings.ini", ".logs", ".shaderCache", ".icoCache" }) ||
+       stats.bytesCopied > 0) {
+        printf("Couldn't save prefix template for %s: %s\n", runner.toLocal8Bit().constData(), NeroCopy::FormatStats(stats).toLocal8Bit().constData());
+        QDir(tempPath).removeRecursively();
+        return false;
+    }
+
+    QFile stamp(tempPath + "/.nero-template");
+    if(!stamp.open(QIODevice::WriteOnly)) {
+        QDir(tempPath).removeRecursively();
+        return false;
+    }
+    stamp.write(GetRunnerStamp(runner) + '\n' + verbs.join(' ').toUtf8() + '\n');
+    stamp.close();
+
+    QDir(templatePath).removeRecursively();
+    if(!QDir().rename(tempPath, templatePath)) {
+        QDir(tempPath).removeRecursively();
+        return false;
+    }
+    printf("Saved prefix template %s (%s)\n", templatePath.toLocal8Bit().constData(), NeroCopy::FormatStats(stats).toLocal8Bit().constData());
+    return true;
+}
+
+bool NeroFS::ClearPrefixTemplates()
+{
+    return QDir(prefixesPath.path() + "/.templates").removeRecursively();
 }
 
 void NeroFS::DeleteShortcut(const QString &shortcutHash)
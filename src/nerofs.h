@@ -26,6 +26,10 @@
 #include <QFileDialog>
 #include <QStandardPaths>
 
+#include "nerobundle.h"
+#include "nerocopy.h"
+#include "nerosnapshot.h"
+
 class NeroFS
 {
 private:
@@ -59,15 +63,65 @@ public:
     static QMap<QString, QVariant> GetShortcutSettings(const QString &);
     static QSettings* GetManagerCfg() { return &managerCfg; }
     static void CreateUserLinks(const QString &);
-    static void AddNewPrefix(const QString &, const QString &);
+    static void AddNewPrefix(const QString &);
+    static void InitPrefixSettings(const QString &prefix, const QString &runner);
     static void AddNewShortcut(const QString &, const QString &, const QString &);
+    // moves the prefix into the trash (refusing if it's still running); EmptyTrash does the slow part.
     static bool DeletePrefix(const QString &);
+    static bool EmptyTrash(NeroCopy::Stats &stats, const NeroCopy::ProgressFunc &progress = nullptr);
+    static bool ClonePrefix(const QString &prefix, const QString &newPrefix, const bool skipCaches,
+                            NeroCopy::Stats &stats, const NeroCopy::ProgressFunc &progress = nullptr);
+    // portable bundles, for moving a prefix (or just one of its shortcuts) to another machine
+    static bool ExportPrefix(const QString &prefix, const QString &outPath, const QString &shortcutHash, const int level,
+                             NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress = nullptr);
+    static bool ImportPrefix(const QString &archivePath, const QString &newName, QString &importedName,
+                             NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress = nullptr);
+
+    // hibernated prefixes are packed away under <home>/.hibernated, leaving a stub with just their settings & icons
+    static QString GetHibernatedPath(const QString &prefix) { return prefixesPath.path() + "/.hibernated/" + prefix + ".nero.zip"; }
+    static bool IsPrefixHibernated(const QString &prefix);
+    static bool HibernatePrefix(const QString &prefix, NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress = nullptr);
+    static bool WakePrefix(const QString &prefix, NeroBundle::Stats &stats, const NeroBundle::ProgressFunc &progress = nullptr);
+    // prefixes not launched in at least this many days, that aren't hibernated (or running) already
+    static QStringList GetIdlePrefixes(const int days);
+
+    // Proton upgrades each prefix the first time it's run with a new (or updated) runner; these track which ones
+    // still have that coming, so it can be done ahead of time in the background.
+    static bool PrefixNeedsUpgrade(const QString &prefix);
+    static void SetPrefixUpgraded(const QString &prefix, const QString &runner);
+    static QStringList GetPrefixesNeedingUpgrade();
+
+    // W_CACHE for every winetricks run Nero does, so each installer's only downloaded once for all prefixes
+    static QString GetWinetricksCachePath() { return prefixesPath.path() + "/.winetricks-cache"; }
+
+    // pristine per-runner(/verb set) prefixes that new prefixes get cloned from
+    enum {
+        TemplatesOff = 0,
+        // one per runner, for prefixes made without any verbs
+        TemplatesPerRunner,
+        // plus one for every distinct set of verbs, which adds up quickly
+        TemplatesPerVerbSet
+    } TemplateModes_e;
+    // from the UsePrefixTemplates & PrefixTemplatesPerVerbSet prefs; read up front, so workers don't touch the config
+    static int GetPrefixTemplateMode();
+    static QString GetPrefixTemplatePath(const QString &runner, QStringList verbs = {});
+    static bool IsPrefixTemplateCurrent(const QString &templatePath, const QString &runner);
+    static bool SavePrefixTemplate(const QString &prefixPath, const QString &runner, const QStringList &verbs = {});
+    static bool ClearPrefixTemplates();
     static void DeleteShortcut(const QString &);
 
+    // per-prefix snapshots, kept under <home>/.snapshots
+    static QString GetSnapshotsPath(const QString &prefix) { return prefixesPath.path() + "/.snapshots/" + prefix; }
+    static bool SnapshotPrefix(const QString &prefix, const QString &reason,
+                               NeroSnapshot::Stats &stats, const NeroSnapshot::ProgressFunc &progress = nullptr);
+    static bool RestorePrefixSnapshot(const QString &prefix, const QString &id,
+                                      NeroSnapshot::Stats &stats, const NeroSnapshot::ProgressFunc &progress = nullptr);
+    // registry fingerprints (see NeroRegistry::Snapshot) sit next to those, in .registry so they aren't listed as such
+    static QString GetRegistrySnapshotsPath(const QString &prefix) { return GetSnapshotsPath(prefix) + "/.registry"; }
+    static bool SnapshotPrefixRegistry(const QString &prefix, const QString &label, QString *id = nullptr);
+
     static QSettings* GetCurrentPrefixCfg();
 
-    static QString GetIcoextract();
-    static QString GetIcoutils();
     static QString GetUmU();
     static QString GetWinetricks(const QString & = "");
     static bool SetUmU(const QString & = "");
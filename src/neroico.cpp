@@ -17,284 +17,344 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-/*  !! This app relies on the following external components: !!
-
-    `icoextract`, MIT License, (C) 2015-2016 Fadhil Mandaga / (C) 2019 James Lu
-
-    `icotool` as part of `icoutils`, GPLv3, (C) 1998 Oskar Liljeblad
-
-    As this Free Software relies on existing binaries present on the user's system,
-    any licenses attached to this file do not apply to these components,
-    and are governed by their respective owners.
-*/
-
 #include "neroico.h"
-#include "nerofs.h"
 
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QString>
-#include <QProcess>
+#include <QTemporaryDir>
+
+#include <cstring>
+
+namespace {
+    // resource type ids, from winuser.h
+    enum {
+        RT_ICON = 3,
+        RT_GROUP_ICON = 14
+    };
+
+    struct Frame {
+        int width = 0;
+        int height = 0;
+        int depth = 0;
+        const uchar *data = nullptr;
+        quint32 size = 0;
+    };
+
+    // everything in PE/ICO is little-endian, and none of it is guaranteed to be aligned
+    quint16 U16(const uchar *p) { return quint16(p[0] | (p[1] << 8)); }
+    quint32 U32(const uchar *p) { return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24); }
+
+    // bounds-checked view over the mapped file
+    struct View {
+        const uchar *data;
+        quint64 size;
+
+        bool Has(const quint64 offset, const quint64 length) const { return offset <= size && length <= size - offset; }
+    };
+
+    // the group/dir entries store 0 for 256, and old ones leave the depth out in favor of a color count
+    Frame EntryFrame(const uchar *entry)
+    {
+        Frame frame;
+        frame.width = entry[0] ? entry[0] : 256;
+        frame.height = entry[1] ? entry[1] : 256;
+        frame.depth = U16(entry + 6);
+        if(!frame.depth && entry[2])
+            for(int colors = entry[2]; colors > 1; colors >>= 1)
+                frame.depth++;
+        return frame;
+    }
 
-QString NeroIcoExtractor::GetIcon(QString sourceFile)
-{
-    if(sourceFile.endsWith(".exe", Qt::CaseInsensitive)) {
-        if(!NeroFS::GetIcoextract().isEmpty() && !NeroFS::GetIcoutils().isEmpty()) {
-            QDir tmpDir(QDir::temp());
-            // test if this is writable
-            tmpDir.mkdir("nero-manager");
-            if(tmpDir.cd("nero-manager")) {
-                // clean tmp directory
-                for(const auto &file : tmpDir.entryList())
-                    tmpDir.remove(file);
-
-                QProcess extProcess;
-                extProcess.setWorkingDirectory(tmpDir.path());
-
-                // extract .ico
-                extProcess.start(NeroFS::GetIcoextract(), { sourceFile,
-                                                            QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe")) });
-                extProcess.waitForFinished();
-
-                if(extProcess.exitCode() == 0) {
-                    // list the ico file's contents to find the largest one.
-                    extProcess.start(NeroFS::GetIcoutils(), { "-l",
-                                                              "--icon",
-                                                              QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe")) });
-
-                    extProcess.waitForFinished();
-
-                    // prepping for icon index values storage
-                    QString stdout;
-                    int index;
-                    int size;
-                    int depth;
-                    QStringList icotoolOutput;
-                    QMap<int, int> icoScoreTable;
-
-                    while(extProcess.canReadLine()) {
-                        stdout = extProcess.readLine();
-
-                        if(stdout.startsWith("--icon")) {
-                            // leftref is removed post-Qt6, shut up :<
-                            index = stdout.remove("--icon --index=").left(stdout.indexOf(' ')).toInt();
-                            icotoolOutput = stdout.split(' ', Qt::SkipEmptyParts);
-
-                            // trim these lines to get acceptable values
-                            icotoolOutput[1].remove("--width=");
-                            icotoolOutput[3].remove("--bit-depth=");
-
-                            size = icotoolOutput.at(1).toInt();
-                            depth = icotoolOutput.at(3).toInt();
-
-                            // whichever's the highest key wins!
-                            icoScoreTable[size*depth] = index;
-                        }
-                    }
-
-                    // Some games, like Need for Speed Underground 2, don't seem to have an icon that's parseable by icotool
-                    // so exit if no scored indexes could be found
-                    if(icoScoreTable.size() == 0) {
-                        printf("No icons were parsed by icotool, aborting...\n");
-                        return "";
-                    }
-
-                    if(extProcess.exitCode() == 0) {
-                        // now we actually extract the file, using the highest scored icon
-                        extProcess.start(NeroFS::GetIcoutils(), { "-x",
-                                                                  QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe")),
-                                                                  "--icon",
-                                                                  "-i",
-                                                                  QString("%1").arg(icoScoreTable.last()),
-                                                                  "-o",
-                                                                  QString("%1.png").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe")) } );
-
-                        extProcess.waitForFinished();
-
-                        if(tmpDir.exists(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe") + ".png")) {
-                            return QString("%1/%2.png").arg(tmpDir.path(), sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".exe"));
-                        } else {
-                            printf("icotool failed to convert icon to png, aborting...\n");
-                            return "";
-                        }
-                    } else {
-                        printf("icotool couldn't list contents of icon file, aborting...\n");
-                        return "";
-                    }
-                } else {
-                    printf("icoextract couldn't extract an icon, likely because the requested file didn't have any. Aborting...\n");
-                    return "";
-                }
-            } else {
-                printf("Cannot create temp scratch directory, aborting...\n");
-                return "";
-            }
-        } else {
-            printf("icoextract and/or icoutils not found, aborting...\n");
-            return "";
+    bool Better(const Frame &a, const Frame &b)
+    {
+        if(a.width * a.height != b.width * b.height)
+            return a.width * a.height > b.width * b.height;
+        return a.depth > b.depth;
+    }
+
+    Frame BestIcoFrame(const View &file)
+    {
+        Frame best;
+        if(!file.Has(0, 6) || U16(file.data) != 0 || U16(file.data + 2) != 1)
+            return best;
+
+        const int count = U16(file.data + 4);
+        for(int i = 0; i < count && file.Has(6 + i*16, 16); ++i) {
+            const uchar *entry = file.data + 6 + i*16;
+            Frame frame = EntryFrame(entry);
+            frame.size = U32(entry + 8);
+            const quint32 offset = U32(entry + 12);
+            // an empty "frame" would otherwise win over real ones just by claiming to be 256x256
+            if(!frame.size || !file.Has(offset, frame.size))
+                continue;
+            frame.data = file.data + offset;
+            if(!best.data || Better(frame, best))
+                best = frame;
         }
-    } else if(sourceFile.endsWith(".dll", Qt::CaseInsensitive)) {
-        if(!NeroFS::GetIcoextract().isEmpty() && !NeroFS::GetIcoutils().isEmpty()) {
-            QDir tmpDir(QDir::temp());
-            // test if this is writable
-            tmpDir.mkdir("nero-manager");
-            if(tmpDir.cd("nero-manager")) {
-                // clean tmp directory
-                for(const auto &file : tmpDir.entryList())
-                    tmpDir.remove(file);
-
-                QProcess extProcess;
-                extProcess.setWorkingDirectory(tmpDir.path());
-
-                // extract .ico
-                extProcess.start(NeroFS::GetIcoextract(), { sourceFile,
-                                                           QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".dll")) });
-                extProcess.waitForFinished();
-
-                if(extProcess.exitCode() == 0) {
-                    // list the ico file's contents to find the largest one.
-                    extProcess.start(NeroFS::GetIcoutils(), { "-l",
-                                                             "--icon",
-                                                             QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".dll")) });
-
-                    extProcess.waitForFinished();
-
-                    // prepping for icon index values storage
-                    QString stdout;
-                    int index;
-                    int size;
-                    int depth;
-                    QStringList icotoolOutput;
-                    QMap<int, int> icoScoreTable;
-
-                    while(extProcess.canReadLine()) {
-                        stdout = extProcess.readLine();
-
-                        if(stdout.startsWith("--icon")) {
-                            // leftref is removed post-Qt6, shut up :<
-                            index = stdout.remove("--icon --index=").left(stdout.indexOf(' ')).toInt();
-                            icotoolOutput = stdout.split(' ', Qt::SkipEmptyParts);
-
-                            // trim these lines to get acceptable values
-                            icotoolOutput[1].remove("--width=");
-                            icotoolOutput[3].remove("--bit-depth=");
-
-                            size = icotoolOutput.at(1).toInt();
-                            depth = icotoolOutput.at(3).toInt();
-
-                            // whichever's the highest key wins!
-                            icoScoreTable[size*depth] = index;
-                        }
-                    }
-
-                    if(extProcess.exitCode() == 0) {
-                        // now we actually extract the file, using the highest scored icon
-                        extProcess.start(NeroFS::GetIcoutils(), { "-x",
-                                                                 QString("%1.ico").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".dll")),
-                                                                 "--icon",
-                                                                 "-i",
-                                                                 QString("%1").arg(icoScoreTable.last()),
-                                                                 "-o",
-                                                                 QString("%1.png").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".dll")) } );
-
-                        extProcess.waitForFinished();
-
-                        if(extProcess.exitCode() == 0) {
-                            return QString("%1/%2.png").arg(tmpDir.path(), sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".dll"));
-                        } else {
-                            printf("icotool failed to convert icon to png, aborting...\n");
-                            return "";
-                        }
-                    } else {
-                        printf("icotool couldn't list contents of icon file, aborting...\n");
-                        return "";
-                    }
-                } else {
-                    printf("icoextract couldn't extract an icon, likely because the requested file didn't have any. Aborting...\n");
-                    return "";
+        return best;
+    }
+
+    struct Pe {
+        View file;
+        quint64 sectionsOffset = 0;
+        int sectionCount = 0;
+        quint32 resourceRva = 0;
+
+        // file offset for an rva, or 0 if it's in none of the sections' raw data
+        quint64 Offset(const quint32 rva, const quint32 length) const
+        {
+            for(int i = 0; i < sectionCount; ++i) {
+                const uchar *section = file.data + sectionsOffset + i*40;
+                const quint32 virtualAddress = U32(section + 12);
+                const quint32 rawSize = U32(section + 16);
+                const quint32 rawOffset = U32(section + 20);
+                if(rva >= virtualAddress && quint64(rva) - virtualAddress + length <= rawSize) {
+                    const quint64 offset = quint64(rawOffset) + rva - virtualAddress;
+                    return file.Has(offset, length) ? offset : 0;
                 }
-            } else {
-                printf("Cannot create temp scratch directory, aborting...\n");
-                return "";
             }
-        } else {
-            printf("icoextract and/or icoutils not found, aborting...\n");
-            return "";
+            return 0;
         }
-    } else if(sourceFile.endsWith(".ico", Qt::CaseInsensitive)) {
-        QDir tmpDir(QDir::temp());
-        // test if this is writable
-        tmpDir.mkdir("nero-manager");
-        if(tmpDir.cd("nero-manager")) {
-            // clean tmp directory
-            for(const auto &file : tmpDir.entryList())
-                tmpDir.remove(file);
-
-            QProcess extProcess;
-            extProcess.setWorkingDirectory(tmpDir.path());
-
-            // list the ico file's contents to find the largest one.
-            extProcess.start(NeroFS::GetIcoutils(), { "-l",
-                                                     "--icon",
-                                                     sourceFile });
-
-            extProcess.waitForFinished();
-
-            // prepping for icon index values storage
-            QString stdout;
-            int index;
-            int size;
-            int depth;
-            QStringList icotoolOutput;
-            QMap<int, int> icoScoreTable;
-
-            while(extProcess.canReadLine()) {
-                stdout = extProcess.readLine();
-
-                if(stdout.startsWith("--icon")) {
-                    // leftref is removed post-Qt6, shut up :<
-                    index = stdout.remove("--icon --index=").left(stdout.indexOf(' ')).toInt();
-                    icotoolOutput = stdout.split(' ', Qt::SkipEmptyParts);
-
-                    // trim these lines to get acceptable values
-                    icotoolOutput[1].remove("--width=");
-                    icotoolOutput[3].remove("--bit-depth=");
-
-                    size = icotoolOutput.at(1).toInt();
-                    depth = icotoolOutput.at(3).toInt();
-
-                    // whichever's the highest key wins!
-                    icoScoreTable[size*depth] = index;
-                }
+
+        // the entry (id, or the first one if id is -1) from the resource directory at dirOffset, relative to the
+        // resource section; returns its OffsetToData with the subdirectory bit left as-is, or 0 if it's not there
+        quint32 Find(const quint32 dirOffset, const int id) const
+        {
+            const quint64 dir = Offset(resourceRva + dirOffset, 16);
+            if(!dir)
+                return 0;
+            const int count = U16(file.data + dir + 12) + U16(file.data + dir + 14);
+            for(int i = 0; i < count; ++i) {
+                const quint64 entry = Offset(resourceRva + dirOffset + 16 + i*8, 8);
+                if(!entry)
+                    return 0;
+                const quint32 name = U32(file.data + entry);
+                // named entries come first, ids after
+                if(id == -1 || (!(name & 0x80000000) && int(name) == id))
+                    return U32(file.data + entry + 4);
             }
+            return 0;
+        }
 
-            if(extProcess.exitCode() == 0) {
-                // now we actually extract the file, using the highest scored icon
-                extProcess.start(NeroFS::GetIcoutils(), { "-x",
-                                                         sourceFile,
-                                                         "--icon",
-                                                         "-i",
-                                                         QString("%1").arg(icoScoreTable.last()),
-                                                         "-o",
-                                                         QString("%1.png").arg(sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".ico")) } );
+        // type -> id (or the first) -> first language -> data
+        bool Resource(const int type, const int id, const uchar **data, quint32 *size) const
+        {
+            const quint32 names = Find(0, type);
+            if(!(names & 0x80000000))
+                return false;
+            const quint32 languages = Find(names & 0x7fffffff, id);
+            if(!(languages & 0x80000000))
+                return false;
+            const quint32 leaf = Find(languages & 0x7fffffff, -1);
+            if(!leaf || (leaf & 0x80000000))
+                return false;
+
+            const quint64 entry = Offset(resourceRva + leaf, 16);
+            if(!entry)
+                return false;
+            *size = U32(file.data + entry + 4);
+            const quint64 offset = Offset(U32(file.data + entry), *size);
+            if(!offset)
+                return false;
+            *data = file.data + offset;
+            return true;
+        }
+    };
+
+    bool ParsePe(const View &file, Pe &pe)
+    {
+        pe.file = file;
+        if(!file.Has(0, 0x40) || file.data[0] != 'M' || file.data[1] != 'Z')
+            return false;
+        const quint32 header = U32(file.data + 0x3c);
+        if(!file.Has(header, 24) || U32(file.data + header) != 0x4550)
+            return false;
+
+        pe.sectionCount = U16(file.data + header + 6);
+        const int optionalSize = U16(file.data + header + 20);
+        const quint64 optional = quint64(header) + 24;
+        if(!file.Has(optional, optionalSize) || optionalSize < 2)
+            return false;
+
+        // the data directories sit further along in PE32+ (64-bit) images
+        const quint16 magic = U16(file.data + optional);
+        const int directories = magic == 0x20b ? 112 : magic == 0x10b ? 96 : -1;
+        if(directories < 0 || optionalSize < directories + 3*8 || U32(file.data + optional + directories - 4) < 3)
+            return false;
+        pe.resourceRva = U32(file.data + optional + directories + 2*8);
+
+        pe.sectionsOffset = optional + optionalSize;
+        return pe.resourceRva && file.Has(pe.sectionsOffset, quint64(pe.sectionCount) * 40);
+    }
 
-                extProcess.waitForFinished();
+    Frame BestPeFrame(const View &file)
+    {
+        Frame best;
+        Pe pe;
+        if(!ParsePe(file, pe))
+            return best;
+
+        // the first group is the one Explorer shows
+        const uchar *group;
+        quint32 groupSize;
+        if(!pe.Resource(RT_GROUP_ICON, -1, &group, &groupSize) || groupSize < 6)
+            return best;
+
+        const int count = U16(group + 4);
+        int bestId = -1;
+        for(int i = 0; i < count && 6 + quint64(i+1)*14 <= groupSize; ++i) {
+            const uchar *entry = group + 6 + i*14;
+            Frame frame = EntryFrame(entry);
+            if(bestId == -1 || Better(frame, best)) {
+                best = frame;
+                bestId = U16(entry + 12);
+            }
+        }
+        if(bestId == -1 || !pe.Resource(RT_ICON, bestId, &best.data, &best.size))
+            best.data = nullptr;
+        return best;
+    }
 
-                if(extProcess.exitCode() == 0) {
-                    return QString("%1/%2.png").arg(tmpDir.path(), sourceFile.mid(sourceFile.lastIndexOf('/')+1).remove(".ico"));
+    // icon frames are a BITMAPINFOHEADER'd DIB at twice the height, the second half being the 1bpp AND mask
+    QImage DecodeDib(const uchar *data, const quint32 size)
+    {
+        if(size < 40)
+            return QImage();
+        const quint32 headerSize = U32(data);
+        const qint32 width = qint32(U32(data + 4));
+        const qint32 height = qint32(U32(data + 8)) / 2;
+        const int bpp = U16(data + 14);
+        const quint32 compression = U32(data + 16);
+        // BI_BITFIELDS only ever shows up with plain BGRA masks in icons
+        if(headerSize < 40 || headerSize > size || width <= 0 || height <= 0 || width > 1024 || height > 1024 ||
+           (compression != 0 && compression != 3) || (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32))
+            return QImage();
+
+        quint32 paletteCount = bpp <= 8 ? U32(data + 32) : 0;
+        if(bpp <= 8 && (paletteCount == 0 || paletteCount > (1u << bpp)))
+            paletteCount = 1u << bpp;
+        const quint64 paletteOffset = headerSize + (compression == 3 ? 12 : 0);
+        const quint64 pixelsOffset = paletteOffset + paletteCount*4;
+        const quint64 stride = ((quint64(width) * bpp + 31) / 32) * 4;
+        const quint64 maskStride = ((quint64(width) + 31) / 32) * 4;
+        if(pixelsOffset + stride*height > size)
+            return QImage();
+        // some 32bpp icons leave the mask off entirely, since they don't need it
+        const bool hasMask = pixelsOffset + stride*height + maskStride*height <= size;
+
+        const uchar *palette = data + paletteOffset;
+        const uchar *pixels = data + pixelsOffset;
+        const uchar *mask = pixels + stride*height;
+
+        QImage image(width, height, QImage::Format_ARGB32);
+        if(image.isNull())
+            return image;
+
+        bool anyAlpha = false;
+        for(int y = 0; y < height; ++y) {
+            // rows go bottom-up
+            const uchar *row = pixels + stride*(height - 1 - y);
+            QRgb *out = reinterpret_cast<QRgb*>(image.scanLine(y));
+            for(int x = 0; x < width; ++x) {
+                if(bpp == 32) {
+                    const uchar *p = row + x*4;
+                    out[x] = qRgba(p[2], p[1], p[0], p[3]);
+                    anyAlpha |= p[3] != 0;
+                } else if(bpp == 24) {
+                    const uchar *p = row + x*3;
+                    out[x] = qRgb(p[2], p[1], p[0]);
                 } else {
-                    printf("icotool failed to convert icon to png, aborting...\n");
-                    return "";
+                    const int perByte = 8 / bpp;
+                    const int shift = 8 - bpp * (x % perByte + 1);
+                    const int index = (row[x / perByte] >> shift) & ((1 << bpp) - 1);
+                    const uchar *p = palette + qMin<quint32>(index, paletteCount - 1)*4;
+                    out[x] = qRgb(p[2], p[1], p[0]);
                 }
-            } else {
-                printf("icotool couldn't list contents of icon file, aborting...\n");
-                return "";
             }
         }
-    } else if(sourceFile.endsWith(".png", Qt::CaseInsensitive)) {
+
+        // 32bpp frames carry their own alpha, the mask's only there for old Windows versions, unless the alpha's all empty
+        if(hasMask && (bpp != 32 || !anyAlpha)) {
+            for(int y = 0; y < height; ++y) {
+                const uchar *row = mask + maskStride*(height - 1 - y);
+                QRgb *out = reinterpret_cast<QRgb*>(image.scanLine(y));
+                for(int x = 0; x < width; ++x)
+                    out[x] = (row[x / 8] >> (7 - x % 8)) & 1 ? 0 : (out[x] | 0xff000000);
+            }
+        } else if(bpp == 32 && !anyAlpha) {
+            for(int y = 0; y < height; ++y) {
+                QRgb *out = reinterpret_cast<QRgb*>(image.scanLine(y));
+                for(int x = 0; x < width; ++x)
+                    out[x] |= 0xff000000;
+            }
+        }
+        return image;
+    }
+
+    QImage DecodeFrame(const Frame &frame)
+    {
+        // Vista+ icons store their bigger sizes as straight PNGs
+        static const uchar png[] = { 0x89, 'P', 'N', 'G' };
+        if(frame.size >= 4 && memcmp(frame.data, png, 4) == 0)
+            return QImage::fromData(frame.data, int(frame.size), "PNG");
+        return DecodeDib(frame.data, frame.size);
+    }
+}
+
+QImage NeroIcoExtractor::ExtractIcon(const QString &sourceFile)
+{
+    QFile file(sourceFile);
+    if(!file.open(QIODevice::ReadOnly) || file.size() < 6)
+        return QImage();
+
+    // mapped rather than read, as only the headers and the one frame out of a potentially huge exe get touched
+    const uchar *data = file.map(0, file.size());
+    if(!data)
+        return QImage();
+    const View view { data, quint64(file.size()) };
+
+    const Frame frame = data[0] == 'M' && data[1] == 'Z' ? BestPeFrame(view) : BestIcoFrame(view);
+    QImage image;
+    if(frame.data)
+        image = DecodeFrame(frame);
+    // decoded into its own buffer, so the mapping can go now
+    file.unmap(const_cast<uchar*>(data));
+    return image;
+}
+
+QString NeroIcoExtractor::GetIcon(QString sourceFile)
+{
+    if(sourceFile.endsWith(".png", Qt::CaseInsensitive)) {
         // needs no conversion, so just use as-is
         return sourceFile;
-    } else {
-        return "";
+    } else if(sourceFile.endsWith(".exe", Qt::CaseInsensitive) ||
+              sourceFile.endsWith(".dll", Qt::CaseInsensitive) ||
+              sourceFile.endsWith(".ico", Qt::CaseInsensitive)) {
+        const QImage icon = ExtractIcon(sourceFile);
+        if(icon.isNull()) {
+            // Some games, like Need for Speed Underground 2, just don't have a usable icon
+            printf("No usable icon found in %s, skipping...\n", sourceFile.toLocal8Bit().constData());
+            return "";
+        }
+
+        // A private scratch dir that lives as long as Nero does (callers copy the png into .icoCache later),
+        // rather than a fixed /tmp path that other instances or users could clobber or plant files in.
+        static QTemporaryDir tmpDir(QDir::temp().filePath("nero-manager-XXXXXX"));
+        if(!tmpDir.isValid()) {
+            printf("Cannot create temp scratch directory, aborting...\n");
+            return "";
+        }
+
+        // numbered, so picking another setup.exe doesn't overwrite an icon that's still being shown
+        static int extracted = 0;
+        const QString iconPath = tmpDir.filePath(QString("%1-%2.png").arg(QFileInfo(sourceFile).completeBaseName()).arg(++extracted));
+        if(!icon.save(iconPath, "PNG")) {
+            printf("Couldn't write extracted icon to %s, aborting...\n", iconPath.toLocal8Bit().constData());
+            return "";
+        }
+        return iconPath;
     }
 
     return "";
@@ -22,11 +22,17 @@
 
 #include <QString>
 #include <QDir>
+#include <QImage>
 
 class NeroIcoExtractor
 {
 public:
+    // Returns a png path for the icon of sourceFile (.exe/.dll/.ico get extracted into a private temp dir that's
+    // removed on exit, .png is used as-is), or an empty string if there's nothing usable. GUI thread only.
     static QString GetIcon(QString sourceFile);
+    // The biggest, deepest icon in a PE's first icon group or an .ico file, read straight from the (mapped) file.
+    // Null if the file's neither, or has no icons we can decode. Doesn't touch anything else, so it's thread-safe.
+    static QImage ExtractIcon(const QString &sourceFile);
     static void CheckIcoCache(QDir cache) { if(!cache.exists(".icoCache")) { cache.mkdir(".icoCache"); } }
 };
 
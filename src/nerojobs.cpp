@@ -0,0 +1,105 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Bounded-concurrency job queue, for long-running per-prefix chores (e.g. upgrades).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerojobs.h"
+
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void NeroJobQueue::Add(const QString &name, const std::function<int()> &run)
+{
+    Job job;
+    job.name = name;
+    job.run = run;
+    jobs.append(job);
+}
+
+bool NeroJobQueue::Run(const ProgressFunc &progress, const FinishedFunc &finished)
+{
+    std::mutex mutex;
+    std::atomic<int> next(0);
+    std::atomic<int> workersDone(0);
+    std::atomic<bool> cancel(false);
+
+    // jobs mostly sit waiting on child processes, so threads are cheap here; the limit is on how many
+    // prefixes get hammered at once.
+    const int threadCount = qMin(maxConcurrent, (int)jobs.count());
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threadCount; ++t)
+        workers.emplace_back([&]() {
+            for(int i = next++; i < jobs.count() && !cancel; i = next++) {
+                std::function<int()> run;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    jobs[i].state = JobRunning;
+                    run = jobs.at(i).run;
+                }
+                QElapsedTimer timer;
+                timer.start();
+                const int result = run ? run() : -1;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs[i].result = result;
+                jobs[i].msecs = timer.elapsed();
+                jobs[i].state = JobFinished;
+                if(finished)
+                    finished(jobs.at(i));
+            }
+            workersDone++;
+        });
+
+    auto collect = [&]() {
+        Stats stats;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.total = jobs.count();
+        for(const Job &job : jobs) {
+            if(job.state == JobRunning) {
+                stats.running++;
+                stats.current.append(job.name);
+            } else if(job.state == JobFinished) {
+                stats.finished++;
+                if(job.result != 0) stats.failed++;
+            }
+        }
+        return stats;
+    };
+
+    while(workersDone < threadCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if(progress && !cancel && !progress(collect()))
+            cancel = true;
+    }
+    for(auto &worker : workers)
+        worker.join();
+
+    bool ok = true;
+    for(Job &job : jobs) {
+        if(job.state == JobQueued)
+            job.state = JobSkipped;
+        if(job.state != JobFinished || job.result != 0)
+            ok = false;
+    }
+    if(progress) progress(collect());
+    return ok;
+}
@@ -0,0 +1,75 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Bounded-concurrency job queue, for long-running per-prefix chores (e.g. upgrades).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROJOBS_H
+#define NEROJOBS_H
+
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+class NeroJobQueue
+{
+public:
+    enum {
+        JobQueued = 0,
+        JobRunning,
+        JobFinished,
+        // never started, since the queue was canceled first
+        JobSkipped
+    } JobStates_e;
+
+    struct Job {
+        QString name;
+        // returns the job's exit code; anything but 0 is a failure
+        std::function<int()> run;
+        int state = JobQueued;
+        int result = -1;
+        qint64 msecs = 0;
+    };
+
+    struct Stats {
+        int total = 0;
+        int running = 0;
+        int finished = 0;
+        int failed = 0;
+        // whatever's currently running, for progress text
+        QStringList current;
+    };
+
+    // Called from the calling thread every so often; return false to stop starting new jobs
+    // (ones already running are always left to finish).
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+    // Called from worker threads (one at a time) as each job finishes.
+    typedef std::function<void(const Job &)> FinishedFunc;
+
+    explicit NeroJobQueue(const int maxConcurrent = 2) : maxConcurrent(maxConcurrent < 1 ? 1 : maxConcurrent) {}
+
+    void Add(const QString &name, const std::function<int()> &run);
+    // Runs everything queued; true if every job ran and returned 0.
+    bool Run(const ProgressFunc &progress = nullptr, const FinishedFunc &finished = nullptr);
+    const QList<Job>& Jobs() const { return jobs; }
+
+private:
+    int maxConcurrent;
+    QList<Job> jobs;
+};
+
+#endif // NEROJOBS_H
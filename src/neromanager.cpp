@@ -21,16 +21,24 @@
 #include "./ui_neromanager.h"
 #include "nerofs.h"
 #include "neroico.h"
+#include "nerojobs.h"
+#include "nerocopy.h"
+#include "nerodiskusage.h"
 #include "neropreferences.h"
 #include "neroprefixsettings.h"
 #include "nerorunner.h"
 #include "nerorunnerdialog.h"
 #include "neroshortcut.h"
 #include "nerotricks.h"
+#include "nerotricksqueue.h"
+#include "nerotuning.h"
 
 #include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QProcess>
+#include <QProgressDialog>
 #include <QTimer>
 #include <QShortcut>
 
@@ -120,8 +128,44 @@ NeroManagerWindow::NeroManagerWindow(QWidget *parent)
     blinkTimer = new QTimer();
     connect(blinkTimer, &QTimer::timeout, this, &NeroManagerWindow::blinkTimer_timeout);
 
+    diskUsageWorker = new NeroDiskUsageWorker();
+    diskUsageWorker->moveToThread(&diskUsageThread);
+    connect(&diskUsageThread, &QThread::finished, diskUsageWorker, &QObject::deleteLater);
+    connect(this, &NeroManagerWindow::diskUsageRequested, diskUsageWorker, &NeroDiskUsageWorker::measurePrefixes);
+    connect(diskUsageWorker, &NeroDiskUsageWorker::prefixMeasured, this, &NeroManagerWindow::handleDiskUsage);
+    diskUsageThread.start();
+
+    upgradeWorker = new NeroUpgradeWorker();
+    upgradeWorker->moveToThread(&upgradeThread);
+    connect(&upgradeThread, &QThread::finished, upgradeWorker, &QObject::deleteLater);
+    connect(this, &NeroManagerWindow::upgradesRequested, upgradeWorker, &NeroUpgradeWorker::upgradePrefixes);
+    connect(upgradeWorker, &NeroUpgradeWorker::prefixUpgradeStarted, this, &NeroManagerWindow::handleUpgradeStarted);
+    connect(upgradeWorker, &NeroUpgradeWorker::prefixUpgraded, this, &NeroManagerWindow::handleUpgradeResult);
+    connect(upgradeWorker, &NeroUpgradeWorker::upgradesFinished, this, &NeroManagerWindow::handleUpgradesFinished);
+    upgradeThread.start();
+
+    trashWorker = new NeroTrashWorker();
+    trashWorker->moveToThread(&trashThread);
+    connect(&trashThread, &QThread::finished, trashWorker, &QObject::deleteLater);
+    connect(this, &NeroManagerWindow::trashRequested, trashWorker, &NeroTrashWorker::emptyTrash);
+    connect(trashWorker, &NeroTrashWorker::trashProgress, this, &NeroManagerWindow::handleTrashProgress);
+    connect(trashWorker, &NeroTrashWorker::trashEmptied, this, &NeroManagerWindow::handleTrashEmptied);
+    trashThread.start();
+
+    tricksQueue = new NeroTricksQueue(this);
+    tricksQueue->SetMaxConcurrent(managerCfg->value("ConcurrentTricks", 2).toInt());
+    tricksQueue->SetRetries(managerCfg->value("TricksRetries", 1).toInt());
+    connect(tricksQueue, &NeroTricksQueue::queueFinished, this, &NeroManagerWindow::handleTricksFinished);
+
     RenderPrefixes();
     SetHeader();
+
+    // runners may have been added or updated since last time
+    QueueUpgrades(NeroFS::GetPrefixesNeedingUpgrade());
+
+    // after the window's up, so there's something to parent the progress dialog to
+    if(managerCfg->value("HibernateAfterDays", 0).toInt() > 0)
+        QTimer::singleShot(0, this, &NeroManagerWindow::HibernateIdlePrefixes);
 }
 
 NeroManagerWindow::~NeroManagerWindow()
@@ -129,6 +173,20 @@ NeroManagerWindow::~NeroManagerWindow()
     managerCfg->setValue("WinSize", this->size());
     managerCfg->sync();
 
+    diskUsageWorker->halt = true;
+    diskUsageThread.quit();
+    diskUsageThread.wait();
+
+    // anything mid-upgrade is left to finish, rather than leaving a half-upgraded prefix behind
+    upgradeWorker->halt = true;
+    upgradeThread.quit();
+    upgradeThread.wait();
+
+    // whatever's left in the trash just gets cleaned up on the next deletion
+    trashWorker->cancel = true;
+    trashThread.quit();
+    trashThread.wait();
+
     delete ui;
 }
 
@@ -147,6 +205,7 @@ void NeroManagerWindow::SetHeader(const QString prefix, const unsigned int short
         ui->addButton->setIcon(QIcon::fromTheme("folder-new"));
         ui->addButton->setToolTip("Create a new prefix.");
         ui->addButton->clearFocus();
+        ui->importButton->setVisible(true);
         ui->oneTimeRunBtn->setVisible(false);
         ui->oneTimeRunArgs->setVisible(false);
 
@@ -166,6 +225,7 @@ void NeroManagerWindow::SetHeader(const QString prefix, const unsigned int short
         ui->addButton->clearFocus();
         ui->addButton->setIcon(QIcon::fromTheme("list-add"));
         ui->addButton->setToolTip("Add a new shortcut to this prefix.");
+        ui->importButton->setVisible(false);
         ui->oneTimeRunBtn->setVisible(true);
         ui->oneTimeRunArgs->setVisible(true);
         ui->oneTimeRunArgs->clear();
@@ -192,18 +252,47 @@ void NeroManagerWindow::RenderPrefixes()
         if(!prefixMainButton.isEmpty()) {
             for(auto btn : prefixMainButton)
                 delete btn;
+            for(auto label : prefixSizeLabel)
+                delete label;
+            for(auto btn : prefixCloneButton)
+                delete btn;
+            for(auto btn : prefixExportButton)
+                delete btn;
             for(auto btn : prefixDeleteButton)
                 delete btn;
-            prefixMainButton.clear(), prefixDeleteButton.clear();
+            prefixMainButton.clear(), prefixSizeLabel.clear(), prefixCloneButton.clear(), prefixExportButton.clear(), prefixDeleteButton.clear();
         }
 
+        QStringList prefixPaths;
+
         for(int i = 0; i < NeroFS::GetPrefixes().count(); i++) {
             prefixMainButton << new QPushButton(NeroFS::GetPrefixes().at(i));
+            prefixSizeLabel << new QLabel("...");
+            prefixCloneButton << new QPushButton(QIcon::fromTheme("edit-copy"), "");
+            prefixExportButton << new QPushButton(QIcon::fromTheme("document-export"), "");
             prefixDeleteButton << new QPushButton(QIcon::fromTheme("edit-delete"), "");
 
             prefixMainButton.at(i)->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
             prefixMainButton.at(i)->setFont(listFont);
             prefixMainButton.at(i)->setProperty("slot", i);
+            if(NeroFS::IsPrefixHibernated(NeroFS::GetPrefixes().at(i)))
+                prefixMainButton.at(i)->setToolTip("Hibernated; this prefix will be restored when it's opened.");
+            else if(upgradesPending.contains(NeroFS::GetPrefixes().at(i)))
+                prefixMainButton.at(i)->setIcon(QIcon::fromTheme("view-refresh"));
+
+            prefixSizeLabel.at(i)->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            prefixSizeLabel.at(i)->setToolTip("Calculating size...");
+            prefixSizeLabel.at(i)->setEnabled(false);
+
+            prefixCloneButton.at(i)->setFlat(true);
+            prefixCloneButton.at(i)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+            prefixCloneButton.at(i)->setToolTip("Clone " + NeroFS::GetPrefixes().at(i));
+            prefixCloneButton.at(i)->setProperty("slot", i);
+
+            prefixExportButton.at(i)->setFlat(true);
+            prefixExportButton.at(i)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+            prefixExportButton.at(i)->setToolTip("Export " + NeroFS::GetPrefixes().at(i));
+            prefixExportButton.at(i)->setProperty("slot", i);
 
             prefixDeleteButton.at(i)->setFlat(true);
             prefixDeleteButton.at(i)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
@@ -211,11 +300,21 @@ void NeroManagerWindow::RenderPrefixes()
             prefixDeleteButton.at(i)->setProperty("slot", i);
 
             ui->prefixesList->addWidget(prefixMainButton.at(i), i, 0);
-            ui->prefixesList->addWidget(prefixDeleteButton.at(i), i, 1);
+            ui->prefixesList->addWidget(prefixSizeLabel.at(i), i, 1);
+            ui->prefixesList->addWidget(prefixCloneButton.at(i), i, 2);
+            ui->prefixesList->addWidget(prefixExportButton.at(i), i, 3);
+            ui->prefixesList->addWidget(prefixDeleteButton.at(i), i, 4);
 
             connect(prefixMainButton.at(i),   &QPushButton::clicked, this, &NeroManagerWindow::prefixMainButtons_clicked);
+            connect(prefixCloneButton.at(i),  &QPushButton::clicked, this, &NeroManagerWindow::prefixCloneButtons_clicked);
+            connect(prefixExportButton.at(i), &QPushButton::clicked, this, &NeroManagerWindow::prefixExportButtons_clicked);
             connect(prefixDeleteButton.at(i), &QPushButton::clicked, this, &NeroManagerWindow::prefixDeleteButtons_clicked);
+
+            prefixPaths << NeroFS::GetPrefixesPath()->path() + '/' + NeroFS::GetPrefixes().at(i);
         }
+
+        // sizes fill in as they come; unchanged dirs come straight out of the cache, so this is cheap to redo
+        emit diskUsageRequested(prefixPaths);
     }
 }
 
@@ -280,9 +379,8 @@ void NeroManagerWindow::RenderPrefixList()
     }
 }
 
-void NeroManagerWindow::CreatePrefix(const QString &newPrefix, const QString &runner, QStringList tricksToInstall)
+void NeroManagerWindow::CreatePrefix(const QString &newPrefix, const QString &runner, const QStringList &tricksToInstall, const bool userLinks)
 {
-    QProcess umu;
     QMessageBox waitBox(QMessageBox::NoIcon,
                         "Generating Prefix",
                         "Please wait...",
@@ -290,132 +388,80 @@ void NeroManagerWindow::CreatePrefix(const QString &newPrefix, const QString &ru
                         this,
                         Qt::Dialog | Qt::FramelessWindowHint | Qt::MSWindowsFixedSizeDialogHint);
     waitBox.setStandardButtons(QMessageBox::NoButton);
-    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-
-    env.insert("WINEPREFIX", NeroFS::GetPrefixesPath()->path() + '/' + newPrefix);
-
-    // Only explicit set GAMEID when not already declared by user for (their) testing purposes
-    // (may or may not cause issues if user also selects tricks verbs, but since it needs to be expressly set by user, they assume all responsibility)
-    // See SeongGino/Nero-umu#66 for more info
-    if(!env.contains("GAMEID")) env.insert("GAMEID", "0");
-
-    env.insert("PROTONPATH", NeroFS::GetProtonsPath()->path() + '/' + runner);
-    // for Proton 10+. this shit gets real annoying
-    env.insert("PROTON_USE_XALIA", "0");
-    //env.insert("UMU_RUNTIME_UPDATE", "0");
-    umu.setProcessEnvironment(env);
-    umu.setProcessChannelMode(QProcess::MergedChannels);
-
-    if(tricksToInstall.isEmpty()) {
-        // UMU is supposed to have "createprefix" action, but it doesn't actually do anything
-        // (on newer versions, it just runs explorer.exe pointed at nothing)
-        // we just need an easy scapegoat process that exits on its own without spawning a console window
-        umu.start(NeroFS::GetUmU(), {"reg", "/?"});
-    } else {
-        tricksToInstall.prepend("winetricks");
-        QStringList argsList;
-
-        // NOTE: until https://github.com/Winetricks/winetricks/issues/2367 is resolved,
-        // delete two offending reg entries so that dotnet verbs don't erroneously exit.
-        if(!tricksToInstall.filter("dotnet").isEmpty()) {
-            argsList = (QStringList) {  NeroFS::GetUmU() + " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\.NETFramework\" /f && " +
-                                        NeroFS::GetUmU() + " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\NET Framework Setup\" /f && " +
-                                        NeroFS::GetUmU() + ' ' + tricksToInstall.join(' ') };
-            printf(".NET verb detected, cleaning up registry keys before winetricks install...\n");
-        } else argsList = (QStringList){NeroFS::GetUmU() + ' ' + tricksToInstall.join(' ')};
-
-        argsList.prepend("-c");
-        umu.start("/bin/sh", argsList);
-        tricksToInstall.removeFirst();
-    }
-
     waitBox.open();
     waitBox.raise();
     QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 
-    // don't use blocking function so that the dialog shows and the UI doesn't freeze.
-    while(umu.state() != QProcess::NotRunning) {
-        QApplication::processEvents();
-        QByteArray stdout;
-        // TODO: use QTextStream instead of printing line-by-line?
-        umu.waitForReadyRead(1000);
-        if(umu.canReadLine()) {
-            stdout = umu.readLine();
-            printf("%s", stdout.constData());
-            if(stdout.contains("Proton: Upgrading")) {
-                waitBox.setText("Creating prefix " + newPrefix + " using " + runner + "...");
-            } else if(stdout.contains("Downloading latest steamrt sniper")) {
-                waitBox.setText("umu: Updating runtime to latest version...");
-            } else if(stdout.contains("Proton: Running winetricks verbs in prefix:")) {
-                waitBox.setText("Running installations for Winetricks verbs:\n\n" +
-                                tricksToInstall.join('\n') +
-                                "\n\nThis stage may take a while...");
-            }
-        }
-    }
-
-    if(umu.exitCode() == 0) {
+    // the actual work is shared with the CLI's --create-prefix
+    const int exitCode = NeroRunner::CreatePrefix(NeroFS::GetUmU(), newPrefix, runner, tricksToInstall,
+                                                  NeroFS::GetPrefixTemplateMode(), userLinks,
+                                                  [&waitBox](const QString &status) {
+                                                      if(!status.isEmpty() && waitBox.text() != status)
+                                                          waitBox.setText(status);
+                                                      QApplication::processEvents();
+                                                      return true;
+                                                  });
+
+    if(exitCode == 0) {
         if(sysTray->supportsMessages())
             sysTray->showMessage("Finished Making Prefix \"" + newPrefix + "\"",
                                  "New Proton prefix \"" + newPrefix + "\" has been created successfully.");
     } else {
         if(sysTray->supportsMessages())
             sysTray->showMessage("Error Making Prefix \"" + newPrefix + "\"",
-                                 "Prefix creation process for \"" + newPrefix + "\" has exited with error code " + QString::number(umu.exitCode()) +
+                                 "Prefix creation process for \"" + newPrefix + "\" has exited with error code " + QString::number(exitCode) +
                                  ". This usually means that a winetricks verb has failed installation. "
                                  "Confirm that the desired verbs have installed in the prefix's \"Install Winetricks Components\" window.");
     }
 
-    QDir prefixPath(NeroFS::GetPrefixesPath()->path() + '/' + newPrefix);
-    if(prefixPath.exists("system.reg")) {
-        // Add fixes to system.reg
-        QFile regFile(prefixPath.path() + "/system.reg");
-        if(regFile.open(QFile::ReadWrite)) {
-            QString newReg;
-            QString line;
-
-            while(!regFile.atEnd()) {
-                line = regFile.readLine();
-                newReg.append(line);
-                // DualSense fix
-                //if(line.startsWith("[System\\\\CurrentControlSet\\\\Services\\\\winebus]"))
-                //    newReg.append("\"DisableHidraw\"=dword:00000001\n");
-                // connect COM ports for lightguns (in case someone still wants to use MAMEHOOKER) ;)
-                if(line.startsWith("[Software\\\\Wine\\\\Ports]"))
-                    newReg.append(  "\"COM1\"=\"/dev/ttyACM0\"\n"
-                                  "\"COM2\"=\"/dev/ttyACM1\"\n"
-                                  "\"COM3\"=\"/dev/ttyACM2\"\n"
-                                  "\"COM4\"=\"/dev/ttyACM3\"\n"
-                                  "\"COM5\"=\"/dev/ttyS0\"\n");
-            }
-
-            regFile.resize(0);
-            regFile.write(newReg.toUtf8());
-            regFile.close();
-        }
-
+    // settings only get written once the prefix actually exists
+    if(QFileInfo::exists(NeroFS::GetPrefixesPath()->path() + '/' + newPrefix + "/nero-settings.ini")) {
         // add prefix btn to list
-        NeroFS::AddNewPrefix(newPrefix, runner);
+        NeroFS::AddNewPrefix(newPrefix);
 
         unsigned int pos = prefixMainButton.count();
 
         prefixMainButton << new QPushButton(newPrefix);
+        prefixSizeLabel << new QLabel("...");
+        prefixCloneButton << new QPushButton(QIcon::fromTheme("edit-copy"), "");
+        prefixExportButton << new QPushButton(QIcon::fromTheme("document-export"), "");
         prefixDeleteButton << new QPushButton(QIcon::fromTheme("edit-delete"), "");
 
         prefixMainButton.at(pos)->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
         prefixMainButton.at(pos)->setFont(listFont);
         prefixMainButton.at(pos)->setProperty("slot", pos);
 
+        prefixSizeLabel.at(pos)->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        prefixSizeLabel.at(pos)->setToolTip("Calculating size...");
+        prefixSizeLabel.at(pos)->setEnabled(false);
+
+        prefixCloneButton.at(pos)->setFlat(true);
+        prefixCloneButton.at(pos)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+        prefixCloneButton.at(pos)->setToolTip("Clone " + newPrefix);
+        prefixCloneButton.at(pos)->setProperty("slot", pos);
+
+        prefixExportButton.at(pos)->setFlat(true);
+        prefixExportButton.at(pos)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+        prefixExportButton.at(pos)->setToolTip("Export " + newPrefix);
+        prefixExportButton.at(pos)->setProperty("slot", pos);
+
         prefixDeleteButton.at(pos)->setFlat(true);
         prefixDeleteButton.at(pos)->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
         prefixDeleteButton.at(pos)->setToolTip("Delete " + newPrefix);
         prefixDeleteButton.at(pos)->setProperty("slot", pos);
 
         ui->prefixesList->addWidget(prefixMainButton.at(pos), pos, 0);
-        ui->prefixesList->addWidget(prefixDeleteButton.at(pos), pos, 1);
+        ui->prefixesList->addWidget(prefixSizeLabel.at(pos), pos, 1);
+        ui->prefixesList->addWidget(prefixCloneButton.at(pos), pos, 2);
+        ui->prefixesList->addWidget(prefixExportButton.at(pos), pos, 3);
+        ui->prefixesList->addWidget(prefixDeleteButton.at(pos), pos, 4);
 
         connect(prefixMainButton.at(pos),   &QPushButton::clicked, this, &NeroManagerWindow::prefixMainButtons_clicked);
+        connect(prefixCloneButton.at(pos),  &QPushButton::clicked, this, &NeroManagerWindow::prefixCloneButtons_clicked);
+        connect(prefixExportButton.at(pos), &QPushButton::clicked, this, &NeroManagerWindow::prefixExportButtons_clicked);
         connect(prefixDeleteButton.at(pos), &QPushButton::clicked, this, &NeroManagerWindow::prefixDeleteButtons_clicked);
+
+        emit diskUsageRequested({ NeroFS::GetPrefixesPath()->path() + '/' + newPrefix });
     }
 
     QApplication::alert(this);
@@ -563,6 +609,9 @@ void NeroManagerWindow::prefixMainButtons_clicked()
 {
     auto *obj = qobject_cast<QPushButton*>(sender());
 
+    if(!WakeHibernatedPrefix(obj->text()))
+        return;
+
     if(NeroFS::GetCurrentPrefix() != obj->text()) {
         if(prefixShortcutLabel.count())
             CleanupShortcuts();
@@ -587,26 +636,380 @@ void NeroManagerWindow::prefixMainButtons_clicked()
     CheckWinetricks();
 }
 
+void NeroManagerWindow::prefixExportButtons_clicked()
+{
+    const QString prefix = prefixMainButton.at(sender()->property("slot").toInt())->text();
+    if(!WakeHibernatedPrefix(prefix))
+        return;
+
+    if(NeroTuning::FindWineserver(NeroFS::GetPrefixesPath()->path() + '/' + prefix)) {
+        QMessageBox::warning(this,
+                             "Prefix In Use",
+                             prefix + " is currently running.\n"
+                             "Close any apps running in it before exporting, so the bundle isn't caught mid-write.");
+        return;
+    }
+
+    // bundles can carry just one app, with only its shortcut & icon (the rest of drive_c still comes along)
+    NeroFS::SetCurrentPrefix(prefix);
+    const QMap<QString, QString> shortcuts = NeroFS::GetCurrentShortcutsMap();
+    QString shortcutHash;
+    if(!shortcuts.isEmpty()) {
+        QStringList choices = { "Whole prefix" };
+        choices.append(shortcuts.keys());
+        bool ok = false;
+        const QString choice = QInputDialog::getItem(this, "Export Prefix", "What to export from " + prefix + ':',
+                                                     choices, 0, false, &ok);
+        if(!ok)
+            return;
+        if(choice != choices.first())
+            shortcutHash = shortcuts.value(choice);
+    }
+
+    const QString outPath = QFileDialog::getSaveFileName(this, "Export " + prefix,
+                                                         QDir::homePath() + '/' + prefix + ".nero.zip",
+                                                         "Nero prefix bundles (*.zip)");
+    if(outPath.isEmpty())
+        return;
+
+    QProgressDialog progressDialog("Exporting " + prefix + "...", "Cancel", 0, 100, this);
+    progressDialog.setWindowTitle("Export Prefix");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+    NeroBundle::Stats stats;
+    const bool exported = NeroFS::ExportPrefix(prefix, outPath, shortcutHash, 1, stats, [&progressDialog](const NeroBundle::Stats &current) {
+        if(current.totalBytes)
+            progressDialog.setValue(current.bytes * 100 / current.totalBytes);
+        progressDialog.setLabelText(QString("Compressing files (%1 of %2 MiB)...")
+                                    .arg(current.bytes / (1024*1024)).arg(current.totalBytes / (1024*1024)));
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    const bool canceled = progressDialog.wasCanceled();
+    progressDialog.close();
+    QGuiApplication::restoreOverrideCursor();
+
+    if(exported) {
+        QMessageBox::information(this,
+                                 "Prefix Exported",
+                                 QString("%1 has been exported to %2 (%3 MiB).").arg(prefix, outPath,
+                                                                                   QString::number(stats.archiveBytes / (1024.0*1024), 'f', 1)));
+    } else if(!canceled) {
+        QMessageBox::critical(this,
+                              "Error Exporting Prefix",
+                              QString("Exporting %1 failed (%2 files couldn't be read); "
+                                      "check that the destination is writable and has enough free space.").arg(prefix).arg(stats.errors));
+    }
+}
+
+bool NeroManagerWindow::WakeHibernatedPrefix(const QString &prefix)
+{
+    if(!NeroFS::IsPrefixHibernated(prefix))
+        return true;
+
+    // not cancelable; the stub's only swapped out once everything's back, so there's nothing to gain from stopping halfway
+    QProgressDialog progressDialog("Restoring hibernated prefix " + prefix + "...", QString(), 0, 100, this);
+    progressDialog.setWindowTitle("Restoring Prefix");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+    NeroBundle::Stats stats;
+    const bool woken = NeroFS::WakePrefix(prefix, stats, [&progressDialog](const NeroBundle::Stats &current) {
+        if(current.totalBytes)
+            progressDialog.setValue(current.bytes * 100 / current.totalBytes);
+        progressDialog.setLabelText(QString("Restoring files (%1 of %2)...").arg(current.files).arg(current.totalFiles));
+        QApplication::processEvents();
+        return true;
+    });
+    progressDialog.close();
+    QGuiApplication::restoreOverrideCursor();
+
+    if(!woken)
+        QMessageBox::critical(this,
+                              "Error Restoring Prefix",
+                              QString("%1 couldn't be restored from hibernation (%2 files failed); "
+                                      "check that there's enough free space.").arg(prefix).arg(stats.errors));
+    else RenderPrefixes();
+    return woken;
+}
+
+void NeroManagerWindow::HibernateIdlePrefixes()
+{
+    // anything with an upgrade or winetricks job coming up isn't idle, even if nothing's running in it just yet
+    auto busy = [this](const QString &prefix) {
+        return upgradesPending.contains(prefix) || tricksQueue->BusyPrefixes().contains(prefix);
+    };
+    QStringList idle;
+    for(const QString &prefix : NeroFS::GetIdlePrefixes(managerCfg->value("HibernateAfterDays", 0).toInt()))
+        if(!busy(prefix))
+            idle.append(prefix);
+    if(idle.isEmpty())
+        return;
+
+    QProgressDialog progressDialog("Hibernating idle prefixes...", "Skip", 0, 100, this);
+    progressDialog.setWindowTitle("Hibernating Prefixes");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+
+    int hibernated = 0;
+    for(const QString &prefix : idle) {
+        // events get pumped along the way, so more could've been queued since the list was made
+        if(busy(prefix))
+            continue;
+        NeroBundle::Stats stats;
+        if(NeroFS::HibernatePrefix(prefix, stats, [&progressDialog, &prefix](const NeroBundle::Stats &current) {
+            if(current.totalBytes)
+                progressDialog.setValue(current.bytes * 100 / current.totalBytes);
+            progressDialog.setLabelText(QString("Hibernating %1 (%2 of %3 MiB)...").arg(prefix)
+                                        .arg(current.bytes / (1024*1024)).arg(current.totalBytes / (1024*1024)));
+            QApplication::processEvents();
+            return !progressDialog.wasCanceled();
+        }))
+            hibernated++;
+        if(progressDialog.wasCanceled())
+            break;
+    }
+    progressDialog.close();
+
+    printf("Hibernated %d idle prefix(es).\n", hibernated);
+    if(hibernated)
+        RenderPrefixes();
+}
+
+void NeroManagerWindow::on_importButton_clicked()
+{
+    const QString archivePath = QFileDialog::getOpenFileName(this, "Import Prefix Bundle", QDir::homePath(),
+                                                             "Nero prefix bundles (*.zip)");
+    if(archivePath.isEmpty())
+        return;
+
+    bool ok = false;
+    const QString newName = QInputDialog::getText(this,
+                                                  "Import Prefix",
+                                                  "Name for the imported prefix (leave empty to keep the bundle's own):",
+                                                  QLineEdit::Normal, "", &ok).trimmed();
+    if(!ok)
+        return;
+
+    QProgressDialog progressDialog("Importing...", "Cancel", 0, 100, this);
+    progressDialog.setWindowTitle("Import Prefix");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+    QString importedName;
+    NeroBundle::Stats stats;
+    const bool imported = NeroFS::ImportPrefix(archivePath, newName, importedName, stats, [&progressDialog](const NeroBundle::Stats &current) {
+        if(current.totalBytes)
+            progressDialog.setValue(current.bytes * 100 / current.totalBytes);
+        progressDialog.setLabelText(QString("Extracting files (%1 of %2)...").arg(current.files).arg(current.totalFiles));
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    const bool canceled = progressDialog.wasCanceled();
+    progressDialog.close();
+    QGuiApplication::restoreOverrideCursor();
+
+    if(imported) {
+        RenderPrefixes();
+        QMessageBox::information(this, "Prefix Imported", importedName + " has been imported.");
+    } else if(!canceled) {
+        QMessageBox::critical(this,
+                              "Error Importing Prefix",
+                              "Importing failed; the file isn't a Nero prefix bundle, a prefix by that name already exists, "
+                              "or there wasn't enough free space.");
+    }
+}
+
 void NeroManagerWindow::prefixDeleteButtons_clicked()
 {
     int slot = sender()->property("slot").toInt();
+    const QString prefix = prefixMainButton.at(slot)->text();
+
+    if(!NeroTuning::FindPrefixProcesses(NeroFS::GetPrefixesPath()->path() + '/' + prefix).isEmpty()) {
+        QMessageBox::warning(this,
+                             "Prefix In Use",
+                             prefix + " is currently running.\n"
+                             "Close any apps running in it before deleting it.");
+        return;
+    }
 
     if(QMessageBox::question(this,
                              "Removing Prefix",
-                             "Are you sure you wish to delete " + prefixMainButton.at(slot)->text() + "?\n\n"
+                             "Are you sure you wish to delete " + prefix + "?\n\n"
                              "All data inside the prefix will be deleted.\n"
                              "This operation CAN NOT BE UNDONE."
                             ) == QMessageBox::Yes)
     {
-        if(NeroFS::DeletePrefix(prefixMainButton.at(slot)->text())) {
-            if(NeroFS::GetCurrentPrefix() == prefixMainButton.at(slot)->text())
+        if(NeroFS::DeletePrefix(prefix)) {
+            if(NeroFS::GetCurrentPrefix() == prefix)
                 CleanupShortcuts();
 
+            // prefix is already in the trash at this point, so the list can be updated before the files are gone
             RenderPrefixes();
+
+            // the files themselves go in the background, so the manager stays usable while a big prefix is removed
+            trashPending.append(prefix);
+            if(trashProgress == nullptr) {
+                trashProgress = new QProgressDialog(this);
+                trashProgress->setWindowTitle("Removing Prefix");
+                trashProgress->setWindowModality(Qt::NonModal);
+                trashProgress->setAutoClose(false);
+                trashProgress->setAutoReset(false);
+                trashProgress->setRange(0, 0);
+                connect(trashProgress, &QProgressDialog::canceled, this, [this]() { trashWorker->cancel = true; });
+            }
+            trashProgress->setLabelText("Deleting " + prefix + "...");
+            // most prefixes are gone before this would even show up
+            trashProgress->setMinimumDuration(500);
+            trashProgress->setValue(0);
+            emit trashRequested(prefix);
+        } else {
+            QMessageBox::critical(this,
+                                  "Error Removing Prefix",
+                                  prefix + " couldn't be deleted. Check that it's not running, and that you can write to the Nero home directory.");
         }
     }
 }
 
+void NeroTrashWorker::emptyTrash(const QString &prefix)
+{
+    // a cancel only ever applies to the removal that was running when it was asked for
+    cancel = false;
+    NeroCopy::Stats stats;
+    QElapsedTimer sinceUpdate;
+    sinceUpdate.start();
+    const bool emptied = NeroFS::EmptyTrash(stats, [this, &prefix, &sinceUpdate](const NeroCopy::Stats &current) {
+        if(sinceUpdate.elapsed() >= 100) {
+            emit trashProgress(prefix, current.files, current.totalFiles);
+            sinceUpdate.restart();
+        }
+        return !cancel;
+    });
+    printf("Delete %s: %lld files, %.1f MiB removed\n", prefix.toLocal8Bit().constData(),
+           stats.files, stats.totalBytes / (1024.0*1024));
+    emit trashEmptied(prefix, emptied, cancel, stats.errors);
+}
+
+void NeroManagerWindow::handleTrashProgress(const QString &prefix, const qint64 files, const qint64 totalFiles)
+{
+    if(trashProgress == nullptr || trashProgress->wasCanceled())
+        return;
+    // files is still 0 while the prefix is being listed, so the bar stays busy until there's something to count
+    if(files) {
+        trashProgress->setRange(0, 100);
+        trashProgress->setValue(totalFiles ? files * 100 / totalFiles : 0);
+        trashProgress->setLabelText(QString("Deleting %1 (%2 of %3 files)...").arg(prefix).arg(files).arg(totalFiles));
+    } else {
+        trashProgress->setRange(0, 0);
+        trashProgress->setLabelText(QString("Deleting %1 (%2 files found)...").arg(prefix).arg(totalFiles));
+        trashProgress->setValue(0);
+    }
+}
+
+void NeroManagerWindow::handleTrashEmptied(const QString &prefix, const bool emptied, const bool canceled, const qint64 errors)
+{
+    trashPending.removeOne(prefix);
+    if(trashProgress != nullptr) {
+        // clears the canceled flag too, so the next one in line still gets its progress shown
+        trashProgress->reset();
+        if(trashPending.isEmpty())
+            trashProgress->hide();
+        else {
+            trashProgress->setRange(0, 0);
+            trashProgress->setLabelText("Deleting " + trashPending.first() + "...");
+            trashProgress->setValue(0);
+        }
+    }
+
+    if(canceled)
+        QMessageBox::information(this,
+                                 "Deletion Paused",
+                                 prefix + " has been removed from the list, but some of its files are still on disk.\n"
+                                 "They'll be cleaned up the next time a prefix is deleted.");
+    else if(!emptied)
+        QMessageBox::warning(this,
+                             "Error Removing Prefix",
+                             QString("%1 files couldn't be removed; they've been left in %2.")
+                             .arg(errors).arg(NeroFS::GetPrefixesPath()->path() + "/.trash"));
+}
+
+void NeroManagerWindow::prefixCloneButtons_clicked()
+{
+    const QString prefix = prefixMainButton.at(sender()->property("slot").toInt())->text();
+    if(!WakeHibernatedPrefix(prefix))
+        return;
+
+    if(NeroTuning::FindWineserver(NeroFS::GetPrefixesPath()->path() + '/' + prefix)) {
+        QMessageBox::warning(this,
+                             "Prefix In Use",
+                             prefix + " is currently running.\n"
+                             "Close any apps running in it before cloning, so the copy isn't caught mid-write.");
+        return;
+    }
+
+    bool ok = false;
+    const QString newPrefix = QInputDialog::getText(this,
+                                                    "Clone Prefix",
+                                                    "Name for the copy of " + prefix + ":",
+                                                    QLineEdit::Normal,
+                                                    prefix + " (Copy)",
+                                                    &ok).trimmed();
+    if(!ok || newPrefix.isEmpty())
+        return;
+    if(newPrefix.contains('/') || newPrefix.startsWith('.') || NeroFS::GetPrefixesPath()->exists(newPrefix)) {
+        QMessageBox::warning(this,
+                             "Invalid Prefix Name",
+                             "\"" + newPrefix + "\" is already in use, or isn't a valid folder name.");
+        return;
+    }
+
+    const bool skipCaches = QMessageBox::question(this,
+                                                  "Clone Prefix",
+                                                  "Leave out the logs and shader cache?\n\n"
+                                                  "These are rebuilt as needed, but keeping the shader cache "
+                                                  "avoids some stutter the first time apps are run in the copy.") == QMessageBox::Yes;
+
+    QProgressDialog progressDialog("Cloning " + prefix + "...", "Cancel", 0, 100, this);
+    progressDialog.setWindowTitle("Clone Prefix");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+    NeroCopy::Stats stats;
+    const bool cloned = NeroFS::ClonePrefix(prefix, newPrefix, skipCaches, stats, [&progressDialog](const NeroCopy::Stats &current) {
+        if(current.totalBytes)
+            progressDialog.setValue((current.bytesReflinked + current.bytesCopied) * 100 / current.totalBytes);
+        progressDialog.setLabelText(QString("Cloning files (%1 of %2)...").arg(current.files).arg(current.totalFiles));
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    const bool canceled = progressDialog.wasCanceled();
+    progressDialog.close();
+    QGuiApplication::restoreOverrideCursor();
+    printf("Clone %s -> %s: %s\n", prefix.toLocal8Bit().constData(), newPrefix.toLocal8Bit().constData(),
+           NeroCopy::FormatStats(stats).toLocal8Bit().constData());
+
+    if(cloned) {
+        RenderPrefixes();
+        QMessageBox::information(this,
+                                 "Prefix Cloned",
+                                 QString("%1 has been cloned to %2.\n\n"
+                                         "%3 MiB shared with the original (reflinked)\n"
+                                         "%4 MiB physically copied").arg(prefix, newPrefix,
+                                                                         QString::number(stats.bytesReflinked / (1024.0*1024), 'f', 1),
+                                                                         QString::number(stats.bytesCopied / (1024.0*1024), 'f', 1)));
+    } else if(!canceled) {
+        QMessageBox::critical(this,
+                              "Error Cloning Prefix",
+                              QString("Cloning %1 failed (%2 files couldn't be copied); "
+                                      "check that there's enough free space.").arg(prefix).arg(stats.errors));
+    }
+}
+
 void NeroManagerWindow::prefixShortcutPlayButtons_clicked()
 {
 
@@ -706,15 +1109,13 @@ void NeroManagerWindow::on_oneTimeRunBtn_clicked()
 
         if(runnerWindow == nullptr) {
             QIcon icon;
-            QString iconPath = NeroIcoExtractor::GetIcon(oneTimeApp);
-            if(!iconPath.isEmpty())
-                icon = QIcon(QPixmap(iconPath));
+            const QImage iconImage = NeroIcoExtractor::ExtractIcon(oneTimeApp);
+            if(!iconImage.isNull())
+                icon = QIcon(QPixmap::fromImage(iconImage));
             runnerWindow = new NeroRunnerDialog(this);
             runnerWindow->setModal(true);
             runnerWindow->SetupWindow(true, oneTimeApp.mid(oneTimeApp.lastIndexOf('/')+1), &icon);
             runnerWindow->show();
-            QDir tempDir(QDir::tempPath() + "/nero-manager");
-            tempDir.removeRecursively();
         }
 
         if(ui->oneTimeRunArgs->text().isEmpty()) {
@@ -799,6 +1200,12 @@ void NeroManagerWindow::on_prefixTricksBtn_clicked()
     tricks = new NeroTricksWindow(this);
     connect(tricks, &NeroTricksWindow::finished, this, &NeroManagerWindow::tricksWindow_result);
 
+    // ones still queued up count too, so they don't get queued twice
+    for(const NeroTricksQueue::Job &job : tricksQueue->Jobs())
+        if(job.prefix == NeroFS::GetCurrentPrefix() &&
+           (job.state == NeroTricksQueue::JobQueued || job.state == NeroTricksQueue::JobRunning))
+            verbsInstalled.append(job.verbs);
+
     if(!verbsInstalled.isEmpty()) tricks->SetPreinstalledVerbs(verbsInstalled);
 
     tricks->show();
@@ -814,85 +1221,36 @@ void NeroManagerWindow::tricksWindow_result()
                                   "Are you sure you wish to install these verbs?\n\n" + verbsToInstall.join('\n'))
             == QMessageBox::Yes) {
 
-            // Start tricks installation
-            sysTray->setIcon(QIcon(":/ico/systrayPhiBusy"));
-
-            QProcess umu;
-            QMessageBox waitBox(QMessageBox::NoIcon,
-                                "Generating Prefix",
-                                "Please wait...",
-                                QMessageBox::NoButton,
-                                this,
-                                Qt::Dialog | Qt::FramelessWindowHint | Qt::MSWindowsFixedSizeDialogHint);
-            waitBox.setStandardButtons(QMessageBox::NoButton);
-            QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-
-            QMap<QString, QVariant> settingsMap = NeroFS::GetCurrentPrefixSettings();
-            QString prefix = NeroFS::GetCurrentPrefix();
-
-            env.insert("WINEPREFIX", NeroFS::GetPrefixesPath()->path() + '/' + prefix);
-            env.insert("GAMEID", "0"); // force gameid here since tricks installation wouldn't benefit from having a forced profile
-            env.insert("PROTONPATH", NeroFS::GetProtonsPath()->path() + '/' + settingsMap["CurrentRunner"].toString());
-            // for Proton 10+. this shit gets real annoying
-            env.insert("PROTON_USE_XALIA", "0");
-            //env.insert("UMU_RUNTIME_UPDATE", "0");
-            umu.setProcessEnvironment(env);
-            umu.setProcessChannelMode(QProcess::MergedChannels);
-
-            verbsToInstall.prepend("winetricks");
-
-            QStringList argsList;
-
-            // NOTE: until https://github.com/Winetricks/winetricks/issues/2367 is resolved, delete two offending reg entries
-            if(tricks->installedVerbs.filter("dotnet").isEmpty() && !verbsToInstall.filter("dotnet").isEmpty()) {
-                argsList = (QStringList) {  NeroFS::GetUmU() + " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\.NETFramework\" /f && " +
-                                            NeroFS::GetUmU() + " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\NET Framework Setup\" /f && " +
-                                            NeroFS::GetUmU() + ' ' + verbsToInstall.join(' ') };
-                printf("First time .NET verb has been requested, cleaning up registry keys before winetricks install...\n");
-            } else argsList = (QStringList){NeroFS::GetUmU() + ' ' + verbsToInstall.join(' ')};
-
-            argsList.prepend("-c");
-            umu.start("/bin/sh", argsList);
-            verbsToInstall.removeFirst();
-
-            waitBox.open();
-            waitBox.raise();
-            QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-
-            // don't use blocking function so that the dialog shows and the UI doesn't freeze.
-            while(umu.state() != QProcess::NotRunning) {
-                QApplication::processEvents();
-                QByteArray stdout;
-                // TODO: use QTextStream instead of printing line-by-line?
-                umu.waitForReadyRead(100);
-                if(umu.canReadLine()) {
-                    stdout = umu.readLine();
-                    printf("%s", stdout.constData());
-                    if(stdout.contains("Proton: Upgrading")) {
-                        waitBox.setText(QString("Updating %1 with new Proton %2...").arg(prefix, settingsMap["CurrentRunner"].toString()));
-                    } else if(stdout.contains("Downloading latest steamrt sniper")) {
-                        waitBox.setText("umu: Updating runtime to latest version...");
-                    } else if(stdout.contains("Proton: Running winetricks verbs in prefix:")) {
-                        waitBox.setText(QString("Running installations for Winetricks verbs:\n\n%1\n\nThis stage may take a while...").arg(verbsToInstall.join('\n')));
-                    }
+            // verbs can't be uninstalled (and some half-install on failure), so keep a way back;
+            // if there's an install queued already, the snapshot from before that one covers this too
+            if(managerCfg->value("AutoSnapshots", true).toBool() && !tricksQueue->BusyPrefixes().contains(NeroFS::GetCurrentPrefix())) {
+                QProgressDialog progressDialog("Taking a snapshot of " + NeroFS::GetCurrentPrefix() + "...", "Cancel", 0, 100, this);
+                progressDialog.setWindowTitle("Prefix Snapshot");
+                progressDialog.setWindowModality(Qt::WindowModal);
+                progressDialog.setMinimumDuration(500);
+                NeroSnapshot::Stats stats;
+                const bool taken = NeroFS::SnapshotPrefix(NeroFS::GetCurrentPrefix(), "Before installing " + verbsToInstall.join(", "), stats,
+                                                          [&progressDialog](const NeroSnapshot::Stats &current) {
+                    if(current.totalFiles)
+                        progressDialog.setValue(current.files * 100 / current.totalFiles);
+                    QApplication::processEvents();
+                    return !progressDialog.wasCanceled();
+                });
+                progressDialog.close();
+                if(!taken && QMessageBox::question(this,
+                                                   "Snapshot Failed",
+                                                   "A snapshot of this prefix couldn't be taken before installing verbs.\n\n"
+                                                   "Install them anyway?") != QMessageBox::Yes) {
+                    delete tricks;
+                    tricks = nullptr;
+                    return;
                 }
             }
 
-            QApplication::alert(this);
-            if(umu.exitCode() != 0) {
-                if(sysTray->supportsMessages())
-                    sysTray->showMessage("Winetricks Installation Returned An Error",
-                                         "Winetricks process in prefix \"" + prefix + "\" has exited with error code " + QString::number(umu.exitCode()) + ". "
-                                                                                                                                                           "Not all queued verbs may have finished installing. "
-                                                                                                                                                           "Confirm which verbs have been successfully installed by checking for grayed-out entries in the \"Install Winetricks Components\" window for this prefix.",
-                                         QSystemTrayIcon::Warning);
-            } else if(sysTray->supportsMessages())
-                sysTray->showMessage("Finished Installing Winetricks",
-                                     "Queued Winetricks verbs has finished installing to prefix \"" + NeroFS::GetCurrentPrefix() + "\".");
-
-            QGuiApplication::restoreOverrideCursor();
-
-            sysTray->setIcon(QIcon(":/ico/systrayPhi"));
+            // the rest goes on in the background, alongside whatever other prefixes have queued up
+            tricksQueue->Add(NeroFS::GetUmU(), NeroFS::GetCurrentPrefix(), verbsToInstall);
+            sysTray->setIcon(QIcon(":/ico/systrayPhiBusy"));
+            ShowTricksQueue();
 
             delete tricks;
             tricks = nullptr;
@@ -908,9 +1266,7 @@ void NeroManagerWindow::prefixWizard_result()
 {
     if(wizard->result() == QDialog::Accepted) {
         sysTray->setIcon(QIcon(":/ico/systrayPhiBusy"));
-        CreatePrefix(wizard->prefixName, NeroFS::GetAvailableProtons()->at(wizard->protonRunner), wizard->verbsToInstall);
-
-        if(wizard->userSymlinks) NeroFS::CreateUserLinks(wizard->prefixName);
+        CreatePrefix(wizard->prefixName, NeroFS::GetAvailableProtons()->at(wizard->protonRunner), wizard->verbsToInstall, wizard->userSymlinks);
     } else if(NeroFS::GetPrefixes().isEmpty()) StartBlinkTimer();
 
     delete wizard;
@@ -969,6 +1325,10 @@ void NeroManagerWindow::prefixSettings_result()
     }
     delete prefixSettings;
     prefixSettings = nullptr;
+
+    // get the new runner's upgrade out of the way now, instead of on the next launch
+    if(NeroFS::PrefixNeedsUpgrade(NeroFS::GetCurrentPrefix()))
+        QueueUpgrades({ NeroFS::GetCurrentPrefix() });
 }
 
 void NeroManagerWindow::on_managerSettings_clicked()
@@ -1052,6 +1412,143 @@ void NeroManagerWindow::StopBlinkTimer()
     if(!prefixIsSelected) { ui->missingPrefixesLabelArea->setVisible(false); ui->prefixesScrollArea->setVisible(true); }
 }
 
+void NeroDiskUsageWorker::measurePrefixes(const QStringList &prefixPaths)
+{
+    NeroDiskUsage::Measure(prefixPaths, NeroFS::GetPrefixesPath()->path() + "/.nero-du-cache", false, false,
+                           [this](const QString &prefixPath, const NeroDiskUsage::Usage &usage) {
+        emit prefixMeasured(QFileInfo(prefixPath).fileName(), NeroDiskUsage::FormatSize(usage.Total()), NeroDiskUsage::Describe(usage));
+        return !halt;
+    });
+}
+
+void NeroManagerWindow::handleDiskUsage(const QString &prefix, const QString &size, const QString &details)
+{
+    // the list may have been redrawn since this was requested, so go by name rather than slot
+    for(int i = 0; i < prefixMainButton.count(); ++i) {
+        if(prefixMainButton.at(i)->text() == prefix) {
+            prefixSizeLabel.at(i)->setText(size);
+            prefixSizeLabel.at(i)->setToolTip(details);
+            prefixSizeLabel.at(i)->setEnabled(true);
+            break;
+        }
+    }
+}
+
+void NeroManagerWindow::QueueUpgrades(const QStringList &prefixes)
+{
+    if(!managerCfg->value("BackgroundUpgrades", true).toBool())
+        return;
+
+    QStringList toQueue;
+    for(const QString &prefix : prefixes)
+        if(!upgradesPending.contains(prefix))
+            toQueue.append(prefix);
+    if(toQueue.isEmpty() || NeroFS::GetUmU().isEmpty())
+        return;
+
+    upgradesPending.append(toQueue);
+    for(auto btn : prefixMainButton)
+        if(toQueue.contains(btn->text()))
+            btn->setIcon(QIcon::fromTheme("view-refresh"));
+    emit upgradesRequested(NeroFS::GetUmU(), toQueue, managerCfg->value("ConcurrentUpgrades", 2).toInt());
+}
+
+void NeroUpgradeWorker::upgradePrefixes(const QString &umuPath, const QStringList &prefixes, const int maxConcurrent)
+{
+    NeroJobQueue queue(maxConcurrent);
+    for(const QString &prefix : prefixes) {
+        queue.Add(prefix, [this, umuPath, prefix]() {
+            // read when the job actually starts, in case it's been changed again while queued
+            const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix;
+            const QString runner = QSettings(prefixPath + "/nero-settings.ini", QSettings::IniFormat).value("PrefixSettings/CurrentRunner").toString();
+            // running prefixes are left for later; they'll still be due next time around.
+            // Hibernated ones get upgraded whenever they're woken up instead
+            if(!NeroFS::PrefixNeedsUpgrade(prefix) || NeroFS::IsPrefixHibernated(prefix) ||
+               !NeroTuning::FindPrefixProcesses(prefixPath).isEmpty())
+                return 0;
+            emit prefixUpgradeStarted(prefix, runner);
+            const int result = NeroRunner::UpgradePrefix(umuPath, prefixPath, NeroFS::GetProtonsPath()->path() + '/' + runner);
+            if(result == 0)
+                NeroFS::SetPrefixUpgraded(prefix, runner);
+            return result;
+        });
+    }
+
+    int failed = 0;
+    queue.Run([this](const NeroJobQueue::Stats &) { return !halt; },
+              [this, &failed](const NeroJobQueue::Job &job) {
+        if(job.result != 0) failed++;
+        emit prefixUpgraded(job.name, job.result, job.msecs);
+    });
+    emit upgradesFinished(prefixes.count(), failed);
+}
+
+void NeroManagerWindow::handleUpgradeStarted(const QString &prefix, const QString &runner)
+{
+    printf("Upgrading prefix %s for %s in the background...\n", prefix.toLocal8Bit().constData(), runner.toLocal8Bit().constData());
+    for(auto btn : prefixMainButton)
+        if(btn->text() == prefix)
+            btn->setToolTip("Upgrading for " + runner + "...");
+}
+
+void NeroManagerWindow::handleUpgradeResult(const QString &prefix, const int result, const qint64 msecs)
+{
+    printf("Prefix %s upgrade %s (%.1fs)\n", prefix.toLocal8Bit().constData(),
+           result == 0 ? "done" : QString("failed with code %1").arg(result).toLocal8Bit().constData(), msecs / 1000.0);
+    upgradesPending.removeOne(prefix);
+    if(result != 0)
+        upgradesFailed.append(prefix);
+
+    for(auto btn : prefixMainButton)
+        if(btn->text() == prefix) {
+            btn->setIcon(QIcon());
+            btn->setToolTip(result == 0 ? QString() : "Background upgrade failed; see .logs/" + Logs::upgradeLogName + " in this prefix.");
+        }
+}
+
+void NeroManagerWindow::handleUpgradesFinished(const int total, const int failed)
+{
+    // only worth mentioning once everything queued has gone through
+    if(!upgradesPending.isEmpty() || !sysTray->supportsMessages())
+        return;
+
+    if(upgradesFailed.isEmpty())
+        sysTray->showMessage("Prefixes Upgraded",
+                             QString("%1 prefix(es) are ready for their new runners.").arg(total));
+    else sysTray->showMessage("Some Prefix Upgrades Failed",
+                              QString("%1 of %2 prefix upgrade(s) failed: %3\n"
+                                      "They'll be upgraded on their next launch instead.").arg(failed).arg(total).arg(upgradesFailed.join(", ")),
+                              QSystemTrayIcon::Warning);
+    upgradesFailed.clear();
+}
+
+void NeroManagerWindow::ShowTricksQueue()
+{
+    if(tricksPanel == nullptr)
+        tricksPanel = new NeroTricksQueueDialog(tricksQueue, this);
+    tricksPanel->show();
+    tricksPanel->raise();
+    tricksPanel->activateWindow();
+}
+
+void NeroManagerWindow::handleTricksFinished(const int total, const int failed)
+{
+    sysTray->setIcon(QIcon(":/ico/systrayPhi"));
+    QApplication::alert(this);
+    if(!sysTray->supportsMessages())
+        return;
+
+    if(failed)
+        sysTray->showMessage("Winetricks Installation Returned An Error",
+                             QString("%1 of %2 winetricks job(s) failed. "
+                                     "Not all queued verbs may have finished installing; "
+                                     "check the Winetricks Queue window to see which, or to retry them.").arg(failed).arg(total),
+                             QSystemTrayIcon::Warning);
+    else if(total)
+        sysTray->showMessage("Finished Installing Winetricks",
+                             QString("Queued Winetricks verbs have finished installing (%1 job(s)).").arg(total));
+}
+
 // umu runner stuff here!
 void NeroThreadWorker::umuRunnerProcess()
 {
@@ -25,6 +25,7 @@
 #include "nerorunner.h"
 #include "nerorunnerdialog.h"
 #include "nerotricks.h"
+#include "nerotricksqueue.h"
 #include "nerowizard.h"
 
 #include <QMainWindow>
@@ -37,6 +38,9 @@
 #include <QSettings>
 #include <QSystemTrayIcon>
 #include <QMenu>
+#include <QProgressDialog>
+
+#include <atomic>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -92,6 +96,48 @@ public slots:
     void handleUmuResults(const int &buttonSlot, const int &result) { emit passUmuResults(buttonSlot, result); }
 };
 
+// Measures prefix sizes off the GUI thread, reporting each prefix as it's done.
+class NeroDiskUsageWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    std::atomic<bool> halt { false };
+public slots:
+    void measurePrefixes(const QStringList &prefixPaths);
+signals:
+    void prefixMeasured(const QString &prefix, const QString &size, const QString &details);
+};
+
+class NeroUpgradeWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    std::atomic<bool> halt { false };
+public slots:
+    void upgradePrefixes(const QString &umuPath, const QStringList &prefixes, const int maxConcurrent);
+signals:
+    void prefixUpgradeStarted(const QString &prefix, const QString &runner);
+    void prefixUpgraded(const QString &prefix, const int result, const qint64 msecs);
+    void upgradesFinished(const int total, const int failed);
+};
+
+// Empties the prefixes trash off the GUI thread; deletions queue up behind each other on the one thread.
+class NeroTrashWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // stops whatever's being removed right now; the rest is picked up by the next deletion
+    std::atomic<bool> cancel { false };
+public slots:
+    void emptyTrash(const QString &prefix);
+signals:
+    void trashProgress(const QString &prefix, const qint64 files, const qint64 totalFiles);
+    void trashEmptied(const QString &prefix, const bool emptied, const bool canceled, const qint64 errors);
+};
+
 class NeroManagerWindow : public QMainWindow
 {
     Q_OBJECT
@@ -107,9 +153,24 @@ protected:
 public slots:
     void handleUmuResults(const int &, const int &);
     void handleUmuSignal(const int &);
+    void handleDiskUsage(const QString &, const QString &, const QString &);
+    void handleUpgradeStarted(const QString &, const QString &);
+    void handleUpgradeResult(const QString &, const int, const qint64);
+    void handleUpgradesFinished(const int, const int);
+    void handleTricksFinished(const int total, const int failed);
+    void handleTrashProgress(const QString &, const qint64, const qint64);
+    void handleTrashEmptied(const QString &, const bool, const bool, const qint64);
+
+signals:
+    void diskUsageRequested(const QStringList &);
+    void upgradesRequested(const QString &umuPath, const QStringList &prefixes, const int maxConcurrent);
+    void trashRequested(const QString &prefix);
 
 private slots:
     void prefixMainButtons_clicked();
+    void prefixCloneButtons_clicked();
+    void prefixExportButtons_clicked();
+    void HibernateIdlePrefixes();
     void prefixDeleteButtons_clicked();
     void prefixShortcutPlayButtons_clicked();
     void prefixShortcutEditButtons_clicked();
@@ -125,6 +186,8 @@ private slots:
 
     void on_addButton_clicked();
 
+    void on_importButton_clicked();
+
     void on_backButton_clicked();
 
     void on_prefixTricksBtn_clicked();
@@ -149,8 +212,12 @@ private:
     void SetHeader(const QString prefix = "", const unsigned int shortcutsCount = 0);
     void CheckWinetricks();
     void RenderPrefixes();
+    // restores a hibernated prefix (with progress) before it gets used; true if it's good to go
+    bool WakeHibernatedPrefix(const QString &);
+    void QueueUpgrades(const QStringList &prefixes);
+    void ShowTricksQueue();
     void RenderPrefixList();
-    void CreatePrefix(const QString &, const QString &, QStringList tricksToInstall = {});
+    void CreatePrefix(const QString &, const QString &, const QStringList &tricksToInstall = {}, const bool userLinks = false);
     void RenderShortcuts();
     void CleanupShortcuts();
     void StartBlinkTimer();
@@ -175,8 +242,30 @@ private:
     int threadsCount = 0;
     QStringList oneOffsRunning;
 
+    // prefix sizes
+    QThread diskUsageThread;
+    NeroDiskUsageWorker *diskUsageWorker;
+    QThread upgradeThread;
+    NeroUpgradeWorker *upgradeWorker;
+    // queued or running background upgrades, so the same prefix isn't queued twice
+    QStringList upgradesPending;
+    QStringList upgradesFailed;
+
+    // prefix deletions
+    QThread trashThread;
+    NeroTrashWorker *trashWorker;
+    QProgressDialog *trashProgress = nullptr;
+    QStringList trashPending;
+
+    // winetricks installs, for any number of prefixes
+    NeroTricksQueue *tricksQueue;
+    NeroTricksQueueDialog *tricksPanel = nullptr;
+
     // Prefixes list assets
     QList<QPushButton*> prefixMainButton;
+    QList<QLabel*> prefixSizeLabel;
+    QList<QPushButton*> prefixCloneButton;
+    QList<QPushButton*> prefixExportButton;
     QList<QPushButton*> prefixDeleteButton;
 
     // Prefix Shortcuts list assets
@@ -0,0 +1,381 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Declarative home manifests, applied by only doing whatever's missing.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neromanifest.h"
+#include "nerofs.h"
+#include "neroico.h"
+#include "nerorunner.h"
+#include "nerosnapshot.h"
+#include "nerotuning.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+
+#include <cmath>
+
+// ini values come back as strings, so compare them the same way
+static QVariant FromJson(const QJsonValue &value)
+{
+    if(value.isBool())
+        return value.toBool();
+    else if(value.isDouble()) {
+        const double number = value.toDouble();
+        if(std::floor(number) == number && std::abs(number) < 1e9)
+            return (int)number;
+        return number;
+    } else if(value.isArray()) {
+        QStringList list;
+        for(const QJsonValue &item : value.toArray())
+            list << item.toVariant().toString();
+        return list;
+    } else if(value.isString())
+        return value.toString();
+    return QVariant();
+}
+
+static bool Matches(const QVariant &stored, const QVariant &wanted)
+{
+    if(wanted.userType() == QMetaType::QStringList)
+        return stored.toStringList() == wanted.toStringList();
+    return stored.isValid() && stored.toString() == wanted.toString();
+}
+
+static QMap<QString, QVariant> SettingsFromJson(const QJsonObject &object)
+{
+    QMap<QString, QVariant> settings;
+    for(auto it = object.constBegin(); it != object.constEnd(); ++it)
+        if(!it.value().isNull())
+            settings[it.key()] = FromJson(it.value());
+    return settings;
+}
+
+// "D", "d" and "d:" are all drive d:
+static QString DriveLetter(QString letter)
+{
+    letter = letter.toLower();
+    if(letter.endsWith(':')) letter.chop(1);
+    if(letter.length() != 1 || letter.at(0) < 'a' || letter.at(0) > 'z')
+        return QString();
+    return letter + ':';
+}
+
+static QString IconCachePath(const QString &prefixPath, const QString &shortcutName, const QString &hash)
+{
+    return prefixPath + "/.icoCache/" + shortcutName + '-' + hash + ".png";
+}
+
+static bool IconOutdated(const QString &icon, const QString &cachedPath)
+{
+    if(icon.isEmpty())
+        return false;
+    const QFileInfo cached(cachedPath);
+    return !cached.exists() || QFileInfo(icon).lastModified() > cached.lastModified();
+}
+
+// shortcut name -> hash
+static QMap<QString, QString> ShortcutHashes(QSettings &cfg)
+{
+    QMap<QString, QString> hashes;
+    cfg.beginGroup("Shortcuts");
+    for(const QString &hash : cfg.childKeys())
+        hashes[cfg.value(hash).toString()] = hash;
+    cfg.endGroup();
+    return hashes;
+}
+
+QStringList NeroManifest::Plan::Describe() const
+{
+    QStringList lines;
+    if(create) lines << "create prefix";
+    for(auto it = settings.constBegin(); it != settings.constEnd(); ++it)
+        lines << QString("set %1 = %2").arg(it.key(), it.value().userType() == QMetaType::QStringList ?
+                                                      it.value().toStringList().join(", ") : it.value().toString());
+    if(!verbs.isEmpty()) lines << "install " + verbs.join(", ");
+    for(auto it = drives.constBegin(); it != drives.constEnd(); ++it)
+        lines << (it.value().isEmpty() ? "remove drive " + it.key() : QString("map drive %1 to %2").arg(it.key(), it.value()));
+    for(const Shortcut &shortcut : shortcuts)
+        lines << "update shortcut " + shortcut.name;
+    for(const QString &note : notes)
+        lines << "note: " + note;
+    return lines;
+}
+
+bool NeroManifest::Load(const QString &manifestPath, QList<Prefix> &prefixes)
+{
+    QFile file(manifestPath);
+    if(!file.open(QIODevice::ReadOnly)) {
+        printf("Couldn't open %s!\n", manifestPath.toLocal8Bit().constData());
+        return false;
+    }
+    QJsonParseError error;
+    const QJsonDocument manifest = QJsonDocument::fromJson(file.readAll(), &error);
+    if(manifest.isNull() || !manifest.isObject()) {
+        printf("%s isn't a valid manifest: %s (at offset %d)\n", manifestPath.toLocal8Bit().constData(),
+               error.errorString().toLocal8Bit().constData(), (int)error.offset);
+        return false;
+    }
+
+    const QJsonObject prefixesObject = manifest.object().value("prefixes").toObject();
+    for(auto it = prefixesObject.constBegin(); it != prefixesObject.constEnd(); ++it) {
+        const QJsonObject object = it.value().toObject();
+        Prefix prefix;
+        prefix.name = it.key();
+        if(prefix.name.isEmpty() || prefix.name.contains('/') || prefix.name.startsWith('.')) {
+            printf("\"%s\" isn't a valid prefix name!\n", prefix.name.toLocal8Bit().constData());
+            return false;
+        }
+        prefix.runner = object.value("runner").toString();
+        for(const QJsonValue &verb : object.value("verbs").toArray())
+            if(!verb.toString().isEmpty())
+                prefix.verbs << verb.toString();
+        prefix.verbs.removeDuplicates();
+        prefix.userLinks = object.value("userLinks").toBool();
+        prefix.settings = SettingsFromJson(object.value("settings").toObject());
+
+        const QJsonObject drives = object.value("drives").toObject();
+        for(auto drive = drives.constBegin(); drive != drives.constEnd(); ++drive) {
+            const QString letter = DriveLetter(drive.key());
+            // c: is the prefix itself
+            if(letter.isEmpty() || letter == "c:") {
+                printf("%s: \"%s\" isn't a usable drive letter!\n", prefix.name.toLocal8Bit().constData(), drive.key().toLocal8Bit().constData());
+                return false;
+            }
+            const QString path = drive.value().toString();
+            if(!path.isEmpty() && !QFileInfo(path).isDir()) {
+                printf("%s: drive %s points to %s, which isn't a directory!\n", prefix.name.toLocal8Bit().constData(),
+                       letter.toLocal8Bit().constData(), path.toLocal8Bit().constData());
+                return false;
+            }
+            prefix.drives[letter] = path;
+        }
+
+        const QJsonObject shortcuts = object.value("shortcuts").toObject();
+        for(auto entry = shortcuts.constBegin(); entry != shortcuts.constEnd(); ++entry) {
+            const QJsonObject shortcutObject = entry.value().toObject();
+            Shortcut shortcut;
+            shortcut.name = entry.key();
+            shortcut.path = shortcutObject.value("path").toString();
+            shortcut.icon = shortcutObject.value("icon").toString();
+            shortcut.settings = SettingsFromJson(shortcutObject.value("settings").toObject());
+            if(shortcut.name.isEmpty() || shortcut.name.contains('/')) {
+                printf("%s: \"%s\" isn't a valid shortcut name!\n", prefix.name.toLocal8Bit().constData(), shortcut.name.toLocal8Bit().constData());
+                return false;
+            }
+            prefix.shortcuts << shortcut;
+        }
+
+        prefixes << prefix;
+    }
+
+    return true;
+}
+
+NeroManifest::Plan NeroManifest::Diff(const Prefix &prefix)
+{
+    Plan plan;
+    const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix.name;
+
+    // everything's missing, so no need to look any closer
+    if(!QFileInfo::exists(prefixPath + "/nero-settings.ini")) {
+        plan.create = true;
+        plan.settings = prefix.settings;
+        for(auto it = prefix.drives.constBegin(); it != prefix.drives.constEnd(); ++it)
+            if(!it.value().isEmpty())
+                plan.drives[it.key()] = it.value();
+        plan.shortcuts = prefix.shortcuts;
+        return plan;
+    }
+
+    QSettings cfg(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+    cfg.beginGroup("PrefixSettings");
+    if(!prefix.runner.isEmpty() && cfg.value("CurrentRunner").toString() != prefix.runner)
+        plan.settings["CurrentRunner"] = prefix.runner;
+    for(auto it = prefix.settings.constBegin(); it != prefix.settings.constEnd(); ++it)
+        if(!Matches(cfg.value(it.key()), it.value()))
+            plan.settings[it.key()] = it.value();
+    const bool hibernated = cfg.value("Hibernated", false).toBool();
+    cfg.endGroup();
+
+    // a hibernated prefix is just its settings & icons until it's woken up,
+    // and waking every one of them just to check would defeat the point
+    if(hibernated) {
+        if(!prefix.verbs.isEmpty() || !prefix.drives.isEmpty())
+            plan.notes << "hibernated, so its verbs & drives weren't checked";
+    } else {
+        if(!prefix.verbs.isEmpty()) {
+            QStringList installed;
+            QFile winetricksLog(prefixPath + "/winetricks.log");
+            if(winetricksLog.open(QIODevice::ReadOnly | QIODevice::Text))
+                while(!winetricksLog.atEnd())
+                    installed << winetricksLog.readLine().trimmed();
+            for(const QString &verb : prefix.verbs)
+                if(!installed.contains(verb))
+                    plan.verbs << verb;
+        }
+
+        for(auto it = prefix.drives.constBegin(); it != prefix.drives.constEnd(); ++it) {
+            const QFileInfo link(prefixPath + "/dosdevices/" + it.key());
+            if(it.value().isEmpty()) {
+                if(link.isSymLink())
+                    plan.drives[it.key()] = QString();
+            } else if(!link.isSymLink() || link.canonicalFilePath() != QDir(it.value()).canonicalPath())
+                plan.drives[it.key()] = it.value();
+        }
+    }
+
+    const QMap<QString, QString> hashes = ShortcutHashes(cfg);
+    for(const Shortcut &shortcut : prefix.shortcuts) {
+        const QString hash = hashes.value(shortcut.name);
+        if(hash.isEmpty()) {
+            plan.shortcuts << shortcut;
+            continue;
+        }
+        cfg.beginGroup("Shortcuts--" + hash);
+        bool changed = !shortcut.path.isEmpty() && cfg.value("Path").toString() != shortcut.path;
+        for(auto it = shortcut.settings.constBegin(); !changed && it != shortcut.settings.constEnd(); ++it)
+            changed = !Matches(cfg.value(it.key()), it.value());
+        cfg.endGroup();
+        if(changed || IconOutdated(shortcut.icon, IconCachePath(prefixPath, shortcut.name, hash)))
+            plan.shortcuts << shortcut;
+    }
+
+    return plan;
+}
+
+int NeroManifest::Apply(const QString &umuPath, const Prefix &prefix, const Plan &plan, const int templateMode,
+                        const int snapshotsToKeep, const std::function<bool(const QString &)> &status)
+{
+    const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix.name;
+    int result = 0;
+    int failed = 0;
+
+    // Verbs, relinked drives and settings/icons written from under a running prefix (or into a hibernated stub,
+    // while a wake could be copying it) don't end up where they should, so those have to be dealt with first.
+    if(!plan.create) {
+        if(NeroFS::IsPrefixHibernated(prefix.name)) {
+            printf("%s is hibernated, wake it up before applying the manifest to it.\n", prefix.name.toLocal8Bit().constData());
+            return -1;
+        }
+        if(!NeroTuning::FindPrefixProcesses(prefixPath).isEmpty()) {
+            printf("%s is still running, close it before applying the manifest to it.\n", prefix.name.toLocal8Bit().constData());
+            return -1;
+        }
+    }
+
+    if(plan.create) {
+        result = NeroRunner::CreatePrefix(umuPath, prefix.name, prefix.runner, prefix.verbs, templateMode, prefix.userLinks, status);
+        if(!QFileInfo::exists(prefixPath + "/nero-settings.ini"))
+            return result ? result : -1;
+    }
+
+    QSettings cfg(prefixPath + "/nero-settings.ini", QSettings::IniFormat);
+    if(!plan.settings.isEmpty()) {
+        if(status && !status("Updating settings...")) return -1;
+        cfg.beginGroup("PrefixSettings");
+        for(auto it = plan.settings.constBegin(); it != plan.settings.constEnd(); ++it)
+            cfg.setValue(it.key(), it.value());
+        cfg.endGroup();
+        cfg.sync();
+    }
+
+    if(!plan.verbs.isEmpty()) {
+        // verbs can't be uninstalled (and some half-install on failure), so keep a way back
+        if(snapshotsToKeep > 0) {
+            if(status && !status("Taking a snapshot...")) return -1;
+            NeroSnapshot::Stats stats;
+            if(NeroSnapshot::Create(prefixPath, NeroFS::GetSnapshotsPath(prefix.name), "Before installing " + plan.verbs.join(", "), stats))
+                NeroSnapshot::Prune(NeroFS::GetSnapshotsPath(prefix.name), snapshotsToKeep);
+            else printf("Couldn't snapshot %s before installing verbs, installing anyway...\n", prefix.name.toLocal8Bit().constData());
+        }
+        const QString runner = cfg.value("PrefixSettings/CurrentRunner").toString();
+        const int verbResult = NeroRunner::InstallVerbs(umuPath, prefixPath, NeroFS::GetProtonsPath()->path() + '/' + runner, plan.verbs, status);
+        if(verbResult != 0 && result == 0)
+            result = verbResult;
+    }
+
+    if(!plan.drives.isEmpty()) {
+        if(status && !status("Updating drives...")) return -1;
+        QDir().mkpath(prefixPath + "/dosdevices");
+        for(auto it = plan.drives.constBegin(); it != plan.drives.constEnd(); ++it) {
+            const QString linkPath = prefixPath + "/dosdevices/" + it.key();
+            const QFileInfo link(linkPath);
+            // only ever replace links, never something real that happens to be there
+            if(link.isSymLink())
+                QFile::remove(linkPath);
+            else if(link.exists()) {
+                failed++;
+                continue;
+            }
+            if(!it.value().isEmpty() && !QFile::link(QDir(it.value()).canonicalPath(), linkPath))
+                failed++;
+        }
+    }
+
+    if(!plan.shortcuts.isEmpty()) {
+        if(status && !status("Updating shortcuts...")) return -1;
+        QMap<QString, QString> hashes = ShortcutHashes(cfg);
+        for(const Shortcut &shortcut : plan.shortcuts) {
+            QString hash = hashes.value(shortcut.name);
+            if(hash.isEmpty()) {
+                // named after the shortcut (rather than random like the GUI), so it comes out the same every time
+                QByteArray seed = prefix.name.toUtf8() + '/' + shortcut.name.toUtf8();
+                hash = QCryptographicHash::hash(seed, QCryptographicHash::Md5).toHex();
+                while(hashes.values().contains(hash)) {
+                    seed.append('_');
+                    hash = QCryptographicHash::hash(seed, QCryptographicHash::Md5).toHex();
+                }
+                hashes[shortcut.name] = hash;
+                cfg.setValue("Shortcuts/" + hash, shortcut.name);
+                cfg.beginGroup("Shortcuts--" + hash);
+                cfg.setValue("Name", shortcut.name);
+                cfg.setValue("LimitFPS", 0);
+                cfg.setValue("IgnoreGlobalDLLs", false);
+            } else cfg.beginGroup("Shortcuts--" + hash);
+
+            if(!shortcut.path.isEmpty())
+                cfg.setValue("Path", shortcut.path);
+            for(auto it = shortcut.settings.constBegin(); it != shortcut.settings.constEnd(); ++it)
+                cfg.setValue(it.key(), it.value());
+            cfg.endGroup();
+
+            const QString cachedIcon = IconCachePath(prefixPath, shortcut.name, hash);
+            if(IconOutdated(shortcut.icon, cachedIcon)) {
+                QDir(prefixPath).mkdir(".icoCache");
+                // exes/dlls/icos get their icon pulled out like the GUI does, anything else is read as an image
+                QImage icon = NeroIcoExtractor::ExtractIcon(shortcut.icon);
+                if(icon.isNull())
+                    icon.load(shortcut.icon);
+                if(icon.isNull() || !icon.save(cachedIcon, "PNG"))
+                    failed++;
+            }
+        }
+        cfg.sync();
+    }
+
+    if(failed)
+        printf("%s: %d drive(s)/icon(s) couldn't be set up.\n", prefix.name.toLocal8Bit().constData(), failed);
+    return result ? result : (failed ? -1 : 0);
+}
@@ -0,0 +1,84 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Declarative home manifests, applied by only doing whatever's missing.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROMANIFEST_H
+#define NEROMANIFEST_H
+
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include <functional>
+
+class NeroManifest
+{
+public:
+    struct Shortcut {
+        QString name;
+        QString path;
+        // an .exe/.dll/.ico to pull the icon out of, or any image Qt can read; cached as the shortcut's png
+        QString icon;
+        QMap<QString, QVariant> settings;
+    };
+
+    struct Prefix {
+        QString name;
+        // empty = whatever it has now (or the first installed runner, for new prefixes)
+        QString runner;
+        QStringList verbs;
+        // only used when the prefix is created
+        bool userLinks = false;
+        // PrefixSettings keys, as in nero-settings.ini
+        QMap<QString, QVariant> settings;
+        // drive letter (e.g. "d:") -> directory; an empty directory removes the drive
+        QMap<QString, QString> drives;
+        QList<Shortcut> shortcuts;
+    };
+
+    // What's needed to bring a prefix in line with the manifest.
+    struct Plan {
+        bool create = false;
+        QMap<QString, QVariant> settings;
+        QStringList verbs;
+        QMap<QString, QString> drives;
+        // new shortcuts, or ones with a different path/settings/icon
+        QList<Shortcut> shortcuts;
+        // things that couldn't be checked, e.g. for hibernated prefixes
+        QStringList notes;
+
+        bool IsEmpty() const { return !create && settings.isEmpty() && verbs.isEmpty() && drives.isEmpty() && shortcuts.isEmpty(); }
+        QStringList Describe() const;
+    };
+
+    // The manifest is JSON, as { "prefixes": { "Name": { "runner", "verbs", "userLinks", "settings", "drives",
+    // "shortcuts": { "Name": { "path", "icon", "settings" } } } } }; everything past the prefix name is optional.
+    static bool Load(const QString &manifestPath, QList<Prefix> &prefixes);
+    // Only reads the prefix's ini, winetricks.log & dosdevices links, so an up-to-date home is cheap to check.
+    static Plan Diff(const Prefix &prefix);
+    // Blocking & thread-safe, so separate prefixes can be applied at once. umuPath is only needed when the plan
+    // creates the prefix or installs verbs; prefix.runner has to be filled in for new prefixes. Like the tricks window,
+    // a snapshot is taken before installing verbs when snapshotsToKeep > 0. status is called every so often with
+    // what's going on; return false to abort. Returns 0 if everything in the plan was done.
+    static int Apply(const QString &umuPath, const Prefix &prefix, const Plan &plan, const int templateMode,
+                     const int snapshotsToKeep, const std::function<bool(const QString &)> &status = nullptr);
+};
+
+#endif // NEROMANIFEST_H
@@ -19,11 +19,15 @@
 
 #include "neropreferences.h"
 #include "ui_neropreferences.h"
+#include "nerodedup.h"
 #include "nerofs.h"
+#include "nerosysinfo.h"
 
 #include <QShortcut>
 #include <QFileDialog>
+#include <QMessageBox>
 #include <QProcess>
+#include <QProgressDialog>
 #include <QStandardPaths>
 
 NeroManagerPreferences::NeroManagerPreferences(QWidget *parent)
@@ -40,6 +44,15 @@ NeroManagerPreferences::NeroManagerPreferences(QWidget *parent)
     managerCfg = NeroFS::GetManagerCfg();
     //ui->runnerNotifs->setChecked(managerCfg->value("UseNotifier").toBool());
     ui->shortcutHide->setChecked(managerCfg->value("ShortcutHidesManager").toBool());
+    ui->prefixTemplates->setChecked(managerCfg->value("UsePrefixTemplates", true).toBool());
+    ui->prefixTemplatesPerVerbSet->setChecked(managerCfg->value("PrefixTemplatesPerVerbSet", false).toBool());
+    ui->prefixTemplatesPerVerbSet->setEnabled(ui->prefixTemplates->isChecked());
+    connect(ui->prefixTemplates, &QCheckBox::toggled, ui->prefixTemplatesPerVerbSet, &QCheckBox::setEnabled);
+    ui->clearTemplatesBtn->setEnabled(NeroFS::GetPrefixesPath()->exists(".templates"));
+    ui->autoSnapshots->setChecked(managerCfg->value("AutoSnapshots", true).toBool());
+    ui->snapshotsToKeep->setValue(managerCfg->value("SnapshotsToKeep", 5).toInt());
+    ui->hibernateAfterDays->setValue(managerCfg->value("HibernateAfterDays", 0).toInt());
+    ui->backgroundUpgrades->setChecked(managerCfg->value("BackgroundUpgrades", true).toBool());
     ui->umuPath->setText(managerCfg->value("UMUpath").toString());
     if(ui->umuPath->text().isEmpty() || ui->umuPath->text() == QStandardPaths::findExecutable("umu-run")) {
         ui->umuPath->clear();
@@ -47,6 +60,8 @@ NeroManagerPreferences::NeroManagerPreferences(QWidget *parent)
                                         QStandardPaths::findExecutable("umu-run") + ")");
         ui->umuPathClearBtn->setVisible(false);
     }
+
+    RunDoctor();
 }
 
 NeroManagerPreferences::~NeroManagerPreferences()
@@ -54,6 +69,12 @@ NeroManagerPreferences::~NeroManagerPreferences()
     if(accepted) {
         //managerCfg->setValue("UseNotifier", ui->runnerNotifs->isChecked());
         managerCfg->setValue("ShortcutHidesManager", ui->shortcutHide->isChecked());
+        managerCfg->setValue("UsePrefixTemplates", ui->prefixTemplates->isChecked());
+        managerCfg->setValue("PrefixTemplatesPerVerbSet", ui->prefixTemplatesPerVerbSet->isChecked());
+        managerCfg->setValue("AutoSnapshots", ui->autoSnapshots->isChecked());
+        managerCfg->setValue("SnapshotsToKeep", ui->snapshotsToKeep->value());
+        managerCfg->setValue("HibernateAfterDays", ui->hibernateAfterDays->value());
+        managerCfg->setValue("BackgroundUpgrades", ui->backgroundUpgrades->isChecked());
 
         if(ui->umuPath->text().isEmpty()) {
             if(!managerCfg->value("UMUpath").toString().isEmpty()) {
@@ -94,3 +115,74 @@ void NeroManagerPreferences::on_umuPath_textChanged(const QString &arg1)
     else ui->umuPathClearBtn->setVisible(true);
 }
 
+
+void NeroManagerPreferences::on_clearTemplatesBtn_clicked()
+{
+    if(NeroFS::ClearPrefixTemplates())
+        ui->clearTemplatesBtn->setEnabled(false);
+}
+
+void NeroManagerPreferences::on_dedupBtn_clicked()
+{
+    const QString home = NeroFS::GetPrefixesPath()->path();
+    QProgressDialog progressDialog("Scanning prefixes...", "Stop", 0, 0, this);
+    progressDialog.setWindowTitle("Deduplicate Prefixes");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+
+    NeroDedup::Stats stats;
+    const bool finished = NeroDedup::Run(NeroDedup::GetDedupRoots(home), home + "/.nero-dedup-state", stats,
+                                         [&progressDialog](const NeroDedup::Stats &current) {
+        switch(current.phase) {
+        case NeroDedup::PhaseScanning:
+            progressDialog.setLabelText(QString("Scanning prefixes... (%1 files)").arg(current.filesScanned));
+            break;
+        case NeroDedup::PhaseHashing:
+            progressDialog.setMaximum(current.toHash);
+            progressDialog.setValue(current.hashed);
+            progressDialog.setLabelText(QString("Looking for duplicates... (%1 of %2 files)").arg(current.hashed).arg(current.toHash));
+            break;
+        case NeroDedup::PhaseDeduplicating:
+            progressDialog.setMaximum(current.groups);
+            progressDialog.setValue(current.groupsDone);
+            progressDialog.setLabelText(QString("Sharing identical files... (%1 MiB so far)")
+                                        .arg(QString::number(current.bytesDeduped / (1024.0*1024), 'f', 1)));
+            break;
+        default: break;
+        }
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    progressDialog.close();
+
+    QMessageBox::information(this,
+                             finished ? "Deduplication Finished" : "Deduplication Stopped",
+                             QString("%1 files are now shared between prefixes, reclaiming %2 MiB.%3")
+                             .arg(stats.filesDeduped)
+                             .arg(QString::number(stats.bytesDeduped / (1024.0*1024), 'f', 1),
+                                  finished ? QString() : QString("\n\nRunning this again will pick up where it left off.")));
+}
+
+void NeroManagerPreferences::RunDoctor()
+{
+    ui->doctorList->clear();
+
+    int warnings = 0;
+    const QList<NeroSysInfo::Check> checks = NeroSysInfo::RunChecks(NeroFS::GetPrefixesPath()->path());
+    for(const NeroSysInfo::Check &check : checks) {
+        QTreeWidgetItem *item = new QTreeWidgetItem(ui->doctorList, { check.name, check.value });
+        item->setIcon(0, QIcon::fromTheme(check.ok ? "dialog-ok" : "dialog-warning"));
+        if(!check.ok) {
+            warnings++;
+            // hints are long, so they get their own (expanded) line under the check
+            QTreeWidgetItem *hint = new QTreeWidgetItem(item, { QString(), check.hint });
+            hint->setToolTip(1, check.hint);
+            item->setToolTip(1, check.hint);
+            item->setExpanded(true);
+        }
+    }
+    ui->doctorList->resizeColumnToContents(0);
+
+    if(warnings) ui->doctorSummary->setText(QString("%1 check(s) need attention.").arg(warnings));
+    else ui->doctorSummary->setText("Everything looks good!");
+}
@@ -44,10 +44,18 @@ private slots:
 
     void on_umuPath_textChanged(const QString &arg1);
 
+    void on_doctorRecheckBtn_clicked() { RunDoctor(); }
+
+    void on_clearTemplatesBtn_clicked();
+
+    void on_dedupBtn_clicked();
+
 private:
     Ui::NeroManagerPreferences *ui;
     QSettings *managerCfg;
     bool accepted = false;
+
+    void RunDoctor();
 };
 
 #endif // NEROPREFERENCES_H
@@ -0,0 +1,295 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Shared winetricks download cache, filled in ahead of verb installs.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroprefetch.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QSet>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace {
+    struct Script {
+        qint64 mtime = -1;
+        qint64 size = -1;
+        // verb -> the downloads in its load_ function, and the verbs it w_calls
+        QHash<QString, QList<NeroPrefetch::Download>> downloads;
+        QHash<QString, QStringList> calls;
+    };
+
+    std::mutex scriptsMutex;
+    QHash<QString, Script> scripts;
+
+    // keeps part files apart between concurrent Fetch calls in this process
+    std::atomic<quint32> partCounter{0};
+
+    // shell words, minus their quotes; stops at comments
+    QStringList Tokens(const QString &line)
+    {
+        QStringList tokens;
+        QString token;
+        QChar quote;
+        bool inToken = false;
+        for(const QChar c : line) {
+            if(!quote.isNull()) {
+                if(c == quote) quote = QChar();
+                else token += c;
+            } else if(c == '"' || c == '\'') {
+                quote = c;
+                inToken = true;
+            } else if(c.isSpace()) {
+                if(inToken) tokens << token;
+                token.clear();
+                inToken = false;
+            } else if(c == '#' && !inToken) {
+                break;
+            } else {
+                token += c;
+                inToken = true;
+            }
+        }
+        if(inToken) tokens << token;
+        return tokens;
+    }
+
+    Script ParseScript(const QString &path)
+    {
+        Script script;
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly))
+            return script;
+
+        // verb -> its file1 metadata, which some download lines are built from
+        QHash<QString, QString> file1;
+        QString verb;
+        QString line;
+        while(!file.atEnd()) {
+            const QString raw = QString::fromUtf8(file.readLine());
+            // functions always close at the start of a line in winetricks
+            if(raw.startsWith('}')) {
+                verb.clear();
+                line.clear();
+                continue;
+            }
+            line += raw.trimmed();
+            if(line.endsWith('\\')) {
+                line.chop(1);
+                line += ' ';
+                continue;
+            }
+            const QStringList tokens = Tokens(line);
+            line.clear();
+            if(tokens.isEmpty())
+                continue;
+
+            if(tokens.first() == "w_metadata" && tokens.count() > 1) {
+                for(const QString &token : tokens)
+                    if(token.startsWith("file1="))
+                        file1.insert(tokens.at(1), token.mid(6));
+            } else if(tokens.first().startsWith("load_") && tokens.first().endsWith("()")) {
+                verb = tokens.first().mid(5).chopped(2);
+            } else if(verb.isEmpty()) {
+                continue;
+            } else if(tokens.first() == "w_download" && tokens.count() > 1) {
+                NeroPrefetch::Download download;
+                download.verb = verb;
+                download.url = tokens.at(1);
+                download.checksum = tokens.value(2);
+                download.fileName = tokens.value(3);
+                for(QString *field : { &download.url, &download.fileName })
+                    field->replace("${file1}", file1.value(verb)).replace("$file1", file1.value(verb));
+                if(download.fileName.isEmpty())
+                    download.fileName = download.url.section('/', -1);
+                // anything else depends on what winetricks works out at runtime
+                if(!download.url.startsWith("http") || download.fileName.isEmpty() ||
+                   download.url.contains('$') || download.fileName.contains('$') || download.checksum.contains('$'))
+                    continue;
+                script.downloads[verb] << download;
+            } else if(tokens.first() == "w_call" && tokens.count() > 1 && !tokens.at(1).contains('$')) {
+                script.calls[verb] << tokens.at(1);
+            }
+        }
+        return script;
+    }
+}
+
+QString NeroPrefetch::Stats::Describe() const
+{
+    QString text = QString("%1 cached, %2 downloaded (%3 MiB)").arg(hits).arg(fetched).arg(bytes / (1024.0*1024), 0, 'f', 1);
+    if(failed)
+        text += QString(", %1 left to winetricks").arg(failed);
+    return text;
+}
+
+QList<NeroPrefetch::Download> NeroPrefetch::Resolve(const QString &winetricks, const QStringList &verbs)
+{
+    QList<Download> downloads;
+    const QFileInfo info(winetricks);
+    if(!info.exists())
+        return downloads;
+
+    std::lock_guard<std::mutex> lock(scriptsMutex);
+    Script &script = scripts[winetricks];
+    if(script.mtime != info.lastModified().toMSecsSinceEpoch() || script.size != info.size()) {
+        script = ParseScript(winetricks);
+        script.mtime = info.lastModified().toMSecsSinceEpoch();
+        script.size = info.size();
+    }
+
+    QSet<QString> seen;
+    QSet<QString> files;
+    QStringList pending = verbs;
+    while(!pending.isEmpty()) {
+        const QString verb = pending.takeFirst();
+        if(seen.contains(verb))
+            continue;
+        seen.insert(verb);
+        for(const Download &download : script.downloads.value(verb)) {
+            const QString file = download.verb + '/' + download.fileName;
+            if(!files.contains(file)) {
+                files.insert(file);
+                downloads << download;
+            }
+        }
+        pending << script.calls.value(verb);
+    }
+    return downloads;
+}
+
+bool NeroPrefetch::Fetch(const QList<Download> &downloads, const QString &cachePath, const int maxParallel,
+                         Stats &stats, const ProgressFunc &progress)
+{
+    stats = Stats();
+    stats.total = downloads.count();
+
+    QList<Download> queue;
+    for(const Download &download : downloads) {
+        // winetricks checks the sum of whatever's cached itself, so a plain existence check is enough here
+        if(QFileInfo(cachePath + '/' + download.verb + '/' + download.fileName).size() > 0)
+            stats.hits++;
+        else queue << download;
+    }
+    if(queue.isEmpty()) {
+        if(progress) progress(stats);
+        return true;
+    }
+
+    QNetworkAccessManager manager;
+    QEventLoop loop;
+    int next = 0;
+    int running = 0;
+    bool cancel = false;
+
+    std::function<void()> startNext = [&]() {
+        while(!cancel && running < qMax(1, maxParallel) && next < queue.count()) {
+            const Download download = queue.at(next++);
+            const QString target = cachePath + '/' + download.verb + '/' + download.fileName;
+            QDir().mkpath(cachePath + '/' + download.verb);
+
+            // installers can be a few hundred MB, so they're written out as they come in. Other jobs (and other
+            // Nero processes) can be fetching the same file into the same cache, so each download gets its own part file
+            auto part = std::make_shared<QFile>(QString("%1.part.%2.%3").arg(target).arg(QCoreApplication::applicationPid())
+                                                                           .arg(partCounter.fetch_add(1)));
+            if(!part->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                stats.failed++;
+                continue;
+            }
+            auto hash = std::make_shared<QCryptographicHash>(download.checksum.length() == 40 ? QCryptographicHash::Sha1
+                                                                                              : QCryptographicHash::Sha256);
+            QNetworkRequest request{QUrl(download.url)};
+            // plenty of these (e.g. aka.ms) are redirects
+            request.setAttribute(QNetworkRequest::RedirectPolicyAttribute, QNetworkRequest::NoLessSafeRedirectPolicy);
+            request.setHeader(QNetworkRequest::UserAgentHeader, "Nero-umu");
+            QNetworkReply *reply = manager.get(request);
+            running++;
+            stats.current << download.verb + '/' + download.fileName;
+
+            QObject::connect(reply, &QNetworkReply::readyRead, [reply, part, hash, &stats]() {
+                const QByteArray chunk = reply->readAll();
+                part->write(chunk);
+                hash->addData(chunk);
+                stats.bytes += chunk.size();
+            });
+            QObject::connect(reply, &QNetworkReply::finished, [&, reply, part, hash, download, target]() {
+                const QByteArray chunk = reply->readAll();
+                part->write(chunk);
+                hash->addData(chunk);
+                stats.bytes += chunk.size();
+                part->close();
+
+                bool fetched = !cancel && reply->error() == QNetworkReply::NoError;
+                if(!fetched && !cancel)
+                    printf("Couldn't prefetch %s: %s\n", download.url.toLocal8Bit().constData(), reply->errorString().toLocal8Bit().constData());
+                // a changed installer is winetricks' problem to report, not ours
+                if(fetched && !download.checksum.isEmpty() && hash->result().toHex() != download.checksum.toLower().toLatin1()) {
+                    printf("Checksum mismatch for %s, leaving it to winetricks\n", download.url.toLocal8Bit().constData());
+                    fetched = false;
+                }
+                // never replace a finished download, some winetricks run might be reading it already. QFile::rename
+                // won't overwrite, so if another job got there first, ours just gets dropped
+                if(fetched && !part->rename(target)) {
+                    fetched = QFileInfo::exists(target);
+                    part->remove();
+                }
+                if(fetched) stats.fetched++;
+                else {
+                    part->remove();
+                    stats.failed++;
+                }
+
+                stats.current.removeOne(download.verb + '/' + download.fileName);
+                running--;
+                reply->deleteLater();
+                startNext();
+                if(running == 0)
+                    loop.quit();
+            });
+        }
+    };
+
+    QTimer ticker;
+    ticker.setInterval(100);
+    QObject::connect(&ticker, &QTimer::timeout, [&]() {
+        if(progress && !progress(stats) && !cancel) {
+            cancel = true;
+            for(QNetworkReply *reply : manager.findChildren<QNetworkReply*>())
+                reply->abort();
+        }
+    });
+
+    startNext();
+    if(running > 0) {
+        ticker.start();
+        loop.exec();
+    }
+    if(progress) progress(stats);
+    return !cancel && stats.failed == 0;
+}
@@ -0,0 +1,68 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Shared winetricks download cache, filled in ahead of verb installs.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROPREFETCH_H
+#define NEROPREFETCH_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+class NeroPrefetch
+{
+public:
+    struct Download {
+        // the cache subdirectory it goes in, same as winetricks' W_PACKAGE
+        QString verb;
+        QString url;
+        // sha256 (or sha1, for some older verbs) in hex; empty if winetricks doesn't check it either
+        QString checksum;
+        QString fileName;
+    };
+
+    struct Stats {
+        int total = 0;
+        // already in the cache
+        int hits = 0;
+        int fetched = 0;
+        int failed = 0;
+        qint64 bytes = 0;
+        // downloads in flight, for progress text
+        QStringList current;
+
+        QString Describe() const;
+    };
+
+    // Called every so often from the thread Fetch was called on; return false to stop (downloads in flight get aborted).
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+
+    // Reads what verbs (and whatever they w_call) download straight from the winetricks script. Only the plain
+    // w_download lines can be known ahead of time; anything built from other variables is left to winetricks.
+    // The script's parsed once per mtime, and this is thread-safe.
+    static QList<Download> Resolve(const QString &winetricks, const QStringList &verbs);
+    // Blocking. Downloads whatever's not in cachePath yet, up to maxParallel at a time, into <cachePath>/<verb>/<file>
+    // (right where winetricks looks with W_CACHE=cachePath), checking sums before moving them into place.
+    // Runs its own event loop, so it's fine from both the GUI thread and workers; true if nothing failed.
+    static bool Fetch(const QList<Download> &downloads, const QString &cachePath, const int maxParallel,
+                      Stats &stats, const ProgressFunc &progress = nullptr);
+};
+
+#endif // NEROPREFETCH_H
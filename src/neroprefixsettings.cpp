@@ -23,11 +23,16 @@
 #include "nerodrives.h"
 #include "nerofs.h"
 #include "neroico.h"
+#include "neroregistry.h"
+#include "nerosysinfo.h"
+#include "nerotuning.h"
 
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QAction>
+#include <QInputDialog>
 #include <QProcess>
+#include <QProgressDialog>
 #include <QSpinBox>
 #include <QShortcut>
 
@@ -54,6 +59,11 @@ NeroPrefixSettingsWindow::NeroPrefixSettingsWindow(QWidget *parent, const QStrin
     ui->prefixRunner->addItems(*NeroFS::GetAvailableProtons());
     ui->prefixRunner->setCurrentText(NeroFS::GetCurrentRunner());
 
+    // GPUs are saved by PCI slot rather than index, since cards can come and go (e.g. eGPUs)
+    ui->gpuDeviceBox->setItemData(0, "auto");
+    for(const NeroSysInfo::GpuDevice &gpu : NeroSysInfo::GetGpus())
+        ui->gpuDeviceBox->addItem(NeroSysInfo::GpuLabel(gpu), gpu.pciSlot);
+
     if(shortcutHash.isEmpty()) {
         settings = NeroFS::GetCurrentPrefixSettings();
 
@@ -79,6 +89,11 @@ NeroPrefixSettingsWindow::NeroPrefixSettingsWindow(QWidget *parent, const QStrin
         ui->prefixSettings->setVisible(false);
         ui->prefixServices->setVisible(false);
         ui->nameMatchWarning->setVisible(false);
+        // wineserver is shared by everything in the prefix, so these can't be per-shortcut
+        ui->wineserverPriorityLabel->setVisible(false);
+        ui->wineserverPriorityBox->setVisible(false);
+        ui->wineserverAffinityLabel->setVisible(false);
+        ui->wineserverAffinityBox->setVisible(false);
 
         deleteShortcut = new QPushButton(QIcon::fromTheme("edit-delete"), "Delete Shortcut");
         ui->buttonBox->addButton(deleteShortcut, QDialogButtonBox::ResetRole);
@@ -122,6 +137,10 @@ NeroPrefixSettingsWindow::NeroPrefixSettingsWindow(QWidget *parent, const QStrin
         ui->toggleWaylandHDR->setEnabled(false);
     }
 
+    // show what the "fastest sync" option actually resolves to with this runner on this machine
+    UpdateSyncDetection();
+    connect(ui->prefixRunner, &QComboBox::currentTextChanged, this, &NeroPrefixSettingsWindow::UpdateSyncDetection);
+
     resValidator = new QIntValidator(0, 32767);
     ui->fsrCustomH->setValidator(resValidator);
     ui->fsrCustomW->setValidator(resValidator);
@@ -242,7 +261,22 @@ void NeroPrefixSettingsWindow::LoadSettings()
     // advanced tab
     ui->debugBox->setCurrentIndex(settings.value("DebugOutput").toInt());
     ui->fileSyncBox->setCurrentIndex(settings.value("FileSyncMode").toInt());
+    ui->niceBox->setCurrentIndex(settings.value("NiceLevel").toInt());
+    ui->schedPolicyBox->setCurrentIndex(settings.value("CpuSchedPolicy").toInt());
+    ui->ioPriorityBox->setCurrentIndex(settings.value("IoPriority").toInt());
+    ui->oomScoreBox->setCurrentIndex(settings.value("OomScoreAdj").toInt());
+    ui->wineserverPriorityBox->setCurrentIndex(settings.value("WineserverPriority").toInt());
+    ui->wineserverAffinityBox->setCurrentIndex(settings.value("WineserverAffinity").toInt());
     SetCheckboxState("ForceiGPU",            ui->toggleiGPU);
+    if(settings.value("GpuDevice").toString().isEmpty())
+        ui->gpuDeviceBox->setCurrentIndex(0);
+    else {
+        const QString gpuSlot = settings.value("GpuDevice").toString();
+        // keep a device that's currently unplugged selectable, rather than silently dropping it
+        if(ui->gpuDeviceBox->findData(gpuSlot) < 0)
+            ui->gpuDeviceBox->addItem(QString("Unavailable device @ %1").arg(gpuSlot), gpuSlot);
+        ui->gpuDeviceBox->setCurrentIndex(ui->gpuDeviceBox->findData(gpuSlot));
+    }
     SetCheckboxState("LimitGLextensions",  ui->toggleLimitGL);
     SetCheckboxState("NoD8VK",             ui->toggleNoD8VK);
     SetCheckboxState("ForceWineD3D",       ui->toggleWineD3D);
@@ -312,7 +346,8 @@ void NeroPrefixSettingsWindow::LoadSettings()
         // if value is filled, scoot comboboxes down one index
         for(const auto &child : this->findChildren<QComboBox*>())
             if(child != ui->prefixRunner &&
-               child != ui->winVerBox)
+               child != ui->winVerBox &&
+               child != ui->gpuDeviceBox)
                 if(!settings.value(child->property("isFor").toString()).toString().isEmpty())
                     child->setCurrentIndex(child->currentIndex()+1);
 
@@ -320,6 +355,15 @@ void NeroPrefixSettingsWindow::LoadSettings()
             ui->winVerBox->setCurrentIndex(-2);
         else ui->winVerBox->setCurrentText(winVersionListBackwards.at(settings.value("WindowsVersion").toInt()));
 
+        // the registry's what Wine actually goes by (and winecfg/winetricks can change it behind Nero's back),
+        // so show that rather than only what was last set here.
+        const QString exe = settings.value("Path").toString().mid(settings.value("Path").toString().lastIndexOf('/')+1);
+        const int realVersion = winVersionVerb.indexOf(NeroRegistryView::WindowsVersion(NeroFS::GetPrefixesPath()->path()+'/'+NeroFS::GetCurrentPrefix(), exe));
+        if(realVersion >= 0 && realVersion < winVersionListBackwards.count()) {
+            ui->winVerBox->setPlaceholderText("[Use Default Setting] (" + winVersionListBackwards.at(realVersion) + ')');
+            ui->winVerBox->setToolTip("Currently reported to this app: " + winVersionListBackwards.at(realVersion));
+        }
+
         // if current scaler is set as disabled due to incompatible runner, set to Normal.
         auto *model = qobject_cast<QStandardItemModel*>(ui->setScalingBox->model());
         auto *item = model->item(ui->setScalingBox->currentIndex());
@@ -358,6 +402,13 @@ void NeroPrefixSettingsWindow::LoadSettings()
 }
 
 
+void NeroPrefixSettingsWindow::UpdateSyncDetection()
+{
+    const NeroSysInfo::SyncChoice sync = NeroSysInfo::DetectFastestSync(NeroFS::GetProtonsPath()->path()+'/'+ui->prefixRunner->currentText());
+    ui->fileSyncDetected->setText(QString("Fastest sync on this system: %1\n(%2)").arg(NeroSysInfo::SyncModeName(sync.mode), sync.reason));
+}
+
+
 void NeroPrefixSettingsWindow::SetCheckboxState(const QString &varName, QCheckBox* checkBox)
 {
     if(!settings.value(varName).toString().isEmpty())
@@ -699,6 +750,84 @@ void NeroPrefixSettingsWindow::on_prefixRegeditBtn_clicked()
 }
 
 
+void NeroPrefixSettingsWindow::on_prefixSnapshotsBtn_clicked()
+{
+    const QList<NeroSnapshot::Info> snapshots = NeroSnapshot::List(NeroFS::GetSnapshotsPath(NeroFS::GetCurrentPrefix()));
+    QStringList items("Take a new snapshot now");
+    for(const NeroSnapshot::Info &info : snapshots)
+        items << QString("Restore: %1 - %2").arg(info.created.toString("yyyy-MM-dd HH:mm"), info.reason);
+
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, "Prefix Snapshots", "Snapshots of " + NeroFS::GetCurrentPrefix() + ':',
+                                                 items, 0, false, &ok);
+    if(!ok)
+        return;
+
+    const int index = items.indexOf(choice);
+    if(index == 0) {
+        const QString reason = QInputDialog::getText(this, "Take Snapshot", "Description:", QLineEdit::Normal,
+                                                     "Manual snapshot", &ok).trimmed();
+        if(!ok)
+            return;
+        if(TakeSnapshot(reason.isEmpty() ? "Manual snapshot" : reason))
+            QMessageBox::information(this, "Snapshot Taken", "A snapshot of " + NeroFS::GetCurrentPrefix() + " has been taken.");
+        else QMessageBox::warning(this, "Snapshot Failed", "A snapshot of " + NeroFS::GetCurrentPrefix() + " couldn't be taken.");
+        return;
+    }
+
+    const NeroSnapshot::Info &info = snapshots.at(index-1);
+    if(!NeroTuning::FindPrefixProcesses(NeroFS::GetPrefixesPath()->path() + '/' + NeroFS::GetCurrentPrefix()).isEmpty()) {
+        QMessageBox::warning(this, "Prefix In Use", "Close any apps running in this prefix before restoring a snapshot.");
+        return;
+    }
+    if(QMessageBox::question(this,
+                             "Restore Snapshot",
+                             QString("Roll %1 back to how it was on %2?\n\n"
+                                     "Any changes made since then (including settings) will be lost.")
+                             .arg(NeroFS::GetCurrentPrefix(), info.created.toString("yyyy-MM-dd HH:mm"))) != QMessageBox::Yes)
+        return;
+
+    QProgressDialog progressDialog("Restoring snapshot...", QString(), 0, 100, this);
+    progressDialog.setWindowTitle("Restore Snapshot");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    NeroSnapshot::Stats stats;
+    const bool restored = NeroFS::RestorePrefixSnapshot(NeroFS::GetCurrentPrefix(), info.id, stats, [&progressDialog](const NeroSnapshot::Stats &current) {
+        if(current.totalFiles)
+            progressDialog.setValue(current.files * 100 / current.totalFiles);
+        QApplication::processEvents();
+        return true;
+    });
+    progressDialog.close();
+
+    if(restored)
+        QMessageBox::information(this, "Snapshot Restored",
+                                 QString("%1 has been restored (%2 files rolled back).\n\n"
+                                         "This window will now close, so the restored settings don't get overwritten.")
+                                 .arg(NeroFS::GetCurrentPrefix()).arg(stats.filesChanged));
+    else QMessageBox::critical(this, "Restore Failed",
+                               QString("%1 files couldn't be restored.").arg(stats.errors));
+    // either way, what's shown here may not match what's on disk anymore
+    reject();
+}
+
+bool NeroPrefixSettingsWindow::TakeSnapshot(const QString &reason)
+{
+    QProgressDialog progressDialog("Taking a snapshot of " + NeroFS::GetCurrentPrefix() + "...", "Cancel", 0, 100, this);
+    progressDialog.setWindowTitle("Prefix Snapshot");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    NeroSnapshot::Stats stats;
+    const bool taken = NeroFS::SnapshotPrefix(NeroFS::GetCurrentPrefix(), reason, stats, [&progressDialog](const NeroSnapshot::Stats &current) {
+        if(current.totalFiles)
+            progressDialog.setValue(current.files * 100 / current.totalFiles);
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    progressDialog.close();
+    return taken;
+}
+
 void NeroPrefixSettingsWindow::on_prefixWinecfgBtn_clicked()
 {
     StartUmu("winecfg");
@@ -768,6 +897,15 @@ void NeroPrefixSettingsWindow::OptionSet()
 {
     if(sender()->inherits("QComboBox")) {
         QComboBox* comboBox = qobject_cast<QComboBox*>(sender());
+        // GPU box is keyed by the device's PCI slot, not the index
+        if(comboBox == ui->gpuDeviceBox) {
+            QString gpuSlot = settings.value("GpuDevice").toString();
+            if(gpuSlot.isEmpty() && currentShortcutHash.isEmpty()) gpuSlot = "auto";
+            if(comboBox->currentData().toString() != gpuSlot)
+                comboBox->setFont(boldFont);
+            else comboBox->setFont(QFont());
+            return;
+        }
         // Shortcut settings: handle "use default" (blank entry)
         if(settings.value(comboBox->property("isFor").toString()).toString().isEmpty())
             if(comboBox->currentIndex() > 0)
@@ -827,6 +965,18 @@ void NeroPrefixSettingsWindow::on_buttonBox_clicked(QAbstractButton *button)
     if(ui->buttonBox->standardButton(button) == QDialogButtonBox::Reset) {
         LoadSettings();
     } else if(ui->buttonBox->standardButton(button) == QDialogButtonBox::Save) {
+        // runner switches are the most likely thing to break a working prefix, so keep a way back
+        if(currentShortcutHash.isEmpty() && ui->prefixRunner->currentText() != settings.value("CurrentRunner").toString() &&
+           NeroFS::GetManagerCfg()->value("AutoSnapshots", true).toBool()) {
+            if(!TakeSnapshot(QString("Before switching runner from %1 to %2").arg(settings.value("CurrentRunner").toString(),
+                                                                                 ui->prefixRunner->currentText())) &&
+               QMessageBox::question(this,
+                                     "Snapshot Failed",
+                                     "A snapshot of this prefix couldn't be taken before switching runners.\n\n"
+                                     "Switch runners anyway?") != QMessageBox::Yes)
+                return;
+        }
+
         QStringList dllsToAdd;
         for(const QString &key : dllOverrides.keys()) {
             switch(dllOverrides.value(key)) {
@@ -863,6 +1013,8 @@ void NeroPrefixSettingsWindow::on_buttonBox_clicked(QAbstractButton *button)
             for(const auto &child : this->findChildren<QComboBox*>())
                 if(child->font() == boldFont)
                     NeroFS::SetCurrentPrefixCfg("PrefixSettings", child->property("isFor").toString(), child->currentIndex());
+            if(ui->gpuDeviceBox->font() == boldFont)
+                NeroFS::SetCurrentPrefixCfg("PrefixSettings", "GpuDevice", ui->gpuDeviceBox->currentData().toString());
 
             NeroFS::SetCurrentPrefixCfg("PrefixSettings", "CurrentRunner", ui->prefixRunner->currentText());
 
@@ -901,43 +1053,20 @@ void NeroPrefixSettingsWindow::on_buttonBox_clicked(QAbstractButton *button)
                         NeroFS::SetCurrentPrefixCfg("Shortcuts--"+currentShortcutHash, child->property("isFor").toString(), "");
                     else NeroFS::SetCurrentPrefixCfg("Shortcuts--"+currentShortcutHash, child->property("isFor").toString(), child->currentIndex()-1);
                 }
+            // "[Use Default Setting]" has no data, which unsets it.
+            if(ui->gpuDeviceBox->font() == boldFont)
+                NeroFS::SetCurrentPrefixCfg("Shortcuts--"+currentShortcutHash, "GpuDevice", ui->gpuDeviceBox->currentData().toString());
 
             // windows version overrides are currently a one-way op (e.g. can't be unset from the UI)
             if(ui->winVerBox->font() == boldFont) {
                 int winVerSelected = winVersionListBackwards.indexOf(ui->winVerBox->itemText(ui->winVerBox->currentIndex()));
                 NeroFS::SetCurrentPrefixCfg("Shortcuts--"+currentShortcutHash, "WindowsVersion", winVerSelected);
 
-                QDir prefixPath(NeroFS::GetPrefixesPath()->path()+'/'+NeroFS::GetCurrentPrefix());
-                if(prefixPath.exists("user.reg")) {
-                    QFile regFile(prefixPath.path()+"/user.reg");
-                    if(regFile.open(QFile::ReadWrite)) {
-                        QString newReg;
-                        QString line;
-                        const QString exe = settings.value("Path").toString().mid(settings.value("Path").toString().lastIndexOf('/')+1);
-                        const QString compareString = QString("[Software\\\\Wine\\\\AppDefaults\\\\%1]").arg(exe);
-                        bool exists = false;
-
-                        while(!regFile.atEnd()) {
-                            line = regFile.readLine();
-                            newReg.append(line);
-
-                            // winreg adds timestamp info, so just check the beginning of this line.
-                            if(line.startsWith(compareString)) {
-                                // in case this is a reg entry that's been absorbed into WinReg format (which adds timestamps)
-                                line = regFile.readLine();
-                                if(line.startsWith("#time=")) newReg.append(line), regFile.readLine();
-                                newReg.append(QString("\"Version\"=\"%1\"\n").arg(winVersionVerb.at(winVerSelected)));
-                                exists = true;
-                            }
-                        }
-
-                        if(!exists)
-                            newReg.append(QString("\n[Software\\\\Wine\\\\AppDefaults\\\\%1]\n\"Version\"=\"%2\"\n").arg(exe, winVersionVerb.at(winVerSelected)));
-
-                        regFile.resize(0);
-                        regFile.write(newReg.toUtf8());
-                        regFile.close();
-                    }
+                NeroRegistry userReg;
+                if(userReg.Open(NeroFS::GetPrefixesPath()->path()+'/'+NeroFS::GetCurrentPrefix()+"/user.reg")) {
+                    const QString exe = settings.value("Path").toString().mid(settings.value("Path").toString().lastIndexOf('/')+1);
+                    userReg.SetString("Software\\Wine\\AppDefaults\\" + exe, "Version", winVersionVerb.at(winVerSelected));
+                    userReg.Commit();
                 }
             }
 
@@ -93,14 +93,19 @@ private slots:
 
     void on_prefixWinecfgBtn_clicked();
 
+    void on_prefixSnapshotsBtn_clicked();
+
     void on_openToShortcutPath_clicked();
 
+    void UpdateSyncDetection();
+
 private:
     Ui::NeroPrefixSettingsWindow *ui;
 
     void LoadSettings();
     void AddDLL(const QString, const int);
     void StartUmu(const QString, QStringList = {});
+    bool TakeSnapshot(const QString &);
 
     void SetComboBoxItemEnabled(QComboBox * comboBox, const int index, const bool enabled) {
         auto * model = qobject_cast<QStandardItemModel*>(comboBox->model());
@@ -0,0 +1,823 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Wine registry (.reg) file indexing & streaming edits.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroregistry.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+
+#include <sys/stat.h>
+
+// Same rules as wineserver's dump_strW: backslash escapes for the usual suspects,
+// \x for anything outside of printable ASCII (always 4 digits, so the next character can't be mistaken for one).
+static QByteArray Escape(const QString &text, const char *specials)
+{
+    QByteArray escaped;
+    escaped.reserve(text.size());
+    for(const QChar &c : text) {
+        const ushort code = c.unicode();
+        if(code == '\\') escaped += "\\\\";
+        else if(code == '\n') escaped += "\\n";
+        else if(code == '\r') escaped += "\\r";
+        else if(code == '\t') escaped += "\\t";
+        else if(code == 0) escaped += "\\0";
+        else if(code < 32 || code > 127) escaped += "\\x" + QByteArray::number(code, 16).rightJustified(4, '0');
+        else {
+            if(strchr(specials, code)) escaped += '\\';
+            escaped += (char)code;
+        }
+    }
+    return escaped;
+}
+
+static QByteArray ValueLine(const QByteArray &name, const QByteArray &data)
+{
+    if(name == "@")
+        return "@=" + data + '\n';
+    return '"' + name + "\"=" + data + '\n';
+}
+
+// end of the line starting at pos (not including the newline), and where the next one starts
+static inline qint64 LineEnd(const char *data, const qint64 pos, const qint64 limit, qint64 &next)
+{
+    const char *newline = (const char*)memchr(data + pos, '\n', limit - pos);
+    if(!newline) {
+        next = limit;
+        return limit;
+    }
+    next = newline - data + 1;
+    return newline - data;
+}
+
+static inline bool ContinuesOnNextLine(const char *data, const qint64 start, qint64 end)
+{
+    if(end > start && data[end-1] == '\r') end--;
+    return end > start && data[end-1] == '\\';
+}
+
+QVector<NeroRegistry::Key> NeroRegistry::Index(const char *data, const qint64 size)
+{
+    QVector<Key> keys;
+    qint64 pos = 0, next = 0;
+    bool continued = false;
+
+    while(pos < size) {
+        const qint64 end = LineEnd(data, pos, size, next);
+        if(!continued && end > pos && data[pos] == '[') {
+            // [path] timestamp - any ']' within the path itself is escaped, but go by the last one anyway
+            qint64 close = end - 1;
+            while(close > pos && data[close] != ']') close--;
+            if(close > pos) {
+                if(!keys.isEmpty()) keys.last().end = pos;
+                Key key;
+                key.path = QByteArray(data + pos + 1, close - pos - 1);
+                key.start = pos;
+                key.bodyStart = next;
+                key.end = size;
+                keys.append(key);
+            }
+        }
+        // hex data runs on with a trailing backslash
+        continued = ContinuesOnNextLine(data, pos, end);
+        pos = next;
+    }
+
+    return keys;
+}
+
+QList<NeroRegistry::Value> NeroRegistry::ParseValues(const char *data, const Key &key, qint64 *insertAt)
+{
+    QList<Value> values;
+    qint64 pos = key.bodyStart, next = 0;
+    qint64 lastContent = key.bodyStart;
+
+    while(pos < key.end) {
+        qint64 end = LineEnd(data, pos, key.end, next);
+        if(end == pos || (end == pos + 1 && data[pos] == '\r')) {
+            pos = next;
+            continue;
+        }
+
+        Value value;
+        value.start = pos;
+        const char first = data[pos];
+        qint64 dataStart = -1;
+        if(first == '@' && end > pos + 1 && data[pos+1] == '=') {
+            value.name = "@";
+            dataStart = pos + 2;
+        } else if(first == '"') {
+            qint64 i = pos + 1;
+            while(i < end && data[i] != '"')
+                i += data[i] == '\\' ? 2 : 1;
+            if(i + 1 < end && data[i+1] == '=') {
+                value.name = QByteArray(data + pos + 1, i - pos - 1);
+                dataStart = i + 2;
+            }
+        }
+
+        while(ContinuesOnNextLine(data, pos, end) && next < key.end) {
+            pos = next;
+            end = LineEnd(data, pos, key.end, next);
+        }
+        lastContent = next;
+
+        // anything else is metadata like #time= or #class=, which stays with the key
+        if(dataStart >= 0) {
+            qint64 dataEnd = end;
+            if(dataEnd > dataStart && data[dataEnd-1] == '\r') dataEnd--;
+            value.data = QByteArray(data + dataStart, dataEnd - dataStart);
+            value.end = next;
+            values << value;
+        }
+        pos = next;
+    }
+
+    if(insertAt) *insertAt = lastContent;
+    return values;
+}
+
+QByteArray NeroRegistry::EscapeKey(const QString &key)
+{
+    return Escape(key, "[]");
+}
+
+QByteArray NeroRegistry::EscapeName(const QString &name)
+{
+    return Escape(name, "\"");
+}
+
+QByteArray NeroRegistry::QuoteString(const QString &text)
+{
+    return '"' + Escape(text, "\"") + '"';
+}
+
+QString NeroRegistry::UnquoteString(const QByteArray &data)
+{
+    if(data.size() < 2 || !data.startsWith('"') || !data.endsWith('"'))
+        return QString();
+
+    QString text;
+    for(int i = 1; i < data.size() - 1; ++i) {
+        if(data.at(i) != '\\' || i + 1 >= data.size() - 1) {
+            text += QChar((uchar)data.at(i));
+            continue;
+        }
+        const char escaped = data.at(++i);
+        if(escaped == 'n') text += '\n';
+        else if(escaped == 'r') text += '\r';
+        else if(escaped == 't') text += '\t';
+        else if(escaped == '0') text += QChar(0);
+        else if(escaped == 'x') {
+            int digits = 0;
+            ushort code = 0;
+            while(digits < 4 && i + 1 < data.size() - 1 && isxdigit((uchar)data.at(i+1)))
+                code = code * 16 + QByteArray(1, data.at(++i)).toUShort(nullptr, 16), digits++;
+            text += QChar(code);
+        } else text += QChar((uchar)escaped);
+    }
+    return text;
+}
+
+QStringList NeroRegistry::DefaultPruneKeys()
+{
+    return {
+        "Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RecentDocs",
+        "Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\ComDlg32",
+        "Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU",
+        "Software\\Microsoft\\Windows\\ShellNoRoam\\MUICache",
+        "Software\\Classes\\Local Settings\\Software\\Microsoft\\Windows\\Shell\\MuiCache"
+    };
+}
+
+// copies data[start, end) line by line, minus any #time= lines
+static void WriteWithoutTimes(QIODevice &out, const char *data, qint64 start, const qint64 end)
+{
+    qint64 next = 0;
+    qint64 run = start;
+    while(start < end) {
+        LineEnd(data, start, end, next);
+        if(end - start >= 6 && memcmp(data + start, "#time=", 6) == 0) {
+            out.write(data + run, start - run);
+            run = next;
+        }
+        start = next;
+    }
+    out.write(data + run, end - run);
+}
+
+bool NeroRegistry::Compact(const QString &path, const QStringList &pruneKeys, CompactStats &stats)
+{
+    QFile in(path);
+    if(!in.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray contents = in.readAll();
+    in.close();
+    const char *data = contents.constData();
+    const QVector<Key> keys = Index(data, contents.size());
+    stats.sizeBefore = contents.size();
+    stats.keysBefore = keys.size();
+
+    QList<QByteArray> pruned;
+    for(const QString &key : pruneKeys)
+        pruned << EscapeKey(key).toLower();
+    auto isPruned = [&pruned](const QByteArray &lowerPath) {
+        for(const QByteArray &prune : std::as_const(pruned))
+            if(lowerPath == prune || lowerPath.startsWith(prune + "\\\\"))
+                return true;
+        return false;
+    };
+
+    // every section of each key, so duplicates can be folded into the first one
+    QHash<QByteArray, QList<int>> sections;
+    for(int i = 0; i < keys.size(); ++i)
+        sections[keys.at(i).path.toLower()] << i;
+
+    QSaveFile out(path);
+    if(!out.open(QIODevice::WriteOnly))
+        return false;
+    // WINE REGISTRY Version 2, #arch and such
+    out.write(data, keys.isEmpty() ? contents.size() : keys.first().start);
+
+    for(int i = 0; i < keys.size(); ++i) {
+        const Key &key = keys.at(i);
+        const QByteArray lowerPath = key.path.toLower();
+        if(isPruned(lowerPath)) {
+            stats.keysPruned++;
+            continue;
+        }
+        const QList<int> &same = sections[lowerPath];
+        if(same.first() != i)
+            continue;
+        stats.keysAfter++;
+
+        if(same.count() == 1) {
+            WriteWithoutTimes(out, data, key.start, key.end);
+            continue;
+        }
+
+        // later sections win, same as when wineserver loads them
+        stats.duplicatesMerged += same.count() - 1;
+        QList<QByteArray> order;
+        QHash<QByteArray, QByteArray> overrides;
+        for(int j = 1; j < same.count(); ++j) {
+            for(const Value &value : ParseValues(data, keys.at(same.at(j)))) {
+                const QByteArray lowerName = value.name.toLower();
+                if(!overrides.contains(lowerName))
+                    order << lowerName;
+                overrides[lowerName] = QByteArray(data + value.start, value.end - value.start);
+            }
+        }
+
+        qint64 insertAt = 0;
+        const QList<Value> values = ParseValues(data, key, &insertAt);
+        qint64 pos = key.start;
+        for(const Value &value : values) {
+            const QByteArray lowerName = value.name.toLower();
+            if(!overrides.contains(lowerName))
+                continue;
+            WriteWithoutTimes(out, data, pos, value.start);
+            out.write(overrides.take(lowerName));
+            pos = value.end;
+        }
+        WriteWithoutTimes(out, data, pos, insertAt);
+        if(insertAt > 0 && data[insertAt-1] != '\n')
+            out.write("\n");
+        for(const QByteArray &lowerName : std::as_const(order))
+            if(overrides.contains(lowerName))
+                out.write(overrides.take(lowerName));
+        WriteWithoutTimes(out, data, insertAt, key.end);
+    }
+
+    stats.sizeAfter = out.pos();
+    if(!out.commit()) {
+        printf("Couldn't write out %s!\n", path.toLocal8Bit().constData());
+        return false;
+    }
+    return true;
+}
+
+bool NeroRegistry::CompactPrefix(const QString &prefixPath, const QStringList &pruneKeys, QList<QPair<QString, CompactStats>> &stats)
+{
+    bool compacted = true;
+    for(const QString &regFile : QStringList{ "system.reg", "user.reg", "userdef.reg" }) {
+        if(!QFileInfo::exists(prefixPath + '/' + regFile))
+            continue;
+        CompactStats fileStats;
+        if(!Compact(prefixPath + '/' + regFile, regFile == "user.reg" ? pruneKeys : QStringList(), fileStats)) {
+            printf("Couldn't compact %s!\n", regFile.toLocal8Bit().constData());
+            compacted = false;
+            continue;
+        }
+        stats << qMakePair(regFile, fileStats);
+    }
+    return compacted;
+}
+
+// FNV-1a; nothing fancy, just stable across runs & Qt versions (unlike qHash)
+static inline quint64 HashBytes(quint64 hash, const char *data, qint64 size)
+{
+    for(qint64 i = 0; i < size; ++i) {
+        hash ^= (uchar)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool NeroRegistry::TakeSnapshot(const QString &prefixPath, const QString &label, Snapshot &snapshot)
+{
+    snapshot = Snapshot();
+    snapshot.created = QDateTime::currentDateTime();
+    snapshot.id = snapshot.created.toString("yyyyMMdd-hhmmsszzz");
+    snapshot.label = label;
+
+    const QList<QPair<QString, QByteArray>> files = {
+        { "system.reg",  "HKLM\\\\" },
+        { "user.reg",    "HKCU\\\\" },
+        { "userdef.reg", "HKU\\\\.Default\\\\" }
+    };
+    bool found = false;
+    for(const auto &file : files) {
+        QFile regFile(prefixPath + '/' + file.first);
+        if(!regFile.open(QIODevice::ReadOnly))
+            continue;
+        const qint64 size = regFile.size();
+        const char *data = size > 0 ? (const char*)regFile.map(0, size) : nullptr;
+        if(!data)
+            continue;
+        found = true;
+
+        for(const Key &key : Index(data, size)) {
+            const QByteArray path = file.second + key.path;
+            // wineserver never writes a key twice, but older edits did; chaining keeps them all counted
+            quint64 hash = snapshot.keys.value(path, 0xcbf29ce484222325ULL);
+            qint64 pos = key.bodyStart, next = 0;
+            while(pos < key.end) {
+                const qint64 end = LineEnd(data, pos, key.end, next);
+                if(!(end - pos >= 6 && memcmp(data + pos, "#time=", 6) == 0))
+                    hash = HashBytes(hash, data + pos, next - pos);
+                pos = next;
+            }
+            snapshot.keys.insert(path, hash);
+        }
+    }
+    snapshot.keyCount = snapshot.keys.size();
+    return found;
+}
+
+bool NeroRegistry::SaveSnapshot(const QString &snapshotsPath, const Snapshot &snapshot)
+{
+    QDir().mkpath(snapshotsPath);
+    QSaveFile file(snapshotsPath + '/' + snapshot.id + ".regsnap");
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out << (quint32)0x4e52534e << (quint32)1 << snapshot.label << snapshot.created << (quint32)snapshot.keys.size();
+    for(auto it = snapshot.keys.constBegin(); it != snapshot.keys.constEnd(); ++it)
+        out << it.key() << it.value();
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool NeroRegistry::LoadSnapshot(const QString &snapshotFile, Snapshot &snapshot, const bool headerOnly)
+{
+    snapshot = Snapshot();
+    QFile file(snapshotFile);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version;
+    if(magic != 0x4e52534e || version != 1)
+        return false;
+    in >> snapshot.label >> snapshot.created >> count;
+    snapshot.id = QFileInfo(snapshotFile).completeBaseName();
+    snapshot.keyCount = count;
+    if(headerOnly)
+        return in.status() == QDataStream::Ok;
+
+    QByteArray path;
+    quint64 hash = 0;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        in >> path >> hash;
+        snapshot.keys.insert(path, hash);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+QList<NeroRegistry::Snapshot> NeroRegistry::ListSnapshots(const QString &snapshotsPath)
+{
+    QList<Snapshot> snapshots;
+    const QDir dir(snapshotsPath);
+    for(const QString &name : dir.entryList({ "*.regsnap" }, QDir::Files)) {
+        Snapshot snapshot;
+        if(LoadSnapshot(dir.filePath(name), snapshot, true))
+            snapshots << snapshot;
+    }
+    std::sort(snapshots.begin(), snapshots.end(), [](const Snapshot &a, const Snapshot &b) { return a.created > b.created; });
+    return snapshots;
+}
+
+int NeroRegistry::PruneSnapshots(const QString &snapshotsPath, const int keep)
+{
+    int removed = 0;
+    const QList<Snapshot> snapshots = ListSnapshots(snapshotsPath);
+    for(int i = keep; i < snapshots.count(); ++i)
+        if(QFile::remove(snapshotsPath + '/' + snapshots.at(i).id + ".regsnap"))
+            removed++;
+    return removed;
+}
+
+NeroRegistry::SnapshotDiff NeroRegistry::DiffSnapshots(const Snapshot &from, const Snapshot &to)
+{
+    SnapshotDiff diff;
+    // paths are case-insensitive, but keep the case they were written with for showing
+    QHash<QByteArray, QMap<QByteArray, quint64>::const_iterator> fromKeys;
+    fromKeys.reserve(from.keys.size());
+    for(auto it = from.keys.constBegin(); it != from.keys.constEnd(); ++it)
+        fromKeys.insert(it.key().toLower(), it);
+
+    auto display = [](const QByteArray &path) { return UnquoteString('"' + path + '"'); };
+    for(auto it = to.keys.constBegin(); it != to.keys.constEnd(); ++it) {
+        const auto old = fromKeys.find(it.key().toLower());
+        if(old == fromKeys.end())
+            diff.added << display(it.key());
+        else {
+            if(old.value().value() != it.value())
+                diff.changed << display(it.key());
+            fromKeys.erase(old);
+        }
+    }
+    for(auto it = fromKeys.constBegin(); it != fromKeys.constEnd(); ++it)
+        diff.removed << display(it.value().key());
+
+    diff.added.sort(Qt::CaseInsensitive);
+    diff.removed.sort(Qt::CaseInsensitive);
+    diff.changed.sort(Qt::CaseInsensitive);
+    return diff;
+}
+
+bool NeroRegistry::Open(const QString &path)
+{
+    filePath = path;
+    contents.clear();
+    keys.clear();
+    keyIndex.clear();
+    pending.clear();
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    contents = file.readAll();
+
+    keys = Index(contents.constData(), contents.size());
+    keyIndex.reserve(keys.size());
+    for(int i = 0; i < keys.size(); ++i)
+        keyIndex.insert(keys.at(i).path.toLower(), i);
+    return true;
+}
+
+bool NeroRegistry::HasKey(const QString &key) const
+{
+    return keyIndex.contains(EscapeKey(key).toLower());
+}
+
+QByteArray NeroRegistry::GetValue(const QString &key, const QString &name) const
+{
+    const int index = keyIndex.value(EscapeKey(key).toLower(), -1);
+    if(index < 0)
+        return QByteArray();
+
+    const QByteArray wanted = (name == "@" ? QByteArray("@") : EscapeName(name)).toLower();
+    for(const Value &value : ParseValues(contents.constData(), keys.at(index)))
+        if(value.name.toLower() == wanted)
+            return value.data;
+    return QByteArray();
+}
+
+NeroRegistry::PendingKey& NeroRegistry::Pending(const QString &key)
+{
+    const QByteArray path = EscapeKey(key);
+    PendingKey &edit = pending[path.toLower()];
+    if(edit.path.isEmpty())
+        edit.path = path;
+    return edit;
+}
+
+void NeroRegistry::SetValue(const QString &key, const QString &name, const QByteArray &data)
+{
+    PendingKey &edit = Pending(key);
+    const QByteArray escapedName = name == "@" ? QByteArray("@") : EscapeName(name);
+    for(auto &value : edit.values) {
+        if(value.first.toLower() == escapedName.toLower()) {
+            value.second = data.isNull() ? QByteArray("") : data;
+            return;
+        }
+    }
+    edit.values.append({ escapedName, data.isNull() ? QByteArray("") : data });
+}
+
+void NeroRegistry::SetDword(const QString &key, const QString &name, const quint32 number)
+{
+    SetValue(key, name, "dword:" + QByteArray::number(number, 16).rightJustified(8, '0'));
+}
+
+void NeroRegistry::DeleteValue(const QString &key, const QString &name)
+{
+    PendingKey &edit = Pending(key);
+    const QByteArray escapedName = name == "@" ? QByteArray("@") : EscapeName(name);
+    for(auto &value : edit.values) {
+        if(value.first.toLower() == escapedName.toLower()) {
+            value.second = QByteArray();
+            return;
+        }
+    }
+    edit.values.append({ escapedName, QByteArray() });
+}
+
+void NeroRegistry::DeleteKey(const QString &key)
+{
+    const QByteArray lowerPath = EscapeKey(key).toLower();
+    // anything queued up for subkeys is moot now
+    for(auto it = pending.begin(); it != pending.end();) {
+        if(it.key().startsWith(lowerPath + "\\\\"))
+            it = pending.erase(it);
+        else ++it;
+    }
+
+    PendingKey &edit = Pending(key);
+    edit.remove = true;
+    edit.values.clear();
+}
+
+bool NeroRegistry::Commit()
+{
+    if(pending.isEmpty())
+        return true;
+
+    // a byte range of the old file to replace (or just an insertion, with no length)
+    struct Span {
+        qint64 offset;
+        qint64 length;
+        QByteArray text;
+    };
+    QList<Span> spans;
+    QByteArray appended;
+    const char *data = contents.constData();
+    const QByteArray timestamp = QByteArray::number(QDateTime::currentSecsSinceEpoch());
+
+    auto removedWithParent = [this](const QByteArray &lowerPath) {
+        for(auto it = pending.constBegin(); it != pending.constEnd(); ++it)
+            if(it.value().remove && lowerPath.startsWith(it.key() + "\\\\"))
+                return true;
+        return false;
+    };
+
+    for(auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        const PendingKey &edit = it.value();
+        const bool parentRemoved = removedWithParent(it.key());
+
+        if(edit.remove && !parentRemoved) {
+            for(const Key &key : std::as_const(keys)) {
+                const QByteArray lowerPath = key.path.toLower();
+                if(lowerPath == it.key() || lowerPath.startsWith(it.key() + "\\\\"))
+                    spans.append({ key.start, key.end - key.start, QByteArray() });
+            }
+        }
+
+        const int index = keyIndex.value(it.key(), -1);
+        if(index >= 0 && !edit.remove && !parentRemoved) {
+            qint64 insertAt = 0;
+            const QList<Value> values = ParseValues(data, keys.at(index), &insertAt);
+            QByteArray inserted;
+            for(const auto &value : edit.values) {
+                const QByteArray lowerName = value.first.toLower();
+                bool found = false;
+                for(const Value &existing : values) {
+                    if(existing.name.toLower() != lowerName)
+                        continue;
+                    // any duplicates of it go too
+                    spans.append({ existing.start, existing.end - existing.start,
+                                   found || value.second.isNull() ? QByteArray() : ValueLine(value.first, value.second) });
+                    found = true;
+                }
+                if(!found && !value.second.isNull())
+                    inserted += ValueLine(value.first, value.second);
+            }
+            if(!inserted.isEmpty()) {
+                if(insertAt > 0 && data[insertAt-1] != '\n')
+                    inserted.prepend('\n');
+                spans.append({ insertAt, 0, inserted });
+            }
+        } else {
+            QByteArray section;
+            for(const auto &value : edit.values)
+                if(!value.second.isNull())
+                    section += ValueLine(value.first, value.second);
+            if(!section.isEmpty())
+                appended += "\n[" + edit.path + "] " + timestamp + '\n' + section;
+        }
+    }
+
+    // brand new keys go at the end; wineserver sorts everything out the next time it saves
+    if(!appended.isEmpty()) {
+        if(!contents.isEmpty() && !contents.endsWith('\n'))
+            appended.prepend('\n');
+        spans.append({ contents.size(), 0, appended });
+    }
+
+    std::stable_sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.offset < b.offset; });
+
+    QSaveFile out(filePath);
+    if(!out.open(QIODevice::WriteOnly))
+        return false;
+
+    qint64 pos = 0;
+    for(const Span &span : std::as_const(spans)) {
+        if(span.offset < pos) {
+            printf("Overlapping edits to %s, leaving it alone!\n", filePath.toLocal8Bit().constData());
+            out.cancelWriting();
+            return false;
+        }
+        out.write(data + pos, span.offset - pos);
+        out.write(span.text);
+        pos = span.offset + span.length;
+    }
+    out.write(data + pos, contents.size() - pos);
+
+    if(!out.commit()) {
+        printf("Couldn't write out %s!\n", filePath.toLocal8Bit().constData());
+        return false;
+    }
+
+    // pick up the new layout, so this can keep being used
+    return Open(filePath);
+}
+
+NeroRegistryView::NeroRegistryView(const QString &path) : filePath(path), file(path)
+{
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    // go by the file that's actually open, in case wineserver swaps in a new one meanwhile
+    struct stat info;
+    if(fstat(file.handle(), &info) != 0 || info.st_size <= 0)
+        return;
+    size = info.st_size;
+    mtime = (qint64)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    data = (const char*)file.map(0, size);
+}
+
+const NeroRegistryView::IndexData& NeroRegistryView::GetIndex() const
+{
+    if(index)
+        return *index;
+
+    static std::mutex cacheMutex;
+    static QHash<QString, std::shared_ptr<const IndexData>> cache;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        const auto cached = cache.value(filePath);
+        if(cached && cached->mtime == mtime && cached->size == size) {
+            index = cached;
+            return *index;
+        }
+    }
+
+    auto fresh = std::make_shared<IndexData>();
+    fresh->mtime = mtime;
+    fresh->size = size;
+    if(data)
+        fresh->keys = NeroRegistry::Index(data, size);
+    fresh->lookup.reserve(fresh->keys.size());
+    for(int i = 0; i < fresh->keys.size(); ++i)
+        fresh->lookup.insert(fresh->keys.at(i).path.toLower(), i);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.insert(filePath, fresh);
+    index = fresh;
+    return *index;
+}
+
+const NeroRegistry::Key* NeroRegistryView::FindKey(const QString &key) const
+{
+    if(!data)
+        return nullptr;
+    const IndexData &current = GetIndex();
+    const int i = current.lookup.value(NeroRegistry::EscapeKey(key).toLower(), -1);
+    return i < 0 ? nullptr : &current.keys.at(i);
+}
+
+bool NeroRegistryView::HasKey(const QString &key) const
+{
+    return FindKey(key) != nullptr;
+}
+
+QStringList NeroRegistryView::SubKeys(const QString &key) const
+{
+    QStringList subKeys;
+    if(!data)
+        return subKeys;
+
+    const QByteArray parent = NeroRegistry::EscapeKey(key).toLower() + "\\\\";
+    for(const NeroRegistry::Key &entry : GetIndex().keys) {
+        if(entry.path.size() <= parent.size() || entry.path.left(parent.size()).toLower() != parent)
+            continue;
+        const QByteArray rest = entry.path.mid(parent.size());
+        // the tree isn't always written out level by level, so go by the first component only
+        const QString name = NeroRegistry::UnquoteString('"' + rest.left(rest.indexOf("\\\\")) + '"');
+        if(!subKeys.contains(name, Qt::CaseInsensitive))
+            subKeys << name;
+    }
+    return subKeys;
+}
+
+QList<NeroRegistry::Value> NeroRegistryView::Values(const QString &key) const
+{
+    const NeroRegistry::Key *entry = FindKey(key);
+    return entry ? NeroRegistry::ParseValues(data, *entry) : QList<NeroRegistry::Value>();
+}
+
+QByteArray NeroRegistryView::GetValue(const QString &key, const QString &name) const
+{
+    const QByteArray wanted = (name == "@" ? QByteArray("@") : NeroRegistry::EscapeName(name)).toLower();
+    for(const NeroRegistry::Value &value : Values(key))
+        if(value.name.toLower() == wanted)
+            return value.data;
+    return QByteArray();
+}
+
+qint64 NeroRegistryView::GetDword(const QString &key, const QString &name) const
+{
+    const QByteArray value = GetValue(key, name);
+    if(!value.startsWith("dword:"))
+        return -1;
+    bool ok = false;
+    const qint64 number = value.mid(6).toLongLong(&ok, 16);
+    return ok ? number : -1;
+}
+
+QString NeroRegistryView::WindowsVersion(const QString &prefixPath, const QString &exe)
+{
+    {
+        const NeroRegistryView userReg(prefixPath + "/user.reg");
+        QString version;
+        if(!exe.isEmpty())
+            version = userReg.GetString("Software\\Wine\\AppDefaults\\" + exe, "Version");
+        if(version.isEmpty())
+            version = userReg.GetString("Software\\Wine", "Version");
+        if(!version.isEmpty())
+            return version.toLower();
+    }
+
+    const NeroRegistryView systemReg(prefixPath + "/system.reg");
+    const QString currentVersion = "Software\\Microsoft\\Windows NT\\CurrentVersion";
+    if(!systemReg.HasKey(currentVersion))
+        return QString();
+
+    const bool server = systemReg.GetString(currentVersion, "ProductName").contains("Server");
+    const qint64 major = systemReg.GetDword(currentVersion, "CurrentMajorVersionNumber");
+    int build = systemReg.GetString(currentVersion, "CurrentBuildNumber").toInt();
+    if(!build) build = systemReg.GetString(currentVersion, "CurrentBuild").toInt();
+
+    // Windows 10 & 11 still claim to be 6.3 here for old apps' sake, so the major version number comes first
+    if(major >= 10)
+        return build >= 22000 ? "win11" : "win10";
+
+    const QString version = systemReg.GetString(currentVersion, "CurrentVersion");
+    if(version == "6.3") return "win81";
+    else if(version == "6.2") return "win8";
+    else if(version == "6.1") return server ? "win2008r2" : "win7";
+    else if(version == "6.0") return server ? "win2008" : "winvista";
+    else if(version == "5.2") return server ? "win2003" : "winxp64";
+    else if(version == "5.1") return "winxp";
+    else if(version == "5.0") return "win2k";
+    else if(version == "4.0") return "nt40";
+    else if(version == "3.51") return "nt351";
+    return QString();
+}
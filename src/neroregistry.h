@@ -0,0 +1,204 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Wine registry (.reg) file indexing & streaming edits.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROREGISTRY_H
+#define NEROREGISTRY_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+class NeroRegistry
+{
+public:
+    // Where one [key] section sits in the file. Paths are as written, i.e. with doubled backslashes.
+    struct Key {
+        QByteArray path;
+        // the '[' of the header line
+        qint64 start = 0;
+        // first line after the header
+        qint64 bodyStart = 0;
+        // start of the next section (or the end of the file)
+        qint64 end = 0;
+    };
+
+    // One "name"=data entry (including any continuation lines) within a key's section.
+    struct Value {
+        // as written between the quotes (still escaped), or @ for the default value
+        QByteArray name;
+        // everything after the '=', continuation lines and all
+        QByteArray data;
+        qint64 start = 0;
+        qint64 end = 0;
+    };
+
+    // Finds every section in raw .reg contents, in file order. Only looks at line starts, so it's a single cheap pass.
+    static QVector<Key> Index(const char *data, const qint64 size);
+    // Values of the section at key, in file order; insertAt is set to where new values would go (after the last one).
+    static QList<Value> ParseValues(const char *data, const Key &key, qint64 *insertAt = nullptr);
+
+    struct CompactStats {
+        qint64 sizeBefore = 0;
+        qint64 sizeAfter = 0;
+        int keysBefore = 0;
+        int keysAfter = 0;
+        // sections for the same key written out more than once (e.g. by older AppDefaults edits)
+        int duplicatesMerged = 0;
+        int keysPruned = 0;
+    };
+
+    // MRU lists & shell caches that only ever grow, and that nothing misses when they're gone (all under HKCU, so
+    // they're only meant for user.reg; other hives can have unrelated keys by the same path).
+    static QStringList DefaultPruneKeys();
+    // Rewrites a .reg file without duplicate sections (merged into the first, later values winning), without the given
+    // subtrees, and without the #time lines (the header's timestamp is enough for Wine). Same single pass & atomic
+    // commit as edits; only for prefixes that aren't running.
+    static bool Compact(const QString &path, const QStringList &pruneKeys, CompactStats &stats);
+    // Compacts whichever of a prefix's system.reg, user.reg & userdef.reg exist, in that order. pruneKeys are HKCU
+    // paths, so they only ever go to user.reg; an HKLM key by the same name is left alone. stats gets a file name ->
+    // stats entry for each one that was compacted; false if any couldn't be.
+    static bool CompactPrefix(const QString &prefixPath, const QStringList &pruneKeys, QList<QPair<QString, CompactStats>> &stats);
+
+    // A compact fingerprint of a prefix's whole registry: one hash per key, covering its values but not its timestamps,
+    // for seeing what a verb install or patch actually changed.
+    struct Snapshot {
+        QString id;
+        QString label;
+        QDateTime created;
+        // HKLM\..., HKCU\... or HKU\.Default\... (escaped as in the .reg files) -> hash
+        QMap<QByteArray, quint64> keys;
+        int keyCount = 0;
+    };
+
+    struct SnapshotDiff {
+        QStringList added;
+        QStringList removed;
+        QStringList changed;
+    };
+
+    static bool TakeSnapshot(const QString &prefixPath, const QString &label, Snapshot &snapshot);
+    // saved as <snapshotsPath>/<id>.regsnap
+    static bool SaveSnapshot(const QString &snapshotsPath, const Snapshot &snapshot);
+    // headerOnly skips the keys, for listing
+    static bool LoadSnapshot(const QString &snapshotFile, Snapshot &snapshot, const bool headerOnly = false);
+    // newest first, without their keys
+    static QList<Snapshot> ListSnapshots(const QString &snapshotsPath);
+    static int PruneSnapshots(const QString &snapshotsPath, const int keep);
+    // key paths come back unescaped, sorted
+    static SnapshotDiff DiffSnapshots(const Snapshot &from, const Snapshot &to);
+
+    // Registry paths are case-insensitive; keys here are given with single backslashes (e.g. Software\Wine\Ports).
+    static QByteArray EscapeKey(const QString &key);
+    static QByteArray EscapeName(const QString &name);
+    static QByteArray QuoteString(const QString &text);
+    static QString UnquoteString(const QByteArray &data);
+
+    bool Open(const QString &path);
+    const QString& Path() const { return filePath; }
+    bool HasKey(const QString &key) const;
+    // raw data as written after the '=' (e.g. "\"win10\"" or "dword:00000001"); null if there's no such value
+    QByteArray GetValue(const QString &key, const QString &name) const;
+
+    // Edits are only queued up here, and written out by Commit(). Pass @ as the name for the key's default value.
+    void SetValue(const QString &key, const QString &name, const QByteArray &data);
+    void SetString(const QString &key, const QString &name, const QString &text) { SetValue(key, name, QuoteString(text)); }
+    void SetDword(const QString &key, const QString &name, const quint32 number);
+    void DeleteValue(const QString &key, const QString &name);
+    // subkeys included
+    void DeleteKey(const QString &key);
+    bool IsModified() const { return !pending.isEmpty(); }
+
+    // Writes out the file in one pass, copying everything that wasn't touched verbatim, then swaps it in atomically
+    // (so a crash leaves either the old or the new registry, never half of one). Wine must not be running in the prefix.
+    bool Commit();
+
+private:
+    struct PendingKey {
+        QByteArray path;
+        // the old sections (subkeys included) go away first
+        bool remove = false;
+        // escaped name -> data (null = delete), in the order they were set
+        QList<QPair<QByteArray, QByteArray>> values;
+    };
+
+    QString filePath;
+    QByteArray contents;
+    QVector<Key> keys;
+    // lowercased path -> index into keys
+    QHash<QByteArray, int> keyIndex;
+    // lowercased path -> edits
+    QMap<QByteArray, PendingKey> pending;
+
+    PendingKey& Pending(const QString &key);
+};
+
+// Read-only access to a .reg file, without copying it: the file is mmap'd, and the section index is only built on
+// the first lookup (then cached by path & mtime, so reopening an unchanged file costs next to nothing).
+// Safe to use while Wine's running, though it's only as current as wineserver's last save.
+class NeroRegistryView
+{
+public:
+    explicit NeroRegistryView(const QString &path);
+    NeroRegistryView(const NeroRegistryView &) = delete;
+    NeroRegistryView& operator=(const NeroRegistryView &) = delete;
+
+    bool IsOpen() const { return data != nullptr; }
+    bool HasKey(const QString &key) const;
+    // immediate subkey names, e.g. for everything under ...\Uninstall
+    QStringList SubKeys(const QString &key) const;
+    QList<NeroRegistry::Value> Values(const QString &key) const;
+    // same as NeroRegistry::GetValue
+    QByteArray GetValue(const QString &key, const QString &name) const;
+    QString GetString(const QString &key, const QString &name) const { return NeroRegistry::UnquoteString(GetValue(key, name)); }
+    // dword values, or -1 if it's missing or some other type
+    qint64 GetDword(const QString &key, const QString &name) const;
+
+    // The Windows version Wine reports in a prefix, as its winetricks verb (e.g. win10): an app's AppDefaults override
+    // if exe is given and has one, then the prefix-wide override, then whatever system.reg has. Empty if unknown.
+    static QString WindowsVersion(const QString &prefixPath, const QString &exe = QString());
+
+private:
+    struct IndexData {
+        qint64 mtime = 0;
+        qint64 size = 0;
+        QVector<NeroRegistry::Key> keys;
+        // lowercased path -> index into keys
+        QHash<QByteArray, int> lookup;
+    };
+
+    QString filePath;
+    QFile file;
+    const char *data = nullptr;
+    qint64 size = 0;
+    qint64 mtime = 0;
+    mutable std::shared_ptr<const IndexData> index;
+
+    const IndexData& GetIndex() const;
+    const NeroRegistry::Key* FindKey(const QString &key) const;
+};
+
+#endif // NEROREGISTRY_H
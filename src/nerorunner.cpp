@@ -19,16 +19,25 @@
 
 #include "nerorunner.h"
 #include "neroconstants.h"
+#include "nerocopy.h"
 #include "nerofs.h"
+#include "neroregistry.h"
+#include "nerosysinfo.h"
 
 #include <QApplication>
+#include <QDateTime>
 #include <QProcess>
 #include <QDir>
 #include <QDebug>
 #include <QStringBuilder>
+#include <QThread>
+
+#include <mutex>
 
 int NeroRunner::StartShortcut(const QString &hash, const bool &prefixAlreadyRunning)
 {
+    // for auto-hibernation (done first, since this reloads the cfg that settings points to)
+    NeroFS::SetCurrentPrefixCfg("PrefixSettings", "LastLaunched", QDateTime::currentDateTime());
     settings = NeroFS::GetCurrentPrefixCfg();
     // failsafe for cli runs
     if(NeroFS::GetUmU().isEmpty()) return -1;
@@ -129,11 +138,15 @@ int NeroRunner::StartShortcut(const QString &hash, const bool &prefixAlreadyRunn
         {NeroConfig::forceIGpu,                 CliArgs::forceIgpu},
     };
     boolOptions = InsertArgs(boolOptions, false);
+    SetGpuDevice(false);
     int fpsLimit = CombinedSetting(NeroConfig::limitFps, *this).toInt();
     if(fpsLimit)
         env.insert(CliArgs::dxvkFrameRate, QString::number(fpsLimit));
     int syncType = CombinedSetting(NeroConfig::fileSyncMode, *this).toInt();
     SetSyncMode(protonRunner, syncType);
+    InitWineserverTuning();
+    // inherited by umu-run & everything under it, so esync doesn't run out of fds.
+    NeroSysInfo::RaiseFileLimit();
     CombinedSetting debug(NeroConfig::debugOutput, *this);
     if(debug.hasSetting()) {
         InitDebugProperties(debug.toInt());
@@ -215,13 +228,21 @@ int NeroRunner::StartShortcut(const QString &hash, const bool &prefixAlreadyRunn
         log.resize(0);
         log.write(Logs::currentlyRunningEnv.toLocal8Bit());
         log.write(runner.environment().join('\n').toLocal8Bit());
+        log.write(Logs::newLine.toLocal8Bit() % Logs::syncPrimitive.toLocal8Bit() % syncUsed.toLocal8Bit());
         log.write(Logs::runningCommand.toLocal8Bit() % command.toLocal8Bit() % ' ' % arguments.join(' ').toLocal8Bit() % Logs::newLine.toLocal8Bit());
         log.write(Logs::blankLine.toLocal8Bit());
     }
+    printf("%s%s\n", Logs::syncPrimitive.toLocal8Bit().constData(), syncUsed.toLocal8Bit().constData());
+    NeroTuning::Params tuning = GetTuning(false);
+    ApplyTuning(runner, tuning);
     runner.start(command, arguments);
     runner.waitForStarted(-1);
+    LogTuning(runner, tuning, log);
     WaitLoop(runner, log);
 
+    // scripts are run as-is, without the app's tuning
+    ApplyTuning(runner, NeroTuning::Params());
+
     // in case settings changed from manager
     settings = NeroFS::GetCurrentPrefixCfg();
 
@@ -240,6 +261,340 @@ int NeroRunner::StartShortcut(const QString &hash, const bool &prefixAlreadyRunn
     return runner.exitCode();
 }
 
+int NeroRunner::UpgradePrefix(const QString &umuPath, const QString &prefixPath, const QString &runnerPath)
+{
+    if(umuPath.isEmpty() || !QFileInfo::exists(runnerPath))
+        return -1;
+
+    QProcess umu;
+    QProcessEnvironment upgradeEnv = QProcessEnvironment::systemEnvironment();
+    upgradeEnv.insert(CliArgs::Wine::prefix, prefixPath);
+    if(!upgradeEnv.contains(CliArgs::gameId))
+        upgradeEnv.insert(CliArgs::gameId, "0");
+    upgradeEnv.insert(CliArgs::protonPath, runnerPath);
+    // for Proton 10+, same as when creating prefixes
+    upgradeEnv.insert(CliArgs::Proton::useXalia, "0");
+    umu.setProcessEnvironment(upgradeEnv);
+    umu.setProcessChannelMode(QProcess::MergedChannels);
+
+    // this is background work, so stay out of the way of whatever's actually being played
+    NeroTuning::Params tuning;
+    tuning.setNice = true, tuning.nice = 10;
+    tuning.setIoPrio = true, tuning.ioClass = NeroTuning::IoClassIdle;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    umu.setChildProcessModifier([tuning]() { NeroTuning::Apply(tuning); });
+#endif
+
+    QDir(prefixPath).mkdir(Logs::logDirName);
+    QFile log(prefixPath % '/' % Logs::logDirName % '/' % Logs::upgradeLogName);
+    log.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+    umu.start(umuPath, { "wineboot", "-u" });
+    if(!umu.waitForStarted(-1))
+        return -1;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    NeroTuning::Apply(tuning, umu.processId());
+#endif
+    while(umu.state() != QProcess::NotRunning) {
+        umu.waitForReadyRead(1000);
+        log.write(umu.readAll());
+    }
+    log.write(umu.readAll());
+    const int result = umu.exitStatus() == QProcess::NormalExit ? umu.exitCode() : -1;
+
+    // the upgrade isn't really done until wineserver's written the registry back out
+    QElapsedTimer serverWait;
+    serverWait.start();
+    while(NeroTuning::FindWineserver(prefixPath) && serverWait.elapsed() < 30000)
+        QThread::msleep(100);
+
+    log.write(QByteArray("\nwineboot -u exited with code ") + QByteArray::number(result) + '\n');
+    return result;
+}
+
+qint64 NeroRunner::TimeWineboot(const QString &umuPath, const QString &prefixPath, const QString &runnerPath)
+{
+    if(umuPath.isEmpty() || !QFileInfo::exists(runnerPath))
+        return -1;
+
+    QProcess umu;
+    QProcessEnvironment bootEnv = QProcessEnvironment::systemEnvironment();
+    bootEnv.insert(CliArgs::Wine::prefix, prefixPath);
+    if(!bootEnv.contains(CliArgs::gameId))
+        bootEnv.insert(CliArgs::gameId, "0");
+    bootEnv.insert(CliArgs::protonPath, runnerPath);
+    bootEnv.insert(CliArgs::Proton::useXalia, "0");
+    umu.setProcessEnvironment(bootEnv);
+    umu.setProcessChannelMode(QProcess::MergedChannels);
+
+    QElapsedTimer timer;
+    timer.start();
+    umu.start(umuPath, { "wineboot" });
+    if(!umu.waitForStarted(-1))
+        return -1;
+    // nothing worth keeping in here, but don't let the pipe fill up either
+    while(umu.state() != QProcess::NotRunning) {
+        umu.waitForReadyRead(100);
+        umu.readAll();
+    }
+    if(umu.exitStatus() != QProcess::NormalExit || umu.exitCode() != 0)
+        return -1;
+
+    while(NeroTuning::FindWineserver(prefixPath) && timer.elapsed() < 120000)
+        QThread::msleep(20);
+    return timer.elapsed();
+}
+
+int NeroRunner::CreatePrefix(const QString &umuPath, const QString &prefix, const QString &runner, const QStringList &verbs,
+                             const int templateMode, const bool userLinks, const std::function<bool(const QString &)> &status)
+{
+    // templates are shared between everything being created at once, so only one gets to write one at a time
+    static std::mutex templateMutex;
+
+    const QString prefixDir = NeroFS::GetPrefixesPath()->path() % '/' % prefix;
+    const QString runnerPath = NeroFS::GetProtonsPath()->path() % '/' % runner;
+    if(prefix.isEmpty() || prefix.contains('/') || prefix.startsWith('.') || QFileInfo::exists(prefixDir) ||
+       umuPath.isEmpty() || !QFileInfo::exists(runnerPath))
+        return -1;
+
+    QString currentStatus;
+    bool aborted = false;
+    auto report = [&](const QString &newStatus = QString()) {
+        if(!newStatus.isEmpty()) currentStatus = newStatus;
+        if(status && !status(currentStatus)) aborted = true;
+        return !aborted;
+    };
+
+    // templates for verb sets are opt-in, as each one's a whole prefix of its own
+    const bool useTemplates = templateMode == NeroFS::TemplatesPerVerbSet ||
+                              (templateMode == NeroFS::TemplatesPerRunner && verbs.isEmpty());
+    const QString templatePath = NeroFS::GetPrefixTemplatePath(runner, verbs);
+    bool fromTemplate = false;
+    int exitCode = 0;
+
+    // A template is just a freshly made prefix for this runner + verbs, so cloning it (reflinked on btrfs/xfs)
+    // gets the same result as booting a new one, minus the wait.
+    if(useTemplates && NeroFS::IsPrefixTemplateCurrent(templatePath, runner)) {
+        report("Creating prefix " % prefix % " from " % runner % " template...");
+        NeroCopy::Stats stats;
+        fromTemplate = NeroCopy::CloneTree(templatePath, prefixDir, stats, { ".nero-template" },
+                                           [&](const NeroCopy::Stats &) { return report(); });
+        printf("Cloned template %s: %s\n", templatePath.toLocal8Bit().constData(), NeroCopy::FormatStats(stats).toLocal8Bit().constData());
+        if(!fromTemplate) {
+            printf("Template clone failed, creating prefix from scratch instead...\n");
+            QDir(prefixDir).removeRecursively();
+            if(aborted) return -1;
+        }
+    }
+
+    if(!fromTemplate) {
+        QProcess umu;
+        QProcessEnvironment createEnv = QProcessEnvironment::systemEnvironment();
+        createEnv.insert(CliArgs::Wine::prefix, prefixDir);
+        // Only explicit set GAMEID when not already declared by user for (their) testing purposes
+        // See SeongGino/Nero-umu#66 for more info
+        if(!createEnv.contains(CliArgs::gameId)) createEnv.insert(CliArgs::gameId, "0");
+        createEnv.insert(CliArgs::protonPath, runnerPath);
+        // for Proton 10+. this shit gets real annoying
+        createEnv.insert(CliArgs::Proton::useXalia, "0");
+        createEnv.insert(CliArgs::winetricksCache, NeroFS::GetWinetricksCachePath());
+        umu.setProcessEnvironment(createEnv);
+        umu.setProcessChannelMode(QProcess::MergedChannels);
+
+        QStringList tricksToInstall = verbs;
+        if(tricksToInstall.isEmpty()) {
+            // UMU is supposed to have "createprefix" action, but it doesn't actually do anything
+            // (on newer versions, it just runs explorer.exe pointed at nothing)
+            // we just need an easy scapegoat process that exits on its own without spawning a console window
+            umu.start(umuPath, {"reg", "/?"});
+        } else {
+            NeroPrefetch::Stats prefetchStats;
+            PrefetchVerbs(runnerPath, tricksToInstall, prefetchStats, [&](const QString &text) { return report(text); });
+            if(aborted) return -1;
+
+            QString command = umuPath % " winetricks " % tricksToInstall.join(' ');
+            // NOTE: until https://github.com/Winetricks/winetricks/issues/2367 is resolved,
+            // delete two offending reg entries so that dotnet verbs don't erroneously exit.
+            if(!tricksToInstall.filter("dotnet").isEmpty()) {
+                command = umuPath % " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\.NETFramework\" /f && " %
+                          umuPath % " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\NET Framework Setup\" /f && " % command;
+                printf(".NET verb detected, cleaning up registry keys before winetricks install...\n");
+            }
+            umu.start("/bin/sh", { "-c", command });
+        }
+        report("Creating prefix " % prefix % " using " % runner % "...");
+
+        // the prefix dir only shows up once umu gets going, so the log is buffered until then
+        QByteArray output;
+        while(umu.state() != QProcess::NotRunning) {
+            umu.waitForReadyRead(100);
+            while(umu.canReadLine()) {
+                const QByteArray line = umu.readLine();
+                output.append(line);
+                if(line.contains("Proton: Upgrading")) {
+                    report("Creating prefix " % prefix % " using " % runner % "...");
+                } else if(line.contains("Downloading latest steamrt sniper")) {
+                    report("umu: Updating runtime to latest version...");
+                } else if(line.contains("Proton: Running winetricks verbs in prefix:")) {
+                    report("Running installations for Winetricks verbs:\n\n" % tricksToInstall.join('\n') %
+                           "\n\nThis stage may take a while...");
+                }
+            }
+            if(!report()) {
+                umu.kill();
+                umu.waitForFinished(-1);
+            }
+        }
+        output.append(umu.readAll());
+        exitCode = umu.exitStatus() == QProcess::NormalExit ? umu.exitCode() : -1;
+
+        // wineserver only writes out the registry once it shuts down,
+        // so wait for it before touching system.reg or snapshotting this prefix.
+        QElapsedTimer serverWait;
+        serverWait.start();
+        while(NeroTuning::FindWineserver(prefixDir) && serverWait.elapsed() < 15000) {
+            report();
+            QThread::msleep(100);
+        }
+        const bool serverExited = !NeroTuning::FindWineserver(prefixDir);
+
+        if(QDir().mkpath(prefixDir % '/' % Logs::logDirName)) {
+            QFile log(prefixDir % '/' % Logs::logDirName % '/' % Logs::createLogName);
+            if(log.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                log.write(output);
+        }
+
+        if(exitCode == 0 && useTemplates && !aborted) {
+            // a template taken while wineserver's still up could have a registry that was never flushed,
+            // and every prefix cloned from it afterwards would inherit that
+            if(!serverExited) {
+                printf("wineserver is still running for %s, not saving a template from it\n", prefix.toLocal8Bit().constData());
+            } else {
+                report("Saving template for future " % runner % " prefixes...");
+                std::lock_guard<std::mutex> lock(templateMutex);
+                // someone else may have beaten us to it
+                if(!NeroFS::IsPrefixTemplateCurrent(templatePath, runner))
+                    NeroFS::SavePrefixTemplate(prefixDir, runner, verbs);
+            }
+        }
+    }
+
+    if(aborted) {
+        NeroCopy::Stats removeStats;
+        NeroCopy::RemoveTree(prefixDir, removeStats);
+        return -1;
+    }
+
+    // no registry means there's no prefix to speak of
+    if(!QFileInfo::exists(prefixDir % "/system.reg"))
+        return exitCode ? exitCode : -1;
+
+    // Add fixes to system.reg
+    NeroRegistry systemReg;
+    if(systemReg.Open(prefixDir % "/system.reg")) {
+        // DualSense fix
+        //if(systemReg.HasKey("System\\CurrentControlSet\\Services\\winebus"))
+        //    systemReg.SetDword("System\\CurrentControlSet\\Services\\winebus", "DisableHidraw", 1);
+        // connect COM ports for lightguns (in case someone still wants to use MAMEHOOKER) ;)
+        if(systemReg.HasKey("Software\\Wine\\Ports")) {
+            systemReg.SetString("Software\\Wine\\Ports", "COM1", "/dev/ttyACM0");
+            systemReg.SetString("Software\\Wine\\Ports", "COM2", "/dev/ttyACM1");
+            systemReg.SetString("Software\\Wine\\Ports", "COM3", "/dev/ttyACM2");
+            systemReg.SetString("Software\\Wine\\Ports", "COM4", "/dev/ttyACM3");
+            systemReg.SetString("Software\\Wine\\Ports", "COM5", "/dev/ttyS0");
+        }
+        systemReg.Commit();
+    }
+
+    NeroFS::InitPrefixSettings(prefix, runner);
+    NeroFS::SetPrefixUpgraded(prefix, runner);
+    if(userLinks)
+        NeroFS::CreateUserLinks(prefix);
+    return exitCode;
+}
+
+int NeroRunner::InstallVerbs(const QString &umuPath, const QString &prefixPath, const QString &runnerPath, const QStringList &verbs,
+                             const std::function<bool(const QString &)> &status)
+{
+    if(verbs.isEmpty())
+        return 0;
+    if(umuPath.isEmpty() || !QFileInfo::exists(prefixPath % "/system.reg") || !QFileInfo::exists(runnerPath))
+        return -1;
+
+    QProcess umu;
+    QProcessEnvironment tricksEnv = QProcessEnvironment::systemEnvironment();
+    tricksEnv.insert(CliArgs::Wine::prefix, prefixPath);
+    // force gameid here since tricks installation wouldn't benefit from having a forced profile
+    tricksEnv.insert(CliArgs::gameId, "0");
+    tricksEnv.insert(CliArgs::protonPath, runnerPath);
+    tricksEnv.insert(CliArgs::Proton::useXalia, "0");
+    tricksEnv.insert(CliArgs::winetricksCache, NeroFS::GetWinetricksCachePath());
+    umu.setProcessEnvironment(tricksEnv);
+    umu.setProcessChannelMode(QProcess::MergedChannels);
+
+    QString command = umuPath % " winetricks " % verbs.join(' ');
+    // NOTE: until https://github.com/Winetricks/winetricks/issues/2367 is resolved, delete two offending reg entries
+    if(!verbs.filter("dotnet").isEmpty()) {
+        QStringList installed;
+        QFile winetricksLog(prefixPath % "/winetricks.log");
+        if(winetricksLog.open(QIODevice::ReadOnly | QIODevice::Text))
+            installed = QString::fromUtf8(winetricksLog.readAll()).split('\n');
+        if(installed.filter("dotnet").isEmpty())
+            command = umuPath % " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\.NETFramework\" /f && " %
+                      umuPath % " reg delete \"HKLM\\Software\\Wow6432Node\\Microsoft\\NET Framework Setup\" /f && " % command;
+    }
+
+    bool canceled = false;
+    NeroPrefetch::Stats prefetchStats;
+    PrefetchVerbs(runnerPath, verbs, prefetchStats, [&](const QString &text) {
+        if(status && !status(text)) canceled = true;
+        return !canceled;
+    });
+    if(canceled)
+        return -1;
+
+    QDir(prefixPath).mkdir(Logs::logDirName);
+    QFile log(prefixPath % '/' % Logs::logDirName % '/' % Logs::tricksLogName);
+    log.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+    umu.start("/bin/sh", { "-c", command });
+    if(!umu.waitForStarted(-1))
+        return -1;
+    const QString installing = "Installing " % verbs.join(", ") % "...";
+    while(umu.state() != QProcess::NotRunning) {
+        umu.waitForReadyRead(100);
+        log.write(umu.readAll());
+        if(status && !status(installing)) {
+            umu.kill();
+            umu.waitForFinished(-1);
+        }
+    }
+    log.write(umu.readAll());
+    const int result = umu.exitStatus() == QProcess::NormalExit ? umu.exitCode() : -1;
+
+    QElapsedTimer serverWait;
+    serverWait.start();
+    while(NeroTuning::FindWineserver(prefixPath) && serverWait.elapsed() < 15000)
+        QThread::msleep(100);
+
+    log.write(QByteArray("\nwinetricks exited with code ") + QByteArray::number(result) + '\n');
+    return result;
+}
+
+void NeroRunner::PrefetchVerbs(const QString &runnerPath, const QStringList &verbs, NeroPrefetch::Stats &stats,
+                               const std::function<bool(const QString &)> &status)
+{
+    const QList<NeroPrefetch::Download> downloads = NeroPrefetch::Resolve(NeroFS::GetWinetricks(QFileInfo(runnerPath).fileName()), verbs);
+    if(downloads.isEmpty())
+        return;
+
+    NeroPrefetch::Fetch(downloads, NeroFS::GetWinetricksCachePath(), 4, stats, [&](const NeroPrefetch::Stats &current) {
+        return !status || status(QString("Fetching installers for %1...\n\n%2 of %3 ready (%4)")
+                                 .arg(verbs.join(", ")).arg(current.hits + current.fetched).arg(current.total).arg(current.Describe()));
+    });
+    printf("Winetricks downloads for %s: %s\n", verbs.join(' ').toLocal8Bit().constData(), stats.Describe().toLocal8Bit().constData());
+}
+
 QString NeroRunner::GamescopeFilterType(int filterVal) {
     switch(filterVal) {
     case NeroConstant::GSfilterNearest:
@@ -261,6 +616,7 @@ int NeroRunner::StartOnetime(const QString &path, const bool &prefixAlreadyRunni
     // failsafe for cli runs
     if(NeroFS::GetUmU().isEmpty()) return -1;
 
+    NeroFS::SetCurrentPrefixCfg("PrefixSettings", "LastLaunched", QDateTime::currentDateTime());
     settings = NeroFS::GetCurrentPrefixCfg();
 
     QProcess runner;
@@ -323,8 +679,12 @@ int NeroRunner::StartOnetime(const QString &path, const bool &prefixAlreadyRunni
     };
     bool isPrefixOnly = true;
     simpleBoolSettings = InsertArgs(simpleBoolSettings, isPrefixOnly);
+    SetGpuDevice(isPrefixOnly);
     int fileSyncMode = PrefixSetting(NeroConfig::fileSyncMode, *this).toInt();
     SetSyncMode(protonRunner, fileSyncMode);
+    InitWineserverTuning();
+    // inherited by umu-run & everything under it, so esync doesn't run out of fds.
+    NeroSysInfo::RaiseFileLimit();
     int debugVal = PrefixSetting(NeroConfig::debugOutput, *this).toInt();
     InitDebugProperties(debugVal);
     // Different logic for Prefix Launch of this versus shortcut; is that intentional?
@@ -394,11 +754,16 @@ int NeroRunner::StartOnetime(const QString &path, const bool &prefixAlreadyRunni
         log.resize(0);
         log.write(Logs::currentlyRunningEnv.toLocal8Bit());
         log.write(runner.environment().join('\n').toLocal8Bit());
+        log.write(Logs::newLine.toLocal8Bit() % Logs::syncPrimitive.toLocal8Bit() % syncUsed.toLocal8Bit());
         log.write(Logs::runningCommand.toLocal8Bit() % command.toLocal8Bit() % ' ' % arguments.join(' ').toLocal8Bit() % Logs::newLine.toLocal8Bit());
         log.write(Logs::blankLine.toLocal8Bit());
     }
+    printf("%s%s\n", Logs::syncPrimitive.toLocal8Bit().constData(), syncUsed.toLocal8Bit().constData());
+    NeroTuning::Params tuning = GetTuning(true);
+    ApplyTuning(runner, tuning);
     runner.start(command, arguments);
     runner.waitForStarted(-1);
+    LogTuning(runner, tuning, log);
     WaitLoop(runner, log);
 
     return runner.exitCode();
@@ -552,17 +917,24 @@ QStringList NeroRunner::SetGamescopeArgs(int scalingMode, int fpsLimit, bool isP
 
 void NeroRunner::SetSyncMode(QString protonRunner, int syncType)
 {
-    // ntsync SHOULD be better in all scenarios compared to other sync options, but requires kernel 6.14+ and GE-Proton10-9+
-        // For older Protons, they should be safely ignoring this and fallback to fsync anyways.
-        // Newer protons than GE10-9 should enable this automatically from its end, and doesn't require WOW64
-        // (and currently, WOW64 seems problematic for some fringe cases, like TeknoParrot's BudgieLoader not spawning a window)
+    // ntsync SHOULD be better in all scenarios compared to other sync options, but needs both kernel & runner support.
+        // The "NTsync" index is really "use the fastest available", so work out what this host + runner can actually do,
+        // instead of only trusting one runner name.
+        // (WOW64 is only forced for GE10-9, as it seems problematic for some fringe cases, like TeknoParrot's BudgieLoader not spawning a window)
+    NeroSysInfo::SyncChoice sync;
+    if(syncType == NeroConstant::NTsync) {
+        sync = NeroSysInfo::DetectFastestSync(NeroFS::GetProtonsPath()->path() % '/' % protonRunner);
+    } else {
+        sync.mode = syncType;
+        sync.reason = "forced in settings";
+    }
 
-    switch(syncType) {
+    switch(sync.mode) {
         case NeroConstant::NTsync:
-            if(protonRunner == ge109) {
+            if(sync.ntsyncOptIn)
                 env.insert(CliArgs::Proton::Sync::ntSync, TRUE);
+            if(sync.ntsyncNeedsWow64)
                 env.insert(CliArgs::useWow64, TRUE);
-            }
             break;
         case NeroConstant::Fsync:
             env.insert(CliArgs::Proton::Sync::noNtSync, TRUE);
@@ -576,6 +948,133 @@ void NeroRunner::SetSyncMode(QString protonRunner, int syncType)
         default:
             break;
     }
+
+    syncUsed = NeroSysInfo::SyncModeName(sync.mode) % " (" % sync.reason % ')';
+}
+
+NeroTuning::Params NeroRunner::GetTuning(bool isPrefixOnly)
+{
+    NeroTuning::Params tuning = NeroTuning::FromSettings(initSetting(isPrefixOnly, NeroConfig::niceLevel).toInt(),
+                                                         initSetting(isPrefixOnly, NeroConfig::schedPolicy).toInt(),
+                                                         initSetting(isPrefixOnly, NeroConfig::ioPriority).toInt(),
+                                                         initSetting(isPrefixOnly, NeroConfig::oomScoreAdj).toInt());
+    NeroTuning::Merge(tuning, tuningOverride);
+    return tuning;
+}
+
+void NeroRunner::ApplyTuning(QProcess &runner, const NeroTuning::Params &tuning)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    // done in the forked child right before exec, so it's in place before umu gets to spawn anything.
+    if(tuning.isEmpty())
+        runner.setChildProcessModifier(std::function<void(void)>());
+    else runner.setChildProcessModifier([tuning]() { NeroTuning::Apply(tuning); });
+#endif
+}
+
+void NeroRunner::LogTuning(QProcess &runner, const NeroTuning::Params &tuning, QFile &log)
+{
+    if(tuning.isEmpty() || runner.processId() <= 0)
+        return;
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    // Qt5 has no child modifier, so tune the process as soon as it's up instead.
+    if(NeroTuning::Apply(tuning, runner.processId()))
+        printf("Some process tuning options were refused by the system (missing permissions?)\n");
+#endif
+
+    // read back what the kernel actually took, rather than what was asked for.
+    const QByteArray applied = Logs::processTuning.toLocal8Bit()
+                               % QByteArray::number(runner.processId()) % ": "
+                               % NeroTuning::Describe(runner.processId()).toLocal8Bit()
+                               % Logs::newLine.toLocal8Bit();
+    printf("%s", applied.constData());
+    if(loggingEnabled)
+        log.write(applied);
+}
+
+void NeroRunner::SetGpuDevice(bool isPrefixOnly)
+{
+    const QString slot = initSetting(isPrefixOnly, NeroConfig::gpuDevice).toString();
+    if(slot.isEmpty() || slot == NeroConfig::gpuDeviceAuto)
+        return;
+
+    const QList<NeroSysInfo::GpuDevice> gpus = NeroSysInfo::GetGpus();
+    const QMap<QString, QString> gpuEnv = GpuSelectEnv(gpus, slot);
+    if(gpuEnv.isEmpty()) {
+        printf("Selected GPU at %s wasn't found, using the system default instead.\n", slot.toLocal8Bit().constData());
+        return;
+    }
+
+    // an explicit pick trumps "force iGPU"
+    env.remove(CliArgs::forceIgpu);
+    for(auto it = gpuEnv.constBegin(); it != gpuEnv.constEnd(); ++it)
+        env.insert(it.key(), it.value());
+
+    for(const NeroSysInfo::GpuDevice &gpu : gpus)
+        if(gpu.pciSlot == slot)
+            printf("Using GPU: %s\n", NeroSysInfo::GpuLabel(gpu).toLocal8Bit().constData());
+}
+
+QMap<QString, QString> NeroRunner::GpuSelectEnv(const QList<NeroSysInfo::GpuDevice> &gpus, const QString &slot)
+{
+    QMap<QString, QString> gpuEnv;
+    NeroSysInfo::GpuDevice selected;
+    int sameVendor = 0;
+    for(const NeroSysInfo::GpuDevice &gpu : gpus)
+        if(gpu.pciSlot == slot)
+            selected = gpu;
+    if(selected.pciSlot.isEmpty())
+        return gpuEnv;
+    for(const NeroSysInfo::GpuDevice &gpu : gpus)
+        if(gpu.vendor == selected.vendor)
+            sameVendor++;
+
+    // Vulkan (Mesa's device select layer): "vid:did", in hex
+    gpuEnv.insert(CliArgs::Gpu::vkDeviceSelect, QString("%1:%2").arg(selected.vendor, 4, 16, QChar('0'))
+                                                                .arg(selected.device, 4, 16, QChar('0')));
+    // OpenGL/Mesa PRIME offload: "pci-0000_01_00_0"
+    gpuEnv.insert(CliArgs::Gpu::driPrime, "pci-" + QString(slot).replace(':', '_').replace('.', '_'));
+    // DXVK only matches by (partial) device name, which vendor alone can only do when it's unique.
+    if(sameVendor == 1)
+        gpuEnv.insert(CliArgs::Gpu::dxvkFilterDeviceName, NeroSysInfo::GpuVendorName(selected.vendor));
+    // the proprietary NVIDIA driver doesn't honor DRI_PRIME, and needs its own offload vars instead.
+    if(selected.driver == "nvidia" && !selected.bootVga) {
+        gpuEnv.insert(CliArgs::Gpu::nvPrimeOffload, "1");
+        gpuEnv.insert(CliArgs::Gpu::nvOptimusLayer, "NVIDIA_only");
+        gpuEnv.insert(CliArgs::Gpu::glxVendor, "nvidia");
+    }
+    return gpuEnv;
+}
+
+// wineserver settings are prefix-wide, since all apps in a prefix share the one server.
+void NeroRunner::InitWineserverTuning()
+{
+    wineserverPriority = PrefixSetting(NeroConfig::wineserverPriority, *this).toInt();
+    wineserverAffinity = PrefixSetting(NeroConfig::wineserverAffinity, *this).toInt();
+    wineserverPending = wineserverPriority != NeroConstant::WineserverPrioDefault ||
+                        wineserverAffinity != NeroConstant::WineserverAffinityDefault;
+}
+
+void NeroRunner::TuneWineserver(QFile &log)
+{
+    // don't walk /proc for every line of output
+    if(wineserverCheck.isValid() && wineserverCheck.elapsed() < 500)
+        return;
+    wineserverCheck.start();
+
+    const pid_t wineserver = NeroTuning::FindWineserver(env.value(CliArgs::Wine::prefix));
+    if(!wineserver)
+        return;
+
+    wineserverPending = false;
+    const QByteArray applied = Logs::wineserverTuning.toLocal8Bit()
+                               % QByteArray::number(wineserver) % ": "
+                               % NeroTuning::TuneWineserver(wineserver, wineserverPriority, wineserverAffinity).toLocal8Bit()
+                               % Logs::newLine.toLocal8Bit();
+    printf("%s", applied.constData());
+    if(loggingEnabled)
+        log.write(applied);
 }
 
 void NeroRunner::WaitLoop(QProcess &runner, QFile &log)
@@ -583,6 +1082,8 @@ void NeroRunner::WaitLoop(QProcess &runner, QFile &log)
     QByteArray stdout;
     while(runner.state() != QProcess::NotRunning) {
         if(!halt) {
+            if(wineserverPending)
+                TuneWineserver(log);
             runner.waitForReadyRead(1000);
             if(runner.canReadLine()) {
                 stdout = runner.readLine();
@@ -21,13 +21,19 @@
 #define NERORUNNER_H
 
 #include "nerofs.h"
+#include "neroprefetch.h"
+#include "nerosysinfo.h"
+#include "nerotuning.h"
 
 #include <QString>
 #include <QProcessEnvironment>
 #include <QFile>
+#include <QElapsedTimer>
 #include <QStringBuilder>
 #include <qvariant.h>
 
+#include <functional>
+
 class NeroRunner : public QObject
 {
     Q_OBJECT
@@ -36,6 +42,33 @@ public:
 
     int StartShortcut(const QString &, const bool & = false);
     int StartOnetime(const QString &, const bool & = false, const QStringList & = {});
+    // Runs wineboot -u in a prefix through umu, so Proton's upgrade for a new runner happens now rather than
+    // in front of the next launch. Blocking, but safe to call from any thread (so umuPath has to be looked up
+    // beforehand); runs at low CPU & I/O priority, with output going to the prefix's upgrade log.
+    static int UpgradePrefix(const QString &umuPath, const QString &prefixPath, const QString &runnerPath);
+    // Makes a new prefix the way the wizard does: cloned from a current template if there is one (templateMode being
+    // one of NeroFS::TemplateModes_e), otherwise booted through umu (with any winetricks verbs), then Nero's system.reg
+    // tweaks & default settings. Also blocking and
+    // thread-safe, so several can run at once. status is called every so often from the calling thread with what's
+    // going on; return false to abort. Returns umu's exit code (or -1 if it never got that far).
+    static int CreatePrefix(const QString &umuPath, const QString &prefix, const QString &runner, const QStringList &verbs,
+                            const int templateMode, const bool userLinks,
+                            const std::function<bool(const QString &)> &status = nullptr);
+    // Boots the prefix once with plain wineboot & waits for wineserver to shut down again (so registry loading & saving
+    // are both counted); returns how long that took in ms, or -1 if it failed. Thread-safe like the above.
+    static qint64 TimeWineboot(const QString &umuPath, const QString &prefixPath, const QString &runnerPath);
+    // Installs winetricks verbs into an existing prefix through umu, same as the tricks window does.
+    // Blocking & thread-safe like the above, with output going to the prefix's winetricks log.
+    static int InstallVerbs(const QString &umuPath, const QString &prefixPath, const QString &runnerPath, const QStringList &verbs,
+                            const std::function<bool(const QString &)> &status = nullptr);
+    // Downloads whatever verbs need into the shared winetricks cache ahead of time, several at once, so winetricks
+    // itself only has installing left to do. Anything that can't be fetched is just left for winetricks to try.
+    // Blocking & thread-safe; status works like the above.
+    static void PrefetchVerbs(const QString &runnerPath, const QStringList &verbs, NeroPrefetch::Stats &stats,
+                              const std::function<bool(const QString &)> &status = nullptr);
+    // The env vars that point Vulkan, GL, DXVK (and NVIDIA's offload) at the GPU in slot, out of gpus as listed by
+    // NeroSysInfo::GetGpus(); empty if it isn't there.
+    static QMap<QString, QString> GpuSelectEnv(const QList<NeroSysInfo::GpuDevice> &gpus, const QString &slot);
     QString GetHash() {return hashVal;}
     void WaitLoop(QProcess &, QFile &);
     void writeToLog(QStringList lines);
@@ -45,6 +78,13 @@ public:
     bool halt = false;
     bool loggingEnabled = false;
     QProcessEnvironment env;
+    // set from the CLI, takes priority over the prefix/shortcut's tuning settings
+    NeroTuning::Params tuningOverride;
+    // wineserver only shows up a bit after umu starts, so WaitLoop keeps checking for it
+    int wineserverPriority = 0;
+    int wineserverAffinity = 0;
+    bool wineserverPending = false;
+    QElapsedTimer wineserverCheck;
     enum {
         RunnerStarting = 0,
         RunnerUpdated,
@@ -125,6 +165,12 @@ private:
     QStringList Gamescope(QMap<QString, QString> resMap, QStringList arguments);
     QMap<QString, QString> InsertArgs(QMap<QString, QString> properties, bool isPrefixOnly);
     QString GamescopeFilterType(int filterVal);
+    NeroTuning::Params GetTuning(bool isPrefixOnly);
+    void ApplyTuning(QProcess &runner, const NeroTuning::Params &tuning);
+    void LogTuning(QProcess &runner, const NeroTuning::Params &tuning, QFile &log);
+    void InitWineserverTuning();
+    void TuneWineserver(QFile &log);
+    void SetGpuDevice(bool isPrefixOnly);
 
     const QString FALSE = "0";
     const QString TRUE = "1";
@@ -132,7 +178,7 @@ private:
     const QString cDrive = "C:/";
     const QString drive_c = "drive_c/";
 
-    const QString ge109 = "GE-Proton10-9";
+    QString syncUsed;
     void InitDebugProperties(int value);
     QString hashVal;
 
@@ -203,9 +249,18 @@ namespace CliArgs {
     const QString protonPath = "PROTONPATH";
     const QString mangoapp = "--mangoapp";
     const QString forceIgpu = "MESA_VK_DEVICE_SELECT_FORCE_DEFAULT_DEVICE";
+    namespace Gpu {
+        const QString vkDeviceSelect = "MESA_VK_DEVICE_SELECT";
+        const QString driPrime = "DRI_PRIME";
+        const QString dxvkFilterDeviceName = "DXVK_FILTER_DEVICE_NAME";
+        const QString nvPrimeOffload = "__NV_PRIME_RENDER_OFFLOAD";
+        const QString nvOptimusLayer = "__VK_LAYER_NV_optimus";
+        const QString glxVendor = "__GLX_VENDOR_LIBRARY_NAME";
+    }
     const QString umuRuntimeUpdate = "UMU_RUNTIME_UPDATE";
     const QString gamemoderun = "gamemoderun";
     const QString gameId = "GAMEID";
+    const QString winetricksCache = "W_CACHE";
     const QString useWow64 = "PROTON_USE_WOW64";
 
     const QString verb = "PROTON_VERB";
@@ -254,6 +309,12 @@ namespace Logs {
     const QString currentlyRunningEnv = "Current running environment:" % newLine;
     const QString runningCommand = newLine % newLine % "Running command:" % newLine;
     const QString blankLine = "==============================================" % newLine;
+    const QString processTuning = "Process tuning applied to PID ";
+    const QString wineserverTuning = "Wineserver tuning applied to PID ";
+    const QString syncPrimitive = "Sync primitive: ";
+    const QString upgradeLogName = "prefix-upgrade.txt";
+    const QString createLogName = "prefix-create.txt";
+    const QString tricksLogName = "winetricks.txt";
 }
 
 namespace NeroConfig {
@@ -269,6 +330,9 @@ namespace NeroConfig {
 
     //Force Integrated GPU
     const QString forceIGpu = "ForceiGPU";
+    // PCI slot of a specific GPU to use, or "auto"
+    const QString gpuDevice = "GpuDevice";
+    const QString gpuDeviceAuto = "auto";
 
 
     namespace Proton {
@@ -305,6 +369,14 @@ namespace NeroConfig {
     const QString gamemode = "Gamemode";
     const QString args = "Args";
 
+    //Process Tuning
+    const QString niceLevel = "NiceLevel";
+    const QString schedPolicy = "CpuSchedPolicy";
+    const QString ioPriority = "IoPriority";
+    const QString oomScoreAdj = "OomScoreAdj";
+    const QString wineserverPriority = "WineserverPriority";
+    const QString wineserverAffinity = "WineserverAffinity";
+
     //TBD
     const QString nvidiaLibs = "NvidiaLibs";
     const QString fsr4Upgrade = "Fsr4Upgrade";
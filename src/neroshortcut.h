@@ -50,9 +50,6 @@ private slots:
 private:
     Ui::NeroShortcutWizard *ui;
 
-    QString GetIcoextract();
-    QString GetIcoutils();
-
     QStringList existingShortcuts;
 };
 
@@ -0,0 +1,647 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Prefix snapshots (reflinked, or chunked & compressed) and restoring them.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerosnapshot.h"
+#include "nerocopy.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+namespace {
+    // regenerated on demand and often huge, so not worth keeping around (or rolling back)
+    const QStringList excludedDirs = { ".logs", ".shaderCache" };
+
+    // content-defined chunk sizes; ~1MiB on average, so a small change in a big file only costs a chunk or two
+    const size_t minChunk = 256*1024;
+    const size_t maxChunk = 4*1024*1024;
+    const quint64 chunkMask = (1ULL << 20) - 1;
+
+    const quint32 manifestMagic = 0x4e52534d; // "NRSM"
+    const quint32 manifestVersion = 1;
+
+    enum { EntryDir = 0, EntryFile, EntryLink };
+
+    struct Entry {
+        quint8 type = EntryFile;
+        quint32 mode = 0;
+        qint64 mtime = 0;
+        qint64 size = 0;
+        // relative to the prefix
+        QByteArray path;
+        QByteArray linkTarget;
+        // sha256 of each chunk, in order (chunked snapshots only)
+        QList<QByteArray> chunks;
+        // where to copy the file back from (reflinked snapshots only; not saved)
+        QByteArray source;
+    };
+
+    QDataStream &operator<<(QDataStream &out, const Entry &entry)
+    {
+        return out << entry.type << entry.mode << entry.mtime << entry.size << entry.path << entry.linkTarget << entry.chunks;
+    }
+
+    QDataStream &operator>>(QDataStream &in, Entry &entry)
+    {
+        return in >> entry.type >> entry.mode >> entry.mtime >> entry.size >> entry.path >> entry.linkTarget >> entry.chunks;
+    }
+
+    qint64 MtimeOf(const struct stat &st) { return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec; }
+
+    bool SameFile(const Entry &a, const Entry &b)
+    {
+        return a.type == b.type && a.size == b.size && a.mtime == b.mtime && a.mode == b.mode;
+    }
+
+    // Lists everything under root (parents before their children), leaving out excludedDirs at the top level
+    // and anything on another filesystem.
+    void ListTree(const QByteArray &root, const QByteArray &relative, const dev_t dev, std::vector<Entry> &entries, qint64 &errors)
+    {
+        const QByteArray dirPath = relative.isEmpty() ? root : root + '/' + relative;
+        DIR *dir = opendir(dirPath.constData());
+        if(!dir) {
+            errors++;
+            return;
+        }
+
+        while(struct dirent *dirEntry = readdir(dir)) {
+            const QByteArray name(dirEntry->d_name);
+            if(name == "." || name == "..")
+                continue;
+            if(relative.isEmpty() && excludedDirs.contains(QString::fromLocal8Bit(name)))
+                continue;
+
+            struct stat st;
+            if(fstatat(dirfd(dir), name.constData(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                errors++;
+                continue;
+            }
+
+            Entry entry;
+            entry.path = relative.isEmpty() ? name : relative + '/' + name;
+            entry.mode = st.st_mode & 07777;
+            entry.mtime = MtimeOf(st);
+            if(S_ISDIR(st.st_mode)) {
+                if(st.st_dev != dev)
+                    continue;
+                entry.type = EntryDir;
+                entries.push_back(entry);
+                ListTree(root, entry.path, dev, entries, errors);
+            } else if(S_ISLNK(st.st_mode)) {
+                char target[PATH_MAX];
+                const ssize_t len = readlinkat(dirfd(dir), name.constData(), target, sizeof(target)-1);
+                if(len < 0) {
+                    errors++;
+                    continue;
+                }
+                entry.type = EntryLink;
+                entry.linkTarget = QByteArray(target, len);
+                entries.push_back(entry);
+            } else if(S_ISREG(st.st_mode)) {
+                entry.type = EntryFile;
+                entry.size = st.st_size;
+                entries.push_back(entry);
+            }
+        }
+        closedir(dir);
+    }
+
+    bool LoadManifest(const QString &path, std::vector<Entry> &entries)
+    {
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly))
+            return false;
+        QDataStream in(&file);
+        quint32 magic = 0, version = 0;
+        qint64 count = 0;
+        in >> magic >> version >> count;
+        if(magic != manifestMagic || version != manifestVersion || count < 0)
+            return false;
+        entries.clear();
+        entries.reserve(count);
+        for(qint64 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            Entry entry;
+            in >> entry;
+            entries.push_back(entry);
+        }
+        return in.status() == QDataStream::Ok;
+    }
+
+    bool SaveManifest(const QString &path, const std::vector<Entry> &entries)
+    {
+        QSaveFile file(path);
+        if(!file.open(QIODevice::WriteOnly))
+            return false;
+        QDataStream out(&file);
+        out << manifestMagic << manifestVersion << (qint64)entries.size();
+        for(const Entry &entry : entries)
+            out << entry;
+        return file.commit();
+    }
+
+    const std::array<quint64, 256> &GearTable()
+    {
+        // any fixed set of random-ish values works, so long as it never changes between versions
+        static const std::array<quint64, 256> table = []() {
+            std::array<quint64, 256> values;
+            quint64 seed = 0x4e65726f2d756d75ULL;
+            for(auto &value : values) {
+                seed += 0x9e3779b97f4a7c15ULL;
+                quint64 z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                value = z ^ (z >> 31);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    QByteArray ChunkPath(const QByteArray &store, const QByteArray &digest)
+    {
+        const QByteArray hex = digest.toHex();
+        return store + '/' + hex.left(2) + '/' + hex;
+    }
+
+    bool StoreChunk(const QByteArray &store, const QByteArray &data, const QByteArray &digest, std::atomic<qint64> &stored)
+    {
+        static std::atomic<quint64> tmpCounter(0);
+
+        const QByteArray path = ChunkPath(store, digest);
+        // already there from an earlier snapshot (or elsewhere in this one)
+        if(access(path.constData(), F_OK) == 0)
+            return true;
+        const QByteArray dir = path.left(path.lastIndexOf('/'));
+        if(mkdir(dir.constData(), 0755) != 0 && errno != EEXIST)
+            return false;
+
+        const QByteArray compressed = qCompress(data, 3);
+        const QByteArray tmpPath = path + ".tmp" + QByteArray::number(getpid()) + '.' + QByteArray::number(tmpCounter++);
+        QFile tmp(QString::fromLocal8Bit(tmpPath));
+        if(!tmp.open(QIODevice::WriteOnly) || tmp.write(compressed) != compressed.size()) {
+            tmp.remove();
+            return false;
+        }
+        tmp.close();
+        if(rename(tmpPath.constData(), path.constData()) != 0) {
+            unlink(tmpPath.constData());
+            return false;
+        }
+        stored += compressed.size();
+        return true;
+    }
+
+    // Streams the file through the chunker, storing any chunk the store doesn't have yet.
+    bool ChunkFile(const QByteArray &store, const QByteArray &filePath, Entry &entry, std::atomic<qint64> &stored)
+    {
+        const int fd = open(filePath.constData(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if(fd < 0)
+            return false;
+
+        const auto &gear = GearTable();
+        std::vector<char> buf(maxChunk);
+        size_t filled = 0;
+        bool eof = false, ok = true;
+        entry.chunks.clear();
+        while(ok) {
+            while(!eof && filled < maxChunk) {
+                const ssize_t got = read(fd, buf.data() + filled, maxChunk - filled);
+                if(got < 0) {
+                    if(errno == EINTR) continue;
+                    ok = false;
+                    break;
+                }
+                if(got == 0) eof = true;
+                else filled += got;
+            }
+            if(!ok || filled == 0)
+                break;
+
+            size_t cut = filled;
+            if(filled > minChunk) {
+                quint64 hash = 0;
+                for(size_t i = minChunk; i < filled; ++i) {
+                    hash = (hash << 1) + gear[(uchar)buf[i]];
+                    if(!(hash & chunkMask)) {
+                        cut = i+1;
+                        break;
+                    }
+                }
+            }
+
+            const QByteArray chunk = QByteArray::fromRawData(buf.data(), cut);
+            const QByteArray digest = QCryptographicHash::hash(chunk, QCryptographicHash::Sha256);
+            if(!StoreChunk(store, chunk, digest, stored))
+                ok = false;
+            entry.chunks << digest;
+
+            memmove(buf.data(), buf.data() + cut, filled - cut);
+            filled -= cut;
+        }
+        close(fd);
+        return ok;
+    }
+
+    bool WriteFromChunks(const QByteArray &store, const Entry &entry, const QByteArray &dstPath)
+    {
+        const int out = open(dstPath.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, entry.mode);
+        if(out < 0)
+            return false;
+
+        bool ok = true;
+        for(const QByteArray &digest : entry.chunks) {
+            QFile chunkFile(QString::fromLocal8Bit(ChunkPath(store, digest)));
+            if(!chunkFile.open(QIODevice::ReadOnly)) {
+                ok = false;
+                break;
+            }
+            const QByteArray data = qUncompress(chunkFile.readAll());
+            // a damaged chunk store shouldn't silently put garbage back into the prefix
+            if(QCryptographicHash::hash(data, QCryptographicHash::Sha256) != digest) {
+                ok = false;
+                break;
+            }
+            qint64 written = 0;
+            while(written < data.size()) {
+                const ssize_t put = write(out, data.constData() + written, data.size() - written);
+                if(put < 0) {
+                    if(errno == EINTR) continue;
+                    ok = false;
+                    break;
+                }
+                written += put;
+            }
+            if(!ok) break;
+        }
+
+        if(ok) {
+            fchmod(out, entry.mode);
+            const struct timespec mtime = { (time_t)(entry.mtime / 1000000000LL), (long)(entry.mtime % 1000000000LL) };
+            const struct timespec times[2] = { mtime, mtime };
+            futimens(out, times);
+        }
+        if(close(out) != 0)
+            ok = false;
+        if(!ok)
+            unlink(dstPath.constData());
+        return ok;
+    }
+
+    // Runs func over [0, count) on a few workers while the calling thread reports progress.
+    // Returns false if canceled.
+    template<typename Func, typename Update>
+    bool RunPool(const size_t count, Func func, Update update, const bool cancelable,
+                 NeroSnapshot::Stats &stats, const NeroSnapshot::ProgressFunc &progress)
+    {
+        std::atomic<size_t> next(0), done(0);
+        std::atomic<bool> cancel(false);
+        std::vector<std::thread> workers;
+        const int threadCount = qBound(2, QThread::idealThreadCount(), 8);
+        for(int t = 0; t < threadCount && (size_t)t < count; ++t)
+            workers.emplace_back([&]() {
+                for(size_t i = next++; i < count && !cancel; i = next++) {
+                    func(i);
+                    done++;
+                }
+            });
+
+        while(done < count && !cancel) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            update();
+            if(progress && !progress(stats) && cancelable)
+                cancel = true;
+        }
+        for(auto &worker : workers)
+            worker.join();
+        update();
+        return !cancel;
+    }
+}
+
+QList<NeroSnapshot::Info> NeroSnapshot::List(const QString &snapshotsPath)
+{
+    QList<Info> snapshots;
+    const QDir dir(snapshotsPath);
+    for(const QString &id : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        if(id.startsWith('.') || id.endsWith(".tmp") || !dir.exists(id + "/snapshot.ini"))
+            continue;
+        QSettings ini(dir.path() + '/' + id + "/snapshot.ini", QSettings::IniFormat);
+        Info info;
+        info.id = id;
+        info.path = dir.path() + '/' + id;
+        info.created = ini.value("Snapshot/Created").toDateTime();
+        info.reason = ini.value("Snapshot/Reason").toString();
+        info.mode = ini.value("Snapshot/Mode").toInt();
+        info.files = ini.value("Snapshot/Files").toLongLong();
+        info.storedBytes = ini.value("Snapshot/StoredBytes").toLongLong();
+        snapshots << info;
+    }
+    // newest first
+    std::sort(snapshots.begin(), snapshots.end(), [](const Info &a, const Info &b) { return a.created > b.created; });
+    return snapshots;
+}
+
+bool NeroSnapshot::Create(const QString &prefixPath, const QString &snapshotsPath, const QString &reason,
+                          Stats &stats, const ProgressFunc &progress, QString *newId)
+{
+    stats = Stats();
+
+    const QByteArray root = prefixPath.toLocal8Bit();
+    struct stat rootStat;
+    if(stat(root.constData(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode))
+        return false;
+    if(!QDir().mkpath(snapshotsPath))
+        return false;
+
+    const QDateTime now = QDateTime::currentDateTime();
+    QString id = now.toString("yyyyMMdd-HHmmss");
+    for(int i = 2; QFileInfo::exists(snapshotsPath + '/' + id); ++i)
+        id = now.toString("yyyyMMdd-HHmmss") + QString("-%1").arg(i);
+    const QString snapshotPath = snapshotsPath + '/' + id;
+    const QString tmpPath = snapshotPath + ".tmp";
+    if(!QDir().mkpath(tmpPath))
+        return false;
+
+    const int mode = NeroCopy::SupportsReflink(root + "/system.reg", tmpPath.toLocal8Bit()) ? ModeReflink : ModeChunked;
+    bool ok = false;
+
+    if(mode == ModeReflink) {
+        NeroCopy::Stats copyStats;
+        ok = NeroCopy::CloneTree(prefixPath, tmpPath + "/tree", copyStats, excludedDirs, [&](const NeroCopy::Stats &current) {
+            stats.files = stats.filesChanged = current.files;
+            stats.totalFiles = current.totalFiles;
+            // anything that couldn't be reflinked had to be copied for real
+            stats.bytesStored = current.bytesCopied;
+            stats.errors = current.errors;
+            return progress ? progress(stats) : true;
+        });
+        stats.files = stats.filesChanged = copyStats.files;
+        stats.totalFiles = copyStats.totalFiles;
+        stats.bytesStored = copyStats.bytesCopied;
+        stats.errors = copyStats.errors;
+    } else {
+        std::vector<Entry> entries;
+        ListTree(root, QByteArray(), rootStat.st_dev, entries, stats.errors);
+
+        // anything unchanged since the newest chunked snapshot just reuses its chunks, without being read at all
+        std::vector<Entry> previous;
+        for(const Info &info : List(snapshotsPath))
+            if(info.mode == ModeChunked && LoadManifest(info.path + "/manifest", previous))
+                break;
+        QHash<QByteArray, const Entry*> previousByPath;
+        for(const Entry &entry : previous)
+            previousByPath.insert(entry.path, &entry);
+
+        std::vector<size_t> toChunk;
+        for(size_t i = 0; i < entries.size(); ++i) {
+            Entry &entry = entries[i];
+            if(entry.type != EntryFile)
+                continue;
+            stats.totalFiles++;
+            const Entry *old = previousByPath.value(entry.path, nullptr);
+            if(old && SameFile(*old, entry)) {
+                entry.chunks = old->chunks;
+                stats.files++;
+            } else toChunk.push_back(i);
+        }
+
+        const QByteArray store = QString(snapshotsPath + "/.chunks").toLocal8Bit();
+        QDir().mkpath(snapshotsPath + "/.chunks");
+        const qint64 unchanged = stats.files;
+        std::atomic<qint64> chunked(0), stored(0), errors(0);
+        ok = RunPool(toChunk.size(), [&](const size_t i) {
+            Entry &entry = entries[toChunk[i]];
+            if(!ChunkFile(store, root + '/' + entry.path, entry, stored))
+                errors++;
+            chunked++;
+        }, [&]() {
+            stats.files = unchanged + chunked;
+            stats.filesChanged = chunked;
+            stats.bytesStored = stored;
+            stats.errors += errors.exchange(0);
+        }, true, stats, progress);
+
+        ok = ok && stats.errors == 0 && SaveManifest(tmpPath + "/manifest", entries);
+    }
+    if(progress) progress(stats);
+
+    if(ok) {
+        {
+            QSettings ini(tmpPath + "/snapshot.ini", QSettings::IniFormat);
+            ini.setValue("Snapshot/Created", now);
+            ini.setValue("Snapshot/Reason", reason);
+            ini.setValue("Snapshot/Mode", mode);
+            ini.setValue("Snapshot/Files", stats.totalFiles);
+            ini.setValue("Snapshot/StoredBytes", stats.bytesStored);
+            ini.sync();
+            ok = ini.status() == QSettings::NoError;
+        }
+        // the snapshot only shows up once it's complete
+        ok = ok && rename(tmpPath.toLocal8Bit().constData(), snapshotPath.toLocal8Bit().constData()) == 0;
+    }
+    if(!ok) {
+        NeroCopy::Stats removeStats;
+        NeroCopy::RemoveTree(tmpPath, removeStats);
+        return false;
+    }
+
+    if(newId) *newId = id;
+    return true;
+}
+
+bool NeroSnapshot::Restore(const QString &prefixPath, const QString &snapshotsPath, const QString &id,
+                           Stats &stats, const ProgressFunc &progress)
+{
+    stats = Stats();
+
+    const QString snapshotPath = snapshotsPath + '/' + id;
+    if(id.isEmpty() || id.contains('/') || !QFileInfo::exists(snapshotPath + "/snapshot.ini"))
+        return false;
+    const int mode = QSettings(snapshotPath + "/snapshot.ini", QSettings::IniFormat).value("Snapshot/Mode").toInt();
+
+    const QByteArray root = prefixPath.toLocal8Bit();
+    struct stat rootStat;
+    if(stat(root.constData(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode))
+        return false;
+
+    std::vector<Entry> wanted;
+    if(mode == ModeReflink) {
+        const QByteArray tree = QString(snapshotPath + "/tree").toLocal8Bit();
+        struct stat treeStat;
+        if(stat(tree.constData(), &treeStat) != 0)
+            return false;
+        ListTree(tree, QByteArray(), treeStat.st_dev, wanted, stats.errors);
+        for(Entry &entry : wanted)
+            entry.source = tree + '/' + entry.path;
+    } else if(!LoadManifest(snapshotPath + "/manifest", wanted)) {
+        return false;
+    }
+    if(stats.errors)
+        return false;
+
+    std::vector<Entry> current;
+    ListTree(root, QByteArray(), rootStat.st_dev, current, stats.errors);
+    QHash<QByteArray, const Entry*> currentByPath;
+    for(const Entry &entry : current)
+        currentByPath.insert(entry.path, &entry);
+    QHash<QByteArray, quint8> wantedTypes;
+    for(const Entry &entry : wanted)
+        wantedTypes.insert(entry.path, entry.type);
+
+    // 1. get rid of whatever was added since (children first, so dirs are empty by the time they're reached)
+    for(auto entry = current.rbegin(); entry != current.rend(); ++entry) {
+        const auto wantedType = wantedTypes.constFind(entry->path);
+        if(wantedType != wantedTypes.constEnd() && *wantedType == entry->type)
+            continue;
+        const QByteArray path = root + '/' + entry->path;
+        if(entry->type == EntryDir) {
+            NeroCopy::Stats removeStats;
+            if(!NeroCopy::RemoveTree(QString::fromLocal8Bit(path), removeStats))
+                stats.errors++;
+        } else if(unlink(path.constData()) != 0 && errno != ENOENT) {
+            stats.errors++;
+        }
+        currentByPath.remove(entry->path);
+    }
+
+    // 2. directories & links, in order so parents exist first
+    std::vector<size_t> toRestore;
+    for(size_t i = 0; i < wanted.size(); ++i) {
+        const Entry &entry = wanted.at(i);
+        const QByteArray path = root + '/' + entry.path;
+        const Entry *existing = currentByPath.value(entry.path, nullptr);
+        if(entry.type == EntryDir) {
+            if(!existing && mkdir(path.constData(), entry.mode) != 0 && errno != EEXIST)
+                stats.errors++;
+            else if(existing && existing->mode != entry.mode)
+                chmod(path.constData(), entry.mode);
+        } else if(entry.type == EntryLink) {
+            if(existing && existing->linkTarget == entry.linkTarget)
+                continue;
+            unlink(path.constData());
+            if(symlink(entry.linkTarget.constData(), path.constData()) != 0)
+                stats.errors++;
+        } else {
+            stats.totalFiles++;
+            if(existing && SameFile(*existing, entry))
+                stats.files++;
+            else toRestore.push_back(i);
+        }
+    }
+
+    // 3. only the files that actually changed get written back, which is what keeps small rollbacks quick
+    const QByteArray store = QString(snapshotsPath + "/.chunks").toLocal8Bit();
+    const qint64 unchanged = stats.files;
+    std::atomic<qint64> restored(0), errors(0);
+    // not cancelable: stopping halfway would leave the prefix a mix of before & after
+    RunPool(toRestore.size(), [&](const size_t i) {
+        const Entry &entry = wanted.at(toRestore[i]);
+        const QByteArray path = root + '/' + entry.path;
+        const QByteArray tmpPath = path + ".nero-restore";
+        bool ok;
+        if(mode == ModeReflink) {
+            struct stat st;
+            memset(&st, 0, sizeof(st));
+            st.st_mode = S_IFREG | entry.mode;
+            st.st_size = entry.size;
+            st.st_mtim = { (time_t)(entry.mtime / 1000000000LL), (long)(entry.mtime % 1000000000LL) };
+            st.st_atim = st.st_mtim;
+            ok = NeroCopy::CloneFile(entry.source, tmpPath, st) != NeroCopy::CloneFailed;
+            if(ok) chmod(tmpPath.constData(), entry.mode);
+        } else ok = WriteFromChunks(store, entry, tmpPath);
+
+        if(ok && rename(tmpPath.constData(), path.constData()) != 0) {
+            unlink(tmpPath.constData());
+            ok = false;
+        }
+        if(!ok) errors++;
+        restored++;
+    }, [&]() {
+        stats.files = unchanged + restored;
+        stats.filesChanged = restored;
+        stats.errors += errors.exchange(0);
+    }, false, stats, progress);
+    if(progress) progress(stats);
+
+    return stats.errors == 0;
+}
+
+int NeroSnapshot::Prune(const QString &snapshotsPath, const int keep)
+{
+    const QList<Info> snapshots = List(snapshotsPath);
+    int removed = 0;
+    for(int i = qMax(0, keep); i < snapshots.count(); ++i) {
+        NeroCopy::Stats removeStats;
+        if(NeroCopy::RemoveTree(snapshots.at(i).path, removeStats))
+            removed++;
+    }
+    // leftovers from snapshots that never finished
+    for(const QString &tmp : QDir(snapshotsPath).entryList({"*.tmp"}, QDir::Dirs | QDir::NoDotAndDotDot)) {
+        NeroCopy::Stats removeStats;
+        NeroCopy::RemoveTree(snapshotsPath + '/' + tmp, removeStats);
+    }
+
+    // drop any chunks no remaining snapshot refers to
+    const QDir store(snapshotsPath + "/.chunks");
+    if(removed && store.exists()) {
+        QSet<QByteArray> referenced;
+        for(const Info &info : List(snapshotsPath)) {
+            if(info.mode != ModeChunked)
+                continue;
+            std::vector<Entry> entries;
+            // can't tell what's still needed, so better to leave everything be
+            if(!LoadManifest(info.path + "/manifest", entries))
+                return removed;
+            for(const Entry &entry : entries)
+                for(const QByteArray &digest : entry.chunks)
+                    referenced.insert(digest.toHex());
+        }
+        for(const QString &bucket : store.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            QDir bucketDir(store.path() + '/' + bucket);
+            for(const QString &chunk : bucketDir.entryList(QDir::Files))
+                if(!referenced.contains(chunk.toLatin1()))
+                    bucketDir.remove(chunk);
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,75 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Prefix snapshots (reflinked, or chunked & compressed) and restoring them.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROSNAPSHOT_H
+#define NEROSNAPSHOT_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+class NeroSnapshot
+{
+public:
+    enum {
+        // a full copy of the prefix tree, sharing all its extents with the prefix (btrfs, xfs, etc.)
+        ModeReflink = 0,
+        // a manifest pointing into a compressed, content-addressed chunk store shared by the prefix's snapshots,
+        // so each snapshot only costs whatever changed since the last one
+        ModeChunked
+    } Modes_e;
+
+    struct Info {
+        QString id;
+        QString path;
+        QDateTime created;
+        QString reason;
+        int mode = ModeReflink;
+        qint64 files = 0;
+        // new data this snapshot had to write out (excluding anything shared with the prefix or earlier snapshots)
+        qint64 storedBytes = 0;
+    };
+
+    struct Stats {
+        qint64 files = 0;
+        qint64 totalFiles = 0;
+        // files that had to be read (snapshot) or written back (restore), as opposed to being unchanged
+        qint64 filesChanged = 0;
+        qint64 bytesStored = 0;
+        qint64 errors = 0;
+    };
+
+    // Called from the calling thread every so often (so GUI callers can pump events); return false to cancel.
+    typedef std::function<bool(const Stats &)> ProgressFunc;
+
+    // snapshotsPath is the per-prefix snapshot dir, e.g. <home>/.snapshots/<prefix>
+    static QList<Info> List(const QString &snapshotsPath);
+    static bool Create(const QString &prefixPath, const QString &snapshotsPath, const QString &reason,
+                       Stats &stats, const ProgressFunc &progress = nullptr, QString *newId = nullptr);
+    // Only files that differ from the snapshot (by type, size, mode or mtime) are written back, and anything
+    // added since is removed; logs & shader caches are left alone.
+    static bool Restore(const QString &prefixPath, const QString &snapshotsPath, const QString &id,
+                        Stats &stats, const ProgressFunc &progress = nullptr);
+    // keeps the newest `keep` snapshots; returns how many were removed
+    static int Prune(const QString &snapshotsPath, const int keep);
+};
+
+#endif // NEROSNAPSHOT_H
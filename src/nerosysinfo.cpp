@@ -0,0 +1,451 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Host & runner capability probing.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerosysinfo.h"
+#include "neroconstants.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QSet>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+// futex_waitv is the same syscall number on every arch using the generic table
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+
+QVersionNumber NeroSysInfo::GetKernelVersion()
+{
+    struct utsname name;
+    if(uname(&name) != 0)
+        return QVersionNumber();
+
+    // e.g. "6.14.2-arch1-1", fromString stops at the first non-numeric part
+    return QVersionNumber::fromString(QString::fromLocal8Bit(name.release));
+}
+
+bool NeroSysInfo::HasNtsyncDevice(const QString &devRoot)
+{
+    const QByteArray device = QString(devRoot + "/ntsync").toLocal8Bit();
+    return access(device.constData(), R_OK | W_OK) == 0;
+}
+
+bool NeroSysInfo::HasFutexWaitv()
+{
+    // no waiters is always invalid, so a supporting kernel says EINVAL rather than ENOSYS
+    errno = 0;
+    syscall(SYS_futex_waitv, nullptr, 0, 0, nullptr, 0);
+    return errno != ENOSYS;
+}
+
+bool NeroSysInfo::HasEsyncLimits()
+{
+    // esync eats a file descriptor per sync object; Proton's docs ask for 524288
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+    return limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= 524288;
+}
+
+NeroSysInfo::RunnerCaps NeroSysInfo::GetRunnerCaps(const QString &runnerPath)
+{
+    // the wine binaries are a few MB, so only rescan when the runner's been replaced/updated.
+    static QHash<QString, QPair<qint64, RunnerCaps>> capsCache;
+
+    const QFileInfo versionInfo(runnerPath + "/version");
+    const qint64 stamp = versionInfo.exists() ? versionInfo.lastModified().toMSecsSinceEpoch() : 0;
+    if(capsCache.contains(runnerPath) && capsCache.value(runnerPath).first == stamp)
+        return capsCache.value(runnerPath).second;
+
+    RunnerCaps caps;
+
+    // version file is "<build timestamp> <runner name>", e.g. "1750000000 GE-Proton10-9"
+    QFile versionFile(versionInfo.filePath());
+    if(versionFile.open(QIODevice::ReadOnly)) {
+        const QString line = QString::fromUtf8(versionFile.readLine()).trimmed();
+        caps.name = line.mid(line.indexOf(' ')+1);
+    }
+    if(caps.name.isEmpty())
+        caps.name = QFileInfo(runnerPath).fileName();
+
+    // The unix side of ntdll is what actually opens /dev/ntsync & checks WINEFSYNC/WINEESYNC,
+    // so asking the runner's own build is more reliable than guessing from the name.
+    bool scanned = false;
+    for(const QString &ntdll : { QString("/files/lib/wine/x86_64-unix/ntdll.so"),
+                                 QString("/files/lib64/wine/x86_64-unix/ntdll.so"),
+                                 QString("/dist/lib64/wine/x86_64-unix/ntdll.so") }) {
+        QFile lib(runnerPath + ntdll);
+        if(lib.open(QIODevice::ReadOnly)) {
+            const QByteArray data = lib.readAll();
+            caps.ntsync = data.contains("/dev/ntsync");
+            caps.fsync = data.contains("WINEFSYNC");
+            caps.esync = data.contains("WINEESYNC");
+            scanned = true;
+            break;
+        }
+    }
+
+    // Fallback capability table for runners with an unfamiliar layout.
+    if(!scanned) {
+        static const QRegularExpression geVersion("GE-Proton(\\d+)-(\\d+)");
+        static const QRegularExpression valveVersion("(?:proton|experimental)-(\\d+)\\.", QRegularExpression::CaseInsensitiveOption);
+        const QRegularExpressionMatch ge = geVersion.match(caps.name);
+        const QRegularExpressionMatch valve = valveVersion.match(caps.name);
+        if(ge.hasMatch()) {
+            const int major = ge.captured(1).toInt(), minor = ge.captured(2).toInt();
+            caps.ntsync = major > 10 || (major == 10 && minor >= 9);
+        } else if(valve.hasMatch()) {
+            caps.ntsync = valve.captured(1).toInt() >= 11;
+        }
+    }
+
+    // Runners that need to be told to use ntsync check for PROTON_USE_NTSYNC in their launcher script;
+    // ones that enable it on their own only look for PROTON_NO_NTSYNC.
+    QFile protonScript(runnerPath + "/proton");
+    if(caps.ntsync && protonScript.open(QIODevice::ReadOnly)) {
+        const QByteArray script = protonScript.readAll();
+        caps.ntsyncOptIn = script.contains("PROTON_USE_NTSYNC") && !script.contains("PROTON_NO_NTSYNC");
+    }
+
+    // GE-Proton10-9 was the first (opt-in) ntsync release, and only hooks it up under WOW64.
+    if(caps.name == "GE-Proton10-9")
+        caps.ntsyncOptIn = true, caps.ntsyncNeedsWow64 = true;
+
+    capsCache.insert(runnerPath, qMakePair(stamp, caps));
+    return caps;
+}
+
+NeroSysInfo::SyncChoice NeroSysInfo::DetectFastestSync(const QString &runnerPath)
+{
+    SyncChoice choice;
+    const RunnerCaps caps = GetRunnerCaps(runnerPath);
+    const QVersionNumber kernel = GetKernelVersion();
+    QStringList notes;
+
+    if(caps.ntsync && HasNtsyncDevice()) {
+        choice.mode = NeroConstant::NTsync;
+        choice.ntsyncOptIn = caps.ntsyncOptIn;
+        choice.ntsyncNeedsWow64 = caps.ntsyncNeedsWow64;
+        choice.reason = QString("/dev/ntsync available, %1 supports it").arg(caps.name);
+        return choice;
+    }
+
+    if(!caps.ntsync)
+        notes << QString("%1 has no ntsync support").arg(caps.name);
+    else if(kernel < QVersionNumber(6, 14))
+        notes << QString("kernel %1 predates ntsync (6.14)").arg(kernel.toString());
+    else notes << "/dev/ntsync missing or not accessible (is the ntsync module loaded?)";
+
+    if(caps.fsync && HasFutexWaitv()) {
+        choice.mode = NeroConstant::Fsync;
+        notes << QString("kernel %1 supports futex_waitv").arg(kernel.toString());
+    } else if(caps.esync && HasEsyncLimits()) {
+        choice.mode = NeroConstant::Esync;
+        notes << (caps.fsync ? "no futex_waitv in kernel" : QString("%1 has no fsync support").arg(caps.name));
+    } else {
+        choice.mode = NeroConstant::NoSync;
+        notes << "file descriptor limit too low for esync";
+    }
+
+    choice.reason = notes.join(", ");
+    return choice;
+}
+
+QString NeroSysInfo::SyncModeName(const int mode)
+{
+    switch(mode) {
+    case NeroConstant::NTsync: return "NTsync";
+    case NeroConstant::Fsync:  return "Fsync";
+    case NeroConstant::Esync:  return "Esync";
+    default:                   return "Legacy (wineserver) sync";
+    }
+}
+
+static QByteArray ReadSysFile(const QString &path)
+{
+    QFile file(path);
+    if(file.open(QIODevice::ReadOnly))
+        return file.readAll().trimmed();
+    return QByteArray();
+}
+
+static QString FormatBytes(const quint64 bytes)
+{
+    if(bytes >= 1024ull*1024*1024)
+        return QString("%1 GiB").arg(bytes / (1024.0*1024*1024), 0, 'f', 1);
+    return QString("%1 MiB").arg(bytes / (1024.0*1024), 0, 'f', 0);
+}
+
+QList<NeroSysInfo::Check> NeroSysInfo::RunChecks(const QString &prefixesPath)
+{
+    QList<Check> checks;
+
+    // esync needs lots of fds; Nero raises the soft limit itself, but can't go past the hard limit.
+    {
+        Check check;
+        check.name = "Open file limit (esync)";
+        struct rlimit limit;
+        getrlimit(RLIMIT_NOFILE, &limit);
+        check.ok = HasEsyncLimits();
+        check.value = QString("soft %1, hard %2").arg(limit.rlim_cur == RLIM_INFINITY ? QString("unlimited") : QString::number(limit.rlim_cur),
+                                                    limit.rlim_max == RLIM_INFINITY ? QString("unlimited") : QString::number(limit.rlim_max));
+        if(!check.ok)
+            check.hint = "Raise the hard limit to at least 524288, e.g. with \"DefaultLimitNOFILE=1024:524288\" in "
+                         "/etc/systemd/system.conf and /etc/systemd/user.conf, then log in again.";
+        checks << check;
+    }
+
+    // some newer titles (and anti-cheats) run out of memory mappings with the old 65530 default.
+    {
+        Check check;
+        check.name = "vm.max_map_count";
+        const qulonglong count = ReadSysFile("/proc/sys/vm/max_map_count").toULongLong();
+        check.ok = count >= 1048576;
+        check.value = QString::number(count);
+        if(!check.ok)
+            check.hint = "Run \"sudo sysctl -w vm.max_map_count=2147483642\", and add \"vm.max_map_count = 2147483642\" "
+                         "to /etc/sysctl.d/80-gamecompatibility.conf to keep it after reboot.";
+        checks << check;
+    }
+
+    // powersave is only a problem with the legacy cpufreq drivers; pstate drivers manage themselves with EPP.
+    {
+        Check check;
+        check.name = "CPU frequency governor";
+        QSet<QString> governors;
+        const QStringList cpus = QDir("/sys/devices/system/cpu").entryList({"cpu[0-9]*"}, QDir::Dirs);
+        for(const QString &cpu : cpus) {
+            const QByteArray governor = ReadSysFile("/sys/devices/system/cpu/" + cpu + "/cpufreq/scaling_governor");
+            if(!governor.isEmpty())
+                governors << QString::fromLatin1(governor);
+        }
+        const QString driver = QString::fromLatin1(ReadSysFile("/sys/devices/system/cpu/cpu0/cpufreq/scaling_driver"));
+        if(governors.isEmpty()) {
+            check.value = "not exposed by this system";
+        } else {
+            QStringList list(governors.begin(), governors.end());
+            list.sort();
+            check.value = list.join(", ") + (driver.isEmpty() ? QString() : " (" + driver + ')');
+            const bool pstate = driver.contains("pstate");
+            check.ok = !governors.contains("conservative") && !(governors.contains("powersave") && !pstate);
+        }
+        if(!check.ok)
+            check.hint = "Switch to the performance or schedutil governor, e.g. \"powerprofilesctl set performance\" "
+                         "or \"sudo cpupower frequency-set -g performance\".";
+        checks << check;
+    }
+
+    // the active mode is the bracketed one, e.g. "always [madvise] never"
+    {
+        Check check;
+        check.name = "Transparent hugepages";
+        const QByteArray thp = ReadSysFile("/sys/kernel/mm/transparent_hugepage/enabled");
+        const int start = thp.indexOf('['), end = thp.indexOf(']');
+        check.value = (start >= 0 && end > start) ? QString::fromLatin1(thp.mid(start+1, end-start-1)) : QString("unknown");
+        check.ok = check.value != "never";
+        if(!check.ok)
+            check.hint = "Enable hugepages for apps that ask for them: "
+                         "\"echo madvise | sudo tee /sys/kernel/mm/transparent_hugepage/enabled\".";
+        checks << check;
+    }
+
+    {
+        Check check;
+        check.name = "NTsync device";
+        const QVersionNumber kernel = GetKernelVersion();
+        check.ok = HasNtsyncDevice();
+        if(check.ok)
+            check.value = "/dev/ntsync accessible";
+        else if(QFileInfo::exists("/dev/ntsync")) {
+            check.value = "/dev/ntsync exists, but isn't accessible";
+            check.hint = "Give your user read/write access, e.g. with the udev rule "
+                         "KERNEL==\"ntsync\", MODE=\"0666\" (or \"0660\" with a group you're in).";
+        } else if(kernel < QVersionNumber(6, 14)) {
+            check.value = QString("kernel %1 has no ntsync driver").arg(kernel.toString());
+            check.hint = "NTsync needs Linux 6.14 or newer; Fsync will be used in the meantime.";
+        } else {
+            check.value = "ntsync module not loaded";
+            check.hint = "Run \"sudo modprobe ntsync\", and add \"ntsync\" to /etc/modules-load.d/ntsync.conf to load it at boot.";
+        }
+        checks << check;
+    }
+
+    // a box that's already swapping hard will stutter no matter what the game does.
+    {
+        Check check;
+        check.name = "Memory & swap pressure";
+        qulonglong swapTotal = 0, swapFree = 0, memAvailable = 0;
+        QFile meminfo("/proc/meminfo");
+        if(meminfo.open(QIODevice::ReadOnly)) {
+            while(!meminfo.atEnd()) {
+                const QList<QByteArray> fields = meminfo.readLine().simplified().split(' ');
+                if(fields.count() < 2) continue;
+                if(fields.at(0) == "SwapTotal:")         swapTotal = fields.at(1).toULongLong() * 1024;
+                else if(fields.at(0) == "SwapFree:")     swapFree = fields.at(1).toULongLong() * 1024;
+                else if(fields.at(0) == "MemAvailable:") memAvailable = fields.at(1).toULongLong() * 1024;
+            }
+        }
+        // "some avg10=1.23 avg60=..." - share of time any task was stalled on memory
+        double stall = 0;
+        const QList<QByteArray> pressure = ReadSysFile("/proc/pressure/memory").split('\n').value(0).split(' ');
+        for(const QByteArray &field : pressure)
+            if(field.startsWith("avg10="))
+                stall = field.mid(6).toDouble();
+
+        const qulonglong swapUsed = swapTotal - swapFree;
+        check.value = QString("%1 available, %2 of %3 swap used, %4% stalled").arg(FormatBytes(memAvailable),
+                                                                                FormatBytes(swapUsed),
+                                                                                FormatBytes(swapTotal),
+                                                                                QString::number(stall, 'f', 1));
+        check.ok = stall < 10.0 && (swapTotal == 0 || swapUsed * 2 < swapTotal) && memAvailable >= 2048ull*1024*1024;
+        if(!check.ok)
+            check.hint = "The system is short on memory; close memory-hungry apps (e.g. web browsers) before playing, "
+                         "or consider setting up zram-based swap.";
+        checks << check;
+    }
+
+    // prefixes and the driver's shader cache can live on different drives, so check each one once.
+    {
+        const QString mesaCache = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+        const QList<QPair<QString, qulonglong>> volumes = {
+            { prefixesPath, 10ull*1024*1024*1024 },
+            { mesaCache, 2ull*1024*1024*1024 }
+        };
+        QSet<qulonglong> seenDevices;
+        for(const auto &volume : volumes) {
+            if(volume.first.isEmpty())
+                continue;
+            struct stat dirStat;
+            struct statvfs fsStat;
+            const QByteArray path = volume.first.toLocal8Bit();
+            if(stat(path.constData(), &dirStat) != 0 || statvfs(path.constData(), &fsStat) != 0)
+                continue;
+            if(seenDevices.contains(dirStat.st_dev))
+                continue;
+            seenDevices << dirStat.st_dev;
+
+            Check check;
+            check.name = volume.first == prefixesPath ? "Free space (prefixes)" : "Free space (shader cache)";
+            const qulonglong freeBytes = (qulonglong)fsStat.f_bavail * fsStat.f_frsize;
+            check.ok = freeBytes >= volume.second;
+            check.value = QString("%1 free on %2").arg(FormatBytes(freeBytes), volume.first);
+            if(!check.ok)
+                check.hint = QString("Free up at least %1 on this drive; shader caches and game updates "
+                                     "can fail or stutter when space runs out.").arg(FormatBytes(volume.second));
+            checks << check;
+        }
+    }
+
+    return checks;
+}
+
+// Child processes inherit this, so esync gets its fds without the user having to raise the soft limit themselves.
+bool NeroSysInfo::RaiseFileLimit()
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+
+    // some old apps loop over every possible fd, so don't go overboard if the hard limit's huge.
+    const rlim_t target = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > 1048576) ? 1048576 : limit.rlim_max;
+    if(limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur >= target)
+        return true;
+
+    limit.rlim_cur = target;
+    return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+QList<NeroSysInfo::GpuDevice> NeroSysInfo::GetGpus(const QString &sysfsRoot)
+{
+    QList<GpuDevice> gpus;
+
+    // connectors show up as card0-DP-1 etc, so only take the bare cardN entries.
+    QDir drm(sysfsRoot + "/class/drm");
+    QStringList cards = drm.entryList({"card*"}, QDir::Dirs | QDir::NoDotAndDotDot);
+    cards.erase(std::remove_if(cards.begin(), cards.end(), [](const QString &card) { return card.contains('-'); }), cards.end());
+    // card10 should come after card9
+    std::sort(cards.begin(), cards.end(), [](const QString &a, const QString &b) { return a.mid(4).toInt() < b.mid(4).toInt(); });
+
+    for(const QString &card : std::as_const(cards)) {
+        const QString devicePath = drm.path() + '/' + card + "/device";
+        GpuDevice gpu;
+        gpu.card = card;
+        gpu.vendor = ReadSysFile(devicePath + "/vendor").toUShort(nullptr, 16);
+        gpu.device = ReadSysFile(devicePath + "/device").toUShort(nullptr, 16);
+        gpu.bootVga = ReadSysFile(devicePath + "/boot_vga") == "1";
+
+        const QList<QByteArray> uevent = ReadSysFile(devicePath + "/uevent").split('\n');
+        for(const QByteArray &line : uevent) {
+            if(line.startsWith("PCI_SLOT_NAME="))
+                gpu.pciSlot = QString::fromLatin1(line.mid(14));
+            else if(line.startsWith("DRIVER="))
+                gpu.driver = QString::fromLatin1(line.mid(7));
+        }
+
+        // non-PCI devices (e.g. simpledrm, virtual displays) can't be picked by any of the selectors anyways
+        if(gpu.pciSlot.isEmpty() || !gpu.vendor)
+            continue;
+
+        bool duplicate = false;
+        for(const GpuDevice &existing : std::as_const(gpus))
+            if(existing.pciSlot == gpu.pciSlot)
+                duplicate = true;
+        if(!duplicate)
+            gpus << gpu;
+    }
+
+    return gpus;
+}
+
+QString NeroSysInfo::GpuVendorName(const quint16 vendor)
+{
+    switch(vendor) {
+    case 0x1002: return "AMD";
+    case 0x10de: return "NVIDIA";
+    case 0x8086: return "Intel";
+    case 0x5143: return "Qualcomm";
+    case 0x1af4: return "VirtIO";
+    default:     return QString("Vendor %1").arg(vendor, 4, 16, QChar('0'));
+    }
+}
+
+QString NeroSysInfo::GpuLabel(const GpuDevice &gpu)
+{
+    return QString("%1 [%2:%3] @ %4%5%6").arg(GpuVendorName(gpu.vendor),
+                                             QString("%1").arg(gpu.vendor, 4, 16, QChar('0')),
+                                             QString("%1").arg(gpu.device, 4, 16, QChar('0')),
+                                             gpu.pciSlot,
+                                             gpu.driver.isEmpty() ? QString() : " (" + gpu.driver + ')',
+                                             gpu.bootVga ? QString(" - primary") : QString());
+}
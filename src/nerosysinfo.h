@@ -0,0 +1,82 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Host & runner capability probing.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROSYSINFO_H
+#define NEROSYSINFO_H
+
+#include <QString>
+#include <QList>
+#include <QVersionNumber>
+
+class NeroSysInfo
+{
+public:
+    struct RunnerCaps {
+        QString name;
+        bool ntsync = false;
+        // runner only uses ntsync when asked to with PROTON_USE_NTSYNC
+        bool ntsyncOptIn = false;
+        // GE-Proton10-9 additionally needs WOW64 for ntsync to kick in
+        bool ntsyncNeedsWow64 = false;
+        bool fsync = true;
+        bool esync = true;
+    };
+
+    struct SyncChoice {
+        int mode = 0;
+        bool ntsyncOptIn = false;
+        bool ntsyncNeedsWow64 = false;
+        QString reason;
+    };
+
+    static QVersionNumber GetKernelVersion();
+    static bool HasNtsyncDevice(const QString &devRoot = "/dev");
+    static bool HasFutexWaitv();
+    static bool HasEsyncLimits();
+
+    static RunnerCaps GetRunnerCaps(const QString &runnerPath);
+    static SyncChoice DetectFastestSync(const QString &runnerPath);
+    static QString SyncModeName(const int mode);
+
+    // nero-umu --doctor & the preferences readiness panel
+    struct Check {
+        QString name;
+        bool ok = true;
+        QString value;
+        QString hint;
+    };
+    static QList<Check> RunChecks(const QString &prefixesPath);
+    static bool RaiseFileLimit();
+
+    // DRM render devices, as listed under /sys/class/drm
+    struct GpuDevice {
+        QString card;
+        // e.g. "0000:01:00.0"
+        QString pciSlot;
+        quint16 vendor = 0;
+        quint16 device = 0;
+        bool bootVga = false;
+        QString driver;
+    };
+    static QList<GpuDevice> GetGpus(const QString &sysfsRoot = "/sys");
+    static QString GpuVendorName(const quint16 vendor);
+    static QString GpuLabel(const GpuDevice &gpu);
+};
+
+#endif // NEROSYSINFO_H
@@ -30,11 +30,13 @@
 #include "ui_nerotricks.h"
 #include "nerofs.h"
 
+#include <QDataStream>
 #include <QDir>
+#include <QFileInfo>
 #include <QProcess>
 #include <QMessageBox>
 #include <QPushButton>
-#include <QThread>
+#include <QSaveFile>
 #include <QShortcut>
 
 NeroTricksWindow::NeroTricksWindow(QWidget *parent, const QString &runner)
@@ -47,30 +49,24 @@ NeroTricksWindow::NeroTricksWindow(QWidget *parent, const QString &runner)
 	QShortcut *shortcutClose = new QShortcut(QKeySequence::Close, this);
 	connect(shortcutClose, &QShortcut::activated, this,&NeroTricksWindow::close);
 
-    if(winetricksAvailVerbs.isEmpty())
-        InitVerbs(runner);
-
-    for(int i = 0; i < winetricksAvailVerbs.count(); ++i) {
-        verbSelector << new QCheckBox(winetricksAvailVerbs.at(i), this);
-        verbSelector.at(i)->setProperty("slot", i);
-        verbDesc << new QLabel(winetricksDescriptions.at(i), this);
-        verbDesc.at(i)->setAlignment(Qt::AlignRight);
-        verbDesc.at(i)->setWordWrap(true);
-        ui->verbsList->addWidget(verbSelector.at(i), i, 0);
-        ui->verbsList->addWidget(verbDesc.at(i), i, 1);
-        verbIsSelected.insert(winetricksAvailVerbs.at(i), false);
-        connect(verbSelector.at(i), &QCheckBox::stateChanged, this, &NeroTricksWindow::verbSelectors_stateChanged);
+    InitVerbs(runner);
+    // only for the winetricks that was asked for, not whatever was loaded before
+    if(catalog.winetricks == NeroFS::GetWinetricks(runner)) {
+        winetricksAvailVerbs = catalog.verbs;
+        winetricksDescriptions = catalog.descriptions;
     }
 
-    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+    // only the rows on screen ever get laid out or painted, so this is cheap however many verbs there are
+    verbsModel = new NeroVerbModel(winetricksAvailVerbs, winetricksDescriptions, this);
+    verbsFilter = new NeroVerbFilter(verbsModel, this);
+    ui->verbsView->setModel(verbsFilter);
+    ui->verbsView->resizeColumnToContents(NeroVerbModel::ColumnVerb);
+    connect(verbsModel, &NeroVerbModel::checkedChanged, this, &NeroTricksWindow::verbsModel_checkedChanged);
 
-    // for some reason, this fixes scroll area being invisible until the user resizes horizontally
-    ui->scrollAreaContents->setVisible(false);
-    ui->scrollAreaContents->setVisible(true);
+    for(const QString &verb : std::as_const(winetricksAvailVerbs))
+        verbIsSelected.insert(verb, false);
 
-    completer = new QCompleter(winetricksAvailVerbs, this);
-    completer->setCaseSensitivity(Qt::CaseInsensitive);
-    ui->searchBox->setCompleter(completer);
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
 }
 
 NeroTricksWindow::~NeroTricksWindow()
@@ -78,162 +74,376 @@ NeroTricksWindow::~NeroTricksWindow()
     delete ui;
 }
 
+QString NeroVerbCatalog::GetCachePath()
+{
+    return NeroFS::GetPrefixesPath()->path() + "/.nero-verbs-cache";
+}
+
+// bump whenever the cache's layout (or what Parse filters out) changes, so old ones just get ignored
+static const quint32 cacheMagic = 0x4e525643; // "NRVC"
+static const quint32 cacheVersion = 1;
+
+static QList<NeroVerbCatalog::Catalog> LoadCatalogs()
+{
+    QList<NeroVerbCatalog::Catalog> catalogs;
+    QFile file(NeroVerbCatalog::GetCachePath());
+    if(!file.open(QIODevice::ReadOnly))
+        return catalogs;
+
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if(magic != cacheMagic || version != cacheVersion)
+        return catalogs;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        NeroVerbCatalog::Catalog catalog;
+        in >> catalog.winetricks >> catalog.mtime >> catalog.size >> catalog.verbs >> catalog.descriptions;
+        // a truncated cache is as good as none
+        if(catalog.verbs.count() == catalog.descriptions.count())
+            catalogs << catalog;
+    }
+    if(in.status() != QDataStream::Ok)
+        catalogs.clear();
+    return catalogs;
+}
+
+bool NeroVerbCatalog::Load(const QString &winetricks, Catalog &catalog)
+{
+    for(const Catalog &cached : LoadCatalogs())
+        if(cached.winetricks == winetricks && !cached.verbs.isEmpty()) {
+            catalog = cached;
+            return true;
+        }
+    return false;
+}
+
+bool NeroVerbCatalog::IsCurrent(const Catalog &catalog)
+{
+    // follows symlinks, e.g. for a distro's winetricks in /usr/bin
+    const QFileInfo script(catalog.winetricks);
+    return script.exists() && script.lastModified().toMSecsSinceEpoch() == catalog.mtime && script.size() == catalog.size;
+}
+
+NeroVerbCatalog::Catalog NeroVerbCatalog::Parse(const QString &winetricks, const QByteArray &listing)
+{
+    Catalog catalog;
+    catalog.winetricks = winetricks;
+    const QFileInfo script(winetricks);
+    catalog.mtime = script.lastModified().toMSecsSinceEpoch();
+    catalog.size = script.size();
+
+    QStringList lines = QString(listing).split("\n", Qt::SkipEmptyParts);
+    if(winetricks.contains("protontricks") && !lines.isEmpty())
+        // first line is boilerplate cd
+        lines.removeFirst();
+
+    for(const QString &line : std::as_const(lines)) {
+        // The winetricks listing uses a several-spaces-long padding to separate name from description,
+        // so use that as the split point to clean up both lists.
+        const QString verb = line.left(line.indexOf("       "));
+        QString description = line.mid(line.indexOf("       ")).trimmed();
+
+        // cleanup "downloadable/cached" bits.
+        description.remove("[downloadable]");
+        description.remove("[downloadable,cached]");
+
+        // SLIGHTLY DIRTY HACK: add spaces in vcrun to clean up descriptions and allow proper wordwrap
+        if(verb.contains("vcrun")) {
+            description.replace(',', ", ");
+            // VisualC versions >=2012 need this to avoid extraneous spaces after commas (i.e. after "Microsoft").
+            description.replace(",  ", ", ");
+        }
+
+        // filter out these entries, since they're either not needed, are built into, or wouldn't work with Proton
+        bool filtered = false;
+        for(const char *filter : { "dxvk", "faudio", "galliumnine", "vkd3d" })
+            if(verb.contains(filter)) filtered = true;
+        if(filtered)
+            continue;
+
+        catalog.verbs << verb;
+        catalog.descriptions << description;
+    }
+
+    // allfonts isn't in the DLLs list, so weh.
+    if(!catalog.verbs.isEmpty())
+        catalog.verbs.prepend("allfonts"), catalog.descriptions.prepend("All fonts (various, 1998-2010) [Has a long install!]");
+
+    return catalog;
+}
+
+bool NeroVerbCatalog::Store(const Catalog &catalog)
+{
+    QList<Catalog> catalogs = LoadCatalogs();
+    for(int i = catalogs.count() - 1; i >= 0; --i)
+        // scripts that are gone (e.g. with a deleted runner) can go too
+        if(catalogs.at(i).winetricks == catalog.winetricks || !QFileInfo::exists(catalogs.at(i).winetricks))
+            catalogs.removeAt(i);
+    catalogs << catalog;
+
+    QSaveFile file(GetCachePath());
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream out(&file);
+    out << cacheMagic << cacheVersion << (quint32)catalogs.count();
+    for(const Catalog &entry : std::as_const(catalogs))
+        out << entry.winetricks << entry.mtime << entry.size << entry.verbs << entry.descriptions;
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+void NeroVerbCatalog::Refresh(const QString &winetricks)
+{
+    // one listing per script at a time is plenty
+    static QStringList refreshing;
+    if(refreshing.contains(winetricks))
+        return;
+    refreshing << winetricks;
+
+    QProcess *winetricksList = new QProcess(qApp);
+    winetricksList->setProcessChannelMode(QProcess::SeparateChannels);
+    QObject::connect(winetricksList, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), qApp,
+                     [winetricksList, winetricks](int exitCode, QProcess::ExitStatus exitStatus) {
+        if(exitStatus == QProcess::NormalExit && exitCode == 0) {
+            const Catalog catalog = Parse(winetricks, winetricksList->readAllStandardOutput());
+            if(!catalog.verbs.isEmpty())
+                Store(catalog);
+        }
+        refreshing.removeAll(winetricks);
+        winetricksList->deleteLater();
+    });
+    QObject::connect(winetricksList, &QProcess::errorOccurred, qApp, [winetricksList, winetricks](QProcess::ProcessError error) {
+        if(error == QProcess::FailedToStart) {
+            refreshing.removeAll(winetricks);
+            winetricksList->deleteLater();
+        }
+    });
+    winetricksList->start(winetricks, {"dlls", "list"});
+}
+
 void NeroTricksWindow::InitVerbs(const QString &runner)
 {
-    if(winetricksAvailVerbs.isEmpty()) {
-        if(!NeroFS::GetWinetricks(runner).isEmpty()) {
-            QProcess winetricksList;
-            QMessageBox waitBox(QMessageBox::NoIcon, "Winetricks Loading", "Please wait...");
+    const QString winetricks = NeroFS::GetWinetricks(runner);
+    if(winetricks.isEmpty()) {
+        QMessageBox::critical(this,
+                              "No Winetricks!",
+                              "Winetricks doesn't seem to be installed!");
+        return;
+    }
 
-            winetricksList.start(NeroFS::GetWinetricks(runner), {"dlls", "list"});
-            waitBox.open();
-            waitBox.raise();
-            QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+    // already loaded for this script, and it hasn't changed since
+    if(catalog.winetricks == winetricks && !catalog.verbs.isEmpty() && NeroVerbCatalog::IsCurrent(catalog))
+        return;
+
+    // An outdated list is still a fine list to show right away; the new one's picked up the next time around.
+    NeroVerbCatalog::Catalog cached;
+    if(NeroVerbCatalog::Load(winetricks, cached)) {
+        catalog = cached;
+        if(!NeroVerbCatalog::IsCurrent(cached))
+            NeroVerbCatalog::Refresh(winetricks);
+        return;
+    }
 
-            // don't use blocking function so that the dialog shows and the UI doesn't freeze.
-            while(winetricksList.state() != QProcess::NotRunning) {
-                QApplication::processEvents();
-                QThread::msleep(1);
-            }
+    // nothing cached for this script yet, so this once it has to be waited on
+    QProcess winetricksList;
+    QMessageBox waitBox(QMessageBox::NoIcon, "Winetricks Loading", "Please wait...");
 
-            if(winetricksList.exitCode() == 0) {
-                waitBox.setText("Organizing verbs...");
+    winetricksList.start(winetricks, {"dlls", "list"});
+    waitBox.open();
+    waitBox.raise();
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 
-                if(!winetricksAvailVerbs.isEmpty() && !winetricksDescriptions.isEmpty()) {
-                    winetricksAvailVerbs.clear();
-                    winetricksDescriptions.clear();
-                }
+    // don't use blocking function so that the dialog shows and the UI doesn't freeze.
+    while(winetricksList.state() != QProcess::NotRunning) {
+        QApplication::processEvents();
+        winetricksList.waitForFinished(50);
+    }
 
-                if(NeroFS::GetWinetricks(runner).contains("protontricks"))
-                    // read first line, which is boilerplate cd
-                    winetricksList.readLine();
-
-                // capture the rest of the verbs list output to organize.
-                QString winetricksOutput = winetricksList.readAllStandardOutput();
-                winetricksAvailVerbs << winetricksOutput.split("\n", Qt::SkipEmptyParts);
-
-                for(int i = 0; i < winetricksAvailVerbs.count(); ++i) {
-                    // The winetricks listing uses a several-spaces-long padding to separate name from description,
-                    // so use that as the split point to clean up both lists.
-                    winetricksDescriptions.append(winetricksAvailVerbs[i].mid(winetricksAvailVerbs[i].indexOf("       ")).trimmed());
-                    winetricksAvailVerbs[i] = winetricksAvailVerbs[i].left(winetricksAvailVerbs[i].indexOf("       "));
-
-                    // cleanup "downloadable/cached" bits.
-                    winetricksDescriptions[i].remove("[downloadable]");
-                    winetricksDescriptions[i].remove("[downloadable,cached]");
-
-                    // SLIGHTLY DIRTY HACK: add spaces in vcrun to clean up descriptions and allow proper wordwrap
-                    if(winetricksAvailVerbs.at(i).contains("vcrun")) {
-                        winetricksDescriptions[i].replace(',', ", ");
-                        // VisualC versions >=2012 need this to avoid extraneous spaces after commas (i.e. after "Microsoft").
-                        winetricksDescriptions[i].replace(",  ", ", ");
-                    }
-                }
+    if(winetricksList.exitStatus() == QProcess::NormalExit && winetricksList.exitCode() == 0) {
+        waitBox.setText("Organizing verbs...");
+        const NeroVerbCatalog::Catalog listed = NeroVerbCatalog::Parse(winetricks, winetricksList.readAllStandardOutput());
+        if(!listed.verbs.isEmpty()) {
+            catalog = listed;
+            if(!NeroVerbCatalog::Store(catalog))
+                printf("Couldn't write the winetricks verbs cache to %s\n", NeroVerbCatalog::GetCachePath().toLocal8Bit().constData());
+        }
+    }
+    QGuiApplication::restoreOverrideCursor();
+}
 
-                // allfonts isn't in the DLLs list, so weh.
-                winetricksAvailVerbs.prepend("allfonts"), winetricksDescriptions.prepend("All fonts (various, 1998-2010) [Has a long install!]");
-
-                // filter out these entries, since they're either not needed, are built into, or wouldn't work with Proton
-                FilterTricks({"dxvk", "faudio", "galliumnine", "vkd3d"});
-            }
-            QGuiApplication::restoreOverrideCursor();
-        } else {
-            QMessageBox::critical(this,
-                                  "No Winetricks!",
-                                  "Winetricks doesn't seem to be installed!");
+NeroVerbModel::NeroVerbModel(const QStringList &verbs, const QStringList &descriptions, QObject *parent)
+    : QAbstractTableModel(parent)
+    , verbs(verbs)
+    , descriptions(descriptions)
+    , states(verbs.count(), Unchecked)
+{
+    rows.reserve(verbs.count());
+    for(int i = 0; i < verbs.count(); ++i) {
+        rows.insert(verbs.at(i), i);
+        searchNames << verbs.at(i).toLower();
+        searchText << searchNames.last() + ' ' + descriptions.value(i).toLower();
+    }
+}
+
+QVariant NeroVerbModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid() || index.row() >= verbs.count())
+        return QVariant();
+
+    const int row = index.row();
+    if(index.column() == ColumnVerb) {
+        switch(role) {
+        case Qt::DisplayRole:
+            return verbs.at(row);
+        case Qt::CheckStateRole:
+            return states.at(row) == Unchecked ? Qt::Unchecked : Qt::Checked;
+        case Qt::ToolTipRole:
+            return states.at(row) == Installed ? "Already installed in this prefix" : descriptions.value(row);
+        }
+    } else if(index.column() == ColumnDescription) {
+        switch(role) {
+        case Qt::DisplayRole:
+        case Qt::ToolTipRole:
+            return descriptions.value(row);
+        case Qt::TextAlignmentRole:
+            return int(Qt::AlignRight | Qt::AlignVCenter);
         }
     }
+    return QVariant();
+}
+
+QVariant NeroVerbModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+    return section == ColumnVerb ? "Verb" : "Description";
+}
+
+Qt::ItemFlags NeroVerbModel::flags(const QModelIndex &index) const
+{
+    if(!index.isValid())
+        return Qt::NoItemFlags;
+    if(states.at(index.row()) == Installed)
+        return Qt::ItemNeverHasChildren;
+    Qt::ItemFlags itemFlags = Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemNeverHasChildren;
+    if(index.column() == ColumnVerb)
+        itemFlags |= Qt::ItemIsUserCheckable;
+    return itemFlags;
+}
+
+bool NeroVerbModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if(!index.isValid() || index.column() != ColumnVerb || role != Qt::CheckStateRole || states.at(index.row()) == Installed)
+        return false;
+    SetChecked(index.row(), value.toInt() == Qt::Checked);
+    return true;
+}
+
+void NeroVerbModel::SetChecked(const int row, const bool checked)
+{
+    if(row < 0 || row >= states.count() || states.at(row) == Installed || IsChecked(row) == checked)
+        return;
+    states[row] = checked ? Checked : Unchecked;
+    emit dataChanged(index(row, ColumnVerb), index(row, ColumnDescription));
+    emit checkedChanged(verbs.at(row), checked);
+}
+
+void NeroVerbModel::SetInstalled(const int row)
+{
+    if(row < 0 || row >= states.count())
+        return;
+    states[row] = Installed;
+    emit dataChanged(index(row, ColumnVerb), index(row, ColumnDescription));
+}
+
+NeroVerbFilter::NeroVerbFilter(NeroVerbModel *model, QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , verbs(model)
+{
+    setSourceModel(model);
+}
+
+// whether needle's characters all show up in haystack, in order
+static bool FuzzyMatch(const QString &needle, const QString &haystack)
+{
+    int pos = 0;
+    for(const QChar c : needle) {
+        pos = haystack.indexOf(c, pos);
+        if(pos < 0) return false;
+        ++pos;
+    }
+    return true;
 }
 
-void NeroTricksWindow::FilterTricks(const QStringList filters)
+void NeroVerbFilter::SetSearch(const QString &search)
 {
-    for(int i = 0; i < filters.length(); ++i) {
-        QStringList filterEntries = winetricksAvailVerbs.filter(filters.at(i));
-        int slot;
-        for(int e = 0; e < filterEntries.length(); ++e) {
-            slot = winetricksAvailVerbs.indexOf(filterEntries.at(e));
-            winetricksAvailVerbs.removeAt(slot);
-            winetricksDescriptions.removeAt(slot);
+    const QStringList words = search.toLower().split(' ', Qt::SkipEmptyParts);
+    matches.clear();
+    if(!words.isEmpty()) {
+        matches.resize(verbs->rowCount());
+        for(int row = 0; row < matches.count(); ++row) {
+            bool match = true;
+            for(const QString &word : words)
+                if(!verbs->SearchText(row).contains(word) && !FuzzyMatch(word, verbs->SearchName(row))) {
+                    match = false;
+                    break;
+                }
+            matches[row] = match;
         }
     }
+    invalidateFilter();
+}
+
+bool NeroVerbFilter::filterAcceptsRow(int sourceRow, const QModelIndex &) const
+{
+    return matches.isEmpty() || matches.value(sourceRow);
 }
 
 void NeroTricksWindow::AddTricks(const QStringList newTricks)
 {
-    for(int i = 0; i < newTricks.length(); ++i)
-        verbSelector.at(winetricksAvailVerbs.indexOf(newTricks.at(i)))->setCheckState(Qt::Checked);
+    // verbs that aren't in this winetricks' list are skipped
+    for(const QString &verb : newTricks)
+        verbsModel->SetChecked(verbsModel->Row(verb), true);
 }
 
 void NeroTricksWindow::SetPreinstalledVerbs(const QStringList &installed)
 {
-    int slot;
-    for(const auto &verb : installed) {
-        // in case verb isn't in the list
-        slot = winetricksAvailVerbs.indexOf(verb);
-        if(slot >= 0) {
-            const QSignalBlocker blocker(verbSelector.at(slot));
-            verbSelector.at(slot)->setCheckState(Qt::Checked);
-            verbSelector.at(slot)->setEnabled(false);
-            verbDesc.at(slot)->setEnabled(false);
-        }
-    }
+    for(const auto &verb : installed)
+        verbsModel->SetInstalled(verbsModel->Row(verb));
 
     installedVerbs = installed;
 }
 
 void NeroTricksWindow::SetCheckedVerbs(const QStringList &checked)
 {
-    int slot;
-    for(const auto &verb : checked) {
-        // in case verb isn't in the list
-        slot = winetricksAvailVerbs.indexOf(verb);
-        if(slot >= 0) verbSelector.at(slot)->setCheckState(Qt::Checked);
-    }
+    for(const auto &verb : checked)
+        verbsModel->SetChecked(verbsModel->Row(verb), true);
 }
 
-// Apparently "stateChanged" is being deprecated? wtf
-// VERY DISTANT TODO: migrate to checkStateChanged(???)
-void NeroTricksWindow::verbSelectors_stateChanged(int arg1)
+void NeroTricksWindow::verbsModel_checkedChanged(const QString &verb, const bool checked)
 {
-    int slot = sender()->property("slot").toInt();
-
-    verbIsSelected[winetricksAvailVerbs.at(slot)] = arg1;
+    verbIsSelected[verb] = checked;
 
     if(!verbIsSelected.key(true, "").isEmpty())
          ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
     else ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
 }
 
-void NeroTricksWindow::on_searchBox_textEdited(const QString &arg1)
+void NeroTricksWindow::on_verbsView_clicked(const QModelIndex &index)
 {
-    if(arg1.isEmpty()) {
-        winetricksFilter.empty();
-        for(int i = 0; i < winetricksAvailVerbs.length(); ++i) {
-            verbSelector.at(i)->setVisible(true), verbDesc.at(i)->setVisible(true);
-        }
-    } else {
-        winetricksFilter = winetricksAvailVerbs.filter(arg1, Qt::CaseInsensitive);
-
-        // is there a better way than hiding all elements and then unhiding what matches the filter?
-        for(int i = 0; i < winetricksAvailVerbs.count(); ++i) {
-            verbSelector.at(i)->setVisible(false), verbDesc.at(i)->setVisible(false);
-        }
+    // the checkbox itself takes care of clicks on the name column, so this is just to make whole rows clickable
+    if(index.column() != NeroVerbModel::ColumnDescription)
+        return;
+    const int row = verbsFilter->mapToSource(index).row();
+    verbsModel->SetChecked(row, !verbsModel->IsChecked(row));
+}
 
-        int slot;
-        for(const auto &filter : std::as_const(winetricksFilter)) {
-            slot = winetricksAvailVerbs.indexOf(filter);
-            if(slot > -1)
-                verbSelector.at(slot)->setVisible(true), verbDesc.at(slot)->setVisible(true);
-        }
-    }
+void NeroTricksWindow::on_searchBox_textEdited(const QString &arg1)
+{
+    verbsFilter->SetSearch(arg1);
 }
 
 void NeroTricksWindow::on_buttonBox_rejected()
 {
-    QStringList verbsToClean = verbIsSelected.keys(true);
-    if(!verbsToClean.isEmpty()) {
-        for(int i = 0; i < verbsToClean.length(); ++i)
-            verbSelector[winetricksAvailVerbs.indexOf(verbsToClean.at(i))]->setCheckState(Qt::Unchecked);
-    }
+    for(const QString &verb : verbIsSelected.keys(true))
+        verbsModel->SetChecked(verbsModel->Row(verb), false);
 }
-
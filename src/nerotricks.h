@@ -20,11 +20,104 @@
 #ifndef NEROTRICKS_H
 #define NEROTRICKS_H
 
+#include <QAbstractTableModel>
 #include <QDialog>
-#include <QCheckBox>
-#include <QCompleter>
-#include <QLabel>
 #include <QHash>
+#include <QSortFilterProxyModel>
+#include <QVector>
+#include <QStringList>
+
+// The verbs (& descriptions) a winetricks script offers. Listing them means running the whole script, which takes
+// a few seconds, so they're cached per script in <home>/.nero-verbs-cache, and only listed again once it changes.
+class NeroVerbCatalog
+{
+public:
+    struct Catalog {
+        QString winetricks;
+        // of the script, when it was listed
+        qint64 mtime = 0;
+        qint64 size = 0;
+        QStringList verbs;
+        QStringList descriptions;
+    };
+
+    static QString GetCachePath();
+    // whatever's cached for this winetricks, whether it's current or not; false if there's nothing
+    static bool Load(const QString &winetricks, Catalog &catalog);
+    static bool IsCurrent(const Catalog &catalog);
+    // turns `winetricks dlls list` output into a catalog, minus the verbs that are no use with Proton
+    static Catalog Parse(const QString &winetricks, const QByteArray &listing);
+    // replaces the cached entry for the catalog's winetricks, keeping the others (bundled & system scripts alike)
+    static bool Store(const Catalog &catalog);
+    // lists the verbs again without blocking, storing them once it's done
+    static void Refresh(const QString &winetricks);
+};
+
+// The verbs as a flat table (name & description), with a checkbox on each name. Installed verbs stay checked & greyed out.
+class NeroVerbModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum {
+        ColumnVerb = 0,
+        ColumnDescription,
+        ColumnCount
+    } Columns_e;
+
+    NeroVerbModel(const QStringList &verbs, const QStringList &descriptions, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : verbs.count(); }
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : ColumnCount; }
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+
+    // -1 if it's not in the list
+    int Row(const QString &verb) const { return rows.value(verb, -1); }
+    bool IsChecked(const int row) const { return states.at(row) != Unchecked; }
+    void SetChecked(const int row, const bool checked);
+    void SetInstalled(const int row);
+
+    // lowercased, built once up front so searching never has to touch the originals
+    const QString& SearchName(const int row) const { return searchNames.at(row); }
+    const QString& SearchText(const int row) const { return searchText.at(row); }
+
+signals:
+    // only for the user's own picks, not installed verbs
+    void checkedChanged(const QString &verb, const bool checked);
+
+private:
+    enum { Unchecked = 0, Checked, Installed };
+
+    QStringList verbs;
+    QStringList descriptions;
+    QStringList searchNames;
+    // name & description
+    QStringList searchText;
+    QHash<QString, int> rows;
+    QVector<quint8> states;
+};
+
+// Matches every word of the search against the verb's name & description, also letting each one match the name
+// fuzzily (in order, with gaps; e.g. vc19 finds vcrun2019). Works out the matches in one pass per search.
+class NeroVerbFilter : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit NeroVerbFilter(NeroVerbModel *model, QObject *parent = nullptr);
+    void SetSearch(const QString &search);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
+    NeroVerbModel *verbs;
+    // by source row; empty when there's no search
+    QVector<bool> matches;
+};
 
 namespace Ui {
 class NeroTricksWindow;
@@ -54,24 +147,23 @@ public:
 private slots:
     void on_searchBox_textEdited(const QString &arg1);
 
-    void verbSelectors_stateChanged(int arg1);
+    void verbsModel_checkedChanged(const QString &verb, const bool checked);
+
+    void on_verbsView_clicked(const QModelIndex &index);
 
     void on_buttonBox_rejected();
 
 private:
     Ui::NeroTricksWindow *ui;
 
-    void FilterTricks(const QStringList filters);
-
-    static inline QStringList winetricksAvailVerbs;
-    static inline QStringList winetricksDescriptions;
-
-    QStringList winetricksFilter;
+    // whichever catalog was loaded last; each window keeps its own copy of the lists, so this can change underneath
+    static inline NeroVerbCatalog::Catalog catalog;
 
-    QList<QCheckBox*> verbSelector;
-    QList<QLabel*> verbDesc;
+    QStringList winetricksAvailVerbs;
+    QStringList winetricksDescriptions;
 
-    QCompleter *completer;
+    NeroVerbModel *verbsModel;
+    NeroVerbFilter *verbsFilter;
 
 };
 
@@ -0,0 +1,430 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Background winetricks queue, for installing verbs into several prefixes at once.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerotricksqueue.h"
+#include "nerofs.h"
+#include "nerorunner.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QSettings>
+#include <QShortcut>
+#include <QVBoxLayout>
+
+// whatever's been added to a prefix's winetricks.log since offset, which is moved along past it
+static QStringList NewLogEntries(const QString &logPath, qint64 &offset)
+{
+    QStringList entries;
+    QFile log(logPath);
+    if(!log.open(QIODevice::ReadOnly | QIODevice::Text) || log.size() <= offset)
+        return entries;
+    log.seek(offset);
+    // a half-written last line is picked up next time
+    while(log.canReadLine()) {
+        const QString line = QString::fromUtf8(log.readLine()).trimmed();
+        if(!line.isEmpty()) entries << line;
+    }
+    offset = log.pos();
+    return entries;
+}
+
+NeroTricksQueue::NeroTricksQueue(QObject *parent)
+    : QObject(parent)
+{
+}
+
+NeroTricksQueue::~NeroTricksQueue()
+{
+    // a half-installed verb is what the snapshot taken beforehand is for
+    for(auto &worker : workers)
+        *worker.second.cancel = true;
+    for(auto &worker : workers)
+        if(worker.second.thread.joinable())
+            worker.second.thread.join();
+}
+
+QString NeroTricksQueue::GetHistoryPath()
+{
+    return NeroFS::GetPrefixesPath()->path() + "/.nero-tricks-history.tsv";
+}
+
+int NeroTricksQueue::Add(const QString &umuPath, const QString &prefix, const QStringList &verbs, const int attempt)
+{
+    if(verbs.isEmpty())
+        return 0;
+
+    Job job;
+    job.id = nextId++;
+    job.prefix = prefix;
+    job.verbs = verbs;
+    job.attempt = attempt;
+    jobs.append(job);
+    umuPaths.insert(job.id, umuPath);
+
+    Schedule();
+    return job.id;
+}
+
+NeroTricksQueue::Job* NeroTricksQueue::FindJob(const int id)
+{
+    for(Job &job : jobs)
+        if(job.id == id)
+            return &job;
+    return nullptr;
+}
+
+void NeroTricksQueue::Cancel(const int id)
+{
+    Job *job = FindJob(id);
+    if(!job)
+        return;
+    if(job->state == JobQueued) {
+        job->state = JobCanceled;
+        emit jobFinished(id);
+        if(!IsBusy()) {
+            emit queueFinished(finishedCount, failedCount);
+            finishedCount = failedCount = 0;
+        }
+    } else if(job->state == JobRunning && workers.count(id)) {
+        // umu gets killed the next time the install checks in
+        *workers[id].cancel = true;
+    }
+}
+
+void NeroTricksQueue::CancelAll()
+{
+    // running ones first, so nothing queued gets started in between
+    for(const Job &job : jobs)
+        if(job.state == JobRunning)
+            Cancel(job.id);
+    for(const Job &job : jobs)
+        if(job.state == JobQueued)
+            Cancel(job.id);
+}
+
+int NeroTricksQueue::Retry(const int id)
+{
+    const Job *job = FindJob(id);
+    if(!job || (job->state != JobFailed && job->state != JobCanceled))
+        return 0;
+    return Add(umuPaths.value(id), job->prefix, job->failedVerbs.isEmpty() ? job->verbs : job->failedVerbs, job->attempt + 1);
+}
+
+QList<NeroTricksQueue::Job> NeroTricksQueue::Jobs() const
+{
+    QList<Job> list = jobs;
+    std::lock_guard<std::mutex> lock(statusMutex);
+    for(Job &job : list)
+        if(job.state == JobRunning)
+            job.status = statuses.value(job.id);
+    return list;
+}
+
+bool NeroTricksQueue::IsBusy() const
+{
+    for(const Job &job : jobs)
+        if(job.state == JobQueued || job.state == JobRunning)
+            return true;
+    return false;
+}
+
+QStringList NeroTricksQueue::BusyPrefixes() const
+{
+    QStringList prefixes;
+    for(const Job &job : jobs)
+        if((job.state == JobQueued || job.state == JobRunning) && !prefixes.contains(job.prefix))
+            prefixes << job.prefix;
+    return prefixes;
+}
+
+void NeroTricksQueue::Schedule()
+{
+    QStringList busy;
+    int running = 0;
+    for(const Job &job : std::as_const(jobs))
+        if(job.state == JobRunning) {
+            busy << job.prefix;
+            running++;
+        }
+
+    for(Job &job : jobs) {
+        if(running >= maxConcurrent)
+            break;
+        if(job.state != JobQueued || busy.contains(job.prefix))
+            continue;
+        // anything else queued for this prefix waits its turn behind this one
+        busy << job.prefix;
+        running++;
+        Start(job);
+        emit jobStarted(job.id);
+    }
+}
+
+void NeroTricksQueue::Start(Job &job)
+{
+    job.state = JobRunning;
+    job.started = QDateTime::currentMSecsSinceEpoch();
+
+    Worker &worker = workers[job.id];
+    worker.cancel = std::make_shared<std::atomic<bool>>(false);
+
+    const int id = job.id;
+    const QString prefix = job.prefix;
+    const QStringList verbs = job.verbs;
+    const QString umuPath = umuPaths.value(id);
+    const std::shared_ptr<std::atomic<bool>> cancel = worker.cancel;
+    worker.thread = std::thread([this, id, prefix, verbs, umuPath, cancel]() {
+        const QString prefixPath = NeroFS::GetPrefixesPath()->path() + '/' + prefix;
+        // it could've been hibernated while this was queued, and winetricks would only make a mess of the stub
+        if(NeroFS::IsPrefixHibernated(prefix)) {
+            printf("Prefix %s is hibernated, not installing %s\n", prefix.toLocal8Bit().constData(), verbs.join(' ').toLocal8Bit().constData());
+            QMetaObject::invokeMethod(this, [this, id, verbs]() { Finish(id, -1, 0, {}, verbs); }, Qt::QueuedConnection);
+            return;
+        }
+        // read when the job actually starts, in case the runner was changed while it was queued
+        const QString runner = QSettings(prefixPath + "/nero-settings.ini", QSettings::IniFormat).value("PrefixSettings/CurrentRunner").toString();
+        const QString logPath = prefixPath + "/winetricks.log";
+        qint64 logOffset = QFileInfo(logPath).size();
+        QList<QPair<QString, qint64>> timings;
+        QElapsedTimer timer, sinceLast;
+        timer.start();
+
+        // cheap enough to always take, and shows exactly which keys the verbs touched (see --reg-diff)
+        NeroFS::SnapshotPrefixRegistry(prefix, "Before installing " + verbs.join(", "));
+
+        const int result = NeroRunner::InstallVerbs(umuPath, prefixPath, NeroFS::GetProtonsPath()->path() + '/' + runner, verbs,
+                                                    [&](const QString &text) {
+            {
+                std::lock_guard<std::mutex> lock(statusMutex);
+                statuses.insert(id, text);
+            }
+            // winetricks adds each verb (dependencies included) to its log as soon as it's in,
+            // which makes for as good a per-verb clock as any. Prefetching's not counted.
+            if(text.startsWith("Installing")) {
+                if(!sinceLast.isValid()) sinceLast.start();
+                for(const QString &verb : NewLogEntries(logPath, logOffset))
+                    timings << qMakePair(verb, sinceLast.restart());
+            }
+            return !*cancel;
+        });
+        for(const QString &verb : NewLogEntries(logPath, logOffset))
+            timings << qMakePair(verb, sinceLast.isValid() ? sinceLast.restart() : qint64(0));
+
+        // InstallVerbs already waited on wineserver, so the registry's been written back out by now
+        NeroFS::SnapshotPrefixRegistry(prefix, "After installing " + verbs.join(", "));
+
+        QStringList failedVerbs;
+        if(result != 0) {
+            QStringList installed;
+            QFile log(logPath);
+            if(log.open(QIODevice::ReadOnly | QIODevice::Text))
+                for(const QString &line : QString::fromUtf8(log.readAll()).split('\n'))
+                    installed << line.trimmed();
+            for(const QString &verb : verbs)
+                if(!installed.contains(verb))
+                    failedVerbs << verb;
+        }
+
+        const qint64 msecs = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, id, result, msecs, timings, failedVerbs]() {
+            Finish(id, result, msecs, timings, failedVerbs);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void NeroTricksQueue::Finish(const int id, const int result, const qint64 msecs, const QList<QPair<QString, qint64>> &timings,
+                             const QStringList &failedVerbs)
+{
+    bool canceled = false;
+    const auto worker = workers.find(id);
+    if(worker != workers.end()) {
+        // it's already on its way out by the time this gets posted
+        canceled = *worker->second.cancel;
+        if(worker->second.thread.joinable())
+            worker->second.thread.join();
+        workers.erase(worker);
+    }
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        statuses.remove(id);
+    }
+
+    Job *job = FindJob(id);
+    if(!job)
+        return;
+    job->result = result;
+    job->msecs = msecs;
+    job->failedVerbs = failedVerbs;
+    job->state = canceled ? JobCanceled : result == 0 ? JobDone : JobFailed;
+    printf("Winetricks job for %s (%s) %s in %.1fs\n", job->prefix.toLocal8Bit().constData(), job->verbs.join(' ').toLocal8Bit().constData(),
+           canceled ? "canceled" : result == 0 ? "done" : QString("failed with code %1").arg(result).toLocal8Bit().constData(), msecs / 1000.0);
+
+    QFile history(GetHistoryPath());
+    if(history.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        const QString date = QDateTime::currentDateTime().toString(Qt::ISODate);
+        for(const auto &timing : timings)
+            history.write(QString("%1\t%2\t%3\tok\t%4\n").arg(date, job->prefix, timing.first)
+                          .arg(timing.second / 1000.0, 0, 'f', 1).toUtf8());
+        for(const QString &verb : failedVerbs)
+            history.write(QString("%1\t%2\t%3\t%4\t\n").arg(date, job->prefix, verb, canceled ? "canceled" : "failed").toUtf8());
+    }
+
+    finishedCount++;
+    if(job->state == JobFailed)
+        failedCount++;
+    emit jobFinished(id);
+
+    // winetricks downloads are the usual culprit, so a second go often does it
+    if(job->state == JobFailed && !failedVerbs.isEmpty() && job->attempt <= retries) {
+        printf("Retrying %s in %s...\n", failedVerbs.join(' ').toLocal8Bit().constData(), job->prefix.toLocal8Bit().constData());
+        Add(umuPaths.value(id), job->prefix, failedVerbs, job->attempt + 1);
+    } else Schedule();
+
+    if(!IsBusy()) {
+        emit queueFinished(finishedCount, failedCount);
+        finishedCount = failedCount = 0;
+    }
+}
+
+NeroTricksQueueDialog::NeroTricksQueueDialog(NeroTricksQueue *queue, QWidget *parent)
+    : QDialog(parent)
+    , queue(queue)
+{
+    setWindowTitle("Winetricks Queue");
+    resize(640, 320);
+
+    // shortcut ctrl/cmd + W to close the popup window
+    QShortcut *shortcutClose = new QShortcut(QKeySequence::Close, this);
+    connect(shortcutClose, &QShortcut::activated, this, &NeroTricksQueueDialog::close);
+
+    jobList = new QTreeWidget(this);
+    jobList->setHeaderLabels({ "Prefix", "Verbs", "State", "Time" });
+    jobList->setRootIsDecorated(false);
+    jobList->setSelectionMode(QAbstractItemView::SingleSelection);
+    jobList->header()->setSectionResizeMode(1, QHeaderView::Stretch);
+    jobList->header()->setStretchLastSection(false);
+
+    statusLabel = new QLabel(this);
+    statusLabel->setWordWrap(true);
+
+    cancelBtn = new QPushButton(QIcon::fromTheme("process-stop"), "Cancel", this);
+    cancelAllBtn = new QPushButton("Cancel All", this);
+    retryBtn = new QPushButton(QIcon::fromTheme("view-refresh"), "Retry Failed Verbs", this);
+    QPushButton *closeBtn = new QPushButton("Close", this);
+
+    QHBoxLayout *buttons = new QHBoxLayout();
+    buttons->addWidget(cancelBtn);
+    buttons->addWidget(cancelAllBtn);
+    buttons->addWidget(retryBtn);
+    buttons->addStretch();
+    buttons->addWidget(closeBtn);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(jobList);
+    layout->addWidget(statusLabel);
+    layout->addLayout(buttons);
+
+    connect(cancelBtn, &QPushButton::clicked, this, &NeroTricksQueueDialog::cancelBtn_clicked);
+    connect(cancelAllBtn, &QPushButton::clicked, queue, &NeroTricksQueue::CancelAll);
+    connect(retryBtn, &QPushButton::clicked, this, &NeroTricksQueueDialog::retryBtn_clicked);
+    connect(closeBtn, &QPushButton::clicked, this, &NeroTricksQueueDialog::close);
+    connect(jobList, &QTreeWidget::itemSelectionChanged, this, &NeroTricksQueueDialog::Refresh);
+    connect(queue, &NeroTricksQueue::jobStarted, this, &NeroTricksQueueDialog::Refresh);
+    connect(queue, &NeroTricksQueue::jobFinished, this, &NeroTricksQueueDialog::Refresh);
+    // for the running jobs' times & status
+    connect(&refreshTimer, &QTimer::timeout, this, &NeroTricksQueueDialog::Refresh);
+    refreshTimer.start(500);
+
+    Refresh();
+}
+
+int NeroTricksQueueDialog::SelectedJob() const
+{
+    const QList<QTreeWidgetItem*> selected = jobList->selectedItems();
+    return selected.isEmpty() ? 0 : selected.first()->data(0, Qt::UserRole).toInt();
+}
+
+void NeroTricksQueueDialog::Refresh()
+{
+    const QList<NeroTricksQueue::Job> jobs = queue->Jobs();
+    // jobs are never taken out of the queue, so rows can just be matched up by index
+    while(jobList->topLevelItemCount() < jobs.count())
+        jobList->addTopLevelItem(new QTreeWidgetItem());
+
+    const int selectedId = SelectedJob();
+    const NeroTricksQueue::Job *selected = nullptr;
+    int queued = 0, running = 0;
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(int i = 0; i < jobs.count(); ++i) {
+        const NeroTricksQueue::Job &job = jobs.at(i);
+        QTreeWidgetItem *item = jobList->topLevelItem(i);
+        if(job.id == selectedId) selected = &job;
+
+        QString state;
+        switch(job.state) {
+        case NeroTricksQueue::JobQueued: state = "Queued"; queued++; break;
+        case NeroTricksQueue::JobRunning: state = "Installing"; running++; break;
+        case NeroTricksQueue::JobDone: state = "Done"; break;
+        case NeroTricksQueue::JobFailed: state = QString("Failed (code %1)").arg(job.result); break;
+        case NeroTricksQueue::JobCanceled: state = "Canceled"; break;
+        }
+        if(job.attempt > 1)
+            state += QString(", retry %1").arg(job.attempt - 1);
+
+        item->setData(0, Qt::UserRole, job.id);
+        item->setText(0, job.prefix);
+        item->setText(1, job.verbs.join(", "));
+        item->setText(2, state);
+        if(job.state == NeroTricksQueue::JobRunning)
+            item->setText(3, QString("%1s").arg((now - job.started) / 1000));
+        else if(job.state != NeroTricksQueue::JobQueued && job.started)
+            item->setText(3, QString::number(job.msecs / 1000.0, 'f', 1) + 's');
+        else item->setText(3, QString());
+    }
+
+    if(selected && selected->state == NeroTricksQueue::JobRunning && !selected->status.isEmpty())
+        statusLabel->setText(selected->prefix + ": " + QString(selected->status).replace("\n\n", " "));
+    else if(selected && !selected->failedVerbs.isEmpty())
+        statusLabel->setText("Not installed: " + selected->failedVerbs.join(", ") +
+                             "\nSee .logs/" + Logs::tricksLogName + " in " + selected->prefix + " for why.");
+    else statusLabel->setText(queued || running ? QString("%1 installing, %2 queued").arg(running).arg(queued)
+                                                : "Nothing queued. Per-verb times are kept in " + NeroTricksQueue::GetHistoryPath());
+
+    cancelBtn->setEnabled(selected && (selected->state == NeroTricksQueue::JobQueued || selected->state == NeroTricksQueue::JobRunning));
+    cancelAllBtn->setEnabled(queued || running);
+    retryBtn->setEnabled(selected && (selected->state == NeroTricksQueue::JobFailed || selected->state == NeroTricksQueue::JobCanceled));
+}
+
+void NeroTricksQueueDialog::cancelBtn_clicked()
+{
+    if(SelectedJob())
+        queue->Cancel(SelectedJob());
+    Refresh();
+}
+
+void NeroTricksQueueDialog::retryBtn_clicked()
+{
+    if(SelectedJob())
+        queue->Retry(SelectedJob());
+    Refresh();
+}
@@ -0,0 +1,149 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Background winetricks queue, for installing verbs into several prefixes at once.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROTRICKSQUEUE_H
+#define NEROTRICKSQUEUE_H
+
+#include <QDialog>
+#include <QHash>
+#include <QLabel>
+#include <QList>
+#include <QPushButton>
+#include <QStringList>
+#include <QTimer>
+#include <QTreeWidget>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Lives on the GUI thread; each job's winetricks run gets its own thread. Jobs for the same prefix always go one
+// after the other (winetricks can't share a prefix), while different prefixes go up to maxConcurrent at a time.
+class NeroTricksQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum {
+        JobQueued = 0,
+        JobRunning,
+        JobDone,
+        JobFailed,
+        JobCanceled
+    } JobStates_e;
+
+    struct Job {
+        int id = 0;
+        QString prefix;
+        QStringList verbs;
+        int state = JobQueued;
+        int result = -1;
+        // 1 for the first go, counting up with each retry
+        int attempt = 1;
+        // msecs since epoch
+        qint64 started = 0;
+        qint64 msecs = 0;
+        // what the install's up to, while it's running
+        QString status;
+        // verbs that never made it into the prefix's winetricks.log
+        QStringList failedVerbs;
+    };
+
+    explicit NeroTricksQueue(QObject *parent = nullptr);
+    // cancels whatever's left, and waits on the ones running
+    ~NeroTricksQueue();
+
+    void SetMaxConcurrent(const int max) { maxConcurrent = max < 1 ? 1 : max; Schedule(); }
+    // how many times failed verbs get queued again on their own
+    void SetRetries(const int count) { retries = count < 0 ? 0 : count; }
+
+    int Add(const QString &umuPath, const QString &prefix, const QStringList &verbs, const int attempt = 1);
+    void Cancel(const int id);
+    void CancelAll();
+    // queues a finished job's failed verbs (or all of them, if it never got far enough to tell) again; 0 if there's nothing to retry
+    int Retry(const int id);
+    // with their latest status, for showing
+    QList<Job> Jobs() const;
+    bool IsBusy() const;
+    // prefixes with verbs queued or being installed
+    QStringList BusyPrefixes() const;
+
+    // tab-separated: date, prefix, verb, ok/failed, seconds (empty for failed verbs)
+    static QString GetHistoryPath();
+
+signals:
+    void jobStarted(const int id);
+    void jobFinished(const int id);
+    void queueFinished(const int total, const int failed);
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> cancel;
+    };
+
+    QList<Job> jobs;
+    // std::thread can't be copied, which rules out QHash
+    std::map<int, Worker> workers;
+    // status text from the worker threads, by job id
+    mutable std::mutex statusMutex;
+    QHash<int, QString> statuses;
+    QHash<int, QString> umuPaths;
+    int nextId = 1;
+    int maxConcurrent = 2;
+    int retries = 1;
+    // since the queue last went idle, for the summary
+    int finishedCount = 0;
+    int failedCount = 0;
+
+    void Schedule();
+    void Start(Job &job);
+    void Finish(const int id, const int result, const qint64 msecs, const QList<QPair<QString, qint64>> &timings,
+                const QStringList &failedVerbs);
+    Job* FindJob(const int id);
+};
+
+// The panel for keeping an eye on the queue; non-modal, so it can stay open while other prefixes are used.
+class NeroTricksQueueDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit NeroTricksQueueDialog(NeroTricksQueue *queue, QWidget *parent = nullptr);
+
+private slots:
+    void Refresh();
+    void cancelBtn_clicked();
+    void retryBtn_clicked();
+
+private:
+    NeroTricksQueue *queue;
+    QTreeWidget *jobList;
+    QLabel *statusLabel;
+    QPushButton *cancelBtn;
+    QPushButton *cancelAllBtn;
+    QPushButton *retryBtn;
+    QTimer refreshTimer;
+
+    int SelectedJob() const;
+};
+
+#endif // NEROTRICKSQUEUE_H
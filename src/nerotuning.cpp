@@ -0,0 +1,426 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Process tuning helpers (scheduling, I/O priority, OOM score).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerotuning.h"
+#include "neroconstants.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// glibc doesn't wrap ioprio_set/get, so these come from linux/ioprio.h
+#define NERO_IOPRIO_CLASS_SHIFT 13
+#define NERO_IOPRIO_PRIO_MASK ((1 << NERO_IOPRIO_CLASS_SHIFT) - 1)
+#define NERO_IOPRIO_WHO_PROCESS 1
+
+NeroTuning::Params NeroTuning::FromSettings(const int niceMode, const int schedMode, const int ioMode, const int oomMode)
+{
+    Params params;
+
+    switch(niceMode) {
+    case NeroConstant::NiceHigher:    params.setNice = true, params.nice = -5;  break;
+    case NeroConstant::NiceHighest:   params.setNice = true, params.nice = -10; break;
+    case NeroConstant::NiceLower:     params.setNice = true, params.nice = 5;   break;
+    case NeroConstant::NiceLowerMore: params.setNice = true, params.nice = 10;  break;
+    case NeroConstant::NiceLowest:    params.setNice = true, params.nice = 19;  break;
+    default: break;
+    }
+
+    switch(schedMode) {
+    case NeroConstant::SchedBatch: params.setPolicy = true, params.policy = SCHED_BATCH; break;
+    case NeroConstant::SchedIdle:  params.setPolicy = true, params.policy = SCHED_IDLE;  break;
+    default: break;
+    }
+
+    switch(ioMode) {
+    case NeroConstant::IoPrioHigh: params.setIoPrio = true, params.ioClass = IoClassBestEffort, params.ioLevel = 0; break;
+    case NeroConstant::IoPrioLow:  params.setIoPrio = true, params.ioClass = IoClassBestEffort, params.ioLevel = 7; break;
+    case NeroConstant::IoPrioIdle: params.setIoPrio = true, params.ioClass = IoClassIdle,       params.ioLevel = 0; break;
+    default: break;
+    }
+
+    switch(oomMode) {
+    case NeroConstant::OomProtect:    params.setOomAdj = true, params.oomAdj = -500; break;
+    case NeroConstant::OomPreferKill: params.setOomAdj = true, params.oomAdj = 500;  break;
+    case NeroConstant::OomKillFirst:  params.setOomAdj = true, params.oomAdj = 1000; break;
+    default: break;
+    }
+
+    return params;
+}
+
+void NeroTuning::Merge(Params &base, const Params &overrides)
+{
+    if(overrides.setNice)   base.setNice = true,   base.nice = overrides.nice;
+    if(overrides.setPolicy) base.setPolicy = true, base.policy = overrides.policy;
+    if(overrides.setIoPrio) base.setIoPrio = true, base.ioClass = overrides.ioClass, base.ioLevel = overrides.ioLevel;
+    if(overrides.setOomAdj) base.setOomAdj = true, base.oomAdj = overrides.oomAdj;
+}
+
+// Pulls --nice/--sched/--ioprio/--oom-adj out of the CLI args,
+// stopping at the executable so that the app's own arguments are left alone.
+bool NeroTuning::TakeCliArgs(QStringList &args, Params &params)
+{
+    for(int i = 0; i < args.count(); ++i) {
+        const QString arg = args.at(i);
+        const QString lower = arg.toLower();
+        if(lower.endsWith(".exe") || lower.endsWith(".msi") || lower.endsWith(".bat") || lower.endsWith(".cmd"))
+            break;
+
+        if(arg != "--nice" && arg != "--sched" && arg != "--ioprio" && arg != "--oom-adj")
+            continue;
+
+        if(i+1 >= args.count()) {
+            printf("%s requires a value!\n", arg.toLocal8Bit().constData());
+            return false;
+        }
+        const QString value = args.at(i+1).toLower();
+        bool ok = true;
+
+        if(arg == "--nice") {
+            params.nice = value.toInt(&ok);
+            ok = ok && params.nice >= -20 && params.nice <= 19;
+            params.setNice = ok;
+        } else if(arg == "--sched") {
+            if(value == "batch")       params.policy = SCHED_BATCH;
+            else if(value == "idle")   params.policy = SCHED_IDLE;
+            else if(value == "normal") params.policy = SCHED_OTHER;
+            else ok = false;
+            params.setPolicy = ok;
+        } else if(arg == "--ioprio") {
+            if(value == "idle") {
+                params.ioClass = IoClassIdle, params.ioLevel = 0;
+            } else {
+                // accepts "be:N", "rt:N" or just a best-effort level
+                params.ioClass = value.startsWith("rt:") ? IoClassRealtime : IoClassBestEffort;
+                params.ioLevel = value.mid(value.indexOf(':')+1).toInt(&ok);
+                ok = ok && params.ioLevel >= 0 && params.ioLevel <= 7 &&
+                     (value.startsWith("rt:") || value.startsWith("be:") || !value.contains(':'));
+            }
+            params.setIoPrio = ok;
+        } else if(arg == "--oom-adj") {
+            params.oomAdj = value.toInt(&ok);
+            ok = ok && params.oomAdj >= -1000 && params.oomAdj <= 1000;
+            params.setOomAdj = ok;
+        }
+
+        if(!ok) {
+            printf("Invalid value \"%s\" for %s!\n", args.at(i+1).toLocal8Bit().constData(), arg.toLocal8Bit().constData());
+            return false;
+        }
+
+        args.removeAt(i+1);
+        args.removeAt(i);
+        --i;
+    }
+
+    return true;
+}
+
+int NeroTuning::Apply(const Params &params, const pid_t pid)
+{
+    int failed = 0;
+
+    if(params.setPolicy) {
+        struct sched_param schedParam = {};
+        if(sched_setscheduler(pid, params.policy, &schedParam) != 0)
+            ++failed;
+    }
+
+    // SCHED_IDLE ignores nice, but it's still inherited if the child switches back to normal.
+    if(params.setNice)
+        if(setpriority(PRIO_PROCESS, pid, params.nice) != 0)
+            ++failed;
+
+    if(params.setIoPrio)
+        if(!SetIoPriority(pid, params.ioClass, params.ioLevel))
+            ++failed;
+
+    if(params.setOomAdj) {
+        // no snprintf in a forked child; build "/proc/<pid>/oom_score_adj" by hand.
+        char path[64] = "/proc/self/oom_score_adj";
+        if(pid > 0) {
+            char digits[16];
+            int len = 0;
+            for(pid_t rem = pid; rem > 0 && len < 15; rem /= 10)
+                digits[len++] = '0' + (rem % 10);
+            int pos = 6;
+            while(len > 0) path[pos++] = digits[--len];
+            const char suffix[] = "/oom_score_adj";
+            for(unsigned int i = 0; i < sizeof(suffix); ++i) path[pos++] = suffix[i];
+        }
+
+        char value[16];
+        int len = 0;
+        int rem = params.oomAdj < 0 ? -params.oomAdj : params.oomAdj;
+        char digits[8];
+        int count = 0;
+        do { digits[count++] = '0' + (rem % 10); rem /= 10; } while(rem > 0 && count < 7);
+        if(params.oomAdj < 0) value[len++] = '-';
+        while(count > 0) value[len++] = digits[--count];
+
+        const int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if(fd < 0 || write(fd, value, len) != len)
+            ++failed;
+        if(fd >= 0)
+            close(fd);
+    }
+
+    return failed;
+}
+
+QString NeroTuning::Describe(const pid_t pid)
+{
+    QStringList values;
+
+    errno = 0;
+    const int nice = getpriority(PRIO_PROCESS, pid);
+    if(errno == 0) values << QString("nice=%1").arg(nice);
+
+    switch(sched_getscheduler(pid)) {
+    case SCHED_OTHER: values << "sched=SCHED_OTHER"; break;
+    case SCHED_BATCH: values << "sched=SCHED_BATCH"; break;
+    case SCHED_IDLE:  values << "sched=SCHED_IDLE";  break;
+    case SCHED_FIFO:  values << "sched=SCHED_FIFO";  break;
+    case SCHED_RR:    values << "sched=SCHED_RR";    break;
+    default: break;
+    }
+
+    const int ioprio = GetIoPriority(pid);
+    if(ioprio >= 0) {
+        const int level = ioprio & NERO_IOPRIO_PRIO_MASK;
+        switch(ioprio >> NERO_IOPRIO_CLASS_SHIFT) {
+        case IoClassRealtime:   values << QString("ioprio=rt:%1").arg(level); break;
+        case IoClassBestEffort: values << QString("ioprio=be:%1").arg(level); break;
+        case IoClassIdle:       values << "ioprio=idle"; break;
+        default:                values << "ioprio=none"; break;
+        }
+    }
+
+    QFile oomFile(QString("/proc/%1/oom_score_adj").arg(pid));
+    if(oomFile.open(QIODevice::ReadOnly))
+        values << QString("oom_score_adj=%1").arg(oomFile.readAll().trimmed().constData());
+
+    return values.join(' ');
+}
+
+bool NeroTuning::SetIoPriority(const pid_t pid, const int ioClass, const int level)
+{
+    return syscall(SYS_ioprio_set, NERO_IOPRIO_WHO_PROCESS, pid, (ioClass << NERO_IOPRIO_CLASS_SHIFT) | level) == 0;
+}
+
+int NeroTuning::GetIoPriority(const pid_t pid)
+{
+    return syscall(SYS_ioprio_get, NERO_IOPRIO_WHO_PROCESS, pid);
+}
+
+// Wine processes carry the prefix in their environment, while wineserver sits in its
+// server dir (/tmp/.wine-UID/server-DEV-INODE) which is derived from the prefix's dev/inode.
+QList<pid_t> NeroTuning::FindPrefixProcesses(const QString &prefixPath, const QString &processName)
+{
+    QList<pid_t> pids;
+
+    const QString canonicalPrefix = QFileInfo(prefixPath).canonicalFilePath();
+    if(canonicalPrefix.isEmpty())
+        return pids;
+
+    QString serverDir;
+    struct stat prefixStat;
+    if(stat(canonicalPrefix.toLocal8Bit().constData(), &prefixStat) == 0)
+        serverDir = QString("server-%1-%2").arg((qulonglong)prefixStat.st_dev, 0, 16).arg((qulonglong)prefixStat.st_ino, 0, 16);
+
+    const QByteArray envMatch = "WINEPREFIX=" % canonicalPrefix.toLocal8Bit();
+    const QByteArray envMatchSlash = envMatch % '/';
+
+    const QStringList procs = QDir("/proc").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for(const QString &proc : procs) {
+        bool isPid = false;
+        const pid_t pid = proc.toInt(&isPid);
+        if(!isPid || pid == getpid())
+            continue;
+
+        if(!processName.isEmpty()) {
+            QFile comm("/proc/" % proc % "/comm");
+            if(!comm.open(QIODevice::ReadOnly) || comm.readAll().trimmed() != processName.toLocal8Bit())
+                continue;
+        }
+
+        if(!serverDir.isEmpty() && QFileInfo("/proc/" % proc % "/cwd").symLinkTarget().endsWith(QString('/' + serverDir))) {
+            pids << pid;
+            continue;
+        }
+
+        QFile environ("/proc/" % proc % "/environ");
+        if(environ.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> vars = environ.readAll().split('\0');
+            for(const QByteArray &var : vars) {
+                if(var == envMatch || var == envMatchSlash) {
+                    pids << pid;
+                    break;
+                }
+            }
+        }
+    }
+
+    return pids;
+}
+
+pid_t NeroTuning::FindWineserver(const QString &prefixPath)
+{
+    const QList<pid_t> pids = FindPrefixProcesses(prefixPath, "wineserver");
+    return pids.isEmpty() ? 0 : pids.first();
+}
+
+static QList<int> ParseCpuList(const QByteArray &list)
+{
+    // e.g. "0-3,8,10-11"
+    QList<int> cpus;
+    const QList<QByteArray> ranges = list.trimmed().split(',');
+    for(const QByteArray &range : ranges) {
+        if(range.isEmpty())
+            continue;
+        const int dash = range.indexOf('-');
+        bool okStart = false, okEnd = false;
+        const int start = range.left(dash < 0 ? range.size() : dash).toInt(&okStart);
+        const int end = dash < 0 ? start : range.mid(dash+1).toInt(&okEnd);
+        if(!okStart || (dash >= 0 && !okEnd))
+            continue;
+        for(int cpu = start; cpu <= end; ++cpu)
+            cpus << cpu;
+    }
+    return cpus;
+}
+
+// Prefers a core isolated from the scheduler (isolcpus/nohz_full setups),
+// else the last online core with no SMT sibling sharing it. Pinning onto a
+// sibling of a busy core dedicates nothing, so with neither it's -1 (unpinned).
+int NeroTuning::PickDedicatedCore(const QString &sysfsRoot)
+{
+    const QString cpuPath = sysfsRoot % "/devices/system/cpu";
+    QList<int> online;
+    QFile onlineFile(cpuPath % "/online");
+    if(onlineFile.open(QIODevice::ReadOnly))
+        online = ParseCpuList(onlineFile.readAll());
+    // no point pinning on a single core machine
+    if(online.count() < 2)
+        return -1;
+
+    for(const QString &list : { QString("isolated"), QString("nohz_full") }) {
+        QFile file(cpuPath % '/' % list);
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+        for(const int cpu : ParseCpuList(file.readAll()))
+            if(online.contains(cpu))
+                return cpu;
+    }
+
+    for(int i = online.count() - 1; i >= 0; --i) {
+        QFile siblings(cpuPath % "/cpu" % QString::number(online.at(i)) % "/topology/thread_siblings_list");
+        if(siblings.open(QIODevice::ReadOnly) && ParseCpuList(siblings.readAll()) == QList<int>{ online.at(i) })
+            return online.at(i);
+    }
+
+    return -1;
+}
+
+static QList<pid_t> ProcessThreads(const pid_t pid)
+{
+    QList<pid_t> tids;
+    const QStringList tasks = QDir(QString("/proc/%1/task").arg(pid)).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for(const QString &task : tasks)
+        tids << task.toInt();
+    if(tids.isEmpty())
+        tids << pid;
+    return tids;
+}
+
+bool NeroTuning::PinToCore(const pid_t pid, const int core)
+{
+    if(core < 0 || core >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+
+    // affinity is per-thread, so hit every thread that's already running
+    bool ok = true;
+    for(const pid_t tid : ProcessThreads(pid))
+        if(sched_setaffinity(tid, sizeof(set), &set) != 0)
+            ok = false;
+    return ok;
+}
+
+QString NeroTuning::TuneWineserver(const pid_t pid, const int priorityMode, const int affinityMode)
+{
+    QStringList results;
+
+    if(affinityMode == NeroConstant::WineserverAffinityDedicated) {
+        const int core = PickDedicatedCore();
+        if(core < 0)
+            results << "no isolated or SMT-free CPU core to pin to, left unpinned";
+        else if(PinToCore(pid, core))
+            results << QString("pinned to CPU %1").arg(core);
+        else results << QString("could not pin to CPU %1").arg(core);
+    }
+
+    int nice = 0;
+    switch(priorityMode) {
+    case NeroConstant::WineserverPrioRaised: nice = -5; break;
+    case NeroConstant::WineserverPrioHigh:   nice = -10; break;
+    case NeroConstant::WineserverPrioRealtime: {
+        struct sched_param schedParam = {};
+        schedParam.sched_priority = 1;
+        bool ok = true;
+        for(const pid_t tid : ProcessThreads(pid))
+            if(sched_setscheduler(tid, SCHED_RR, &schedParam) != 0)
+                ok = false;
+        if(ok)
+            results << "set to SCHED_RR";
+        else {
+            // RLIMIT_RTPRIO or CAP_SYS_NICE is needed for realtime, so fall back to the next best thing
+            results << "SCHED_RR not permitted, falling back to nice -10";
+            nice = -10;
+        }
+        break;
+    }
+    default: break;
+    }
+
+    if(nice != 0) {
+        bool ok = true;
+        for(const pid_t tid : ProcessThreads(pid))
+            if(setpriority(PRIO_PROCESS, tid, nice) != 0)
+                ok = false;
+        if(ok)
+            results << QString("set to nice %1").arg(nice);
+        else results << QString("nice %1 not permitted").arg(nice);
+    }
+
+    results << Describe(pid);
+    return results.join("; ");
+}
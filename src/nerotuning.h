@@ -0,0 +1,75 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Process tuning helpers (scheduling, I/O priority, OOM score).
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEROTUNING_H
+#define NEROTUNING_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+#include <sys/types.h>
+
+class NeroTuning
+{
+public:
+    // Everything set here is inherited by anything the tuned process spawns afterwards,
+    // so applying this to umu-run covers Proton, wineserver and the game itself.
+    struct Params {
+        bool setNice = false;
+        int nice = 0;
+        bool setPolicy = false;
+        int policy = 0;
+        bool setIoPrio = false;
+        int ioClass = 0;
+        int ioLevel = 0;
+        bool setOomAdj = false;
+        int oomAdj = 0;
+
+        bool isEmpty() const { return !setNice && !setPolicy && !setIoPrio && !setOomAdj; }
+    };
+
+    enum {
+        IoClassNone = 0,
+        IoClassRealtime,
+        IoClassBestEffort,
+        IoClassIdle
+    } IoClasses_e;
+
+    static Params FromSettings(const int niceMode, const int schedMode, const int ioMode, const int oomMode);
+    static void Merge(Params &base, const Params &overrides);
+    static bool TakeCliArgs(QStringList &args, Params &params);
+
+    // NOTE: only async-signal-safe calls in here, as this is also run in the forked child before exec.
+    // pid 0 means the calling process; returns the number of settings the kernel refused.
+    static int Apply(const Params &params, const pid_t pid = 0);
+    static QString Describe(const pid_t pid);
+
+    static bool SetIoPriority(const pid_t pid, const int ioClass, const int level);
+    static int GetIoPriority(const pid_t pid);
+
+    // wineserver
+    static QList<pid_t> FindPrefixProcesses(const QString &prefixPath, const QString &processName = QString());
+    static pid_t FindWineserver(const QString &prefixPath);
+    static int PickDedicatedCore(const QString &sysfsRoot = "/sys");
+    static bool PinToCore(const pid_t pid, const int core);
+    static QString TuneWineserver(const pid_t pid, const int priorityMode, const int affinityMode);
+};
+
+#endif // NEROTUNING_H
@@ -0,0 +1,147 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for cross-prefix deduplication.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerodedup.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Deduplication only does anything on reflink-capable filesystems (btrfs, xfs, bcachefs...), and /tmp is
+// usually tmpfs. Point NERO_TEST_REFLINK_DIR at a directory on one of those to cover the actual swap.
+class TestNeroDedup : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir *home = nullptr;
+    QByteArray dllContents;
+
+    void MakePrefix(const QString &name, const bool hibernated = false)
+    {
+        const QString path = home->path() + '/' + name;
+        QVERIFY(QDir().mkpath(path + "/drive_c/windows/system32"));
+        QSettings cfg(path + "/nero-settings.ini", QSettings::IniFormat);
+        cfg.setValue("Name", name);
+        if(hibernated)
+            cfg.setValue("PrefixSettings/Hibernated", true);
+        cfg.sync();
+
+        QFile dll(path + "/drive_c/windows/system32/shared.dll");
+        QVERIFY(dll.open(QIODevice::WriteOnly));
+        dll.write(dllContents);
+        dll.close();
+        QVERIFY(QFile::setPermissions(dll.fileName(), QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup));
+        // something recognizably old, to tell if it got clobbered
+        const struct timespec times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+        QCOMPARE(utimensat(AT_FDCWD, QFile::encodeName(dll.fileName()).constData(), times, 0), 0);
+    }
+
+private slots:
+    void init()
+    {
+        const QByteArray base = qgetenv("NERO_TEST_REFLINK_DIR");
+        home = base.isEmpty() ? new QTemporaryDir() : new QTemporaryDir(QString(base) + "/nero-dedup-XXXXXX");
+        QVERIFY(home->isValid());
+        dllContents.clear();
+        // comfortably over the minimum size dedup bothers with
+        for(int i = 0; i < 32*1024; ++i)
+            dllContents.append(char(i * 7));
+    }
+
+    void cleanup()
+    {
+        delete home;
+        home = nullptr;
+    }
+
+    void rootsSkipHibernated()
+    {
+        MakePrefix("awake");
+        MakePrefix("sleeping", true);
+        QDir().mkpath(home->path() + "/.templates/Proton-9.0");
+        QDir().mkpath(home->path() + "/.templates/Proton-9.0.tmp");
+
+        const QStringList roots = NeroDedup::GetDedupRoots(home->path());
+        QVERIFY(roots.contains(home->path() + "/awake"));
+        QVERIFY(!roots.contains(home->path() + "/sleeping"));
+        QVERIFY(roots.contains(home->path() + "/.templates/Proton-9.0"));
+        QVERIFY(!roots.contains(home->path() + "/.templates/Proton-9.0.tmp"));
+    }
+
+    void rootsSkipRunning()
+    {
+        MakePrefix("idle");
+        MakePrefix("running");
+
+        // anything with WINEPREFIX pointing at the prefix counts as running in it
+        QProcess proc;
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("WINEPREFIX", QDir(home->path() + "/running").canonicalPath());
+        proc.setProcessEnvironment(env);
+        proc.start("sleep", { "30" });
+        QVERIFY(proc.waitForStarted());
+
+        const QStringList roots = NeroDedup::GetDedupRoots(home->path());
+        proc.kill();
+        proc.waitForFinished();
+
+        QVERIFY(roots.contains(home->path() + "/idle"));
+        QVERIFY(!roots.contains(home->path() + "/running"));
+    }
+
+    void dedupKeepsMetadata()
+    {
+        MakePrefix("a");
+        MakePrefix("b");
+
+        NeroDedup::Stats stats;
+        QVERIFY(NeroDedup::Run(NeroDedup::GetDedupRoots(home->path()), home->path() + "/.dedup-state", stats));
+        QCOMPARE(stats.errors, 0);
+
+        // deduplicated or not, both copies have to look exactly like they did before
+        for(const QString &prefix : { QString("a"), QString("b") }) {
+            const QString dllPath = home->path() + '/' + prefix + "/drive_c/windows/system32/shared.dll";
+            struct stat st;
+            QCOMPARE(stat(QFile::encodeName(dllPath).constData(), &st), 0);
+            QCOMPARE(st.st_mode & 07777, (mode_t)0640);
+            QCOMPARE(st.st_uid, getuid());
+            QCOMPARE((qint64)st.st_mtim.tv_sec, (qint64)1000000000);
+
+            QFile dll(dllPath);
+            QVERIFY(dll.open(QIODevice::ReadOnly));
+            QCOMPARE(dll.readAll(), dllContents);
+        }
+        QVERIFY(!QFile::exists(home->path() + "/b/drive_c/windows/system32/shared.dll.nero-dedup"));
+
+        if(stats.filesDeduped == 0)
+            QSKIP("filesystem has no reflink support, set NERO_TEST_REFLINK_DIR to one that does");
+        QCOMPARE(stats.filesDeduped, 1);
+        QCOMPARE(stats.bytesDeduped, (qint64)dllContents.size());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroDedup)
+#include "tst_nerodedup.moc"
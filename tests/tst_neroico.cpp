@@ -0,0 +1,301 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for the PE/ICO icon parser.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroico.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+namespace {
+    void Put16(QByteArray &data, const int offset, const quint16 value)
+    {
+        data[offset] = char(value & 0xff);
+        data[offset+1] = char(value >> 8);
+    }
+
+    void Put32(QByteArray &data, const int offset, const quint32 value)
+    {
+        for(int i = 0; i < 4; ++i)
+            data[offset+i] = char((value >> (i*8)) & 0xff);
+    }
+
+    // 32bpp BGRA frame with an (empty) AND mask; the top row is blue, the rest red
+    QByteArray MakeDib(const int size)
+    {
+        const int stride = size*4, maskStride = ((size + 31) / 32) * 4;
+        QByteArray dib(40 + stride*size + maskStride*size, '\0');
+        Put32(dib, 0, 40);
+        Put32(dib, 4, size);
+        Put32(dib, 8, size*2);
+        Put16(dib, 12, 1);
+        Put16(dib, 14, 32);
+        for(int row = 0; row < size; ++row)
+            for(int x = 0; x < size; ++x) {
+                // rows are stored bottom-up
+                const int offset = 40 + row*stride + x*4;
+                const bool top = row == size - 1;
+                dib[offset] = char(top ? 0xff : 0);
+                dib[offset+2] = char(top ? 0 : 0xff);
+                dib[offset+3] = char(0xff);
+            }
+        return dib;
+    }
+
+    QByteArray MakePng(const int size)
+    {
+        QImage image(size, size, QImage::Format_ARGB32);
+        image.fill(Qt::green);
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+        return png;
+    }
+
+    // 16-byte ICONDIRENTRY / 14-byte GRPICONDIRENTRY share everything but the last field
+    void PutEntry(QByteArray &data, const int offset, const int size, const quint32 bytes)
+    {
+        data[offset] = char(size >= 256 ? 0 : size);
+        data[offset+1] = char(size >= 256 ? 0 : size);
+        Put16(data, offset+4, 1);
+        Put16(data, offset+6, 32);
+        Put32(data, offset+8, bytes);
+    }
+
+    QByteArray MakeIco(const QList<QPair<int, QByteArray>> &frames)
+    {
+        QByteArray ico(6 + frames.count()*16, '\0');
+        Put16(ico, 2, 1);
+        Put16(ico, 4, frames.count());
+        for(int i = 0; i < frames.count(); ++i) {
+            PutEntry(ico, 6 + i*16, frames.at(i).first, frames.at(i).second.size());
+            Put32(ico, 6 + i*16 + 12, ico.size());
+            ico.append(frames.at(i).second);
+        }
+        return ico;
+    }
+
+    // Smallest PE32 that still has a proper .rsrc: one RT_GROUP_ICON (id 1) pointing at one RT_ICON (id 1).
+    QByteArray MakePe(const int size, const QByteArray &frame)
+    {
+        const int rawOffset = 0x200;
+        const quint32 rva = 0x1000;
+        // resource section layout: root, RT_ICON -> lang, RT_GROUP_ICON -> lang, two data entries, group, frame
+        const int root = 0, icons = 32, iconLangs = 56, groups = 80, groupLangs = 104;
+        const int iconData = 128, groupData = 144, group = 160, image = 184;
+
+        QByteArray pe(rawOffset + image + frame.size(), '\0');
+        pe[0] = 'M'; pe[1] = 'Z';
+        Put32(pe, 0x3c, 0x40);
+        Put32(pe, 0x40, 0x4550);
+        Put16(pe, 0x44, 0x14c);
+        Put16(pe, 0x46, 1);
+        Put16(pe, 0x54, 224);
+        const int optional = 0x58;
+        Put16(pe, optional, 0x10b);
+        Put32(pe, optional + 92, 16);
+        Put32(pe, optional + 96 + 2*8, rva);
+        Put32(pe, optional + 96 + 2*8 + 4, image + frame.size());
+        const int section = optional + 224;
+        memcpy(pe.data() + section, ".rsrc", 5);
+        Put32(pe, section + 8, image + frame.size());
+        Put32(pe, section + 12, rva);
+        Put32(pe, section + 16, image + frame.size());
+        Put32(pe, section + 20, rawOffset);
+
+        const auto dir = [&](const int offset, const QList<QPair<quint32, quint32>> &entries) {
+            Put16(pe, rawOffset + offset + 14, entries.count());
+            for(int i = 0; i < entries.count(); ++i) {
+                Put32(pe, rawOffset + offset + 16 + i*8, entries.at(i).first);
+                Put32(pe, rawOffset + offset + 16 + i*8 + 4, entries.at(i).second);
+            }
+        };
+        dir(root, { { 3, 0x80000000 | icons }, { 14, 0x80000000 | groups } });
+        dir(icons, { { 1, 0x80000000 | iconLangs } });
+        dir(iconLangs, { { 1033, iconData } });
+        dir(groups, { { 1, 0x80000000 | groupLangs } });
+        dir(groupLangs, { { 1033, groupData } });
+        Put32(pe, rawOffset + iconData, rva + image);
+        Put32(pe, rawOffset + iconData + 4, frame.size());
+        Put32(pe, rawOffset + groupData, rva + group);
+        Put32(pe, rawOffset + groupData + 4, 20);
+
+        Put16(pe, rawOffset + group + 2, 1);
+        Put16(pe, rawOffset + group + 4, 1);
+        PutEntry(pe, rawOffset + group + 6, size, frame.size());
+        Put16(pe, rawOffset + group + 6 + 12, 1);
+        memcpy(pe.data() + rawOffset + image, frame.constData(), frame.size());
+        return pe;
+    }
+}
+
+class TestNeroIco : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir dir;
+    int written = 0;
+
+    QString Write(const QByteArray &data, const QString &suffix)
+    {
+        QFile file(dir.filePath(QString("%1.%2").arg(++written).arg(suffix)));
+        if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+            return QString();
+        return file.fileName();
+    }
+
+private slots:
+    void icoPicksBiggestFrame()
+    {
+        const QImage image = NeroIcoExtractor::ExtractIcon(Write(MakeIco({ { 16, MakeDib(16) }, { 48, MakePng(48) } }), "ico"));
+        QCOMPARE(image.size(), QSize(48, 48));
+        QCOMPARE(image.pixel(0, 0), QColor(Qt::green).rgba());
+    }
+
+    void icoDecodesDib()
+    {
+        const QImage image = NeroIcoExtractor::ExtractIcon(Write(MakeIco({ { 32, MakeDib(32) } }), "ico"));
+        QCOMPARE(image.size(), QSize(32, 32));
+        QCOMPARE(image.pixel(0, 0), qRgba(0, 0, 0xff, 0xff));
+        QCOMPARE(image.pixel(0, 31), qRgba(0xff, 0, 0, 0xff));
+    }
+
+    void peDecodesGroupIcon()
+    {
+        const QImage image = NeroIcoExtractor::ExtractIcon(Write(MakePe(32, MakeDib(32)), "exe"));
+        QCOMPARE(image.size(), QSize(32, 32));
+        QCOMPARE(image.pixel(0, 0), qRgba(0, 0, 0xff, 0xff));
+    }
+
+    // every frame's fully needed, so cutting the file anywhere has to come back empty (and not crash)
+    void truncated()
+    {
+        const QByteArray ico = MakeIco({ { 16, MakeDib(16) } });
+        const QByteArray pe = MakePe(16, MakeDib(16));
+        for(int length = 0; length < ico.size(); ++length)
+            QVERIFY2(NeroIcoExtractor::ExtractIcon(Write(ico.left(length), "ico")).isNull(), qPrintable(QString::number(length)));
+        for(int length = 0; length < pe.size(); ++length)
+            QVERIFY2(NeroIcoExtractor::ExtractIcon(Write(pe.left(length), "exe")).isNull(), qPrintable(QString::number(length)));
+    }
+
+    void malformedIco()
+    {
+        QByteArray ico = MakeIco({ { 16, MakeDib(16) } });
+        // frame past the end of the file, with the size wrapping around if added carelessly
+        QByteArray bad = ico;
+        Put32(bad, 6 + 12, 0xfffffff0);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+        bad = ico;
+        Put32(bad, 6 + 8, 0xffffffff);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+        // claims way more entries than there are; the real one still counts
+        bad = ico;
+        Put16(bad, 4, 0xffff);
+        QVERIFY(!NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+        // not an icon at all
+        bad = ico;
+        Put16(bad, 2, 2);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+
+        // broken DIB headers: zero/huge width, odd depth, header bigger than the frame
+        const int dib = 6 + 16;
+        for(const QPair<int, quint32> &field : QList<QPair<int, quint32>>{ { 4, 0 }, { 4, 0x80000000 }, { 8, 0 }, { 8, 0xfffffffe },
+                                                                          { 0, 0xffffffff }, { 0, 8 }, { 16, 4 } }) {
+            bad = ico;
+            Put32(bad, dib + field.first, field.second);
+            QVERIFY2(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull(), qPrintable(QString::number(field.first)));
+        }
+        bad = ico;
+        Put16(bad, dib + 14, 7);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+
+        // a PNG frame that isn't one
+        bad = MakeIco({ { 48, MakePng(48).left(32) } });
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "ico")).isNull());
+    }
+
+    void malformedPe()
+    {
+        const QByteArray pe = MakePe(16, MakeDib(16));
+        const int section = 0x58 + 224;
+        const QList<QPair<int, quint32>> fields = {
+            { 0x3c, 0xfffffff0 },           // PE header past the end
+            { 0x58 + 92, 2 },               // too few data directories for a resource one
+            { 0x58 + 96 + 2*8, 0 },         // no resources
+            { 0x58 + 96 + 2*8, 0xfffff000 },// resources in no section
+            { section + 16, 0 },            // section without any raw data
+            { section + 20, 0xfffffe00 },   // section data past the end
+            { 0x200 + 128, 0xfffffff0 },    // RT_ICON data rva nowhere
+            { 0x200 + 128 + 4, 0x7fffffff },// RT_ICON data huge
+        };
+        for(const QPair<int, quint32> &field : fields) {
+            QByteArray bad = pe;
+            Put32(bad, field.first, field.second);
+            QVERIFY2(NeroIcoExtractor::ExtractIcon(Write(bad, "exe")).isNull(), qPrintable(QString::number(field.first, 16)));
+        }
+
+        // more sections than there's room for
+        QByteArray bad = pe;
+        Put16(bad, 0x46, 0xffff);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "exe")).isNull());
+        // the group points at an icon id that doesn't exist...
+        bad = pe;
+        Put16(bad, 0x200 + 160 + 6 + 12, 2);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "exe")).isNull());
+        // ...and the RT_ICON directory claims more entries than fit in the section, so the search runs off the end
+        Put16(bad, 0x200 + 32 + 14, 0xffff);
+        QVERIFY(NeroIcoExtractor::ExtractIcon(Write(bad, "exe")).isNull());
+    }
+
+    // no particular result expected, just that garbage in any one spot doesn't take it down
+    void corruptBytes()
+    {
+        const QByteArray pe = MakePe(16, MakeDib(16));
+        // everything up to & including the frame's DIB header
+        for(int i = 0; i < 0x200 + 184 + 40; ++i)
+            for(const char value : { char(0), char(0x7f), char(0xff) }) {
+                QByteArray bad = pe;
+                bad[i] = value;
+                const QImage image = NeroIcoExtractor::ExtractIcon(Write(bad, "exe"));
+                QVERIFY(image.isNull() || (image.width() <= 1024 && image.height() <= 1024));
+            }
+    }
+
+    // two different setup.exes get their own pngs, somewhere other processes can't predict
+    void getIconUniquePaths()
+    {
+        QVERIFY(QDir(dir.path()).mkpath("a") && QDir(dir.path()).mkpath("b"));
+        QFile::copy(Write(MakePe(16, MakeDib(16)), "exe"), dir.filePath("a/setup.exe"));
+        QFile::copy(Write(MakePe(32, MakeDib(32)), "exe"), dir.filePath("b/setup.exe"));
+
+        const QString first = NeroIcoExtractor::GetIcon(dir.filePath("a/setup.exe"));
+        const QString second = NeroIcoExtractor::GetIcon(dir.filePath("b/setup.exe"));
+        QVERIFY(!first.isEmpty() && !second.isEmpty());
+        QVERIFY(first != second);
+        QVERIFY(!first.startsWith(QDir::temp().filePath("nero-manager/")));
+        QCOMPARE(QImage(first).size(), QSize(16, 16));
+        QCOMPARE(QImage(second).size(), QSize(32, 32));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroIco)
+#include "tst_neroico.moc"
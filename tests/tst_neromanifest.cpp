@@ -0,0 +1,215 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for home manifests: diffing, applying, and applying again.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neromanifest.h"
+#include "nerofs.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QProcess>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Only existing prefixes are covered, since creating one (or installing verbs) needs umu & a runner.
+class TestNeroManifest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir *home = nullptr;
+    QTemporaryDir *games = nullptr;
+
+    QString PrefixPath() const { return home->path() + "/Game"; }
+
+    QByteArray ReadIni() const
+    {
+        QFile ini(PrefixPath() + "/nero-settings.ini");
+        return ini.open(QIODevice::ReadOnly) ? ini.readAll() : QByteArray();
+    }
+
+    // a PNG-in-ICO, same as what Vista+ icons use for their big sizes. Only written once, since a newer
+    // icon than the cached one is rightly something to update.
+    QString WriteIco()
+    {
+        if(QFile::exists(games->filePath("game.ico")))
+            return games->filePath("game.ico");
+        QImage image(32, 32, QImage::Format_ARGB32);
+        image.fill(Qt::red);
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+
+        QByteArray ico;
+        QDataStream stream(&ico, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream << quint16(0) << quint16(1) << quint16(1)
+               << quint8(32) << quint8(32) << quint8(0) << quint8(0) << quint16(1) << quint16(32)
+               << quint32(png.size()) << quint32(6 + 16);
+        ico += png;
+
+        QFile file(games->filePath("game.ico"));
+        if(!file.open(QIODevice::WriteOnly))
+            return QString();
+        file.write(ico);
+        return file.fileName();
+    }
+
+    bool LoadManifest(QList<NeroManifest::Prefix> &prefixes)
+    {
+        const QString icon = WriteIco();
+        QFile manifest(home->filePath("manifest.json"));
+        if(icon.isEmpty() || !manifest.open(QIODevice::WriteOnly))
+            return false;
+        manifest.write(QString(R"({ "prefixes": { "Game": {
+            "settings": { "DLSSUpgrade": true, "DebugOutput": 2, "DllOverrides": [ "d3d9=n,b", "dinput8=n,b" ] },
+            "drives": { "D": "%1", "e:": "" },
+            "shortcuts": { "The Game": { "path": "C:/Games/game.exe", "icon": "%2", "settings": { "LimitFPS": 60 } } }
+        } } })").arg(games->path(), icon).toUtf8());
+        manifest.close();
+        return NeroManifest::Load(manifest.fileName(), prefixes);
+    }
+
+private slots:
+    void init()
+    {
+        home = new QTemporaryDir();
+        games = new QTemporaryDir();
+        QVERIFY(home->isValid() && games->isValid());
+        NeroFS::GetPrefixesPath()->setPath(home->path());
+
+        QVERIFY(QDir().mkpath(PrefixPath() + "/dosdevices"));
+        QSettings cfg(PrefixPath() + "/nero-settings.ini", QSettings::IniFormat);
+        cfg.setValue("PrefixSettings/CurrentRunner", "GE-Proton9-20");
+        cfg.setValue("PrefixSettings/DebugOutput", 0);
+        cfg.sync();
+        // a stale drive that the manifest wants gone
+        QVERIFY(QFile::link(games->path(), PrefixPath() + "/dosdevices/e:"));
+    }
+
+    void cleanup()
+    {
+        delete home;
+        delete games;
+        home = games = nullptr;
+    }
+
+    void applyThenNothingLeft()
+    {
+        QList<NeroManifest::Prefix> prefixes;
+        QVERIFY(LoadManifest(prefixes));
+        QCOMPARE(prefixes.count(), 1);
+
+        const NeroManifest::Plan plan = NeroManifest::Diff(prefixes.first());
+        QVERIFY(!plan.create);
+        QCOMPARE(plan.settings.count(), 3);
+        QCOMPARE(plan.drives.count(), 2);
+        QCOMPARE(plan.shortcuts.count(), 1);
+        QVERIFY(plan.verbs.isEmpty());
+
+        QCOMPARE(NeroManifest::Apply(QString(), prefixes.first(), plan, NeroFS::TemplatesOff, 0), 0);
+
+        QSettings cfg(PrefixPath() + "/nero-settings.ini", QSettings::IniFormat);
+        QCOMPARE(cfg.value("PrefixSettings/DebugOutput").toInt(), 2);
+        QCOMPARE(cfg.value("PrefixSettings/DllOverrides").toStringList(), QStringList({ "d3d9=n,b", "dinput8=n,b" }));
+        QCOMPARE(QFileInfo(PrefixPath() + "/dosdevices/d:").canonicalFilePath(), QDir(games->path()).canonicalPath());
+        QVERIFY(!QFileInfo(PrefixPath() + "/dosdevices/e:").isSymLink());
+
+        cfg.beginGroup("Shortcuts");
+        QCOMPARE(cfg.childKeys().count(), 1);
+        const QString hash = cfg.childKeys().first();
+        cfg.endGroup();
+        QCOMPARE(cfg.value("Shortcuts--" + hash + "/Path").toString(), QString("C:/Games/game.exe"));
+        QCOMPARE(cfg.value("Shortcuts--" + hash + "/LimitFPS").toInt(), 60);
+        // pulled out of the .ico, not loaded as a plain image
+        const QImage cachedIcon(PrefixPath() + "/.icoCache/The Game-" + hash + ".png");
+        QCOMPARE(cachedIcon.size(), QSize(32, 32));
+
+        // everything's where the manifest wants it now
+        QVERIFY(NeroManifest::Diff(prefixes.first()).IsEmpty());
+    }
+
+    void applyIsIdempotent()
+    {
+        QList<NeroManifest::Prefix> prefixes;
+        QVERIFY(LoadManifest(prefixes));
+        QCOMPARE(NeroManifest::Apply(QString(), prefixes.first(), NeroManifest::Diff(prefixes.first()), NeroFS::TemplatesOff, 0), 0);
+        const QByteArray afterFirst = ReadIni();
+
+        // loading the manifest again & applying what's left touches nothing, not even the shortcut's (stable) hash
+        prefixes.clear();
+        QVERIFY(LoadManifest(prefixes));
+        const NeroManifest::Plan plan = NeroManifest::Diff(prefixes.first());
+        QVERIFY2(plan.IsEmpty(), qPrintable(plan.Describe().join("; ")));
+        QCOMPARE(NeroManifest::Apply(QString(), prefixes.first(), plan, NeroFS::TemplatesOff, 0), 0);
+        QCOMPARE(ReadIni(), afterFirst);
+    }
+
+    void refusesRunningPrefix()
+    {
+        QList<NeroManifest::Prefix> prefixes;
+        QVERIFY(LoadManifest(prefixes));
+        const NeroManifest::Plan plan = NeroManifest::Diff(prefixes.first());
+        const QByteArray before = ReadIni();
+
+        QProcess wine;
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("WINEPREFIX", QDir(PrefixPath()).canonicalPath());
+        wine.setProcessEnvironment(env);
+        wine.start("sleep", { "30" });
+        QVERIFY(wine.waitForStarted());
+        const int result = NeroManifest::Apply(QString(), prefixes.first(), plan, NeroFS::TemplatesOff, 0);
+        wine.kill();
+        wine.waitForFinished();
+
+        QCOMPARE(result, -1);
+        QCOMPARE(ReadIni(), before);
+        QVERIFY(!QFileInfo(PrefixPath() + "/dosdevices/d:").isSymLink());
+    }
+
+    void refusesHibernatedPrefix()
+    {
+        QList<NeroManifest::Prefix> prefixes;
+        QVERIFY(LoadManifest(prefixes));
+        {
+            QSettings cfg(PrefixPath() + "/nero-settings.ini", QSettings::IniFormat);
+            cfg.setValue("PrefixSettings/Hibernated", true);
+        }
+        QVERIFY(QDir().mkpath(home->path() + "/.hibernated"));
+        QFile archive(NeroFS::GetHibernatedPath("Game"));
+        QVERIFY(archive.open(QIODevice::WriteOnly));
+        archive.close();
+
+        // its drives can't be checked without waking it, which Diff won't do
+        const NeroManifest::Plan plan = NeroManifest::Diff(prefixes.first());
+        QVERIFY(plan.drives.isEmpty());
+        QCOMPARE(plan.notes.count(), 1);
+
+        const QByteArray before = ReadIni();
+        QCOMPARE(NeroManifest::Apply(QString(), prefixes.first(), plan, NeroFS::TemplatesOff, 0), -1);
+        QCOMPARE(ReadIni(), before);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroManifest)
+#include "tst_neromanifest.moc"
@@ -0,0 +1,253 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for verb download prefetching, against a local stub server.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroprefetch.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QNetworkProxy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtTest>
+
+#include <atomic>
+
+// Just enough HTTP/1.1 for QNetworkAccessManager: one GET per connection, a fixed set of files, 404 for the rest.
+// Lives on the test's thread, so it gets served by Fetch's own event loop (or QTRY_ for fetches on other threads).
+class StubServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    QTcpServer server;
+    QHash<QString, QByteArray> files;
+    // path -> how many GETs it's had
+    QHash<QString, int> requests;
+    // paths that only get answered once this many requests for them are waiting, to force fetches to overlap
+    QHash<QString, int> holdUntil;
+
+    bool Listen()
+    {
+        connect(&server, &QTcpServer::newConnection, this, [this]() {
+            while(QTcpSocket *socket = server.nextPendingConnection())
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { Read(socket); });
+        });
+        return server.listen(QHostAddress::LocalHost);
+    }
+
+    QString Url(const QString &path) const { return QString("http://127.0.0.1:%1%2").arg(server.serverPort()).arg(path); }
+
+private:
+    QHash<QTcpSocket*, QByteArray> buffers;
+    QHash<QString, QList<QTcpSocket*>> held;
+
+    void Read(QTcpSocket *socket)
+    {
+        QByteArray &buffer = buffers[socket];
+        buffer += socket->readAll();
+        if(!buffer.contains("\r\n\r\n"))
+            return;
+        const QString path = QString::fromLatin1(buffer.left(buffer.indexOf("\r\n")).split(' ').value(1));
+        buffers.remove(socket);
+        requests[path]++;
+
+        if(holdUntil.contains(path)) {
+            held[path] << socket;
+            if(held[path].count() < holdUntil.value(path))
+                return;
+            for(QTcpSocket *waiting : held.take(path))
+                Reply(waiting, path);
+        } else Reply(socket, path);
+    }
+
+    void Reply(QTcpSocket *socket, const QString &path)
+    {
+        const bool found = files.contains(path);
+        const QByteArray body = found ? files.value(path) : QByteArray("not here");
+        socket->write((found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n") +
+                      QByteArray("Content-Length: ") + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+        socket->disconnectFromHost();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+};
+
+class TestNeroPrefetch : public QObject
+{
+    Q_OBJECT
+
+private:
+    StubServer *stub = nullptr;
+    QTemporaryDir *cache = nullptr;
+    QByteArray payload;
+
+    NeroPrefetch::Download Download(const QString &path, const QString &checksum) const
+    {
+        NeroPrefetch::Download download;
+        download.verb = "vcrun2019";
+        download.url = stub->Url(path);
+        download.checksum = checksum;
+        download.fileName = path.section('/', -1);
+        return download;
+    }
+
+    QString Sha256(const QByteArray &data) const { return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex(); }
+
+    QByteArray Cached(const QString &fileName) const
+    {
+        QFile file(cache->path() + "/vcrun2019/" + fileName);
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+    // nothing half-written should ever be left behind, whatever happened
+    int PartFiles() const
+    {
+        return QDir(cache->path() + "/vcrun2019").entryList({ "*.part.*" }, QDir::Files).count();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        // a proxy from the environment would never reach the stub
+        QNetworkProxy::setApplicationProxy(QNetworkProxy::NoProxy);
+    }
+
+    void init()
+    {
+        stub = new StubServer();
+        QVERIFY(stub->Listen());
+        cache = new QTemporaryDir();
+        QVERIFY(cache->isValid());
+        // a few chunks' worth, so it arrives over several readyReads
+        payload.clear();
+        for(int i = 0; i < 256*1024; ++i)
+            payload.append(char(i % 251));
+        stub->files["/vc_redist.x64.exe"] = payload;
+    }
+
+    void cleanup()
+    {
+        delete stub;
+        delete cache;
+        stub = nullptr;
+        cache = nullptr;
+    }
+
+    void miss()
+    {
+        NeroPrefetch::Stats stats;
+        QVERIFY(NeroPrefetch::Fetch({ Download("/vc_redist.x64.exe", Sha256(payload)) }, cache->path(), 4, stats));
+        QCOMPARE(stats.total, 1);
+        QCOMPARE(stats.hits, 0);
+        QCOMPARE(stats.fetched, 1);
+        QCOMPARE(stats.failed, 0);
+        QCOMPARE(stats.bytes, (qint64)payload.size());
+        QCOMPARE(Cached("vc_redist.x64.exe"), payload);
+        QCOMPARE(PartFiles(), 0);
+    }
+
+    void hit()
+    {
+        QVERIFY(QDir().mkpath(cache->path() + "/vcrun2019"));
+        QFile existing(cache->path() + "/vcrun2019/vc_redist.x64.exe");
+        QVERIFY(existing.open(QIODevice::WriteOnly));
+        existing.write("already here");
+        existing.close();
+
+        NeroPrefetch::Stats stats;
+        QVERIFY(NeroPrefetch::Fetch({ Download("/vc_redist.x64.exe", Sha256(payload)) }, cache->path(), 4, stats));
+        QCOMPARE(stats.hits, 1);
+        QCOMPARE(stats.fetched, 0);
+        QCOMPARE(stub->requests.value("/vc_redist.x64.exe"), 0);
+        // winetricks checks cached files itself, prefetching never touches them
+        QCOMPARE(Cached("vc_redist.x64.exe"), QByteArray("already here"));
+    }
+
+    void sha1()
+    {
+        NeroPrefetch::Stats stats;
+        const QString checksum = QCryptographicHash::hash(payload, QCryptographicHash::Sha1).toHex().toUpper();
+        QVERIFY(NeroPrefetch::Fetch({ Download("/vc_redist.x64.exe", checksum) }, cache->path(), 4, stats));
+        QCOMPARE(stats.fetched, 1);
+    }
+
+    void checksumMismatch()
+    {
+        NeroPrefetch::Stats stats;
+        QVERIFY(!NeroPrefetch::Fetch({ Download("/vc_redist.x64.exe", Sha256("something else")) }, cache->path(), 4, stats));
+        QCOMPARE(stats.fetched, 0);
+        QCOMPARE(stats.failed, 1);
+        QVERIFY(!QFile::exists(cache->path() + "/vcrun2019/vc_redist.x64.exe"));
+        QCOMPARE(PartFiles(), 0);
+    }
+
+    void notFound()
+    {
+        NeroPrefetch::Stats stats;
+        const QList<NeroPrefetch::Download> downloads = { Download("/missing.exe", QString()),
+                                                          Download("/vc_redist.x64.exe", Sha256(payload)) };
+        // one failure doesn't hold up the rest
+        QVERIFY(!NeroPrefetch::Fetch(downloads, cache->path(), 1, stats));
+        QCOMPARE(stats.fetched, 1);
+        QCOMPARE(stats.failed, 1);
+        QVERIFY(!QFile::exists(cache->path() + "/vcrun2019/missing.exe"));
+        QCOMPARE(Cached("vc_redist.x64.exe"), payload);
+        QCOMPARE(PartFiles(), 0);
+    }
+
+    // two jobs (e.g. parallel manifest applies) wanting the same installer at the same time
+    void concurrentSameFile()
+    {
+        stub->holdUntil["/vc_redist.x64.exe"] = 2;
+        const QList<NeroPrefetch::Download> downloads = { Download("/vc_redist.x64.exe", Sha256(payload)) };
+        const QString cachePath = cache->path();
+
+        std::atomic<int> done{0}, succeeded{0}, fetched{0};
+        QList<QThread*> threads;
+        for(int i = 0; i < 2; ++i) {
+            threads << QThread::create([&]() {
+                NeroPrefetch::Stats stats;
+                if(NeroPrefetch::Fetch(downloads, cachePath, 4, stats))
+                    succeeded++;
+                fetched += stats.fetched;
+                done++;
+            });
+            threads.last()->start();
+        }
+        // the stub's on this thread, so keep its events going until both are through
+        QTRY_COMPARE_WITH_TIMEOUT(done.load(), 2, 15000);
+        for(QThread *thread : threads) {
+            thread->wait();
+            delete thread;
+        }
+
+        QCOMPARE(stub->requests.value("/vc_redist.x64.exe"), 2);
+        // whichever finished second finds the file already there, which still counts as fetched
+        QCOMPARE(succeeded.load(), 2);
+        QCOMPARE(fetched.load(), 2);
+        QCOMPARE(Cached("vc_redist.x64.exe"), payload);
+        QCOMPARE(PartFiles(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroPrefetch)
+#include "tst_neroprefetch.moc"
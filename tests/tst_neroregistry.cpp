@@ -0,0 +1,191 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for registry compaction.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "neroregistry.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+namespace {
+    const QString runMru = "Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU";
+
+    // the same (HKCU) MRU path in every hive, next to keys that have to survive
+    const QByteArray systemReg = R"(WINE REGISTRY Version 2
+;; All keys relative to \\Machine
+
+#arch=win64
+
+[Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU] 1700000000
+#time=1da1b2c3d4e5f60
+"a"="setup.exe"
+
+[Software\\Wine] 1700000000
+#time=1da1b2c3d4e5f60
+"Version"="win10"
+)";
+
+    const QByteArray userReg = R"(WINE REGISTRY Version 2
+;; All keys relative to \\User\\S-1-5-21-0-0-0-1000
+
+#arch=win64
+
+[Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU] 1700000000
+#time=1da1b2c3d4e5f60
+"a"="notepad"
+"MRUList"="a"
+
+[Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU\\Deeper] 1700000000
+"b"="regedit"
+
+[Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRUish] 1700000000
+"keep"="me"
+
+[Software\\Wine\\Direct3D] 1700000000
+#time=1da1b2c3d4e5f60
+"csmt"=dword:00000001
+
+[Software\\Wine\\Direct3D] 1700000001
+"renderer"="vulkan"
+"csmt"=dword:00000000
+)";
+
+    const QByteArray userdefReg = R"(WINE REGISTRY Version 2
+;; All keys relative to \\User\\.Default
+
+#arch=win64
+
+[Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RunMRU] 1700000000
+"a"="default"
+)";
+}
+
+class TestNeroRegistry : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir *prefix = nullptr;
+
+    void Write(const QString &name, const QByteArray &contents)
+    {
+        QFile file(prefix->filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    }
+
+    QByteArray Read(const QString &name)
+    {
+        QFile file(prefix->filePath(name));
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+private slots:
+    void init()
+    {
+        prefix = new QTemporaryDir();
+        QVERIFY(prefix->isValid());
+        Write("system.reg", systemReg);
+        Write("user.reg", userReg);
+        Write("userdef.reg", userdefReg);
+    }
+
+    void cleanup()
+    {
+        delete prefix;
+        prefix = nullptr;
+    }
+
+    void pruneOnlyUserReg()
+    {
+        QList<QPair<QString, NeroRegistry::CompactStats>> stats;
+        QVERIFY(NeroRegistry::CompactPrefix(prefix->path(), NeroRegistry::DefaultPruneKeys(), stats));
+        QCOMPARE(stats.count(), 3);
+        QCOMPARE(stats.at(0).first, QString("system.reg"));
+        QCOMPARE(stats.at(1).first, QString("user.reg"));
+        QCOMPARE(stats.at(2).first, QString("userdef.reg"));
+        QCOMPARE(stats.at(0).second.keysPruned, 0);
+        // the key & its subkey, but not a sibling that merely starts the same
+        QCOMPARE(stats.at(1).second.keysPruned, 2);
+        QCOMPARE(stats.at(2).second.keysPruned, 0);
+
+        NeroRegistry user;
+        QVERIFY(user.Open(prefix->filePath("user.reg")));
+        QVERIFY(!user.HasKey(runMru));
+        QVERIFY(!user.HasKey(runMru + "\\Deeper"));
+        QVERIFY(user.HasKey(runMru + "ish"));
+
+        // an HKLM key by the same path is something else entirely
+        NeroRegistry system;
+        QVERIFY(system.Open(prefix->filePath("system.reg")));
+        QCOMPARE(system.GetValue(runMru, "a"), QByteArray("\"setup.exe\""));
+        QCOMPARE(system.GetValue("Software\\Wine", "Version"), QByteArray("\"win10\""));
+
+        NeroRegistry userdef;
+        QVERIFY(userdef.Open(prefix->filePath("userdef.reg")));
+        QVERIFY(userdef.HasKey(runMru));
+    }
+
+    void mergesDuplicates()
+    {
+        QList<QPair<QString, NeroRegistry::CompactStats>> stats;
+        QVERIFY(NeroRegistry::CompactPrefix(prefix->path(), QStringList(), stats));
+        QCOMPARE(stats.at(1).second.duplicatesMerged, 1);
+        QCOMPARE(stats.at(1).second.keysPruned, 0);
+
+        // later sections win, like when wineserver loads them
+        NeroRegistry user;
+        QVERIFY(user.Open(prefix->filePath("user.reg")));
+        QCOMPARE(user.GetValue("Software\\Wine\\Direct3D", "csmt"), QByteArray("dword:00000000"));
+        QCOMPARE(user.GetValue("Software\\Wine\\Direct3D", "renderer"), QByteArray("\"vulkan\""));
+        QCOMPARE(Read("user.reg").count("[Software\\\\Wine\\\\Direct3D]"), 1);
+        QVERIFY(!Read("user.reg").contains("#time="));
+        QVERIFY(!Read("system.reg").contains("#time="));
+    }
+
+    // running it again on an already compacted prefix changes nothing
+    void idempotent()
+    {
+        QList<QPair<QString, NeroRegistry::CompactStats>> stats;
+        QVERIFY(NeroRegistry::CompactPrefix(prefix->path(), NeroRegistry::DefaultPruneKeys(), stats));
+        const QByteArray system = Read("system.reg"), user = Read("user.reg"), userdef = Read("userdef.reg");
+
+        stats.clear();
+        QVERIFY(NeroRegistry::CompactPrefix(prefix->path(), NeroRegistry::DefaultPruneKeys(), stats));
+        for(const QPair<QString, NeroRegistry::CompactStats> &file : std::as_const(stats)) {
+            QCOMPARE(file.second.keysPruned, 0);
+            QCOMPARE(file.second.duplicatesMerged, 0);
+            QCOMPARE(file.second.sizeAfter, file.second.sizeBefore);
+        }
+        QCOMPARE(Read("system.reg"), system);
+        QCOMPARE(Read("user.reg"), user);
+        QCOMPARE(Read("userdef.reg"), userdef);
+    }
+
+    void missingFiles()
+    {
+        QVERIFY(QFile::remove(prefix->filePath("userdef.reg")));
+        QList<QPair<QString, NeroRegistry::CompactStats>> stats;
+        QVERIFY(NeroRegistry::CompactPrefix(prefix->path(), NeroRegistry::DefaultPruneKeys(), stats));
+        QCOMPARE(stats.count(), 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroRegistry)
+#include "tst_neroregistry.moc"
@@ -0,0 +1,167 @@
+/*  Nero Launcher: A very basic Bottles-like manager using UMU.
+    Tests for GPU detection & selection.
+
+    Copyright (C) 2024 That One Seong
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nerosysinfo.h"
+#include "nerorunner.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Fakes /sys/class/drm with plain dirs & files; only what GetGpus reads has to be there.
+class TestNeroSysInfo : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir *sysfs = nullptr;
+
+    void WriteFile(const QString &path, const QByteArray &contents)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    }
+
+    // an empty value leaves that file out entirely
+    void AddCard(const QString &card, const QByteArray &slot, const QByteArray &vendor, const QByteArray &device,
+                 const QByteArray &bootVga, const QByteArray &driver)
+    {
+        const QString devicePath = sysfs->path() + "/class/drm/" + card + "/device";
+        QVERIFY(QDir().mkpath(devicePath));
+        if(!vendor.isEmpty()) WriteFile(devicePath + "/vendor", vendor + '\n');
+        if(!device.isEmpty()) WriteFile(devicePath + "/device", device + '\n');
+        if(!bootVga.isEmpty()) WriteFile(devicePath + "/boot_vga", bootVga + '\n');
+        if(!slot.isEmpty())
+            WriteFile(devicePath + "/uevent", "DRIVER=" + driver + "\nPCI_CLASS=30000\nPCI_SLOT_NAME=" + slot + '\n');
+    }
+
+private slots:
+    void init()
+    {
+        sysfs = new QTemporaryDir();
+        QVERIFY(sysfs->isValid());
+        QVERIFY(QDir().mkpath(sysfs->path() + "/class/drm"));
+    }
+
+    void cleanup()
+    {
+        delete sysfs;
+        sysfs = nullptr;
+    }
+
+    void singleGpu()
+    {
+        AddCard("card0", "0000:03:00.0", "0x1002", "0x744c", "1", "amdgpu");
+        // connectors & render nodes live alongside, and aren't GPUs of their own
+        QVERIFY(QDir().mkpath(sysfs->path() + "/class/drm/card0-DP-1"));
+        QVERIFY(QDir().mkpath(sysfs->path() + "/class/drm/renderD128"));
+
+        const QList<NeroSysInfo::GpuDevice> gpus = NeroSysInfo::GetGpus(sysfs->path());
+        QCOMPARE(gpus.count(), 1);
+        QCOMPARE(gpus.at(0).card, QString("card0"));
+        QCOMPARE(gpus.at(0).pciSlot, QString("0000:03:00.0"));
+        QCOMPARE(gpus.at(0).vendor, quint16(0x1002));
+        QCOMPARE(gpus.at(0).device, quint16(0x744c));
+        QVERIFY(gpus.at(0).bootVga);
+        QCOMPARE(gpus.at(0).driver, QString("amdgpu"));
+
+        const QMap<QString, QString> env = NeroRunner::GpuSelectEnv(gpus, "0000:03:00.0");
+        QCOMPARE(env.value("MESA_VK_DEVICE_SELECT"), QString("1002:744c"));
+        QCOMPARE(env.value("DRI_PRIME"), QString("pci-0000_03_00_0"));
+        QCOMPARE(env.value("DXVK_FILTER_DEVICE_NAME"), QString("AMD"));
+        QVERIFY(!env.contains("__NV_PRIME_RENDER_OFFLOAD"));
+    }
+
+    void hybridIgpuDgpu()
+    {
+        // card10 sorts after card2, not before
+        AddCard("card10", "0000:01:00.0", "0x10de", "0x2520", "0", "nvidia");
+        AddCard("card2", "0000:00:02.0", "0x8086", "0x9a49", "1", "i915");
+
+        const QList<NeroSysInfo::GpuDevice> gpus = NeroSysInfo::GetGpus(sysfs->path());
+        QCOMPARE(gpus.count(), 2);
+        QCOMPARE(gpus.at(0).card, QString("card2"));
+        QVERIFY(gpus.at(0).bootVga);
+        QCOMPARE(gpus.at(1).card, QString("card10"));
+        QVERIFY(!gpus.at(1).bootVga);
+
+        // the dGPU needs NVIDIA's own offload vars on top, since its driver ignores DRI_PRIME
+        QMap<QString, QString> env = NeroRunner::GpuSelectEnv(gpus, "0000:01:00.0");
+        QCOMPARE(env.value("MESA_VK_DEVICE_SELECT"), QString("10de:2520"));
+        QCOMPARE(env.value("DRI_PRIME"), QString("pci-0000_01_00_0"));
+        QCOMPARE(env.value("DXVK_FILTER_DEVICE_NAME"), QString("NVIDIA"));
+        QCOMPARE(env.value("__NV_PRIME_RENDER_OFFLOAD"), QString("1"));
+        QCOMPARE(env.value("__GLX_VENDOR_LIBRARY_NAME"), QString("nvidia"));
+
+        env = NeroRunner::GpuSelectEnv(gpus, "0000:00:02.0");
+        QCOMPARE(env.value("MESA_VK_DEVICE_SELECT"), QString("8086:9a49"));
+        QCOMPARE(env.value("DXVK_FILTER_DEVICE_NAME"), QString("Intel"));
+        QVERIFY(!env.contains("__NV_PRIME_RENDER_OFFLOAD"));
+
+        // gone since the setting was saved
+        QVERIFY(NeroRunner::GpuSelectEnv(gpus, "0000:02:00.0").isEmpty());
+    }
+
+    void sameVendorTwice()
+    {
+        AddCard("card0", "0000:03:00.0", "0x1002", "0x744c", "1", "amdgpu");
+        AddCard("card1", "0000:0c:00.0", "0x1002", "0x164e", "0", "amdgpu");
+
+        const QList<NeroSysInfo::GpuDevice> gpus = NeroSysInfo::GetGpus(sysfs->path());
+        QCOMPARE(gpus.count(), 2);
+        // "AMD" would match both, so DXVK's left to follow Vulkan's pick instead
+        const QMap<QString, QString> env = NeroRunner::GpuSelectEnv(gpus, "0000:0c:00.0");
+        QCOMPARE(env.value("MESA_VK_DEVICE_SELECT"), QString("1002:164e"));
+        QVERIFY(!env.contains("DXVK_FILTER_DEVICE_NAME"));
+    }
+
+    void missingFiles()
+    {
+        // no boot_vga (e.g. non-VGA class devices): still listed, just not primary
+        AddCard("card0", "0000:03:00.0", "0x1002", "0x744c", QByteArray(), "amdgpu");
+        // no uevent, so no PCI slot to select it by (like simpledrm)
+        AddCard("card1", QByteArray(), "0x1234", "0x1111", "1", QByteArray());
+        // no vendor
+        AddCard("card2", "0000:05:00.0", QByteArray(), "0x2222", "0", "virtio-pci");
+        // nothing under device/ at all
+        QVERIFY(QDir().mkpath(sysfs->path() + "/class/drm/card3/device"));
+
+        const QList<NeroSysInfo::GpuDevice> gpus = NeroSysInfo::GetGpus(sysfs->path());
+        QCOMPARE(gpus.count(), 1);
+        QCOMPARE(gpus.at(0).card, QString("card0"));
+        QVERIFY(!gpus.at(0).bootVga);
+        QCOMPARE(NeroRunner::GpuSelectEnv(gpus, "0000:03:00.0").value("DRI_PRIME"), QString("pci-0000_03_00_0"));
+
+        // and no drm class at all, e.g. in a container
+        QVERIFY(NeroSysInfo::GetGpus(sysfs->path() + "/nonexistent").isEmpty());
+    }
+
+    void duplicateSlot()
+    {
+        // some drivers expose a second card node for the same device
+        AddCard("card0", "0000:03:00.0", "0x1002", "0x744c", "1", "amdgpu");
+        AddCard("card1", "0000:03:00.0", "0x1002", "0x744c", "1", "amdgpu");
+        QCOMPARE(NeroSysInfo::GetGpus(sysfs->path()).count(), 1);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNeroSysInfo)
+#include "tst_nerosysinfo.moc"